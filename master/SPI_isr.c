@@ -1,211 +1,1086 @@
 /*
     About:
         This is a receiver program on Rasperry Pi 5. This program uses GPIO's as interrupt service
-    and receives data as the master, and then save the received data into binary files. 
-    Be really CAREFUL on the wiring, make sure that 
-        - SPI0 is triggered by GPIO27, 
-        - SPI1 is triggered by GPIO 22, 
+    and receives data as the master, and then save the received data into segment files.
+    Be really CAREFUL on the wiring, every pico in the `picos` table below needs
+        - its SPI bus wired to the listed spidev device,
+        - its TRANSFER_PIN (GPIO 4) wired to the listed GPIO line,
     wrong wiring will result in deadlock.
 
-    Compilation: 
-        gcc -o SPI_isr SPI_isr.c -l wiringPi
+        Every pico gets one reader thread that owns its SPI bus. The main thread waits on
+    the GPIO edge events of all picos (Linux GPIO character device, libgpiod) in one epoll
+    loop and wakes the matching reader, so it sleeps instead of spinning. Adding a pico
+    is one more line in the `picos` table.
+        Every SPI device is opened and configured once at startup, each burst is then
+    read in bufsiz-sized chunks (see spi_link.h), not one ioctl per word.
+        Readers never touch the disk. Each reader reads into a buffer from its own
+    preallocated pool and hands it to a single writer thread through a lock-free queue
+    (see burst_queue.h), the writer appends it to preallocated segment files under
+    DATA_FOLDER (see segment.h) and returns the buffer. A slow disk only drains the
+    pool: the reader then still clocks the burst out, drops it and counts it.
+        Every burst is a frame (see burst_frame.h): a header with the machine id and a
+    sequence number, the samples, and a CRC-32 trailer. The reader checks each frame,
+    realigns to the header magic when words have slipped, and counts lost frames
+    (sequence gaps), resyncs, bad headers and CRC failures. Frames with a bad CRC are
+    still stored, flagged in their segment record.
+        Round-robin bursts (several ADC inputs interleaved, see channel_mask in the
+    frame header) are split per channel by the writer with a vectorized kernel
+    (deinterleave.h) and stored as one block per channel.
+        With PACKED_12BIT (must match the picos) bursts carry 4 samples in 3 words, a
+    quarter fewer words to clock. The writer unpacks them with a vectorized kernel
+    (unpack12.h) before anything else.
+        With RICE_CODED (must match the picos as well) bursts are delta + Rice coded and
+    their length follows the signal. The reader clocks the header first and then only
+    the payload it announces, the writer decodes it (rice_decode.h). The compression
+    ratio, the pico's encode time and the decode time are printed on exit.
+        With CONVERT_VOLTS the writer stores calibrated float32 volts instead of raw
+    codes. Each pico's offset, gain and per-code INL/DNL correction are loaded from
+    CAL_FOLDER/<name>.cal (fitted with adc_cal.c) and applied with one table lookup
+    per sample (adc_cal.h).
+        Each pico is clocked at the rate link_cal.c found for its wiring, kept in
+    CAL_FOLDER/<name>.link (link_cal.h), or at CLOCK_FREQ when it has none. The pico
+    reports the rate it stored in every frame header, a mismatch is printed once.
+        Every record carries the receiver time of its first sample (timebase.h). From
+    the transfer edges alone it is good to tens of microseconds. With SYNC_TIMEBASE a
+    common sync pulse, generated here on SYNC_OUT_GPIO (or externally) and wired to
+    every pico's SYNC_PIN and back to SYNC_IN_GPIO, is latched on both sides and each
+    pico's clock is fitted against ours: offset and drift, to well below a sample.
+    The fit residual goes into every record, drift and residual are printed on exit.
+    pico_merge.c combines the records of all picos into one stream.
+        Picos built with TELEMETRY send their trigger-path histograms after the payload
+    of every few frames. Each block is stored as a telemetry record next to the bursts
+    (telemetry.h), the latest one of every pico is printed on exit.
+        With SPECTRUM the writer also keeps a running Welch PSD of every pico and input
+    (spectrum.h, real FFT of SPECTRUM_SIZE points in fft.h) and stores it with its
+    peak frequencies as a spectrum record every SPECTRUM_EVERY bursts, so a run can
+    be judged while it is being recorded.
+        While it runs the receiver prints nothing per burst. Counters, queue depths,
+    errors and latency histograms of every pico are published in a shared-memory
+    block (live_stats.h, /dev/shm/spi_isr) with plain relaxed stores, picomon.c
+    attaches to it read-only and shows live rates.
+        SPI and GPIO go through a transport (transport.h), spidev and libgpiod here.
+    rx_bench.c builds this same file against a stand-in transport that replays
+    captures (RX_BENCH), so the whole receive path can be load-tested anywhere.
+
+    Compilation:
+        gcc -O2 -o SPI_isr SPI_isr.c -lgpiod -lpthread -lm
 */
 
 #include <stdio.h>
 #include <stdint.h>
+#include <stdlib.h>
+#include <signal.h>
+#include <time.h>
 #include <fcntl.h>
 #include <unistd.h>
+#include <pthread.h>
+#include <semaphore.h>
 #include <sys/stat.h>
-#include <sys/ioctl.h>
-#include <linux/spi/spidev.h>
-#include <wiringPi.h>
-
-// Define the SPI devices
-#define SPI0 "/dev/spidev0.0"
-#define SPI1 "/dev/spidev1.0"
+#include <sys/epoll.h>
+#include <sys/signalfd.h>
+#include "transport.h"
+#ifndef RX_BENCH
+#include "transport_gpiod.h"
+#endif
+#include "segment.h"
+#include "burst_queue.h"
+#include "burst_frame.h"
+#include "deinterleave.h"
+#include "unpack12.h"
+#include "rice_decode.h"
+#include "adc_cal.h"
+#include "timebase.h"
+#include "telemetry.h"
+#include "live_stats.h"
+#include "spectrum.h"
+#include "link_cal.h"
 
-// Define the buffer size
+// Define the buffer size, samples per burst
 #define BUFF_LEN 12500
 
-// Define the clock frequency
+// Uncomment the payload format the picos are built with (PACKED_12BIT or RICE_CODED)
+// #define PACKED_12BIT
+// #define RICE_CODED
+#if defined(PACKED_12BIT)
+#define PAYLOAD_FLAGS FRAME_FLAG_PACKED12
+#define PAYLOAD_WORDS FRAME_PAYLOAD_WORDS(BUFF_LEN, PAYLOAD_FLAGS)
+#elif defined(RICE_CODED)
+#define PAYLOAD_FLAGS FRAME_FLAG_RICE
+#define PAYLOAD_WORDS RICE_MAX_WORDS(BUFF_LEN)     // longest, each burst says how long it is
+#else
+#define PAYLOAD_FLAGS 0
+#define PAYLOAD_WORDS BUFF_LEN
+#endif
+
+// Words clocked per burst (at most with RICE_CODED): header, samples and CRC trailer
+#define FRAME_WORDS (FRAME_HEADER_WORDS + PAYLOAD_WORDS + FRAME_TRAILER_WORDS)
+
+// Define the clock frequency of picos without a link calibration, CAL_FOLDER/<name>.link
 #define CLOCK_FREQ 5000000
 
 // Define the data folder
 #define DATA_FOLDER "data"
 
-// Define the GPIO pins for interrupt
-#define GPIO_PIN0 22
-#define GPIO_PIN1 27
+// Uncomment to store calibrated float32 volts instead of raw codes
+// #define CONVERT_VOLTS
+
+// Define the folder of the per-pico calibration files, <name>.cal and <name>.link
+#define CAL_FOLDER "cal"
+
+// Uncomment to store a running power spectrum of every pico and input next to the data
+// #define SPECTRUM
+#define SPECTRUM_SIZE 12500     // FFT points per segment, even with factors 2, 3 and 5 only (4096, 8192, ...)
+#define SPECTRUM_EVERY 16       // bursts averaged into each spectrum record
+
+// Define the GPIO chip of the 40-pin header (gpiochip0 on kernels 6.6 and later)
+#define GPIO_CHIP "/dev/gpiochip4"
+
+// Uncomment to fit each pico's clock against the sync pulses (the picos always latch them)
+// #define SYNC_TIMEBASE
+#ifdef SYNC_TIMEBASE
+#define SYNC_IN_GPIO 23         // receiver's input of the sync pulse
+#define SYNC_OUT_GPIO 24        // pulse generated here, comment out when an external generator drives the line
+#define SYNC_PERIOD_MS 100      // keep SYNC_EDGE_RING periods longer than the writer may fall behind
+#define SYNC_PULSE_US 20
+#endif
+
+// Define the shared-memory block of the live statistics, watched with picomon
+#ifndef RX_BENCH
+#define LIVE_STATS_NAME "/spi_isr"
+#else
+#define LIVE_STATS_NAME "/rx_bench"
+#endif
+
+// Delay between the transfer edge and the first clock, the pico is still pulsing
+#define TRANSFER_DELAY_US 100
+
+// Define the picos: name, SPI device, GPIO line raised before each burst, machine id in its frames
+typedef struct {
+    const char *name;
+    const char *spi_device;
+    unsigned int gpio;
+    uint16_t machine_id;
+} pico_config_t;
+
+#ifndef RX_BENCH
+static const pico_config_t picos[] = {
+    { "A", "/dev/spidev0.0", 22, 0 },
+    { "B", "/dev/spidev1.0", 27, 1 },
+};
+#else
+// the stand-in picos of transport_replay.h, rx_bench sets how many are used
+static const pico_config_t picos[] = {
+    { "0", "0", 0, 0 }, { "1", "1", 1, 1 }, { "2", "2", 2, 2 }, { "3", "3", 3, 3 },
+    { "4", "4", 4, 4 }, { "5", "5", 5, 5 }, { "6", "6", 6, 6 }, { "7", "7", 7, 7 },
+};
+#endif
+
+#define MACHINES_EMPLOYED (sizeof(picos) / sizeof(picos[0]))
+_Static_assert(MACHINES_EMPLOYED <= LIVE_STATS_MAX_PICOS, "more picos than the live statistics hold");
+
+// Edge timestamps waiting for a reader, more than this many pending bursts is a stall anyway
+#define EDGE_QUEUE_LEN 16
+
+// Burst buffers per pico, the writer may fall this many bursts behind before drops
+#define BURST_POOL_SIZE 32
+
+// A received burst on its way from a reader to the writer
+typedef struct {
+    uint16_t source;                        // index in picos[]
+    uint16_t flags;                         // SEGMENT_FLAG_*
+    uint64_t capture_ns;                    // CLOCK_MONOTONIC of the transfer edge
+    uint16_t frame[FRAME_WORDS + FRAME_TELEMETRY_MAX_WORDS];   // as received, header first
+} burst_t;
+
+// Runtime state of one pico
+typedef struct {
+    const pico_config_t *cfg;
+    int spi;                                // transport handles
+    uint32_t clock_hz;                      // SPI clock, calibrated or CLOCK_FREQ
+    int link_mismatch;                      // reader: the pico's stored rate differs, said once
+    int line;
+    int event_fd;                           // readable when the line has an edge event
+    sem_t pending;                          // one post per edge, consumed by the reader
+    uint64_t edge_ns[EDGE_QUEUE_LEN];       // CLOCK_MONOTONIC timestamps of pending edges
+    volatile unsigned int edge_head;        // written by main
+    volatile unsigned int edge_tail;        // written by the reader
+    unsigned long edges_dropped;            // written by main, the reader was EDGE_QUEUE_LEN behind
+    pthread_t reader;
+    burst_pool_t pool;                      // buffers shared with the writer
+    burst_t scratch;                        // clocks out bursts we have no buffer for
+    unsigned long bursts;
+    unsigned long ioctls;                   // SPI calls it took to clock them in
+    // backpressure counters, written by the reader only
+    unsigned long pool_empty;               // bursts dropped, every buffer was with the writer
+    unsigned long queue_high_water;         // deepest the full queue has been
+    // link error counters, written by the reader only
+    uint32_t next_sequence;                 // sequence expected in the next frame
+    uint16_t channel_mask;                  // of the latest frame with a good CRC
+    unsigned long frames_lost;              // sequence gaps, frames the pico sent that never arrived
+    unsigned long resyncs;                  // frames that did not start with the magic
+    unsigned long bad_headers;              // frames dropped, no usable header
+    unsigned long crc_errors;               // frames stored with SEGMENT_FLAG_CRC_ERROR
+    // payload coding, written by the writer only
+    uint64_t payload_words;                 // words clocked for the stored payloads
+    uint64_t samples;                       // samples they carried
+    uint64_t encode_us;                     // pico time spent packing / coding
+    uint32_t encode_us_max;
+    uint64_t decode_ns;                     // our time spent unpacking / decoding
+    unsigned long decode_errors;            // frames stored with SEGMENT_FLAG_DECODE_ERROR
+    uint64_t converted;                     // samples converted to volts
+    uint64_t convert_ns;                    // our time spent on it
+    adc_cal_t cal;                          // CONVERT_VOLTS: calibration tables of this pico
+    // sample timing, written by the writer only
+    timebase_t timebase;                    // this pico's clock against ours
+    uint32_t sample_period_ps;              // of the latest burst, for the exit report
+    unsigned long untimed;                  // records stored without a sample time
+    // telemetry, written by the writer only
+    telemetry_block_t telemetry;            // latest block
+    unsigned long telemetry_blocks;         // blocks stored
+    unsigned long telemetry_bad;            // blocks that did not check out
+    // SPECTRUM, written by the writer only
+    spectrum_t spectrum[DEINTERLEAVE_MAX_CHANNELS];    // per ADC input, set up on first use
+    uint16_t spectrum_mask;                 // inputs the states belong to
+    uint32_t spectrum_next;                 // sequence that continues the segments
+    unsigned long spectrum_bursts;          // bursts analysed
+    unsigned long spectrum_records;
+    uint64_t spectrum_ns;                   // our time spent on it
+    spectrum_header_t spectrum_last;        // latest record of the lowest input, for the exit report
+    live_pico_t *live;                      // this pico in the live statistics
+} pico_channel_t;
+
+static pico_channel_t channels[MACHINES_EMPLOYED];
+static unsigned int machines = MACHINES_EMPLOYED;  // picos in use, the first of picos[]
+static volatile sig_atomic_t stopping = 0;
+static const transport_t *transport;
+static const char *data_folder = DATA_FOLDER;
+static live_stats_t *live_stats;
+
+// Receiver timestamps of the sync edges, empty without SYNC_TIMEBASE
+static sync_edges_t sync_edges;
+
+// Posted once per queued burst, the writer sleeps on it
+static sem_t write_pending;
+static volatile int writer_done = 0;
 
 // Function to create the data folder if it doesn't exist
 void create_data_folder() {
     struct stat sb;
-    if (stat(DATA_FOLDER, &sb) != 0 || !S_ISDIR(sb.st_mode)) {
-        if (mkdir(DATA_FOLDER, 0777) == -1) {
+    if (stat(data_folder, &sb) != 0 || !S_ISDIR(sb.st_mode)) {
+        if (mkdir(data_folder, 0777) == -1) {
             perror("Error creating data folder");
         }
     }
 }
 
-// Interrupt callback function for SPI0
-void gpio_callback0(void) {
+// Hand a burst to the writer thread, never blocks
+void queue_burst(pico_channel_t *ch, burst_t *burst) {
+    spsc_push(&ch->pool.full, burst);   // cannot fail, the queue holds the whole pool
+
+    size_t depth = spsc_depth(&ch->pool.full);
+    if (depth > ch->queue_high_water) {
+        ch->queue_high_water = depth;
+        live_set(&ch->live->queue_high_water, depth);
+    }
+    live_set(&ch->live->queue_depth, depth);
+    live_add(&ch->live->queued, 1);
+    sem_post(&write_pending);
+}
 
-    printf("Interrupt Raised from pico A (GPIO %d)\n", GPIO_PIN0);
-    delayMicroseconds(100); // this is really important, DON'T delete
+/*
+    Description:
+        Feed a frame's timing into the pico's timebase and give the record the
+    receiver time of its first sample. A frame with a bad CRC may carry corrupted
+    timing, it stays out of the fit and its record is left untimed.
 
-    // Read data from SPI device 0
-    int spi_fd = open(SPI0, O_RDWR);
-    if (spi_fd < 0) {
-        perror("Error opening SPI device 0");
+    Parameter:
+        pico_channel_t *ch            - channel of the frame
+        const burst_frame_t *header   - frame header
+        uint64_t capture_ns           - receiver time of the transfer edge
+        segment_record_t *record      - sample_time_ns, sample_period_ps and align_error_ns are filled in
+*/
+void stamp_record(pico_channel_t *ch, const burst_frame_t *header, uint64_t capture_ns, segment_record_t *record) {
+    if (record->flags & SEGMENT_FLAG_CRC_ERROR) {
+        record->sample_time_ns = 0;
+        record->sample_period_ps = 0;
+        ch->untimed++;
         return;
     }
+    timebase_t *tb = &ch->timebase;
+    timebase_update(tb, &sync_edges, header->transfer_us, capture_ns, header->sync_count, header->sync_latch_us);
 
-    // Set the SPI mode and clock speed
-    uint8_t mode = SPI_MODE_0;
-    uint32_t speed = CLOCK_FREQ;
-    if (ioctl(spi_fd, SPI_IOC_WR_MODE, &mode) < 0) {
-        perror("Error setting SPI mode");
-        close(spi_fd);
-        return;
+    // from the start of the run to the first sample of this frame, pico nanoseconds
+    double offset_ns = header->first_sample_ns + (double)header->run_offset * header->sample_period_ps / 1000.0;
+    double scale = tb->valid ? tb->slope / 1000.0 : 1.0;
+    uint64_t edge_ns = 0;
+    if ((header->flags & FRAME_FLAG_SYNC_START) && tb->valid) {
+        edge_ns = timebase_edge(tb, &sync_edges, header->run_start_us);
     }
-    if (ioctl(spi_fd, SPI_IOC_WR_MAX_SPEED_HZ, &speed) < 0) {
-        perror("Error setting SPI clock speed");
-        close(spi_fd);
-        return;
+    if (edge_ns != 0) {
+        // started by the edge itself, our timestamp of it beats the pico's microsecond latch
+        record->sample_time_ns = edge_ns + (uint64_t)llround(offset_ns * scale);
+    } else {
+        record->sample_time_ns = timebase_map(tb, header->run_start_us, offset_ns);
     }
+    record->sample_period_ps = (uint32_t)llround(header->sample_period_ps * scale);
+    record->align_error_ns = tb->valid ? (uint32_t)ceil(tb->rms_ns) : TIMEBASE_COARSE_NS;
 
-    // Create a filename based on the current time
-    char filename[50];
-    sprintf(filename, "%s/data%d.bin", DATA_FOLDER, millis());
+    ch->sample_period_ps = header->sample_period_ps;
+    if (record->sample_time_ns == 0) {
+        ch->untimed++;
+    }
+}
 
-    // Open the binary file
-    FILE *bin_file = fopen(filename, "wb");
-    if (bin_file == NULL) {
-        perror("Error opening binary file");
-        close(spi_fd);
+/*
+    Description:
+        Store the telemetry block between a frame's payload and CRC as a record of
+    its own, right after the burst
+
+    Parameter:
+        segment_writer_t *writer - open segment writer
+        pico_channel_t *ch       - channel of the frame, keeps the latest block
+        const burst_t *burst     - frame with FRAME_FLAG_TELEMETRY and a good CRC
+*/
+void store_telemetry(segment_writer_t *writer, pico_channel_t *ch, const burst_t *burst) {
+    const burst_frame_t *header = (const burst_frame_t *)burst->frame;
+    telemetry_block_t block;
+    if (telemetry_load(&block, burst->frame + FRAME_HEADER_WORDS + header->payload_words,
+                       header->telemetry_words * sizeof(uint16_t)) < 0) {
+        ch->telemetry_bad++;
         return;
     }
 
-    // Receive data from the SPI device
-    uint16_t rx_data[BUFF_LEN];
-    for (int i = 0; i < BUFF_LEN; i++) {
-        struct spi_ioc_transfer transfer = {
-            .tx_buf = (unsigned long)NULL,
-            .rx_buf = (unsigned long)&rx_data[i],
-            .len = 2,
-            .speed_hz = speed,
-            .bits_per_word = 16,
-        };
-        if (ioctl(spi_fd, SPI_IOC_MESSAGE(1), &transfer) < 0) {
-            perror("Error receiving SPI data");
-            fclose(bin_file);
-            close(spi_fd);
-            return;
+    segment_record_t record = {
+        .type = SEGMENT_RECORD_TELEMETRY,
+        .source = burst->source,
+        .sequence = header->sequence,
+        .capture_ns = burst->capture_ns,
+    };
+    segment_append(writer, &record, &block, sizeof(block));
+    ch->telemetry = block;
+    ch->telemetry_blocks++;
+    live_set(&ch->live->telemetry_blocks, ch->telemetry_blocks);
+}
+
+#ifdef SPECTRUM
+static fft_plan_t spectrum_plan;    // writer thread only
+
+/*
+    Description:
+        Add a burst to the pico's running spectra, and every SPECTRUM_EVERY bursts
+    store one spectrum record per input. A lost frame restarts the segments, so no
+    segment spans a gap.
+
+    Parameter:
+        segment_writer_t *writer - open segment writer
+        pico_channel_t *ch       - channel of the burst
+        const burst_t *burst     - the burst, for its header
+        const uint16_t *codes    - its samples, one block per input for round-robin bursts
+*/
+void update_spectrum(segment_writer_t *writer, pico_channel_t *ch, const burst_t *burst, const uint16_t *codes) {
+    const burst_frame_t *header = (const burst_frame_t *)burst->frame;
+    uint64_t start = segment_clock_ns(CLOCK_MONOTONIC);
+    uint16_t mask = header->channel_mask ? header->channel_mask : 1;
+    unsigned channels = channel_count(mask);
+    size_t frames = BUFF_LEN / channels;
+    double rate = header->sample_period_ps ? 1e12 / ((double)header->sample_period_ps * channels) : 0.0;
+
+    if (mask != ch->spectrum_mask) {
+        for (unsigned input = 0; input < DEINTERLEAVE_MAX_CHANNELS; input++) {
+            spectrum_free(&ch->spectrum[input]);
+        }
+        ch->spectrum_mask = mask;
+    }
+    unsigned block = 0;
+    for (unsigned input = 0; input < DEINTERLEAVE_MAX_CHANNELS; input++) {
+        if (!(mask & (1u << input))) {
+            continue;
+        }
+        spectrum_t *sp = &ch->spectrum[input];
+        if (sp->size == 0 && spectrum_init(sp, SPECTRUM_SIZE) < 0) {
+            continue;
+        }
+        if (header->sequence != ch->spectrum_next) {
+            sp->fill = 0;
+        }
+        spectrum_feed(sp, &spectrum_plan, codes + block++ * frames, frames, header->sequence, rate);
+    }
+    ch->spectrum_next = header->sequence + 1;
+
+    if (++ch->spectrum_bursts % SPECTRUM_EVERY == 0) {
+        static struct {
+            spectrum_header_t header;
+            float psd[SPECTRUM_SIZE / 2 + 1];
+        } out;
+        int first = 1;
+        for (unsigned input = 0; input < DEINTERLEAVE_MAX_CHANNELS; input++) {
+            if (!(mask & (1u << input)) || ch->spectrum[input].size == 0
+                || spectrum_take(&ch->spectrum[input], input, &out.header, out.psd) < 0) {
+                continue;
+            }
+            segment_record_t record = {
+                .type = SEGMENT_RECORD_SPECTRUM,
+                .source = burst->source,
+                .sequence = header->sequence,
+                .sample_count = out.header.bins,
+                .capture_ns = burst->capture_ns,
+                .channel_mask = (uint16_t)(1u << input),
+            };
+            segment_append(writer, &record, &out, sizeof(out.header) + out.header.bins * sizeof(float));
+            ch->spectrum_records++;
+            if (first) {
+                ch->spectrum_last = out.header;
+                first = 0;
+            }
         }
     }
+    ch->spectrum_ns += segment_clock_ns(CLOCK_MONOTONIC) - start;
+}
+#endif
+
+/*
+    Description:
+        Writer thread, appends every queued burst to the segment files until the
+    readers are gone and the queue is empty
+
+    Parameter:
+        void *arg - unused
+
+    Return:
+        NULL
+*/
+void *writer_thread(void *arg) {
+    (void)arg;
+    segment_writer_t writer;
+    segment_writer_init(&writer, data_folder, SEGMENT_BYTES);
+    static uint16_t planar[BUFF_LEN];   // round-robin bursts, one block per channel
+    static uint16_t unpacked[BUFF_LEN]; // packed / coded bursts, one word per sample
+#ifdef CONVERT_VOLTS
+    static float volts[BUFF_LEN];       // calibrated samples
+#endif
+#ifdef SPECTRUM
+    if (fft_plan_init(&spectrum_plan, SPECTRUM_SIZE) < 0) {
+        fprintf(stderr, "No FFT plan for SPECTRUM_SIZE %d, spectra are off\n", SPECTRUM_SIZE);
+    }
+#endif
 
-    printf("Pico A Transfer Finished\n");
+    while (1) {
+        sem_wait(&write_pending);
+        int done = writer_done;     // read before draining, nothing is queued after it is set
 
-    fwrite(rx_data, sizeof(uint16_t), BUFF_LEN, bin_file);
-    fflush(bin_file);
-    fclose(bin_file);
+        // drain every pico, oldest first within each
+        for (unsigned int i = 0; i < machines; i++) {
+            pico_channel_t *ch = &channels[i];
+            burst_pool_t *pool = &ch->pool;
+            burst_t *burst;
+            while ((burst = spsc_pop(&pool->full)) != NULL) {
+                const burst_frame_t *header = (const burst_frame_t *)burst->frame;
+                const uint16_t *payload = burst->frame + FRAME_HEADER_WORDS;
+                unsigned channels = channel_count(header->channel_mask);
+                uint64_t decode_start = segment_clock_ns(CLOCK_MONOTONIC);
 
-    printf("Pico A Data Written\n");
+                // by the build setting, read_frame() has checked the header agrees (a frame
+                // with a bad CRC may carry corrupted flags)
+                if (PAYLOAD_FLAGS & FRAME_FLAG_PACKED12) {
+                    unpack12_u16(payload, unpacked, BUFF_LEN);
+                    payload = unpacked;
+                } else if (PAYLOAD_FLAGS & FRAME_FLAG_RICE) {
+                    if (rice_decode_u16(payload, header->payload_words, unpacked, BUFF_LEN, channels ? channels : 1) < 0) {
+                        memset(unpacked, 0, sizeof(unpacked));
+                        burst->flags |= SEGMENT_FLAG_DECODE_ERROR;
+                        ch->decode_errors++;
+                    }
+                    payload = unpacked;
+                }
+                if (PAYLOAD_FLAGS) {
+                    ch->decode_ns += segment_clock_ns(CLOCK_MONOTONIC) - decode_start;
+                    ch->payload_words += header->payload_words;
+                    ch->samples += BUFF_LEN;
+                    ch->encode_us += header->encode_us;
+                    if (header->encode_us > ch->encode_us_max) {
+                        ch->encode_us_max = header->encode_us;
+                    }
+                }
 
-    close(spi_fd);
+                if (channels > 1) {
+                    size_t frames = BUFF_LEN / channels;
+                    uint16_t *out[DEINTERLEAVE_MAX_CHANNELS];
+                    for (unsigned c = 0; c < channels; c++) {
+                        out[c] = planar + c * frames;
+                    }
+                    deinterleave_u16(payload, out, channels, frames);
+                    payload = planar;
+                }
+
+                const void *data = payload;
+                size_t data_bytes = BUFF_LEN * sizeof(uint16_t);
+#ifdef CONVERT_VOLTS
+                // per-channel blocks or not, each sample is one lookup in the pico's table
+                uint64_t convert_start = segment_clock_ns(CLOCK_MONOTONIC);
+                adc_cal_volts(&ch->cal, payload, volts, BUFF_LEN);
+                ch->convert_ns += segment_clock_ns(CLOCK_MONOTONIC) - convert_start;
+                ch->converted += BUFF_LEN;
+                burst->flags |= SEGMENT_FLAG_VOLTS;
+                data = volts;
+                data_bytes = sizeof(volts);
+#endif
+
+                segment_record_t record = {
+                    .type = SEGMENT_RECORD_BURST,
+                    .source = burst->source,
+                    .sequence = header->sequence,
+                    .sample_count = header->sample_count,
+                    .capture_ns = burst->capture_ns,
+                    .flags = burst->flags,
+                    .channel_mask = header->channel_mask,
+                };
+                stamp_record(ch, header, burst->capture_ns, &record);
+                segment_append(&writer, &record, data, data_bytes);
+#ifdef RX_BENCH
+                rx_bench_persisted(burst->source, burst->capture_ns, data_bytes);
+#endif
+                uint64_t written_ns = segment_clock_ns(CLOCK_MONOTONIC);
+                live_add(&ch->live->written, 1);
+                live_add(&ch->live->written_bytes, data_bytes);
+                live_set(&ch->live->decode_errors, ch->decode_errors);
+                live_set(&ch->live->last_written_ns, written_ns);
+                live_hist_add(&ch->live->write_latency, written_ns - burst->capture_ns);
+                if ((header->flags & FRAME_FLAG_TELEMETRY) && !(burst->flags & SEGMENT_FLAG_CRC_ERROR)) {
+                    store_telemetry(&writer, ch, burst);
+                }
+#ifdef SPECTRUM
+                if (spectrum_plan.size != 0 && !(burst->flags & (SEGMENT_FLAG_CRC_ERROR | SEGMENT_FLAG_DECODE_ERROR))) {
+                    update_spectrum(&writer, ch, burst, payload);
+                }
+#endif
+                spsc_push(&pool->free, burst);
+            }
+        }
+
+        if (done) {
+            break;
+        }
+    }
+
+    segment_close(&writer);
+#ifdef SPECTRUM
+    for (unsigned int i = 0; i < machines; i++) {
+        for (unsigned input = 0; input < DEINTERLEAVE_MAX_CHANNELS; input++) {
+            spectrum_free(&channels[i].spectrum[input]);
+        }
+    }
+    fft_plan_free(&spectrum_plan);
+#endif
+    return NULL;
+}
 
-    printf("Pico A SPI closed\n");
+// Clock in words through the transport
+static inline int read_words(pico_channel_t *ch, uint16_t *rx, size_t words, uint32_t speed, unsigned *ioctls) {
+    return transport->ops->read_burst(transport->ctx, ch->spi, rx, words, speed, ioctls);
 }
 
-// Interrupt callback function for SPI1
-void gpio_callback1(void) {
+/*
+    Description:
+        Clock in one frame and check it. When the frame does not start with the magic
+    (words left over from an earlier, cut-short transfer), it is realigned to the
+    first magic found and the missing tail is clocked in. With RICE_CODED only the
+    header is clocked first, then the payload length it announces. When that fails
+    the longest possible frame is clocked instead, so the pico is never left with
+    words in its FIFO. A telemetry block announced in the header is clocked in after
+    the rest.
 
-    printf("Interrupt Raised from pico B (GPIO %d)\n", GPIO_PIN1);
-    delayMicroseconds(100);
+    Parameter:
+        pico_channel_t *ch - channel, its error counters are updated
+        uint16_t *frame    - FRAME_WORDS + FRAME_TELEMETRY_MAX_WORDS long
 
-    // Read data from SPI device 1
-    int spi_fd = open(SPI1, O_RDWR);
-    if (spi_fd < 0) {
-        perror("Error opening SPI device 1");
-        return;
+    Return:
+        int - FRAME_OK or FRAME_BAD_CRC if the frame is usable, -1 otherwise
+*/
+int read_frame(pico_channel_t *ch, uint16_t *frame, unsigned *ioctls) {
+#ifdef RICE_CODED
+    const size_t first_words = FRAME_HEADER_WORDS;
+#else
+    const size_t first_words = FRAME_WORDS;
+#endif
+    if (read_words(ch, frame, first_words, ch->clock_hz, ioctls) < 0) {
+        return -1;
     }
 
-    // Set the SPI mode and clock speed
-    uint8_t mode = SPI_MODE_0;
-    uint32_t speed = CLOCK_FREQ;
-    if (ioctl(spi_fd, SPI_IOC_WR_MODE, &mode) < 0) {
-        perror("Error setting SPI mode");
-        close(spi_fd);
-        return;
+    if (frame[0] != FRAME_MAGIC) {
+        ch->resyncs++;
+        int offset = frame_find_magic(frame, first_words);
+        if (offset < 0) {
+            ch->bad_headers++;
+            if (first_words < FRAME_WORDS) {
+                read_words(ch, frame + first_words, FRAME_WORDS - first_words, ch->clock_hz, ioctls);
+            }
+            return -1;
+        }
+        memmove(frame, frame + offset, (first_words - offset) * sizeof(uint16_t));
+        if (read_words(ch, frame + first_words - offset, offset, ch->clock_hz, ioctls) < 0) {
+            return -1;
+        }
     }
-    if (ioctl(spi_fd, SPI_IOC_WR_MAX_SPEED_HZ, &speed) < 0) {
-        perror("Error setting SPI clock speed");
-        close(spi_fd);
-        return;
+
+    const burst_frame_t *header = (const burst_frame_t *)frame;
+#ifdef RICE_CODED
+    uint32_t payload_words = header->payload_words;
+    if (payload_words > PAYLOAD_WORDS) {
+        ch->bad_headers++;
+        read_words(ch, frame + first_words, FRAME_WORDS - first_words, ch->clock_hz, ioctls);
+        return -1;
+    }
+    if (read_words(ch, frame + FRAME_HEADER_WORDS, payload_words + FRAME_TRAILER_WORDS, ch->clock_hz, ioctls) < 0) {
+        return -1;
     }
+#else
+    uint32_t payload_words = PAYLOAD_WORDS;
+#endif
 
-    // Create a filename based on the current time
-    char filename[50];
-    sprintf(filename, "%s/data%d.bin", DATA_FOLDER, millis());
+    // a telemetry block sits between payload and CRC, what was read as the trailer is its start
+    if (header->flags & FRAME_FLAG_TELEMETRY) {
+        if (header->telemetry_words > FRAME_TELEMETRY_MAX_WORDS) {
+            ch->bad_headers++;
+            return -1;
+        }
+        if (read_words(ch, frame + FRAME_HEADER_WORDS + payload_words + FRAME_TRAILER_WORDS,
+                       header->telemetry_words, ch->clock_hz, ioctls) < 0) {
+            return -1;
+        }
+    }
 
-    // Open the binary file
-    FILE *bin_file = fopen(filename, "wb");
-    if (bin_file == NULL) {
-        perror("Error opening binary file");
-        close(spi_fd);
-        return;
+    int status = frame_check(frame, payload_words);
+    if (status == FRAME_BAD_HEADER) {
+        ch->bad_headers++;
+        return -1;
+    }
+    // a frame with a bad CRC is still stored, the writer trusts these header fields, so they are checked first
+    if (header->machine_id != ch->cfg->machine_id) {
+        if (status != FRAME_BAD_CRC) {
+            fprintf(stderr, "Pico %s: frame from machine %u, check the wiring\n", ch->cfg->name, header->machine_id);
+        }
+        ch->bad_headers++;
+        return -1;
+    }
+    // the writer stores BUFF_LEN samples per burst, a SAMPLE_BUFFER_SIZE that differs would not match its record
+    unsigned channels = channel_count(header->channel_mask);
+    if ((header->flags & FRAME_FLAG_PACKED12) != (PAYLOAD_FLAGS & FRAME_FLAG_PACKED12)
+        || header->sample_count != BUFF_LEN
+        || (channels > 1 && header->sample_count % channels != 0)) {
+        ch->bad_headers++;
+        return -1;
+    }
+    if (status == FRAME_BAD_CRC) {
+        // a mask flipped to another channel count would deinterleave the payload wrong
+        if (header->channel_mask != ch->channel_mask) {
+            ch->bad_headers++;
+            return -1;
+        }
+        ch->crc_errors++;
+        return status;   // the sequence number may be the corrupted part, leave the gap count alone
+    }
+    if (header->link_khz != 0 && header->link_khz != ch->clock_hz / 1000 && !ch->link_mismatch) {
+        fprintf(stderr, "Pico %s: calibrated for %u kHz, clocked at %u kHz, run link_cal again?\n",
+                ch->cfg->name, header->link_khz, ch->clock_hz / 1000);
+        ch->link_mismatch = 1;
+    }
+
+    if (header->sequence > ch->next_sequence) {
+        ch->frames_lost += header->sequence - ch->next_sequence;
+    } else if (header->sequence < ch->next_sequence) {
+        fprintf(stderr, "Pico %s: sequence restarted at %u, pico reset?\n", ch->cfg->name, header->sequence);
+    }
+    ch->next_sequence = header->sequence + 1;
+    ch->channel_mask = header->channel_mask;
+    return status;
+}
+
+/*
+    Description:
+        Publish the reader's counters after a frame, every one is a store of a value
+    the reader already has
+
+    Parameter:
+        pico_channel_t *ch    - channel of the frame
+        const uint16_t *frame - as read_frame() left it
+        int status            - what read_frame() returned
+        uint64_t edge_ns      - receiver time of the transfer edge
+*/
+static inline void publish_reader(pico_channel_t *ch, const uint16_t *frame, int status, uint64_t edge_ns) {
+    live_pico_t *live = ch->live;
+    uint64_t now = segment_clock_ns(CLOCK_MONOTONIC);
+    live_set(&live->bursts, ch->bursts);
+    live_set(&live->pool_empty, ch->pool_empty);
+    live_set(&live->frames_lost, ch->frames_lost);
+    live_set(&live->resyncs, ch->resyncs);
+    live_set(&live->bad_headers, ch->bad_headers);
+    live_set(&live->crc_errors, ch->crc_errors);
+    live_set(&live->last_burst_ns, now);
+    if (status >= 0) {
+        const burst_frame_t *header = (const burst_frame_t *)frame;
+        live_add(&live->rx_bytes, (FRAME_HEADER_WORDS + header->payload_words + FRAME_TRAILER_WORDS
+                                   + header->telemetry_words) * sizeof(uint16_t));
+        live_hist_add(&live->rx_latency, now - edge_ns);
+    }
+}
+
+/*
+    Description:
+        Reader thread of one pico, waits for its edges and reads one burst per edge
+
+    Parameter:
+        void *arg - pico_channel_t of the pico
+
+    Return:
+        NULL
+*/
+void *reader_thread(void *arg) {
+    pico_channel_t *ch = (pico_channel_t *)arg;
+    const struct timespec delay = { 0, TRANSFER_DELAY_US * 1000 };
+
+    while (1) {
+        sem_wait(&ch->pending);
+        if (stopping) {
+            break;
+        }
+
+        uint64_t edge_ns = ch->edge_ns[ch->edge_tail % EDGE_QUEUE_LEN];
+        ch->edge_tail++;
+
+        nanosleep(&delay, NULL); // this is really important, DON'T delete
+
+        // the pico sends regardless, with no free buffer the burst is still clocked out and dropped
+        burst_t *burst = spsc_pop(&ch->pool.free);
+        if (burst == NULL) {
+            burst = &ch->scratch;
+        }
+
+        // Receive the frame from the SPI device, in bufsiz chunks, and check it
+        unsigned ioctls = 0;
+        int status = read_frame(ch, burst->frame, &ioctls);
+        ch->bursts++;
+        ch->ioctls += ioctls;
+        int dropped = burst == &ch->scratch;
+        ch->pool_empty += dropped;
+        publish_reader(ch, burst->frame, status, edge_ns);
+
+        if (dropped) {
+            continue;
+        }
+        if (status < 0) {
+            spsc_push(&ch->pool.free, burst);
+            continue;
+        }
+
+        burst->source = (uint16_t)(ch - channels);
+        burst->flags = status == FRAME_BAD_CRC ? SEGMENT_FLAG_CRC_ERROR : 0;
+        burst->capture_ns = edge_ns;
+        queue_burst(ch, burst);
     }
 
-    // Receive data from the SPI device
-    uint16_t rx_data[BUFF_LEN];
-    for (int i = 0; i < BUFF_LEN; i++) {
-        struct spi_ioc_transfer transfer = {
-            .tx_buf = (unsigned long)NULL,
-            .rx_buf = (unsigned long)&rx_data[i],
-            .len = 2,
-            .speed_hz = speed,
-            .bits_per_word = 16,
-        };
-        if (ioctl(spi_fd, SPI_IOC_MESSAGE(1), &transfer) < 0) {
-            perror("Error receiving SPI data");
-            fclose(bin_file);
-            close(spi_fd);
-            return;
+    return NULL;
+}
+
+#ifdef SYNC_OUT_GPIO
+/*
+    Description:
+        Sync generator thread, a SYNC_PULSE_US pulse on SYNC_OUT_GPIO every
+    SYNC_PERIOD_MS on absolute deadlines, so the period does not creep
+
+    Parameter:
+        void *arg - transport handle of the output line
+
+    Return:
+        NULL
+*/
+void *sync_thread(void *arg) {
+    int line = (int)(intptr_t)arg;
+    const struct timespec pulse = { 0, SYNC_PULSE_US * 1000 };
+    struct timespec next;
+    clock_gettime(CLOCK_MONOTONIC, &next);
+
+    while (!stopping) {
+        next.tv_nsec += SYNC_PERIOD_MS * 1000000L;
+        while (next.tv_nsec >= 1000000000L) {
+            next.tv_nsec -= 1000000000L;
+            next.tv_sec++;
         }
+        clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next, NULL);
+        transport->ops->set_output(transport->ctx, line, 1);
+        nanosleep(&pulse, NULL);
+        transport->ops->set_output(transport->ctx, line, 0);
     }
+    return NULL;
+}
+#endif
 
-    printf("Pico B Transfer Finished\n");
+/*
+    Description:
+        Open the SPI device, request the GPIO edge events and start the reader of one pico
 
-    fwrite(rx_data, sizeof(uint16_t), BUFF_LEN, bin_file);
-    fflush(bin_file);
-    fclose(bin_file);
+    Parameter:
+        pico_channel_t *ch - channel to set up
 
-    printf("Pico B Data Written\n");
+    Return:
+        int - 0 on success, -1 on error
+*/
+int open_channel(pico_channel_t *ch) {
+    ch->spi = transport->ops->open_spi(transport->ctx, ch->cfg->spi_device, ch->clock_hz);
+    if (ch->spi < 0) {
+        return -1;
+    }
+
+    if (burst_pool_init(&ch->pool, sizeof(burst_t), BURST_POOL_SIZE) < 0) {
+        perror("Error allocating burst pool");
+        return -1;
+    }
 
-    close(spi_fd);
+    ch->line = transport->ops->open_edges(transport->ctx, ch->cfg->gpio, "SPI_isr", &ch->event_fd);
+    if (ch->line < 0) {
+        return -1;
+    }
 
-    printf("Pico B SPI closed\n");
+    sem_init(&ch->pending, 0, 0);
+    if (pthread_create(&ch->reader, NULL, reader_thread, ch) != 0) {
+        perror("Error starting reader thread");
+        return -1;
+    }
+    return 0;
 }
 
-int main() {
+/*
+    Description:
+        Run the receiver on a transport until SIGINT / SIGTERM, then drain and print
+    the statistics
+
+    Parameter:
+        const transport_t *t - SPI and GPIO access, every pico of `picos` below `machines`
+
+    Return:
+        int - 0 on a clean exit, 1 on a setup error
+*/
+int receiver_run(const transport_t *t) {
+    transport = t;
+
     // Create the data folder if it doesn't exist
     create_data_folder();
 
-    // Initialize WiringPi
-    wiringPiSetupGpio();
+    // SIGINT / SIGTERM are delivered through the epoll loop
+    sigset_t signals;
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGINT);
+    sigaddset(&signals, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &signals, NULL);    // inherited by the readers
+    int signal_fd = signalfd(-1, &signals, 0);
 
-    // Set up the GPIO pins for interrupt
-    pinMode(GPIO_PIN0, INPUT);
-    pinMode(GPIO_PIN1, INPUT);
+    int epoll_fd = epoll_create1(0);
+    struct epoll_event ev = { .events = EPOLLIN, .data.u32 = MACHINES_EMPLOYED };
+    epoll_ctl(epoll_fd, EPOLL_CTL_ADD, signal_fd, &ev);
+
+    // Live statistics first, every thread publishes into it from its first burst
+    const char *names[MACHINES_EMPLOYED];
+    for (unsigned int i = 0; i < machines; i++) {
+        names[i] = picos[i].name;
+    }
+    live_stats = live_stats_create(LIVE_STATS_NAME, machines, names, BUFF_LEN, segment_clock_ns(CLOCK_MONOTONIC));
+    if (live_stats == NULL) {
+        perror("Error allocating live statistics");
+        return 1;
+    }
+
+    // Open and configure every SPI device once, the readers only read
+    frame_crc_init();
+    for (unsigned int i = 0; i < machines; i++) {
+        channels[i].cfg = &picos[i];
+        channels[i].live = &live_stats->pico[i];
+        char link_name[256];
+        snprintf(link_name, sizeof(link_name), "%s/%s.link", CAL_FOLDER, picos[i].name);
+        channels[i].clock_hz = link_cal_load(link_name);
+        if (channels[i].clock_hz == 0) {
+            channels[i].clock_hz = CLOCK_FREQ;
+        }
+#ifdef CONVERT_VOLTS
+        char cal_name[256];
+        snprintf(cal_name, sizeof(cal_name), "%s/%s.cal", CAL_FOLDER, picos[i].name);
+        if (adc_cal_load(&channels[i].cal, cal_name) < 0) {
+            fprintf(stderr, "Pico %s: no calibration in %s, using the nominal 3.3 V / 4096\n", picos[i].name, cal_name);
+        }
+#endif
+        if (open_channel(&channels[i]) < 0) {
+            return 1;
+        }
+        ev.data.u32 = i;
+        epoll_ctl(epoll_fd, EPOLL_CTL_ADD, channels[i].event_fd, &ev);
+    }
+
+#ifdef SYNC_TIMEBASE
+    // sync edges come through the same epoll loop, index MACHINES_EMPLOYED + 1
+    int sync_fd;
+    int sync_in = t->ops->open_edges(t->ctx, SYNC_IN_GPIO, "SPI_isr sync", &sync_fd);
+    if (sync_in < 0) {
+        return 1;
+    }
+    ev.data.u32 = MACHINES_EMPLOYED + 1;
+    epoll_ctl(epoll_fd, EPOLL_CTL_ADD, sync_fd, &ev);
+#ifdef SYNC_OUT_GPIO
+    int sync_out = t->ops->open_output(t->ctx, SYNC_OUT_GPIO, "SPI_isr sync");
+    pthread_t sync_generator;
+    if (sync_out < 0 || pthread_create(&sync_generator, NULL, sync_thread, (void *)(intptr_t)sync_out) != 0) {
+        perror("Error starting the sync generator");
+        return 1;
+    }
+#endif
+#endif
+
+    sem_init(&write_pending, 0, 0);
+    pthread_t writer;
+    if (pthread_create(&writer, NULL, writer_thread, NULL) != 0) {
+        perror("Error starting writer thread");
+        return 1;
+    }
 
     printf("Waiting for interrupt...\n");
+    if (t->ops->start) {
+        t->ops->start(t->ctx);
+    }
+
+    // Main loop, sleeps in epoll until an edge (or a signal) arrives
+    while (!stopping) {
+        struct epoll_event events[MACHINES_EMPLOYED + 2];
+        int n = epoll_wait(epoll_fd, events, MACHINES_EMPLOYED + 2, -1);
+
+        for (int i = 0; i < n; i++) {
+            unsigned int index = events[i].data.u32;
+            if (index == MACHINES_EMPLOYED) {
+                stopping = 1;
+                break;
+            }
+#ifdef SYNC_TIMEBASE
+            if (index == MACHINES_EMPLOYED + 1) {
+                uint64_t sync_ns;
+                if (t->ops->read_edge(t->ctx, sync_in, &sync_ns) == 0) {
+                    sync_edges_push(&sync_edges, sync_ns);
+                }
+                continue;
+            }
+#endif
+
+            pico_channel_t *ch = &channels[index];
+            uint64_t edge_ns;
+            if (t->ops->read_edge(t->ctx, ch->line, &edge_ns) < 0) {
+                continue;
+            }
 
-    // Set up the interrupt callback functions
-    wiringPiISR(GPIO_PIN0, INT_EDGE_RISING, gpio_callback0);
-    wiringPiISR(GPIO_PIN1, INT_EDGE_RISING, gpio_callback1);
+            live_add(&ch->live->edges, 1);
+            live_set(&ch->live->last_edge_ns, edge_ns);
+            if (ch->edge_head - ch->edge_tail >= EDGE_QUEUE_LEN) {
+                ch->edges_dropped++;    // counted, printing here would hold up every other pico
+                live_set(&ch->live->edges_dropped, ch->edges_dropped);
+                continue;
+            }
+            ch->edge_ns[ch->edge_head % EDGE_QUEUE_LEN] = edge_ns;
+            ch->edge_head++;
+            sem_post(&ch->pending);
+        }
+    }
+
+    // Wake every reader so it can exit
+    for (unsigned int i = 0; i < machines; i++) {
+        sem_post(&channels[i].pending);
+        pthread_join(channels[i].reader, NULL);
+        t->ops->close_line(t->ctx, channels[i].line);
+        t->ops->close_spi(t->ctx, channels[i].spi);
+    }
+
+    // Let the writer drain what is left
+    writer_done = 1;
+    sem_post(&write_pending);
+    pthread_join(writer, NULL);
+    live_stats_stop(live_stats);
 
-    // Main loop
-    while (1) {}
+#ifdef SYNC_TIMEBASE
+#ifdef SYNC_OUT_GPIO
+    pthread_join(sync_generator, NULL);
+    t->ops->close_line(t->ctx, sync_out);
+#endif
+    t->ops->close_line(t->ctx, sync_in);
+#endif
+
+    for (unsigned int i = 0; i < machines; i++) {
+        printf("Pico %s: %lu bursts, %lu dropped (pool empty), queue high water %lu/%d, %.1f SPI calls per burst\n",
+               picos[i].name, channels[i].bursts, channels[i].pool_empty,
+               channels[i].queue_high_water, BURST_POOL_SIZE,
+               channels[i].bursts ? (double)channels[i].ioctls / channels[i].bursts : 0.0);
+        printf("Pico %s: %lu frames lost, %lu resyncs, %lu bad headers, %lu CRC errors\n",
+               picos[i].name, channels[i].frames_lost, channels[i].resyncs,
+               channels[i].bad_headers, channels[i].crc_errors);
+        if (channels[i].edges_dropped > 0) {
+            printf("Pico %s: %lu edges dropped, the reader was %d bursts behind\n",
+                   picos[i].name, channels[i].edges_dropped, EDGE_QUEUE_LEN);
+        }
+        if (PAYLOAD_FLAGS && channels[i].payload_words > 0) {
+            unsigned long stored = channels[i].samples / BUFF_LEN;
+            printf("Pico %s: ratio %.2f (%.2f bits/sample), encode %.0f us avg %u us max, decode %.0f us avg, %lu decode errors\n",
+                   picos[i].name, (double)channels[i].samples / channels[i].payload_words,
+                   16.0 * channels[i].payload_words / channels[i].samples,
+                   (double)channels[i].encode_us / stored, channels[i].encode_us_max,
+                   channels[i].decode_ns / 1e3 / stored, channels[i].decode_errors);
+        }
+#ifdef SYNC_TIMEBASE
+        const timebase_t *tb = &channels[i].timebase;
+        if (tb->valid) {
+            printf("Pico %s: timebase %lu sync pairs (%lu unmatched), drift %+.2f ppm, residual %.0f ns",
+                   picos[i].name, tb->matched, tb->unmatched, timebase_drift_ppm(tb), tb->rms_ns);
+            if (channels[i].sample_period_ps > 0) {
+                printf(" = %.3f samples", tb->rms_ns * 1000.0 / channels[i].sample_period_ps);
+            }
+            printf("\n");
+        } else {
+            printf("Pico %s: no timebase, %lu sync pairs (%lu unmatched), check the sync wiring\n",
+                   picos[i].name, tb->matched, tb->unmatched);
+        }
+#endif
+        if (channels[i].untimed > 0) {
+            printf("Pico %s: %lu records without a sample time\n", picos[i].name, channels[i].untimed);
+        }
+        if (channels[i].telemetry_blocks > 0 || channels[i].telemetry_bad > 0) {
+            printf("Pico %s: %lu telemetry blocks (%lu unreadable), latest:\n", picos[i].name,
+                   channels[i].telemetry_blocks, channels[i].telemetry_bad);
+            telemetry_print(stdout, picos[i].name, &channels[i].telemetry);
+        }
+#ifdef SPECTRUM
+        if (channels[i].spectrum_bursts > 0) {
+            const spectrum_header_t *sh = &channels[i].spectrum_last;
+            double bin_hz = sh->sample_rate_hz > 0 ? sh->sample_rate_hz / sh->fft_size : 1.0 / sh->fft_size;
+            printf("Pico %s: %lu spectrum records, %.0f us per burst, input %u peak %.6g %s\n", picos[i].name,
+                   channels[i].spectrum_records, channels[i].spectrum_ns / 1e3 / channels[i].spectrum_bursts,
+                   sh->input, sh->peak_bin[0] * bin_hz, sh->sample_rate_hz > 0 ? "Hz" : "cycles/sample");
+        }
+#endif
+#ifdef CONVERT_VOLTS
+        if (channels[i].converted > 0) {
+            printf("Pico %s: conversion %.2f ns/sample\n", picos[i].name,
+                   (double)channels[i].convert_ns / channels[i].converted);
+        }
+#endif
+        burst_pool_destroy(&channels[i].pool);
+    }
 
     return 0;
-}
\ No newline at end of file
+}
+
+#ifndef RX_BENCH
+int main() {
+    transport_gpiod_t gpio;
+    if (transport_gpiod_open(&gpio, GPIO_CHIP) < 0) {
+        return 1;
+    }
+    printf("SPI bufsiz %zu bytes per transfer\n", spi_bufsiz);
+
+    transport_t hardware = { &transport_gpiod_ops, &gpio };
+    int status = receiver_run(&hardware);
+
+    transport_gpiod_close(&gpio);
+    return status;
+}
+#endif
@@ -0,0 +1,217 @@
+/*
+    About:
+        Fits the calibration file of one pico (adc_cal.h) from segment files captured
+    with SPI_isr.
+
+        INL/DNL come from a code density test: drive the captured input with a slow,
+    linear ramp (triangle) that runs a little past both ends of the range, and capture
+    a few million samples. Every code is then hit in proportion to its width, the
+    widths give the code edges and centers. Both end codes are clipped and ignored,
+    the result is anchored at the ideal first and last transitions.
+        Offset and gain come from two optional captures of known, steady voltages near
+    both ends of the range, converted through the fitted centers. Without them the
+    nominal 3.3 V / 4096 is kept.
+
+    Usage:
+        ./adc_cal -p 0 -o cal/A.cal data/ramp_*.pseg
+        ./adc_cal -p 0 -c 1 -l low.pseg -L 0.100 -u high.pseg -U 3.000 -o cal/A.cal data/ramp_*.pseg
+
+        -p selects the pico (its index in the picos table of SPI_isr), -c one ADC input of
+    round-robin records (default: every sample). SPI_isr loads cal/<name>.cal at startup.
+
+    Compilation:
+        gcc -O2 -o adc_cal adc_cal.c
+*/
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "segment.h"
+#include "deinterleave.h"
+#include "adc_cal.h"
+
+// Largest payload handled, well above one burst
+#define MAX_PAYLOAD (1u << 20)
+
+// Average hits per code below which the DNL estimate is mostly noise
+#define MIN_HITS_PER_CODE 64
+
+static uint8_t payload[MAX_PAYLOAD];
+
+/*
+    Description:
+        Walk the records of one pico in a list of segment files and hand the raw
+    samples (of one input, if selected) to a callback
+
+    Return:
+        unsigned long - samples passed on
+*/
+static unsigned long for_each_sample_block(char **files, int count, unsigned source, int input,
+                                           void (*fn)(const uint16_t *, size_t, void *), void *ctx) {
+    unsigned long total = 0;
+    for (int i = 0; i < count; i++) {
+        segment_header_t header;
+        FILE *f = segment_open_read(files[i], &header);
+        if (f == NULL) {
+            continue;
+        }
+        segment_record_t record;
+        while (segment_read_next(f, &record, payload, MAX_PAYLOAD)) {
+            if (record.type != SEGMENT_RECORD_BURST || record.source != source
+                || (record.flags & (SEGMENT_FLAG_CRC_ERROR | SEGMENT_FLAG_DECODE_ERROR | SEGMENT_FLAG_VOLTS))) {
+                continue;
+            }
+            const uint16_t *samples = (const uint16_t *)payload;
+            size_t n = record.payload_bytes / sizeof(uint16_t);
+
+            unsigned channels = channel_count(record.channel_mask);
+            if (input >= 0 && channels > 1) {
+                // one block per input in ascending order, find ours
+                if (!(record.channel_mask & (1u << input))) {
+                    continue;
+                }
+                unsigned block = (unsigned)__builtin_popcount(record.channel_mask & ((1u << input) - 1));
+                n /= channels;
+                samples += block * n;
+            }
+            fn(samples, n, ctx);
+            total += n;
+        }
+        fclose(f);
+    }
+    return total;
+}
+
+static void add_histogram(const uint16_t *samples, size_t n, void *ctx) {
+    uint64_t *hits = (uint64_t *)ctx;
+    for (size_t i = 0; i < n; i++) {
+        hits[samples[i] & (ADC_CAL_CODES - 1)]++;
+    }
+}
+
+typedef struct {
+    const adc_cal_t *cal;
+    double sum;
+} position_t;
+
+static void add_position(const uint16_t *samples, size_t n, void *ctx) {
+    position_t *pos = (position_t *)ctx;
+    for (size_t i = 0; i < n; i++) {
+        pos->sum += pos->cal->center[samples[i] & (ADC_CAL_CODES - 1)];
+    }
+}
+
+/*
+    Description:
+        Mean corrected position (LSB) of a steady-voltage capture
+
+    Return:
+        int - 0 on success, -1 if the capture holds no samples of the pico
+*/
+static int mean_position(const char *file, unsigned source, int input, const adc_cal_t *cal, double *mean) {
+    position_t pos = { cal, 0.0 };
+    char *files[1] = { (char *)file };
+    unsigned long n = for_each_sample_block(files, 1, source, input, add_position, &pos);
+    if (n == 0) {
+        return -1;
+    }
+    *mean = pos.sum / n;
+    return 0;
+}
+
+int main(int argc, char **argv) {
+    unsigned source = 0;
+    int input = -1;
+    const char *out_name = NULL, *low_name = NULL, *high_name = NULL;
+    double low_volts = 0.0, high_volts = 0.0;
+    int opt;
+    while ((opt = getopt(argc, argv, "p:c:o:l:L:u:U:")) != -1) {
+        switch (opt) {
+        case 'p': source = (unsigned)atoi(optarg); break;
+        case 'c': input = atoi(optarg); break;
+        case 'o': out_name = optarg; break;
+        case 'l': low_name = optarg; break;
+        case 'L': low_volts = atof(optarg); break;
+        case 'u': high_name = optarg; break;
+        case 'U': high_volts = atof(optarg); break;
+        default:
+            fprintf(stderr, "usage: %s -o out.cal [-p pico] [-c input] [-l low.pseg -L volts -u high.pseg -U volts] ramp.pseg...\n", argv[0]);
+            return 1;
+        }
+    }
+    if (out_name == NULL || optind >= argc || (low_name == NULL) != (high_name == NULL)) {
+        fprintf(stderr, "usage: %s -o out.cal [-p pico] [-c input] [-l low.pseg -L volts -u high.pseg -U volts] ramp.pseg...\n", argv[0]);
+        return 1;
+    }
+
+    // ---------------- code density ----------------
+    static uint64_t hits[ADC_CAL_CODES];
+    unsigned long samples = for_each_sample_block(argv + optind, argc - optind, source, input, add_histogram, hits);
+
+    uint64_t inner = 0;     // hits on codes 1..4094, the end codes are clipped
+    int missing = 0;
+    for (int c = 1; c < ADC_CAL_CODES - 1; c++) {
+        inner += hits[c];
+        missing += hits[c] == 0;
+    }
+    if (inner == 0) {
+        fprintf(stderr, "No ramp samples of pico %u\n", source);
+        return 1;
+    }
+    if (inner < (uint64_t)MIN_HITS_PER_CODE * (ADC_CAL_CODES - 2)) {
+        fprintf(stderr, "Only %.1f hits per code, capture a longer ramp for a usable DNL\n",
+                (double)inner / (ADC_CAL_CODES - 2));
+    }
+    if (missing > 0) {
+        fprintf(stderr, "%d codes never hit (missing codes or a ramp that does not span the range)\n", missing);
+    }
+
+    // widths in LSB, scaled so codes 1..4094 span their ideal 4094 LSB
+    adc_cal_t cal;
+    adc_cal_nominal(&cal);
+    double edge = 0.5;      // ideal transition from code 0 to 1
+    double worst_dnl = 0.0, worst_inl = 0.0;
+    int worst_dnl_code = 0, worst_inl_code = 0;
+    for (int c = 1; c < ADC_CAL_CODES - 1; c++) {
+        double width = (double)hits[c] * (ADC_CAL_CODES - 2) / (double)inner;
+        cal.center[c] = edge + width / 2;
+        edge += width;
+
+        double dnl = width - 1.0, inl = cal.center[c] - c;
+        if (dnl * dnl > worst_dnl * worst_dnl) {
+            worst_dnl = dnl;
+            worst_dnl_code = c;
+        }
+        if (inl * inl > worst_inl * worst_inl) {
+            worst_inl = inl;
+            worst_inl_code = c;
+        }
+    }
+
+    // ---------------- offset and gain ----------------
+    if (low_name) {
+        double low_pos, high_pos;
+        if (mean_position(low_name, source, input, &cal, &low_pos) < 0
+            || mean_position(high_name, source, input, &cal, &high_pos) < 0 || high_pos <= low_pos) {
+            fprintf(stderr, "Reference captures unusable, keeping the nominal offset and gain\n");
+        } else {
+            cal.gain = (high_volts - low_volts) / (high_pos - low_pos);
+            cal.offset = low_volts - cal.gain * low_pos;
+        }
+    }
+    adc_cal_build(&cal);
+
+    printf("Pico %u: %lu samples, %.1f hits per code\n", source, samples, (double)inner / (ADC_CAL_CODES - 2));
+    printf("Worst DNL %+.2f LSB at code %d, worst INL %+.2f LSB at code %d\n",
+           worst_dnl, worst_dnl_code, worst_inl, worst_inl_code);
+    printf("Offset %.6f V, gain %.9f V/LSB (nominal %.9f)\n", cal.offset, cal.gain, ADC_CAL_NOMINAL_GAIN);
+
+    if (adc_cal_save(&cal, out_name) < 0) {
+        perror("Error writing calibration file");
+        return 1;
+    }
+    printf("Calibration written to %s\n", out_name);
+    return 0;
+}
@@ -0,0 +1,199 @@
+/*
+    About:
+        Calibrated conversion of raw RP2040 ADC codes, one table per pico.
+
+        The RP2040 ADC is not linear: its DNL has large spikes at a few codes (around
+    512, 1536, 2560 and 3584, see the RP2040 datasheet errata E11), so code * 3.3/4096
+    is off by several LSB there. Each pico gets a calibration file with the measured
+    center of every code in LSB (INL/DNL, from a code density test, see adc_cal.c) and
+    a two-point offset/gain fit:
+        volts(code) = offset + gain * center[code]
+    All of it is folded into one 4096-entry table per output type, so conversion is a
+    single lookup per sample whatever the correction.
+
+        Lookups are vectorized where the CPU has a gather (AVX2 on x86, 8 samples per
+    instruction). NEON has none, on the Pi 5 the masking is vectorized and the 8
+    lookups per iteration are plain loads. Either way the 16 KiB table stays in L1
+    and a core converts several hundred million samples per second, far above what
+    all picos together deliver.
+
+    Calibration file (text):
+        adc_cal 1
+        offset <volts>
+        gain <volts per LSB>
+        <code> <center in LSB>      4096 lines, one per code
+*/
+
+#ifndef ADC_CAL_H
+#define ADC_CAL_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stddef.h>
+#if defined(__ARM_NEON)
+#include <arm_neon.h>
+#elif defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+#define ADC_CAL_CODES           4096
+#define ADC_CAL_VERSION         1
+#define ADC_CAL_NOMINAL_GAIN    (3.3 / ADC_CAL_CODES)   // the firmware's conversion_factor
+
+typedef struct {
+    double offset;                      // volts at center 0
+    double gain;                        // volts per LSB
+    double center[ADC_CAL_CODES];       // measured center of each code in LSB, c for an ideal ADC
+    float volts[ADC_CAL_CODES];         // lookup tables built from the above
+    int32_t microvolts[ADC_CAL_CODES];
+} adc_cal_t;
+
+/*
+    Description:
+        Rebuild the lookup tables after offset, gain or center changed
+*/
+static inline void adc_cal_build(adc_cal_t *cal) {
+    for (int c = 0; c < ADC_CAL_CODES; c++) {
+        double v = cal->offset + cal->gain * cal->center[c];
+        cal->volts[c] = (float)v;
+        cal->microvolts[c] = (int32_t)(v * 1e6 + (v < 0 ? -0.5 : 0.5));
+    }
+}
+
+/*
+    Description:
+        Ideal ADC: no offset, nominal gain, code c centered at c
+*/
+static inline void adc_cal_nominal(adc_cal_t *cal) {
+    cal->offset = 0.0;
+    cal->gain = ADC_CAL_NOMINAL_GAIN;
+    for (int c = 0; c < ADC_CAL_CODES; c++) {
+        cal->center[c] = c;
+    }
+    adc_cal_build(cal);
+}
+
+/*
+    Description:
+        Load a calibration file and build its tables
+
+    Return:
+        int - 0 on success, -1 if the file is missing or malformed (cal is then nominal)
+*/
+static inline int adc_cal_load(adc_cal_t *cal, const char *filename) {
+    adc_cal_nominal(cal);
+    FILE *f = fopen(filename, "r");
+    if (f == NULL) {
+        return -1;
+    }
+
+    int version = 0, codes = 0;
+    int ok = fscanf(f, " adc_cal %d offset %lf gain %lf", &version, &cal->offset, &cal->gain) == 3
+             && version == ADC_CAL_VERSION;
+    while (ok && codes < ADC_CAL_CODES) {
+        int code;
+        double center;
+        if (fscanf(f, "%d %lf", &code, &center) != 2 || code != codes) {
+            ok = 0;
+            break;
+        }
+        cal->center[codes++] = center;
+    }
+    fclose(f);
+
+    if (!ok) {
+        adc_cal_nominal(cal);
+        return -1;
+    }
+    adc_cal_build(cal);
+    return 0;
+}
+
+/*
+    Description:
+        Write a calibration file
+
+    Return:
+        int - 0 on success, -1 on error
+*/
+static inline int adc_cal_save(const adc_cal_t *cal, const char *filename) {
+    FILE *f = fopen(filename, "w");
+    if (f == NULL) {
+        return -1;
+    }
+    fprintf(f, "adc_cal %d\noffset %.9g\ngain %.9g\n", ADC_CAL_VERSION, cal->offset, cal->gain);
+    for (int c = 0; c < ADC_CAL_CODES; c++) {
+        fprintf(f, "%d %.6f\n", c, cal->center[c]);
+    }
+    return fclose(f) == 0 ? 0 : -1;
+}
+
+/*
+    Description:
+        Convert raw codes to volts (float32)
+
+    Parameter:
+        const adc_cal_t *cal  - calibration of the pico the codes came from
+        const uint16_t *codes - raw samples, bits above the 12th are ignored
+        float *out            - count volts
+        size_t count          - number of samples
+*/
+static inline void adc_cal_volts(const adc_cal_t *cal, const uint16_t *codes, float *out, size_t count) {
+    const float *lut = cal->volts;
+    size_t i = 0;
+
+#if defined(__AVX2__)
+    const __m256i mask = _mm256_set1_epi32(ADC_CAL_CODES - 1);
+    for (; i + 8 <= count; i += 8) {
+        __m256i index = _mm256_and_si256(_mm256_cvtepu16_epi32(_mm_loadu_si128((const __m128i *)(codes + i))), mask);
+        _mm256_storeu_ps(out + i, _mm256_i32gather_ps(lut, index, 4));
+    }
+#elif defined(__ARM_NEON)
+    const uint16x8_t mask = vdupq_n_u16(ADC_CAL_CODES - 1);
+    for (; i + 8 <= count; i += 8) {
+        uint16_t index[8];
+        vst1q_u16(index, vandq_u16(vld1q_u16(codes + i), mask));
+        float32x4_t lo = { lut[index[0]], lut[index[1]], lut[index[2]], lut[index[3]] };
+        float32x4_t hi = { lut[index[4]], lut[index[5]], lut[index[6]], lut[index[7]] };
+        vst1q_f32(out + i, lo);
+        vst1q_f32(out + i + 4, hi);
+    }
+#endif
+
+    for (; i < count; i++) {
+        out[i] = lut[codes[i] & (ADC_CAL_CODES - 1)];
+    }
+}
+
+/*
+    Description:
+        Convert raw codes to microvolts (int32), same as adc_cal_volts() otherwise
+*/
+static inline void adc_cal_microvolts(const adc_cal_t *cal, const uint16_t *codes, int32_t *out, size_t count) {
+    const int32_t *lut = cal->microvolts;
+    size_t i = 0;
+
+#if defined(__AVX2__)
+    const __m256i mask = _mm256_set1_epi32(ADC_CAL_CODES - 1);
+    for (; i + 8 <= count; i += 8) {
+        __m256i index = _mm256_and_si256(_mm256_cvtepu16_epi32(_mm_loadu_si128((const __m128i *)(codes + i))), mask);
+        _mm256_storeu_si256((__m256i *)(out + i), _mm256_i32gather_epi32(lut, index, 4));
+    }
+#elif defined(__ARM_NEON)
+    const uint16x8_t mask = vdupq_n_u16(ADC_CAL_CODES - 1);
+    for (; i + 8 <= count; i += 8) {
+        uint16_t index[8];
+        vst1q_u16(index, vandq_u16(vld1q_u16(codes + i), mask));
+        int32x4_t lo = { lut[index[0]], lut[index[1]], lut[index[2]], lut[index[3]] };
+        int32x4_t hi = { lut[index[4]], lut[index[5]], lut[index[6]], lut[index[7]] };
+        vst1q_s32(out + i, lo);
+        vst1q_s32(out + i + 4, hi);
+    }
+#endif
+
+    for (; i < count; i++) {
+        out[i] = lut[codes[i] & (ADC_CAL_CODES - 1)];
+    }
+}
+
+#endif
@@ -0,0 +1,192 @@
+/*
+    About:
+        Burst frame format of the picos, keep in sync with src/adc_A/burst_frame.h.
+
+    On the wire (16-bit words, little-endian fields):
+        burst_frame_t header        FRAME_HEADER_WORDS words
+        payload                     payload_words words (the samples)
+        telemetry                   telemetry_words words, FRAME_FLAG_TELEMETRY only (telemetry.h)
+        CRC32                       FRAME_TRAILER_WORDS words, low half first
+
+        The CRC is the standard CRC-32 (zlib / IEEE 802.3) over the header, payload
+    and telemetry bytes. The pico gets it for free from its DMA sniffer, here it is
+    one pass over the frame: with the ARMv8 CRC32 instructions (Raspberry Pi 5) 8
+    bytes per instruction, elsewhere a slicing-by-8 table.
+*/
+
+#ifndef BURST_FRAME_H
+#define BURST_FRAME_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#if defined(__ARM_FEATURE_CRC32)
+#include <arm_acle.h>
+#endif
+
+#define FRAME_MAGIC             0xA5C3
+#define FRAME_VERSION           3
+#define FRAME_HEADER_WORDS      36
+#define FRAME_TRAILER_WORDS     2
+#define FRAME_TELEMETRY_MAX_WORDS 512   // room the receiver keeps for a telemetry block
+
+// flags
+#define FRAME_FLAG_PACKED12     0x0001  // payload is 12-bit packed, 4 samples in 3 words (pack12.h)
+#define FRAME_FLAG_RICE         0x0002  // payload is delta + Rice coded, variable length (rice_encode.h)
+#define FRAME_FLAG_SYNC_START   0x0004  // the run started on the sync pulse latched at run_start_us (INTERLEAVE)
+#define FRAME_FLAG_TELEMETRY    0x0008  // a telemetry block follows the payload (TELEMETRY)
+
+// payload words of sample_count samples with the given flags, fixed length formats only
+#define FRAME_PAYLOAD_WORDS(samples, flags) \
+    (((flags) & FRAME_FLAG_PACKED12) ? ((samples) * 3 + 3) / 4 : (samples))
+
+typedef struct {
+    uint16_t magic;             // FRAME_MAGIC
+    uint16_t version;           // FRAME_VERSION
+    uint16_t machine_id;        // position of the pico in the ring
+    uint16_t header_words;      // FRAME_HEADER_WORDS
+    uint32_t sequence;          // per-pico frame counter, gaps mean dropped frames
+    uint32_t sample_count;      // samples in the payload
+    uint32_t payload_words;     // 16-bit words between header and CRC
+    uint16_t flags;             // FRAME_FLAG_*, 0 for plain 16-bit samples
+    uint16_t channel_mask;      // ADC inputs in the payload, interleaved in ascending order (0: one channel)
+    uint32_t encode_us;         // time the pico spent packing / coding the payload
+    // timing, pico times are its time_us_64(): sample i of the run is at
+    // run_start_us + first_sample_ns + (run_offset + i) * sample_period_ps
+    uint32_t sample_period_ps;  // spacing of the payload samples, 0 when paced by trigger pulses
+    uint32_t run_offset;        // samples of the same gap-free run before this frame
+    int32_t first_sample_ns;    // from run_start_us to the first sample of the run
+    uint32_t sync_count;        // sync pulses latched since boot, 0 if none yet
+    uint16_t telemetry_words;   // words between payload and CRC, 0 without FRAME_FLAG_TELEMETRY
+    uint16_t link_khz;          // SPI clock stored by link_cal, 0 if the link was never calibrated
+    uint64_t run_start_us;      // start of the run (capture armed, ADC started or first trigger)
+    uint64_t sync_latch_us;     // time of the latest sync pulse
+    uint64_t transfer_us;       // time TRANSFER_PIN went high for this frame
+} burst_frame_t;
+
+_Static_assert(sizeof(burst_frame_t) == FRAME_HEADER_WORDS * sizeof(uint16_t), "frame header layout");
+
+// frame_check() results
+#define FRAME_OK                0
+#define FRAME_BAD_HEADER        1   // magic, version or length not what we expect
+#define FRAME_BAD_CRC           2   // header fine, trailer does not match
+
+#if !defined(__ARM_FEATURE_CRC32)
+static uint32_t frame_crc_table[8][256];
+
+static inline void frame_crc_init_table(void) {
+    for (uint32_t i = 0; i < 256; i++) {
+        uint32_t c = i;
+        for (int k = 0; k < 8; k++) {
+            c = (c >> 1) ^ (0xEDB88320u & (0u - (c & 1)));
+        }
+        frame_crc_table[0][i] = c;
+    }
+    for (uint32_t i = 0; i < 256; i++) {
+        for (int t = 1; t < 8; t++) {
+            uint32_t c = frame_crc_table[t - 1][i];
+            frame_crc_table[t][i] = (c >> 8) ^ frame_crc_table[0][c & 0xff];
+        }
+    }
+}
+#endif
+
+/*
+    Description:
+        Prepare the CRC, call once before any frame_crc32()
+*/
+static inline void frame_crc_init(void) {
+#if !defined(__ARM_FEATURE_CRC32)
+    frame_crc_init_table();
+#endif
+}
+
+/*
+    Description:
+        zlib CRC-32 of a byte buffer, the value the pico's DMA sniffer produces
+
+    Parameter:
+        const void *data - bytes to check
+        size_t len       - number of bytes
+
+    Return:
+        uint32_t - CRC-32
+*/
+static inline uint32_t frame_crc32(const void *data, size_t len) {
+    const uint8_t *p = (const uint8_t *)data;
+    uint32_t crc = 0xffffffffu;
+
+#if defined(__ARM_FEATURE_CRC32)
+    for (; len >= 8; p += 8, len -= 8) {
+        uint64_t v;
+        memcpy(&v, p, 8);
+        crc = __crc32d(crc, v);
+    }
+    for (; len > 0; p++, len--) {
+        crc = __crc32b(crc, *p);
+    }
+#else
+    for (; len >= 8; p += 8, len -= 8) {
+        uint32_t lo, hi;
+        memcpy(&lo, p, 4);
+        memcpy(&hi, p + 4, 4);
+        lo ^= crc;
+        crc = frame_crc_table[7][lo & 0xff] ^ frame_crc_table[6][(lo >> 8) & 0xff]
+            ^ frame_crc_table[5][(lo >> 16) & 0xff] ^ frame_crc_table[4][lo >> 24]
+            ^ frame_crc_table[3][hi & 0xff] ^ frame_crc_table[2][(hi >> 8) & 0xff]
+            ^ frame_crc_table[1][(hi >> 16) & 0xff] ^ frame_crc_table[0][hi >> 24];
+    }
+    for (; len > 0; p++, len--) {
+        crc = (crc >> 8) ^ frame_crc_table[0][(crc ^ *p) & 0xff];
+    }
+#endif
+
+    return ~crc;
+}
+
+/*
+    Description:
+        Find the first header magic in a run of words, for resynchronisation
+
+    Return:
+        int - word offset of the magic, -1 if there is none
+*/
+static inline int frame_find_magic(const uint16_t *words, size_t count) {
+    for (size_t i = 0; i < count; i++) {
+        if (words[i] == FRAME_MAGIC) {
+            return (int)i;
+        }
+    }
+    return -1;
+}
+
+/*
+    Description:
+        Validate a complete frame: header fields, then the CRC trailer
+
+    Parameter:
+        const uint16_t *frame - header, payload, telemetry and trailer, word aligned
+        uint32_t payload_words - payload length the receiver expects, the telemetry
+                                 length is the header's
+
+    Return:
+        int - FRAME_OK, FRAME_BAD_HEADER or FRAME_BAD_CRC
+*/
+static inline int frame_check(const uint16_t *frame, uint32_t payload_words) {
+    const burst_frame_t *header = (const burst_frame_t *)frame;
+    if (header->magic != FRAME_MAGIC || header->version != FRAME_VERSION
+        || header->header_words != FRAME_HEADER_WORDS || header->payload_words != payload_words
+        || header->telemetry_words > FRAME_TELEMETRY_MAX_WORDS
+        || (header->telemetry_words != 0) != ((header->flags & FRAME_FLAG_TELEMETRY) != 0)) {
+        return FRAME_BAD_HEADER;
+    }
+
+    size_t words = FRAME_HEADER_WORDS + payload_words + header->telemetry_words;
+    uint32_t trailer = (uint32_t)frame[words] | ((uint32_t)frame[words + 1] << 16);
+    if (frame_crc32(frame, words * sizeof(uint16_t)) != trailer) {
+        return FRAME_BAD_CRC;
+    }
+    return FRAME_OK;
+}
+
+#endif
@@ -0,0 +1,119 @@
+/*
+    About:
+        Lock-free single-producer/single-consumer queue and a preallocated buffer pool
+    built on it.
+
+        Each SPI reader owns a pool: buffers travel reader -> writer through a "full"
+    queue and come back writer -> reader through a "free" queue. Both queues have one
+    producer and one consumer, so a push or pop is one acquire load and one release
+    store, no locks and no syscalls. When the free queue is empty the reader knows
+    the writer is behind and can count it instead of blocking.
+*/
+
+#ifndef BURST_QUEUE_H
+#define BURST_QUEUE_H
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdatomic.h>
+
+#define SPSC_CAPACITY 64            // slots per queue, power of two
+#define CACHE_LINE 64
+
+_Static_assert((SPSC_CAPACITY & (SPSC_CAPACITY - 1)) == 0, "SPSC_CAPACITY must be a power of two");
+
+typedef struct {
+    _Alignas(CACHE_LINE) _Atomic size_t head;  // next slot to pop, written by the consumer
+    _Alignas(CACHE_LINE) _Atomic size_t tail;  // next slot to push, written by the producer
+    _Alignas(CACHE_LINE) void *slots[SPSC_CAPACITY];
+} spsc_queue_t;
+
+static inline void spsc_init(spsc_queue_t *q) {
+    atomic_init(&q->head, 0);
+    atomic_init(&q->tail, 0);
+}
+
+/*
+    Description:
+        Push an item, producer side only
+
+    Return:
+        int - 0 on success, -1 if the queue is full
+*/
+static inline int spsc_push(spsc_queue_t *q, void *item) {
+    size_t tail = atomic_load_explicit(&q->tail, memory_order_relaxed);
+    size_t head = atomic_load_explicit(&q->head, memory_order_acquire);
+    if (tail - head == SPSC_CAPACITY) {
+        return -1;
+    }
+    q->slots[tail & (SPSC_CAPACITY - 1)] = item;
+    atomic_store_explicit(&q->tail, tail + 1, memory_order_release);
+    return 0;
+}
+
+/*
+    Description:
+        Pop an item, consumer side only
+
+    Return:
+        void* - the oldest item, NULL if the queue is empty
+*/
+static inline void *spsc_pop(spsc_queue_t *q) {
+    size_t head = atomic_load_explicit(&q->head, memory_order_relaxed);
+    size_t tail = atomic_load_explicit(&q->tail, memory_order_acquire);
+    if (head == tail) {
+        return NULL;
+    }
+    void *item = q->slots[head & (SPSC_CAPACITY - 1)];
+    atomic_store_explicit(&q->head, head + 1, memory_order_release);
+    return item;
+}
+
+// Number of queued items, exact on either side, a snapshot anywhere else
+static inline size_t spsc_depth(spsc_queue_t *q) {
+    return atomic_load_explicit(&q->tail, memory_order_acquire)
+         - atomic_load_explicit(&q->head, memory_order_acquire);
+}
+
+typedef struct {
+    void *storage;                  // count * item_bytes, one allocation
+    size_t item_bytes;
+    size_t count;
+    spsc_queue_t free;              // writer -> reader
+    spsc_queue_t full;              // reader -> writer
+} burst_pool_t;
+
+/*
+    Description:
+        Allocate count buffers of item_bytes and put them all on the free queue
+
+    Return:
+        int - 0 on success, -1 on error
+*/
+static inline int burst_pool_init(burst_pool_t *pool, size_t item_bytes, size_t count) {
+    if (count > SPSC_CAPACITY) {
+        return -1;
+    }
+    item_bytes = (item_bytes + CACHE_LINE - 1) & ~(size_t)(CACHE_LINE - 1);
+    pool->storage = aligned_alloc(CACHE_LINE, item_bytes * count);
+    if (pool->storage == NULL) {
+        return -1;
+    }
+    memset(pool->storage, 0, item_bytes * count);   // fault the pages in now, not on the receive path
+    pool->item_bytes = item_bytes;
+    pool->count = count;
+    spsc_init(&pool->free);
+    spsc_init(&pool->full);
+    for (size_t i = 0; i < count; i++) {
+        spsc_push(&pool->free, (uint8_t *)pool->storage + i * item_bytes);
+    }
+    return 0;
+}
+
+static inline void burst_pool_destroy(burst_pool_t *pool) {
+    free(pool->storage);
+    pool->storage = NULL;
+}
+
+#endif
@@ -0,0 +1,115 @@
+/*
+    About:
+        Split an interleaved multi-channel burst (round-robin ADC capture, sample i
+    belongs to the (i % channels)-th enabled channel) into one contiguous block per
+    channel.
+
+        The Raspberry Pi 5 path uses the NEON structure loads vld2q/vld3q/vld4q, which
+    deinterleave 8 frames of 2, 3 or 4 channels in a single instruction. On x86 with
+    SSSE3 (build with -march=native) 2 and 4 channels go through byte shuffles.
+    Everything else, and the tail of every burst, is done by the scalar loop.
+*/
+
+#ifndef DEINTERLEAVE_H
+#define DEINTERLEAVE_H
+
+#include <stdint.h>
+#include <stddef.h>
+#if defined(__ARM_NEON)
+#include <arm_neon.h>
+#elif defined(__SSSE3__)
+#include <tmmintrin.h>
+#endif
+
+#define DEINTERLEAVE_MAX_CHANNELS 5     // ADC inputs 0-3 and the temperature sensor
+
+// Number of channels in an ADC round-robin mask
+static inline unsigned channel_count(uint16_t mask) {
+    return (unsigned)__builtin_popcount(mask & ((1u << DEINTERLEAVE_MAX_CHANNELS) - 1));
+}
+
+static inline size_t deinterleave_scalar(const uint16_t *in, uint16_t **out, unsigned channels,
+                                         size_t start, size_t frames) {
+    for (size_t f = start; f < frames; f++) {
+        for (unsigned c = 0; c < channels; c++) {
+            out[c][f] = in[f * channels + c];
+        }
+    }
+    return frames;
+}
+
+/*
+    Description:
+        Deinterleave frames * channels samples
+
+    Parameter:
+        const uint16_t *in - interleaved samples, frames * channels long
+        uint16_t **out     - one destination per channel, each frames long
+        unsigned channels  - 1 to DEINTERLEAVE_MAX_CHANNELS
+        size_t frames      - samples per channel
+*/
+static inline void deinterleave_u16(const uint16_t *in, uint16_t **out, unsigned channels, size_t frames) {
+    size_t f = 0;
+
+#if defined(__ARM_NEON)
+    switch (channels) {
+    case 2:
+        for (; f + 8 <= frames; f += 8) {
+            uint16x8x2_t v = vld2q_u16(in + f * 2);
+            vst1q_u16(out[0] + f, v.val[0]);
+            vst1q_u16(out[1] + f, v.val[1]);
+        }
+        break;
+    case 3:
+        for (; f + 8 <= frames; f += 8) {
+            uint16x8x3_t v = vld3q_u16(in + f * 3);
+            vst1q_u16(out[0] + f, v.val[0]);
+            vst1q_u16(out[1] + f, v.val[1]);
+            vst1q_u16(out[2] + f, v.val[2]);
+        }
+        break;
+    case 4:
+        for (; f + 8 <= frames; f += 8) {
+            uint16x8x4_t v = vld4q_u16(in + f * 4);
+            vst1q_u16(out[0] + f, v.val[0]);
+            vst1q_u16(out[1] + f, v.val[1]);
+            vst1q_u16(out[2] + f, v.val[2]);
+            vst1q_u16(out[3] + f, v.val[3]);
+        }
+        break;
+    }
+#elif defined(__SSSE3__)
+    if (channels == 2) {
+        // even words to the low half, odd words to the high half
+        const __m128i split = _mm_setr_epi8(0, 1, 4, 5, 8, 9, 12, 13, 2, 3, 6, 7, 10, 11, 14, 15);
+        for (; f + 8 <= frames; f += 8) {
+            __m128i a = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(in + f * 2)), split);
+            __m128i b = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(in + f * 2 + 8)), split);
+            _mm_storeu_si128((__m128i *)(out[0] + f), _mm_unpacklo_epi64(a, b));
+            _mm_storeu_si128((__m128i *)(out[1] + f), _mm_unpackhi_epi64(a, b));
+        }
+    } else if (channels == 4) {
+        // each vector holds 2 frames, group them per channel as 32-bit pairs
+        const __m128i pair = _mm_setr_epi8(0, 1, 8, 9, 2, 3, 10, 11, 4, 5, 12, 13, 6, 7, 14, 15);
+        for (; f + 8 <= frames; f += 8) {
+            const __m128i *p = (const __m128i *)(in + f * 4);
+            __m128i v0 = _mm_shuffle_epi8(_mm_loadu_si128(p + 0), pair);
+            __m128i v1 = _mm_shuffle_epi8(_mm_loadu_si128(p + 1), pair);
+            __m128i v2 = _mm_shuffle_epi8(_mm_loadu_si128(p + 2), pair);
+            __m128i v3 = _mm_shuffle_epi8(_mm_loadu_si128(p + 3), pair);
+            __m128i t0 = _mm_unpacklo_epi32(v0, v1);    // channel 0 and 1, frames 0-3
+            __m128i t1 = _mm_unpackhi_epi32(v0, v1);    // channel 2 and 3, frames 0-3
+            __m128i t2 = _mm_unpacklo_epi32(v2, v3);    // channel 0 and 1, frames 4-7
+            __m128i t3 = _mm_unpackhi_epi32(v2, v3);    // channel 2 and 3, frames 4-7
+            _mm_storeu_si128((__m128i *)(out[0] + f), _mm_unpacklo_epi64(t0, t2));
+            _mm_storeu_si128((__m128i *)(out[1] + f), _mm_unpackhi_epi64(t0, t2));
+            _mm_storeu_si128((__m128i *)(out[2] + f), _mm_unpacklo_epi64(t1, t3));
+            _mm_storeu_si128((__m128i *)(out[3] + f), _mm_unpackhi_epi64(t1, t3));
+        }
+    }
+#endif
+
+    deinterleave_scalar(in, out, channels, f, frames);
+}
+
+#endif
@@ -0,0 +1,342 @@
+/*
+    About:
+        Real FFT of any even length whose factors are 2, 3 and 5: 12500 (one burst),
+    4096, 8192, ... A plan is made once per length. It holds the factorization,
+    the twiddles of every stage and the work buffers, so a transform allocates
+    nothing and computes no sines.
+
+        A real transform of N points is a complex one of N/2 points: even samples as
+    the real part, odd samples as the imaginary part, then one pass that separates
+    the two halves. The complex FFT is a Stockham autosort FFT with radix 4, 2, 3
+    and 5 stages, ping-ponging between two buffers, so there is no bit reversal. Real
+    and imaginary parts are kept in separate arrays. Each butterfly then works on 4
+    neighbouring transforms at once, which share their twiddles.
+
+        The butterflies are written once for 4-float vectors (GCC vector types): NEON
+    on the Raspberry Pi 5, SSE on x86. The first stage, and strides that are not a
+    multiple of 4, go through the same code one lane at a time.
+*/
+
+#ifndef FFT_H
+#define FFT_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#define FFT_MAX_STAGES 32
+
+typedef float fft_v4 __attribute__((vector_size(16)));
+typedef float fft_v4u __attribute__((vector_size(16), aligned(4)));     // unaligned loads and stores
+
+typedef struct {
+    unsigned size;                      // real points
+    unsigned n;                         // complex points, size / 2
+    unsigned stages;
+    unsigned radix[FFT_MAX_STAGES];
+    size_t twiddle_at[FFT_MAX_STAGES];  // first twiddle of each stage
+    float *tw_re, *tw_im;               // per stage: W^(k p) at (k - 1) * m + p, p < m, 1 <= k < radix
+    float *split_re, *split_im;         // e^(-2 pi i k / size), k <= n / 2, for the real pass
+    float *re[2], *im[2];               // ping-pong buffers, n each
+} fft_plan_t;
+
+// Load 4 floats, or one float into every lane for the single-lane path
+static inline fft_v4 fft_load(const float *p, int lanes) {
+    if (lanes == 4) {
+        return *(const fft_v4u *)p;
+    }
+    return (fft_v4){ 0, 0, 0, 0 } + p[0];
+}
+
+static inline void fft_store(float *p, fft_v4 v, int lanes) {
+    if (lanes == 4) {
+        *(fft_v4u *)p = v;
+    } else {
+        p[0] = v[0];
+    }
+}
+
+/*
+    Description:
+        DFT of radix points in place, forward (e^(-2 pi i j k / radix))
+
+    Parameter:
+        fft_v4 *re, *im - radix points
+        unsigned radix  - 2, 3, 4 or 5
+*/
+static inline void fft_butterfly(fft_v4 *re, fft_v4 *im, unsigned radix) {
+    if (radix == 2) {
+        fft_v4 r0 = re[0], i0 = im[0];
+        re[0] = r0 + re[1];  im[0] = i0 + im[1];
+        re[1] = r0 - re[1];  im[1] = i0 - im[1];
+    } else if (radix == 4) {
+        fft_v4 t0r = re[0] + re[2], t0i = im[0] + im[2];
+        fft_v4 t1r = re[0] - re[2], t1i = im[0] - im[2];
+        fft_v4 t2r = re[1] + re[3], t2i = im[1] + im[3];
+        fft_v4 t3r = re[1] - re[3], t3i = im[1] - im[3];
+        re[0] = t0r + t2r;  im[0] = t0i + t2i;
+        re[2] = t0r - t2r;  im[2] = t0i - t2i;
+        re[1] = t1r + t3i;  im[1] = t1i - t3r;     // t1 - i t3
+        re[3] = t1r - t3i;  im[3] = t1i + t3r;     // t1 + i t3
+    } else if (radix == 3) {
+        const float s3 = 0.86602540378443865f;     // sin(2 pi / 3)
+        fft_v4 t1r = re[1] + re[2], t1i = im[1] + im[2];
+        fft_v4 t2r = (re[1] - re[2]) * s3, t2i = (im[1] - im[2]) * s3;
+        fft_v4 mr = re[0] - 0.5f * t1r, mi = im[0] - 0.5f * t1i;
+        re[0] += t1r;  im[0] += t1i;
+        re[1] = mr + t2i;  im[1] = mi - t2r;
+        re[2] = mr - t2i;  im[2] = mi + t2r;
+    } else {
+        const float c1 = 0.30901699437494742f, c2 = -0.80901699437494742f;     // cos(2 pi / 5), cos(4 pi / 5)
+        const float s1 = 0.95105651629515357f, s2 = 0.58778525229247313f;      // sin(2 pi / 5), sin(4 pi / 5)
+        fft_v4 t1r = re[1] + re[4], t1i = im[1] + im[4];
+        fft_v4 t2r = re[2] + re[3], t2i = im[2] + im[3];
+        fft_v4 t3r = re[1] - re[4], t3i = im[1] - im[4];
+        fft_v4 t4r = re[2] - re[3], t4i = im[2] - im[3];
+        fft_v4 m1r = re[0] + c1 * t1r + c2 * t2r, m1i = im[0] + c1 * t1i + c2 * t2i;
+        fft_v4 m2r = re[0] + c2 * t1r + c1 * t2r, m2i = im[0] + c2 * t1i + c1 * t2i;
+        fft_v4 n1r = s1 * t3r + s2 * t4r, n1i = s1 * t3i + s2 * t4i;
+        fft_v4 n2r = s2 * t3r - s1 * t4r, n2i = s2 * t3i - s1 * t4i;
+        re[0] += t1r + t2r;  im[0] += t1i + t2i;
+        re[1] = m1r + n1i;  im[1] = m1i - n1r;     // m1 - i n1
+        re[4] = m1r - n1i;  im[4] = m1i + n1r;
+        re[2] = m2r + n2i;  im[2] = m2i - n2r;     // m2 - i n2
+        re[3] = m2r - n2i;  im[3] = m2i + n2r;
+    }
+}
+
+/*
+    Description:
+        One Stockham stage: transforms of length len at stride s, in x, become
+    radix-times-longer runs of length len / radix, in y. Inlined once per radix so
+    the butterfly is unrolled. With s >= 4 the 4 lanes are neighbouring transforms
+    with the same twiddles; in the first stage (s = 1) they are 4 consecutive p,
+    with their own twiddles, and the results are scattered.
+
+    Parameter:
+        const fft_plan_t *plan - twiddles
+        unsigned stage         - index in plan->radix
+        unsigned radix         - plan->radix[stage], a constant after inlining
+        unsigned len           - points per transform in this stage
+        unsigned s             - stride, transforms done side by side
+        const float *xr, *xi   - input
+        float *yr, *yi         - output
+*/
+static inline __attribute__((always_inline)) void fft_stage_radix(const fft_plan_t *plan, unsigned stage, const unsigned radix,
+                                                                  unsigned len, unsigned s, const float *xr, const float *xi,
+                                                                  float *yr, float *yi) {
+    const unsigned m = len / radix;
+    const float *twr = plan->tw_re + plan->twiddle_at[stage];     // W^(k p) at (k - 1) * m + p
+    const float *twi = plan->tw_im + plan->twiddle_at[stage];
+    fft_v4 re[5], im[5], wr[5], wi[5];
+
+    unsigned p = 0;
+    if (s == 1) {
+        for (; p + 4 <= m; p += 4) {
+            for (unsigned j = 0; j < radix; j++) {
+                re[j] = *(const fft_v4u *)(xr + p + j * m);
+                im[j] = *(const fft_v4u *)(xi + p + j * m);
+            }
+            fft_butterfly(re, im, radix);
+            for (unsigned k = 0; k < radix; k++) {
+                fft_v4 r = re[k], i = im[k];
+                if (k > 0) {
+                    fft_v4 cr = *(const fft_v4u *)(twr + (k - 1) * m + p), ci = *(const fft_v4u *)(twi + (k - 1) * m + p);
+                    r = re[k] * cr - im[k] * ci;
+                    i = re[k] * ci + im[k] * cr;
+                }
+                for (unsigned l = 0; l < 4; l++) {
+                    yr[radix * (p + l) + k] = r[l];
+                    yi[radix * (p + l) + k] = i[l];
+                }
+            }
+        }
+    }
+
+    for (; p < m; p++) {
+        for (unsigned k = 1; k < radix; k++) {
+            wr[k] = (fft_v4){ 0, 0, 0, 0 } + twr[(k - 1) * m + p];
+            wi[k] = (fft_v4){ 0, 0, 0, 0 } + twi[(k - 1) * m + p];
+        }
+        for (unsigned q = 0; q < s; ) {
+            int lanes = s - q >= 4 ? 4 : 1;
+            for (unsigned j = 0; j < radix; j++) {
+                size_t at = q + (size_t)s * (p + j * m);
+                re[j] = fft_load(xr + at, lanes);
+                im[j] = fft_load(xi + at, lanes);
+            }
+            fft_butterfly(re, im, radix);
+            for (unsigned k = 0; k < radix; k++) {
+                size_t at = q + (size_t)s * (radix * p + k);
+                fft_v4 r = re[k], i = im[k];
+                if (k > 0) {
+                    r = re[k] * wr[k] - im[k] * wi[k];
+                    i = re[k] * wi[k] + im[k] * wr[k];
+                }
+                fft_store(yr + at, r, lanes);
+                fft_store(yi + at, i, lanes);
+            }
+            q += lanes;
+        }
+    }
+}
+
+static inline void fft_stage(const fft_plan_t *plan, unsigned stage, unsigned len, unsigned s,
+                             const float *xr, const float *xi, float *yr, float *yi) {
+    switch (plan->radix[stage]) {
+    case 2: fft_stage_radix(plan, stage, 2, len, s, xr, xi, yr, yi); break;
+    case 3: fft_stage_radix(plan, stage, 3, len, s, xr, xi, yr, yi); break;
+    case 4: fft_stage_radix(plan, stage, 4, len, s, xr, xi, yr, yi); break;
+    default: fft_stage_radix(plan, stage, 5, len, s, xr, xi, yr, yi); break;
+    }
+}
+
+static inline void fft_plan_free(fft_plan_t *plan) {
+    free(plan->tw_re);
+    free(plan->tw_im);
+    free(plan->split_re);
+    free(plan->split_im);
+    for (int b = 0; b < 2; b++) {
+        free(plan->re[b]);
+        free(plan->im[b]);
+    }
+    memset(plan, 0, sizeof(*plan));
+}
+
+/*
+    Description:
+        Plan a real FFT
+
+    Parameter:
+        fft_plan_t *plan - filled in, free with fft_plan_free()
+        unsigned size    - real points, even, no prime factors other than 2, 3 and 5
+
+    Return:
+        int - 0 on success, -1 for an unsupported size or no memory
+*/
+static inline int fft_plan_init(fft_plan_t *plan, unsigned size) {
+    memset(plan, 0, sizeof(*plan));
+    if (size < 4 || size % 2 != 0) {
+        return -1;
+    }
+    plan->size = size;
+    plan->n = size / 2;
+
+    // radix 4 first, so that most strides are multiples of 4, then 5 and 3, the one 2 left last
+    unsigned rest = plan->n;
+    static const unsigned radices[] = { 4, 5, 3, 2 };
+    for (unsigned r = 0; r < sizeof(radices) / sizeof(radices[0]); r++) {
+        while (rest % radices[r] == 0 && plan->stages < FFT_MAX_STAGES) {
+            plan->radix[plan->stages++] = radices[r];
+            rest /= radices[r];
+        }
+    }
+    if (rest != 1) {
+        return -1;
+    }
+
+    // twiddles of stage t: len = n / (radix[0] ... radix[t-1]), W = e^(-2 pi i / len)
+    size_t twiddles = 0;
+    unsigned len = plan->n;
+    for (unsigned t = 0; t < plan->stages; t++) {
+        plan->twiddle_at[t] = twiddles;
+        twiddles += (size_t)(len / plan->radix[t]) * (plan->radix[t] - 1);
+        len /= plan->radix[t];
+    }
+    plan->tw_re = malloc((twiddles + 1) * sizeof(float));
+    plan->tw_im = malloc((twiddles + 1) * sizeof(float));
+    plan->split_re = malloc((plan->n / 2 + 1) * sizeof(float));
+    plan->split_im = malloc((plan->n / 2 + 1) * sizeof(float));
+    for (int b = 0; b < 2; b++) {
+        plan->re[b] = malloc(plan->n * sizeof(float));
+        plan->im[b] = malloc(plan->n * sizeof(float));
+    }
+    if (!plan->tw_re || !plan->tw_im || !plan->split_re || !plan->split_im
+        || !plan->re[0] || !plan->im[0] || !plan->re[1] || !plan->im[1]) {
+        fft_plan_free(plan);
+        return -1;
+    }
+
+    len = plan->n;
+    for (unsigned t = 0; t < plan->stages; t++) {
+        unsigned radix = plan->radix[t], m = len / radix;
+        for (unsigned p = 0; p < m; p++) {
+            for (unsigned k = 1; k < radix; k++) {
+                double angle = -2.0 * M_PI * (double)k * p / len;
+                size_t at = plan->twiddle_at[t] + (size_t)(k - 1) * m + p;
+                plan->tw_re[at] = (float)cos(angle);
+                plan->tw_im[at] = (float)sin(angle);
+            }
+        }
+        len = m;
+    }
+    for (unsigned k = 0; k <= plan->n / 2; k++) {
+        double angle = -2.0 * M_PI * k / size;
+        plan->split_re[k] = (float)cos(angle);
+        plan->split_im[k] = (float)sin(angle);
+    }
+    return 0;
+}
+
+/*
+    Description:
+        Complex FFT of the plan's n points in re[0] / im[0]
+
+    Parameter:
+        fft_plan_t *plan - plan, its buffers hold the input
+
+    Return:
+        int - buffer (0 or 1) that holds the result
+*/
+static inline int fft_complex(fft_plan_t *plan) {
+    unsigned len = plan->n, s = 1;
+    int in = 0;
+    for (unsigned t = 0; t < plan->stages; t++) {
+        fft_stage(plan, t, len, s, plan->re[in], plan->im[in], plan->re[!in], plan->im[!in]);
+        len /= plan->radix[t];
+        s *= plan->radix[t];
+        in = !in;
+    }
+    return in;
+}
+
+/*
+    Description:
+        Power spectrum of a real signal, |X[k]|^2 added to an accumulator
+
+    Parameter:
+        fft_plan_t *plan    - plan of the length
+        const float *x      - plan->size points, windowed
+        float *power        - plan->size / 2 + 1 bins, |X[k]|^2 is added to each
+*/
+static inline void fft_power_add(fft_plan_t *plan, const float *x, float *power) {
+    const unsigned n = plan->n;
+    float *zr = plan->re[0], *zi = plan->im[0];
+    for (unsigned i = 0; i < n; i++) {
+        zr[i] = x[2 * i];
+        zi[i] = x[2 * i + 1];
+    }
+    int out = fft_complex(plan);
+    zr = plan->re[out];
+    zi = plan->im[out];
+
+    // X[k] = E[k] + W^k O[k], E and O the spectra of the even and odd samples:
+    // E[k] = (Z[k] + conj Z[n-k]) / 2, O[k] = (Z[k] - conj Z[n-k]) / 2i; X[n-k] follows from the same pair
+    power[0] += (zr[0] + zi[0]) * (zr[0] + zi[0]);
+    power[n] += (zr[0] - zi[0]) * (zr[0] - zi[0]);
+    for (unsigned k = 1; k <= n / 2; k++) {
+        float er = 0.5f * (zr[k] + zr[n - k]), ei = 0.5f * (zi[k] - zi[n - k]);
+        float or_ = 0.5f * (zi[k] + zi[n - k]), oi = -0.5f * (zr[k] - zr[n - k]);
+        float wr = plan->split_re[k], wi = plan->split_im[k];
+        float tr = or_ * wr - oi * wi, ti = or_ * wi + oi * wr;
+        power[k] += (er + tr) * (er + tr) + (ei + ti) * (ei + ti);
+        if (k != n - k) {
+            // X[n-k] = conj(E[k]) - conj(W^k O[k])
+            power[n - k] += (er - tr) * (er - tr) + (ti - ei) * (ti - ei);
+        }
+    }
+}
+
+#endif
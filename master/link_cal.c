@@ -0,0 +1,345 @@
+/*
+    About:
+        Finds the fastest SPI clock the wiring to one pico sustains. The pico listens
+    for a calibration request for a moment after every reset (src/adc_A/link_cal.h),
+    so start this first, then reset the pico. It then serves blocks of a known PRBS
+    pattern, and this sweeps the clock from -f to -t MHz, clocking -b blocks at
+    every rate and counting the bits that differ from the pattern.
+
+        A rate passes with no bit error and no missing block. Above what the slave
+    follows the pico loses words, ends the block short and serves the next one, so
+    a block that is not announced in time fails the rate too. The sweep stops after
+    two failing rates in a row. The rate kept is the margin (-m) times the fastest rate below
+    which everything passed; it is verified with as many blocks again (and lowered
+    by the margin once more if that fails), then sent to the pico, which stores it
+    in its flash config block and acknowledges. Here it goes to CAL_FOLDER/<name>.link,
+    where SPI_isr picks it up (link_cal.h). Commands and the ack always go at 1 MHz.
+
+        Burst transfer time is proportional to 1 / rate, a 12500-sample burst takes
+    about 40 ms at 5 MHz and 20 ms at 10 MHz. The RP2040 SPI slave cannot follow
+    more than clk_peri / 12, about 10.4 MHz at the default 125 MHz, whatever the
+    wiring, so -t defaults to 10 MHz. The Pi rounds every requested clock down to
+    what its divider makes, the rates printed and stored are the ones requested.
+
+    Usage:
+        ./link_cal -n A -d /dev/spidev0.0 -g 22             then reset pico A
+        ./link_cal -n B -d /dev/spidev1.0 -g 27 -f 4 -t 16 -s 0.5 -b 32 -m 0.75
+
+        -n pico name (file name), -d its spidev device, -g the GPIO line of its
+    TRANSFER_PIN, as in the picos table of SPI_isr. -o writes another file instead
+    of cal/<name>.link, -w waits that many seconds for the pico (default 30).
+
+    Compilation:
+        gcc -O2 -o link_cal link_cal.c -lgpiod
+*/
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "transport_gpiod.h"
+#include "link_cal.h"
+
+#define GPIO_CHIP "/dev/gpiochip4"
+#define CAL_FOLDER "cal"
+
+// Delay between the transfer edge and the first clock, the pico is still pulsing
+#define TRANSFER_DELAY_US 100
+
+// Request words per attempt, and how long to wait for the first block after each
+#define REQUEST_WORDS 16
+#define REQUEST_WAIT_MS 20
+
+// The pico serves a block nobody clocked again after 2 s, wait a little longer
+#define EDGE_TIMEOUT_MS 2500
+
+// Failing rates in a row that end the sweep
+#define FAILS_TO_STOP 2
+
+// Attempts at the margin before giving up
+#define VERIFY_ATTEMPTS 3
+
+typedef struct {
+    int spi;
+    int line;
+    int event_fd;
+    transport_gpiod_t gpio;
+    uint16_t expected[LINK_CAL_WORDS];
+    uint16_t rx[LINK_CAL_WORDS];
+    uint16_t tx[LINK_CAL_WORDS];
+} link_t;
+
+// Errors at one rate
+typedef struct {
+    uint32_t hz;
+    unsigned blocks;
+    uint64_t bits;
+    uint64_t bit_errors;
+    uint64_t word_errors;
+    unsigned missed;            // blocks the pico never announced, the rate is abandoned
+} rate_result_t;
+
+static link_t pico;
+
+/*
+    Description:
+        Clock words in and out at once, in bufsiz-sized chunks
+
+    Return:
+        int - 0 on success, -1 on error
+*/
+static int transfer(int spi_fd, const uint16_t *tx, uint16_t *rx, size_t words, uint32_t speed) {
+    size_t chunk_words = spi_bufsiz / sizeof(uint16_t);
+    for (size_t offset = 0; offset < words; offset += chunk_words) {
+        size_t n = words - offset < chunk_words ? words - offset : chunk_words;
+        struct spi_ioc_transfer t;
+        memset(&t, 0, sizeof(t));
+        t.tx_buf = (unsigned long)&tx[offset];
+        t.rx_buf = (unsigned long)&rx[offset];
+        t.len = n * sizeof(uint16_t);
+        t.speed_hz = speed;
+        t.bits_per_word = SPI_LINK_BITS;
+        if (ioctl(spi_fd, SPI_IOC_MESSAGE(1), &t) < 0) {
+            perror("Error clocking SPI data");
+            return -1;
+        }
+    }
+    return 0;
+}
+
+/*
+    Description:
+        Wait for the pico's next transfer edge
+
+    Return:
+        int - 1 on an edge, 0 on a timeout, -1 on error
+*/
+static int wait_edge(int timeout_ms) {
+    struct pollfd p = { .fd = pico.event_fd, .events = POLLIN };
+    int ready = poll(&p, 1, timeout_ms);
+    if (ready <= 0) {
+        return ready;
+    }
+    uint64_t edge_ns;
+    return transport_gpiod_ops.read_edge(&pico.gpio, pico.line, &edge_ns) == 0 ? 1 : -1;
+}
+
+/*
+    Description:
+        Clock one block the pico has announced, sending a command for the next one
+    in its last 4 words
+
+    Parameter:
+        size_t words      - LINK_CAL_WORDS, or LINK_CAL_ACK_WORDS for the ack
+        uint32_t speed    - clock in Hz
+        uint16_t command  - LINK_CAL_NEXT, _DONE or _QUIT
+        uint16_t argument - kHz with LINK_CAL_DONE
+
+    Return:
+        int - 0 on success, 1 if the pico did not announce the block in time, -1 on error
+*/
+static int read_block(size_t words, uint32_t speed, uint16_t command, uint16_t argument) {
+    int edge = wait_edge(EDGE_TIMEOUT_MS);
+    if (edge != 1) {
+        return edge == 0 ? 1 : -1;
+    }
+    usleep(TRANSFER_DELAY_US);
+    memset(pico.tx, 0, words * sizeof(uint16_t));
+    pico.tx[words - 4] = command;
+    pico.tx[words - 3] = argument;
+    pico.tx[words - 2] = (uint16_t)~argument;
+    pico.tx[words - 1] = (uint16_t)~command;
+    return transfer(pico.spi, pico.tx, pico.rx, words, speed);
+}
+
+/*
+    Description:
+        Clock blocks at one rate and count the errors
+
+    Return:
+        int - 0 when the rate was tested (a missing block fails it), -1 on error
+*/
+static int test_rate(uint32_t hz, unsigned blocks, rate_result_t *r) {
+    memset(r, 0, sizeof(*r));
+    r->hz = hz;
+    for (unsigned b = 0; b < blocks; b++) {
+        int status = read_block(LINK_CAL_WORDS, hz, LINK_CAL_NEXT, 0);
+        if (status < 0) {
+            return -1;
+        }
+        if (status > 0) {
+            r->missed++;
+            break;
+        }
+        r->blocks++;
+        r->bits += LINK_CAL_WORDS * 16;
+        r->bit_errors += link_cal_bit_errors(pico.rx, pico.expected, LINK_CAL_WORDS, &r->word_errors);
+    }
+    return 0;
+}
+
+// A rate passes with every block announced and read without a bit error
+static int rate_passed(const rate_result_t *r) {
+    return r->missed == 0 && r->bit_errors == 0;
+}
+
+static void print_rate(const char *what, const rate_result_t *r) {
+    printf("%-7s %7.3f MHz  %4u blocks  %9lu bits  %7lu bit errors  %6lu word errors  BER %.1e  %s%s\n",
+           what, r->hz / 1e6, r->blocks, (unsigned long)r->bits, (unsigned long)r->bit_errors,
+           (unsigned long)r->word_errors, r->bits ? (double)r->bit_errors / r->bits : 0.0,
+           rate_passed(r) ? "pass" : "FAIL", r->missed ? " (block missing)" : "");
+    fflush(stdout);
+}
+
+/*
+    Description:
+        Clock request pairs at the safe rate until the pico answers with a block
+
+    Return:
+        int - 0 when the first block is announced, -1 if it never was
+*/
+static int request(int wait_s) {
+    uint16_t words[REQUEST_WORDS], rx[REQUEST_WORDS];
+    for (int i = 0; i < REQUEST_WORDS; i += 2) {
+        words[i] = LINK_CAL_REQUEST;
+        words[i + 1] = (uint16_t)~LINK_CAL_REQUEST;
+    }
+    while (wait_edge(0) == 1) {
+        // edges from before, not an answer
+    }
+
+    time_t deadline = time(NULL) + wait_s;
+    while (time(NULL) < deadline) {
+        if (transfer(pico.spi, words, rx, REQUEST_WORDS, LINK_CAL_REQUEST_HZ) < 0) {
+            return -1;
+        }
+        struct pollfd p = { .fd = pico.event_fd, .events = POLLIN };
+        if (poll(&p, 1, REQUEST_WAIT_MS) == 1) {
+            return 0;   // the edge is left for read_block()
+        }
+    }
+    return -1;
+}
+
+int main(int argc, char **argv) {
+    const char *name = NULL, *device = NULL, *output = NULL, *chip = GPIO_CHIP;
+    int gpio = -1, wait_s = 30;
+    double from_mhz = 2, to_mhz = 10, step_mhz = 1, margin = 0.8;
+    unsigned blocks = 16;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "n:d:g:c:o:f:t:s:m:b:w:")) != -1) {
+        switch (opt) {
+        case 'n': name = optarg; break;
+        case 'd': device = optarg; break;
+        case 'g': gpio = atoi(optarg); break;
+        case 'c': chip = optarg; break;
+        case 'o': output = optarg; break;
+        case 'f': from_mhz = atof(optarg); break;
+        case 't': to_mhz = atof(optarg); break;
+        case 's': step_mhz = atof(optarg); break;
+        case 'm': margin = atof(optarg); break;
+        case 'b': blocks = (unsigned)atoi(optarg); break;
+        case 'w': wait_s = atoi(optarg); break;
+        default: name = NULL; device = NULL; break;
+        }
+    }
+    if (name == NULL || device == NULL || gpio < 0 || from_mhz <= 0 || to_mhz < from_mhz || to_mhz > 65
+        || step_mhz <= 0 || margin <= 0 || margin > 1 || blocks == 0) {
+        fprintf(stderr, "usage: %s -n name -d spidev -g gpio [-c gpiochip] [-o file] [-f MHz] [-t MHz] [-s MHz]"
+                        " [-m margin] [-b blocks] [-w seconds]\n", argv[0]);
+        return 1;
+    }
+    char default_output[256];
+    if (output == NULL) {
+        mkdir(CAL_FOLDER, 0755);
+        snprintf(default_output, sizeof(default_output), "%s/%s.link", CAL_FOLDER, name);
+        output = default_output;
+    }
+
+    if (transport_gpiod_open(&pico.gpio, chip) < 0) {
+        return 1;
+    }
+    pico.spi = spi_open_device(device, LINK_CAL_REQUEST_HZ);
+    pico.line = transport_gpiod_ops.open_edges(&pico.gpio, (unsigned)gpio, "link_cal", &pico.event_fd);
+    if (pico.spi < 0 || pico.line < 0) {
+        return 1;
+    }
+    link_cal_prbs(pico.expected, LINK_CAL_WORDS);
+
+    printf("link_cal %s: reset the pico now (waiting %d s)\n", name, wait_s);
+    fflush(stdout);
+    if (request(wait_s) < 0) {
+        fprintf(stderr, "link_cal: no answer from the pico on GPIO %d\n", gpio);
+        return 1;
+    }
+
+    // sweep up until FAILS_TO_STOP rates in a row fail
+    uint32_t best_hz = 0;
+    int fails = 0, clean = 1;
+    rate_result_t r;
+    for (double mhz = from_mhz; mhz <= to_mhz + 1e-9 && fails < FAILS_TO_STOP; mhz += step_mhz) {
+        if (test_rate((uint32_t)(mhz * 1e6 + 0.5), blocks, &r) < 0) {
+            return 1;
+        }
+        print_rate("sweep", &r);
+        if (rate_passed(&r)) {
+            fails = 0;
+            if (clean) {
+                best_hz = r.hz;
+            }
+        } else {
+            fails++;
+            clean = 0;  // a pass above a failure does not count
+        }
+    }
+
+    // the margin, verified, lowered again if it does not hold
+    uint32_t chosen_khz = 0;
+    double rate_hz = best_hz * margin;
+    for (int attempt = 0; best_hz > 0 && attempt < VERIFY_ATTEMPTS && chosen_khz == 0; attempt++) {
+        uint32_t khz = (uint32_t)(rate_hz / 1000);
+        if (test_rate(khz * 1000, blocks, &r) < 0) {
+            return 1;
+        }
+        print_rate("verify", &r);
+        if (rate_passed(&r)) {
+            chosen_khz = khz;
+        }
+        rate_hz *= margin;
+    }
+
+    if (chosen_khz == 0) {
+        fprintf(stderr, "link_cal %s: no reliable rate from %.3f MHz up, check the wiring\n", name, from_mhz);
+        read_block(LINK_CAL_WORDS, LINK_CAL_REQUEST_HZ, LINK_CAL_QUIT, 0);
+        return 1;
+    }
+
+    // the pico stores it and acks with what it stored
+    if (read_block(LINK_CAL_WORDS, LINK_CAL_REQUEST_HZ, LINK_CAL_DONE, (uint16_t)chosen_khz) != 0
+        || read_block(LINK_CAL_ACK_WORDS, LINK_CAL_REQUEST_HZ, LINK_CAL_NEXT, 0) != 0) {
+        fprintf(stderr, "link_cal %s: the pico stopped serving blocks before the ack\n", name);
+        return 1;
+    }
+    if (pico.rx[0] != LINK_CAL_ACK || pico.rx[3] != (uint16_t)~LINK_CAL_ACK || pico.rx[1] != chosen_khz
+        || pico.rx[2] != (uint16_t)~chosen_khz) {
+        fprintf(stderr, "link_cal %s: the pico did not store %u kHz (ack %04x %04x %04x %04x)\n", name, chosen_khz,
+                pico.rx[0], pico.rx[1], pico.rx[2], pico.rx[3]);
+        return 1;
+    }
+    if (link_cal_save(chosen_khz * 1000, output) < 0) {
+        perror("Error writing the link calibration");
+        return 1;
+    }
+    printf("link_cal %s: fastest clean rate %.3f MHz, kept %.3f MHz, stored on the pico and in %s\n",
+           name, best_hz / 1e6, chosen_khz / 1e3, output);
+
+    transport_gpiod_ops.close_line(&pico.gpio, pico.line);
+    close(pico.spi);
+    transport_gpiod_close(&pico.gpio);
+    return 0;
+}
@@ -0,0 +1,124 @@
+/*
+    About:
+        SPI link-speed calibration, shared by link_cal.c (the sweep) and SPI_isr.c
+    (which clocks every pico at its calibrated rate). The pico side is
+    src/adc_A/link_cal.h, keep the constants and the PRBS in sync with it.
+
+        The pico sends blocks of LINK_CAL_WORDS words of a PRBS-15 (x^15 + x^14 + 1)
+    bit stream, most significant bit first in every word, always from the same seed.
+    The last 4 words the master clocks out with a block are its command for the next
+    one: [command, argument, ~argument, ~command].
+
+        The rate link_cal settles on is kept in CAL_FOLDER/<name>.link, one line:
+            link_cal 1 hz 8000000
+    and in the pico's flash config block, which it reports in every frame header.
+*/
+
+#ifndef LINK_CAL_H
+#define LINK_CAL_H
+
+#include <stdio.h>
+#include <stdint.h>
+
+#define LINK_CAL_REQUEST    0x4C43      // "LC", sent with its complement to start
+#define LINK_CAL_NEXT       0x4E58      // another block
+#define LINK_CAL_DONE       0x444E      // argument: chosen rate in kHz, the pico stores it and acks
+#define LINK_CAL_QUIT       0x5154      // leave without storing anything
+#define LINK_CAL_ACK        0x414B      // the ack block: [ACK, stored kHz, ~kHz, ~ACK], 0 kHz if the flash write failed
+#define LINK_CAL_WORDS      4096        // PRBS words per block
+#define LINK_CAL_ACK_WORDS  4
+#define LINK_CAL_PRBS_SEED  0x7fff
+#define LINK_CAL_REQUEST_HZ 1000000     // request, commands and ack, slow enough for any wiring
+
+#define LINK_CAL_FILE_VERSION 1
+
+/*
+    Description:
+        Fill a buffer with the pico's PRBS-15 words
+
+    Parameter:
+        uint16_t *words - destination
+        size_t count    - number of 16-bit words
+*/
+static inline void link_cal_prbs(uint16_t *words, size_t count) {
+    uint32_t state = LINK_CAL_PRBS_SEED;
+    for (size_t i = 0; i < count; i++) {
+        uint16_t word = 0;
+        for (int bit = 0; bit < 16; bit++) {
+            uint32_t next = ((state >> 14) ^ (state >> 13)) & 1;
+            state = ((state << 1) | next) & 0x7fff;
+            word = (uint16_t)((word << 1) | next);
+        }
+        words[i] = word;
+    }
+}
+
+/*
+    Description:
+        Compare received words with the expected ones
+
+    Parameter:
+        const uint16_t *rx       - as clocked in
+        const uint16_t *expected - as sent
+        size_t count             - number of 16-bit words
+        uint64_t *word_errors    - incremented by the words that differ, may be NULL
+
+    Return:
+        uint64_t - bits that differ
+*/
+static inline uint64_t link_cal_bit_errors(const uint16_t *rx, const uint16_t *expected, size_t count,
+                                           uint64_t *word_errors) {
+    uint64_t bits = 0, words = 0;
+    for (size_t i = 0; i < count; i++) {
+        uint16_t diff = rx[i] ^ expected[i];
+        bits += __builtin_popcount(diff);
+        words += diff != 0;
+    }
+    if (word_errors) {
+        *word_errors += words;
+    }
+    return bits;
+}
+
+/*
+    Description:
+        Read a pico's calibrated link rate
+
+    Parameter:
+        const char *filename - CAL_FOLDER/<name>.link
+
+    Return:
+        uint32_t - rate in Hz, 0 if the file is missing or not a link calibration
+*/
+static inline uint32_t link_cal_load(const char *filename) {
+    FILE *f = fopen(filename, "r");
+    if (f == NULL) {
+        return 0;
+    }
+    int version = 0;
+    unsigned long hz = 0;
+    if (fscanf(f, " link_cal %d hz %lu", &version, &hz) != 2 || version != LINK_CAL_FILE_VERSION
+        || hz > UINT32_MAX) {
+        hz = 0;
+    }
+    fclose(f);
+    return (uint32_t)hz;
+}
+
+/*
+    Description:
+        Write a pico's calibrated link rate
+
+    Return:
+        int - 0 on success, -1 on error
+*/
+static inline int link_cal_save(uint32_t hz, const char *filename) {
+    FILE *f = fopen(filename, "w");
+    if (f == NULL) {
+        return -1;
+    }
+    fprintf(f, "link_cal %d hz %u\n", LINK_CAL_FILE_VERSION, hz);
+    return fclose(f) == 0 ? 0 : -1;
+}
+
+#endif
@@ -0,0 +1,262 @@
+/*
+    About:
+        Live statistics of the receiver in POSIX shared memory, for picomon.c and any
+    other tool that wants to watch a running SPI_isr (or rx_bench) without stopping
+    it or parsing its output.
+
+        The block is a fixed-size struct in /dev/shm/<name>: a header, then one
+    live_pico_t per pico. Every field has exactly one writer, the main loop (edges),
+    the pico's reader thread or the writer thread, and each writer's fields sit on
+    cache lines of their own. An update is a relaxed atomic store of a value the
+    thread already holds: no locks, no syscalls, no read-modify-write, and no
+    formatting on the receive path. Monitors map the block read-only and take
+    relaxed loads, so a snapshot may be a burst apart between fields, and a
+    histogram's count may differ from the sum of its buckets by one or two.
+        Counters only grow while the receiver runs, a monitor takes the difference
+    of two snapshots to get rates. The block stays behind when the receiver exits
+    (state LIVE_STATS_STOPPED) and is replaced by the next run, whose start_ns
+    differs.
+
+        Latency histograms count microseconds in four buckets per power of two, so a
+    percentile is within a quarter of its value: 0 to 3 have a bucket each, then
+    [4, 5), [5, 6), [6, 7), [7, 8), [8, 10), ... [2^e + k 2^(e-2), 2^e + (k+1) 2^(e-2)).
+    The last bucket holds everything from 7.3 s.
+*/
+
+#ifndef LIVE_STATS_H
+#define LIVE_STATS_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <stdatomic.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#define LIVE_STATS_MAGIC        0x5354534C  // "LSTS"
+#define LIVE_STATS_VERSION      1
+#define LIVE_STATS_MAX_PICOS    8
+#define LIVE_STATS_BUCKETS      88          // the last one starts at 7 * 2^20 us
+#define LIVE_STATS_LINE         64          // cache line
+
+#define LIVE_STATS_RUNNING      1
+#define LIVE_STATS_STOPPED      2
+
+typedef _Atomic uint64_t live_counter_t;
+
+typedef struct {
+    live_counter_t count;
+    live_counter_t sum_us;
+    live_counter_t bucket[LIVE_STATS_BUCKETS];
+} live_hist_t;
+
+typedef struct {
+    char name[16];                                  // as in the receiver's picos table
+    // main loop
+    _Alignas(LIVE_STATS_LINE) live_counter_t edges; // transfer edges seen
+    live_counter_t edges_dropped;                   // edges the reader was too far behind for
+    live_counter_t last_edge_ns;                    // CLOCK_MONOTONIC of the latest edge
+    // reader thread
+    _Alignas(LIVE_STATS_LINE) live_counter_t bursts;// frames clocked in, good or not
+    live_counter_t rx_bytes;                        // bytes of the usable ones
+    live_counter_t queued;                          // handed to the writer
+    live_counter_t queue_depth;                     // full queue right after the latest hand-off
+    live_counter_t queue_high_water;
+    live_counter_t pool_empty;                      // dropped, every buffer was with the writer
+    live_counter_t frames_lost;
+    live_counter_t resyncs;
+    live_counter_t bad_headers;
+    live_counter_t crc_errors;
+    live_counter_t last_burst_ns;                   // CLOCK_MONOTONIC when the latest frame was in
+    live_hist_t rx_latency;                         // transfer edge to frame in memory
+    // writer thread
+    _Alignas(LIVE_STATS_LINE) live_counter_t written;   // records appended
+    live_counter_t written_bytes;                   // their data
+    live_counter_t decode_errors;
+    live_counter_t telemetry_blocks;
+    live_counter_t last_written_ns;                 // CLOCK_MONOTONIC when the latest record was appended
+    live_hist_t write_latency;                      // transfer edge to record appended
+} live_pico_t;
+
+typedef struct {
+    uint32_t magic;                                 // LIVE_STATS_MAGIC
+    uint32_t version;                               // LIVE_STATS_VERSION
+    uint32_t size;                                  // sizeof(live_stats_t)
+    uint32_t picos;                                 // entries of pico[] in use
+    uint32_t buckets;                               // LIVE_STATS_BUCKETS
+    int32_t pid;                                    // of the receiver
+    uint64_t start_ns;                              // CLOCK_MONOTONIC at startup
+    uint32_t samples_per_burst;
+    _Atomic uint32_t state;                         // LIVE_STATS_RUNNING / STOPPED
+    _Alignas(LIVE_STATS_LINE) live_pico_t pico[LIVE_STATS_MAX_PICOS];
+} live_stats_t;
+
+// Publish a value this thread owns, single writer per field
+static inline void live_set(live_counter_t *field, uint64_t value) {
+    atomic_store_explicit(field, value, memory_order_relaxed);
+}
+
+static inline uint64_t live_get(const live_counter_t *field) {
+    return atomic_load_explicit((live_counter_t *)field, memory_order_relaxed);
+}
+
+// Count up a field this thread owns, a load and a store, no atomic read-modify-write
+static inline void live_add(live_counter_t *field, uint64_t n) {
+    live_set(field, live_get(field) + n);
+}
+
+static inline unsigned live_bucket(uint64_t us) {
+    if (us < 4) {
+        return (unsigned)us;
+    }
+    unsigned e = 63 - __builtin_clzll(us);
+    unsigned b = 4 * (e - 1) + (unsigned)((us >> (e - 2)) & 3);
+    return b < LIVE_STATS_BUCKETS ? b : LIVE_STATS_BUCKETS - 1;
+}
+
+// Largest value a bucket holds
+static inline uint64_t live_bucket_top(unsigned b) {
+    if (b < 4) {
+        return b;
+    }
+    unsigned e = b / 4 + 1;
+    return ((uint64_t)(4 + b % 4 + 1) << (e - 2)) - 1;
+}
+
+// Add one latency, only from the thread that owns the histogram
+static inline void live_hist_add(live_hist_t *h, uint64_t ns) {
+    uint64_t us = ns / 1000;
+    live_add(&h->bucket[live_bucket(us)], 1);
+    live_add(&h->sum_us, us);
+    live_add(&h->count, 1);
+}
+
+/*
+    Description:
+        Create (or replace) the block and mark it running. When shared memory is not
+    available the block is private memory, so the receiver runs the same, only
+    nobody can watch it.
+
+    Parameter:
+        const char *name       - shm object, "/<name>"
+        unsigned picos         - entries in use, at most LIVE_STATS_MAX_PICOS
+        const char *const *names - name of each pico
+        uint32_t samples       - samples per burst
+        uint64_t start_ns      - CLOCK_MONOTONIC now
+
+    Return:
+        live_stats_t * - the block, NULL only if no memory at all
+*/
+static inline live_stats_t *live_stats_create(const char *name, unsigned picos, const char *const *names,
+                                              uint32_t samples, uint64_t start_ns) {
+    void *map = MAP_FAILED;
+    int fd = shm_open(name, O_CREAT | O_RDWR, 0644);
+    if (fd >= 0) {
+        if (ftruncate(fd, sizeof(live_stats_t)) == 0) {
+            map = mmap(NULL, sizeof(live_stats_t), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        }
+        close(fd);
+    }
+    if (map == MAP_FAILED) {
+        perror("Live statistics not shared");
+        map = mmap(NULL, sizeof(live_stats_t), PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (map == MAP_FAILED) {
+            return NULL;
+        }
+    }
+
+    live_stats_t *s = (live_stats_t *)map;
+    s->magic = 0;   // a monitor attaching now sees no block until it is complete
+    atomic_thread_fence(memory_order_release);
+    memset((char *)s + sizeof(s->magic), 0, sizeof(*s) - sizeof(s->magic));
+    s->version = LIVE_STATS_VERSION;
+    s->size = sizeof(live_stats_t);
+    s->picos = picos < LIVE_STATS_MAX_PICOS ? picos : LIVE_STATS_MAX_PICOS;
+    s->buckets = LIVE_STATS_BUCKETS;
+    s->pid = (int32_t)getpid();
+    s->start_ns = start_ns;
+    s->samples_per_burst = samples;
+    for (unsigned i = 0; i < s->picos; i++) {
+        snprintf(s->pico[i].name, sizeof(s->pico[i].name), "%s", names[i]);
+    }
+    atomic_store_explicit(&s->state, LIVE_STATS_RUNNING, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+    s->magic = LIVE_STATS_MAGIC;
+    return s;
+}
+
+// Mark the block stopped, it stays for the monitors until the next run
+static inline void live_stats_stop(live_stats_t *s) {
+    atomic_store_explicit(&s->state, LIVE_STATS_STOPPED, memory_order_release);
+}
+
+/*
+    Description:
+        Map a running (or stopped) receiver's block read-only
+
+    Parameter:
+        const char *name - shm object, "/<name>"
+
+    Return:
+        const live_stats_t * - the block, NULL if there is none or it is from another version
+*/
+static inline const live_stats_t *live_stats_attach(const char *name) {
+    int fd = shm_open(name, O_RDONLY, 0);
+    if (fd < 0) {
+        return NULL;
+    }
+    struct stat sb;
+    void *map = MAP_FAILED;
+    if (fstat(fd, &sb) == 0 && (size_t)sb.st_size >= sizeof(live_stats_t)) {
+        map = mmap(NULL, sizeof(live_stats_t), PROT_READ, MAP_SHARED, fd, 0);
+    }
+    close(fd);
+    if (map == MAP_FAILED) {
+        return NULL;
+    }
+
+    const live_stats_t *s = (const live_stats_t *)map;
+    if (s->magic != LIVE_STATS_MAGIC || s->version != LIVE_STATS_VERSION || s->size != sizeof(live_stats_t)
+        || s->buckets != LIVE_STATS_BUCKETS || s->picos > LIVE_STATS_MAX_PICOS) {
+        munmap(map, sizeof(live_stats_t));
+        return NULL;
+    }
+    atomic_thread_fence(memory_order_acquire);
+    return s;
+}
+
+static inline void live_stats_detach(const live_stats_t *s) {
+    munmap((void *)s, sizeof(live_stats_t));
+}
+
+/*
+    Description:
+        Upper end of the bucket holding the q-quantile of the latencies between two
+    snapshots of a histogram, in microseconds
+
+    Parameter:
+        const uint64_t *now    - buckets of the later snapshot
+        const uint64_t *before - buckets of the earlier one, or zeros
+        double q               - 0.5 for the median
+
+    Return:
+        uint64_t - microseconds, 0 if no values in between
+*/
+static inline uint64_t live_hist_quantile(const uint64_t *now, const uint64_t *before, double q) {
+    uint64_t total = 0;
+    for (unsigned b = 0; b < LIVE_STATS_BUCKETS; b++) {
+        total += now[b] - before[b];
+    }
+    uint64_t target = (uint64_t)(total * q), seen = 0;
+    for (unsigned b = 0; b < LIVE_STATS_BUCKETS && total > 0; b++) {
+        seen += now[b] - before[b];
+        if (seen > target) {
+            return live_bucket_top(b);
+        }
+    }
+    return 0;
+}
+
+#endif
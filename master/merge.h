@@ -0,0 +1,321 @@
+/*
+    About:
+        Streaming merge of the sample blocks of several picos into one time-ordered
+    stream. Each block is a run of equally spaced samples with the receiver time of
+    its first one (segment record: sample_time_ns, sample_period_ps). Blocks of one
+    source must arrive in time order, sources may arrive in any mix.
+
+        Samples are only released up to a horizon: the earliest end of the latest block
+    of every live source, anything earlier can no longer be preceded by a block still
+    to come. A source that has sent nothing for MERGE_STALE_NS of stream time stops
+    holding the horizon back. merge_flush() releases the rest at the end.
+
+        Each source's blocks are checked against the end of its previous one: a start
+    more than half a period late is a gap, half a period early an overlap. A sample
+    released before the last one released (only after an overlap, or a source that
+    came back after being stale) counts as out of order.
+
+        With N picos sampling the same signal time-interleaved (INTERLEAVE), the merged
+    stream has N times the rate when source k sits k / N of a period after source 0.
+    merge_phase_t tracks how far each source is from that, once from the timestamps
+    and once from the signal itself: a source late by d reads x(t + d), about
+    x(t) + d * x'(t), so d = sum(e * x') / sum(x'^2) with e the difference to source 0
+    interpolated at the same time. The second needs a signal well inside the band of
+    one pico, it checks the first.
+*/
+
+#ifndef MERGE_H
+#define MERGE_H
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#define MERGE_MAX_SOURCES   8
+#define MERGE_QUEUE         64                      // blocks waiting per source, power of two
+#define MERGE_STALE_NS      1000000000ull           // a source this far behind the newest block no longer holds the horizon
+
+typedef struct {
+    uint64_t t0_ns;             // receiver time of samples[0]
+    uint32_t period_ps;         // sample spacing
+    uint32_t count;
+    uint32_t next;              // first sample not yet released
+    uint16_t samples[];
+} merge_block_t;
+
+typedef struct {
+    merge_block_t *queue[MERGE_QUEUE];
+    uint32_t head;              // oldest block
+    uint32_t tail;              // next free slot
+    uint64_t end_ns;            // expected start of the next block
+    int seen;                   // has sent a block
+    unsigned long blocks;
+    unsigned long gaps;         // blocks starting late
+    unsigned long overlaps;     // blocks starting early
+    unsigned long dropped;      // blocks refused, queue full
+} merge_source_t;
+
+typedef struct {
+    merge_source_t source[MERGE_MAX_SOURCES];
+    unsigned sources;
+    uint64_t first_ns;          // start of the first block of any source
+    uint64_t newest_end_ns;     // latest block end of any source
+    uint64_t last_ns;           // time of the last released sample
+    unsigned long released;
+    unsigned long out_of_order;
+} merge_t;
+
+static inline void merge_init(merge_t *m, unsigned sources) {
+    memset(m, 0, sizeof(*m));
+    m->sources = sources;
+}
+
+static inline uint64_t merge_sample_ns(const merge_block_t *b, uint32_t i) {
+    return b->t0_ns + (uint64_t)i * b->period_ps / 1000;
+}
+
+/*
+    Description:
+        Queue a block of one source, the samples are copied
+
+    Parameter:
+        merge_t *m               - merge state
+        unsigned source          - source index, below the count given to merge_init
+        uint64_t t0_ns           - time of the first sample
+        uint32_t period_ps       - sample spacing, not 0
+        const uint16_t *samples  - the block
+        uint32_t count           - samples in the block
+
+    Return:
+        int - 0 on success, -1 if the source's queue is full or out of memory
+*/
+static inline int merge_push(merge_t *m, unsigned source, uint64_t t0_ns, uint32_t period_ps,
+                             const uint16_t *samples, uint32_t count) {
+    merge_source_t *s = &m->source[source];
+    if (s->tail - s->head == MERGE_QUEUE) {
+        s->dropped++;
+        return -1;
+    }
+    merge_block_t *b = malloc(sizeof(*b) + count * sizeof(uint16_t));
+    if (b == NULL) {
+        s->dropped++;
+        return -1;
+    }
+    b->t0_ns = t0_ns;
+    b->period_ps = period_ps;
+    b->count = count;
+    b->next = 0;
+    memcpy(b->samples, samples, count * sizeof(uint16_t));
+
+    if (s->seen) {
+        int64_t late_ps = ((int64_t)t0_ns - (int64_t)s->end_ns) * 1000;
+        if (late_ps > (int64_t)period_ps / 2) {
+            s->gaps++;
+        } else if (late_ps < -(int64_t)period_ps / 2) {
+            s->overlaps++;
+        }
+    }
+    if (m->first_ns == 0) {
+        m->first_ns = t0_ns;
+    }
+    s->seen = 1;
+    s->end_ns = merge_sample_ns(b, count);
+    if (s->end_ns > m->newest_end_ns) {
+        m->newest_end_ns = s->end_ns;
+    }
+    s->queue[s->tail++ % MERGE_QUEUE] = b;
+    s->blocks++;
+    return 0;
+}
+
+/*
+    Description:
+        Time up to which every source is complete
+*/
+static inline uint64_t merge_horizon(const merge_t *m) {
+    uint64_t horizon = UINT64_MAX;
+    for (unsigned k = 0; k < m->sources; k++) {
+        const merge_source_t *s = &m->source[k];
+        uint64_t end_ns = s->seen ? s->end_ns : m->first_ns;    // a source yet to start holds everything back
+        if (end_ns + MERGE_STALE_NS < m->newest_end_ns) {
+            continue;   // stale
+        }
+        if (end_ns < horizon) {
+            horizon = end_ns;
+        }
+    }
+    return horizon;
+}
+
+/*
+    Description:
+        Release samples in time order, all sources, up to (not including) a time
+
+    Parameter:
+        merge_t *m         - merge state
+        uint64_t until_ns  - release only samples before this time
+        uint16_t *samples  - released samples out
+        uint64_t *times    - their times out, may be NULL
+        uint8_t *sources   - their sources out, may be NULL
+        size_t max         - room in the outputs
+
+    Return:
+        size_t - samples released, fewer than max once nothing before until_ns is left
+*/
+static inline size_t merge_pull_until(merge_t *m, uint64_t until_ns, uint16_t *samples, uint64_t *times,
+                                      uint8_t *sources, size_t max) {
+    size_t n = 0;
+    while (n < max) {
+        // earliest head sample, a linear scan is fine for a handful of sources
+        unsigned best = MERGE_MAX_SOURCES;
+        uint64_t best_ns = until_ns;
+        for (unsigned k = 0; k < m->sources; k++) {
+            merge_source_t *s = &m->source[k];
+            if (s->head == s->tail) {
+                continue;
+            }
+            merge_block_t *b = s->queue[s->head % MERGE_QUEUE];
+            uint64_t t = merge_sample_ns(b, b->next);
+            if (t < best_ns) {
+                best_ns = t;
+                best = k;
+            }
+        }
+        if (best == MERGE_MAX_SOURCES) {
+            break;
+        }
+
+        merge_source_t *s = &m->source[best];
+        merge_block_t *b = s->queue[s->head % MERGE_QUEUE];
+        if (best_ns < m->last_ns) {
+            m->out_of_order++;
+        }
+        m->last_ns = best_ns;
+        samples[n] = b->samples[b->next];
+        if (times) {
+            times[n] = best_ns;
+        }
+        if (sources) {
+            sources[n] = (uint8_t)best;
+        }
+        n++;
+        if (++b->next == b->count) {
+            free(b);
+            s->head++;
+        }
+    }
+    m->released += n;
+    return n;
+}
+
+// Release what is complete in every source
+static inline size_t merge_pull(merge_t *m, uint16_t *samples, uint64_t *times, uint8_t *sources, size_t max) {
+    return merge_pull_until(m, merge_horizon(m), samples, times, sources, max);
+}
+
+// Release everything left, at the end of the input
+static inline size_t merge_flush(merge_t *m, uint16_t *samples, uint64_t *times, uint8_t *sources, size_t max) {
+    return merge_pull_until(m, UINT64_MAX, samples, times, sources, max);
+}
+
+// Time-interleave check, fed with the released samples
+typedef struct {
+    unsigned sources;
+    double period_ns;               // of one source, the merged stream has sources times the rate
+    // from the timestamps: offset of each block start from source 0's sample grid
+    uint64_t grid_ns;               // latest block start of source 0
+    double phase_sum[MERGE_MAX_SOURCES];
+    double phase_sum2[MERGE_MAX_SOURCES];
+    unsigned long phase_n[MERGE_MAX_SOURCES];
+    // from the signal: source 0 around the pending samples of the others
+    int have_prev;
+    uint64_t prev_ns;               // latest source 0 sample
+    double prev_value;
+    uint64_t pending_ns[MERGE_MAX_SOURCES];
+    double pending_value[MERGE_MAX_SOURCES];
+    int pending[MERGE_MAX_SOURCES];
+    double ed_sum[MERGE_MAX_SOURCES];   // sum e * x'
+    double dd_sum[MERGE_MAX_SOURCES];   // sum x'^2
+} merge_phase_t;
+
+static inline void merge_phase_init(merge_phase_t *p, unsigned sources, double period_ns) {
+    memset(p, 0, sizeof(*p));
+    p->sources = sources;
+    p->period_ns = period_ns;
+}
+
+/*
+    Description:
+        Phase of a new block of source k against source 0's sample grid
+
+    Parameter:
+        merge_phase_t *p - check state
+        unsigned source  - source of the block
+        uint64_t t0_ns   - start of the block
+*/
+static inline void merge_phase_block(merge_phase_t *p, unsigned source, uint64_t t0_ns) {
+    if (source == 0) {
+        p->grid_ns = t0_ns;
+        return;
+    }
+    if (p->grid_ns == 0) {
+        return;
+    }
+    // ideal is source / sources of a period, the error in merged samples, wrapped to +-half a period
+    double offset = fmod((double)((int64_t)t0_ns - (int64_t)p->grid_ns), p->period_ns);
+    double error = offset - p->period_ns * source / p->sources;
+    error -= p->period_ns * floor(error / p->period_ns + 0.5);
+    error *= p->sources / p->period_ns;
+    p->phase_sum[source] += error;
+    p->phase_sum2[source] += error * error;
+    p->phase_n[source]++;
+}
+
+/*
+    Description:
+        Feed one released sample to the signal-based estimate
+*/
+static inline void merge_phase_sample(merge_phase_t *p, unsigned source, uint64_t t_ns, double value) {
+    if (source != 0) {
+        // wait for the source 0 sample after it
+        p->pending_ns[source] = t_ns;
+        p->pending_value[source] = value;
+        p->pending[source] = p->have_prev;
+        return;
+    }
+    if (p->have_prev) {
+        double span = (double)(t_ns - p->prev_ns);
+        double slope = (value - p->prev_value) / span;
+        for (unsigned k = 1; k < p->sources; k++) {
+            if (!p->pending[k] || span > 1.5 * p->period_ns) {
+                continue;   // nothing between these two, or source 0 has a gap
+            }
+            double at = (double)(p->pending_ns[k] - p->prev_ns);
+            double e = p->pending_value[k] - (p->prev_value + slope * at);
+            p->ed_sum[k] += e * slope;
+            p->dd_sum[k] += slope * slope;
+            p->pending[k] = 0;
+        }
+    }
+    p->have_prev = 1;
+    p->prev_ns = t_ns;
+    p->prev_value = value;
+}
+
+/*
+    Description:
+        Skew of a source from the signal, in merged samples
+
+    Return:
+        double - positive when the source samples later than its timestamps say, NAN
+                 without a usable signal
+*/
+static inline double merge_phase_skew(const merge_phase_t *p, unsigned source) {
+    if (p->dd_sum[source] <= 0) {
+        return NAN;
+    }
+    return p->ed_sum[source] / p->dd_sum[source] * p->sources / p->period_ns;
+}
+
+#endif
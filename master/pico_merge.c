@@ -0,0 +1,224 @@
+/*
+    About:
+        Merges the bursts of all picos in segment files written by SPI_isr into one
+    time-ordered stream (merge.h), by the receiver time of every sample (timebase.h).
+    Reports gaps and overlaps per pico, samples out of order, and the alignment error
+    the timebase fit gave the records, in samples of the merged stream.
+
+        With -i the picos are taken as time-interleaved (adc_A built with INTERLEAVE):
+    pico k should sample k / N of a period after pico 0. The phase of every pico is
+    reported from the timestamps and, for a test signal well inside one pico's band,
+    from the samples themselves.
+
+        Only timed single-channel records of raw codes are merged, the others are
+    counted and skipped. So are records with a CRC or decode error, their samples
+    and timing cannot be trusted.
+
+    Usage:
+        ./pico_merge -n 2 data/seg_*.pseg                       report only
+        ./pico_merge -n 4 -i -o merged.bin -t times.bin data/seg_*.pseg
+                                                                uint16_t samples, uint64_t ns times
+
+    Compilation:
+        gcc -O2 -o pico_merge pico_merge.c -lm
+*/
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "segment.h"
+#include "deinterleave.h"
+#include "merge.h"
+
+// Largest payload handled, well above one burst
+#define MAX_PAYLOAD (1u << 20)
+
+// Samples released per pull
+#define PULL_SAMPLES 65536
+
+typedef struct {
+    FILE *samples;              // -o
+    FILE *times;                // -t
+    merge_phase_t *phase;       // -i
+    uint64_t first_ns;
+    uint64_t last_ns;
+} merge_output_t;
+
+static uint16_t pulled[PULL_SAMPLES];
+static uint64_t pulled_ns[PULL_SAMPLES];
+static uint8_t pulled_source[PULL_SAMPLES];
+
+// Drain the merge into the outputs, all of it with flush set
+static void drain(merge_t *m, merge_output_t *out, int flush) {
+    size_t n;
+    do {
+        n = flush ? merge_flush(m, pulled, pulled_ns, pulled_source, PULL_SAMPLES)
+                  : merge_pull(m, pulled, pulled_ns, pulled_source, PULL_SAMPLES);
+        if (n == 0) {
+            break;
+        }
+        if (out->first_ns == 0) {
+            out->first_ns = pulled_ns[0];
+        }
+        out->last_ns = pulled_ns[n - 1];
+        if (out->samples) {
+            fwrite(pulled, sizeof(pulled[0]), n, out->samples);
+        }
+        if (out->times) {
+            fwrite(pulled_ns, sizeof(pulled_ns[0]), n, out->times);
+        }
+        if (out->phase) {
+            for (size_t i = 0; i < n; i++) {
+                merge_phase_sample(out->phase, pulled_source[i], pulled_ns[i], pulled[i]);
+            }
+        }
+    } while (n == PULL_SAMPLES);
+}
+
+int main(int argc, char **argv) {
+    unsigned sources = 2;
+    int interleave = 0;
+    const char *samples_file = NULL;
+    const char *times_file = NULL;
+    int opt;
+    while ((opt = getopt(argc, argv, "n:io:t:")) != -1) {
+        if (opt == 'n') {
+            sources = (unsigned)atoi(optarg);
+        } else if (opt == 'i') {
+            interleave = 1;
+        } else if (opt == 'o') {
+            samples_file = optarg;
+        } else if (opt == 't') {
+            times_file = optarg;
+        } else {
+            fprintf(stderr, "usage: %s [-n picos] [-i] [-o samples] [-t times] segment...\n", argv[0]);
+            return 1;
+        }
+    }
+    if (sources == 0 || sources > MERGE_MAX_SOURCES) {
+        fprintf(stderr, "pico_merge: 1 to %d picos\n", MERGE_MAX_SOURCES);
+        return 1;
+    }
+
+    static merge_t merge;
+    static merge_phase_t phase;
+    merge_init(&merge, sources);
+    merge_output_t out = { 0 };
+    if (samples_file && (out.samples = fopen(samples_file, "wb")) == NULL) {
+        perror("Error opening sample output");
+        return 1;
+    }
+    if (times_file && (out.times = fopen(times_file, "wb")) == NULL) {
+        perror("Error opening time output");
+        return 1;
+    }
+
+    uint8_t *payload = malloc(MAX_PAYLOAD);
+    if (payload == NULL) {
+        return 1;
+    }
+
+    unsigned long skipped = 0, damaged = 0, untimed = 0, refused = 0;
+    uint64_t align_sum = 0;
+    uint32_t align_max = 0;
+    unsigned long aligned = 0;
+    uint32_t period_ps = 0;     // of one pico, from the first merged record
+
+    for (int i = optind; i < argc; i++) {
+        segment_header_t header;
+        FILE *f = segment_open_read(argv[i], &header);
+        if (f == NULL) {
+            continue;
+        }
+
+        segment_record_t record;
+        while (segment_read_next(f, &record, payload, MAX_PAYLOAD)) {
+            if (record.type != SEGMENT_RECORD_BURST || (record.flags & SEGMENT_FLAG_VOLTS)
+                || channel_count(record.channel_mask) > 1 || record.source >= sources) {
+                skipped++;
+                continue;
+            }
+            if (record.flags & (SEGMENT_FLAG_CRC_ERROR | SEGMENT_FLAG_DECODE_ERROR)) {
+                damaged++;
+                continue;
+            }
+            if (record.sample_time_ns == 0 || record.sample_period_ps == 0) {
+                untimed++;
+                continue;
+            }
+            if (period_ps == 0) {
+                period_ps = record.sample_period_ps;
+                if (interleave) {
+                    merge_phase_init(&phase, sources, period_ps / 1000.0);
+                    out.phase = &phase;
+                }
+            }
+
+            uint32_t count = record.payload_bytes / sizeof(uint16_t);
+            if (merge_push(&merge, record.source, record.sample_time_ns, record.sample_period_ps,
+                           (const uint16_t *)payload, count) < 0) {
+                refused++;
+                continue;
+            }
+            if (out.phase) {
+                merge_phase_block(out.phase, record.source, record.sample_time_ns);
+            }
+            align_sum += record.align_error_ns;
+            if (record.align_error_ns > align_max) {
+                align_max = record.align_error_ns;
+            }
+            aligned++;
+
+            drain(&merge, &out, 0);
+        }
+        fclose(f);
+    }
+    drain(&merge, &out, 1);
+
+    // merged sample spacing: one pico's period, divided by the picos when interleaved
+    double merged_ns = period_ps / 1000.0 / (interleave ? sources : 1);
+    printf("%lu samples merged, %lu out of order", merge.released, merge.out_of_order);
+    if (merge.released > 1 && out.last_ns > out.first_ns) {
+        printf(", %.1f kSPS", (merge.released - 1) * 1e6 / (double)(out.last_ns - out.first_ns));
+    }
+    printf("\n");
+    printf("%lu records skipped (channels, volts, unknown pico), %lu with CRC or decode errors, %lu without timing,"
+           " %lu refused\n", skipped, damaged, untimed, refused);
+    for (unsigned k = 0; k < sources; k++) {
+        const merge_source_t *s = &merge.source[k];
+        printf("Pico %u: %lu blocks, %lu gaps, %lu overlaps\n", k, s->blocks, s->gaps, s->overlaps);
+    }
+    if (aligned > 0 && merged_ns > 0) {
+        printf("Alignment error %.3f samples avg, %.3f max (%.0f ns / %u ns)\n",
+               (double)align_sum / aligned / merged_ns, align_max / merged_ns,
+               (double)align_sum / aligned, align_max);
+    }
+
+    if (out.phase) {
+        for (unsigned k = 1; k < sources; k++) {
+            if (phase.phase_n[k] == 0) {
+                printf("Pico %u: no blocks to phase against pico 0\n", k);
+                continue;
+            }
+            double mean = phase.phase_sum[k] / phase.phase_n[k];
+            double rms = sqrt(phase.phase_sum2[k] / phase.phase_n[k]);
+            printf("Pico %u: phase error %+.3f samples avg, %.3f rms (timestamps)", k, mean, rms);
+            double skew = merge_phase_skew(&phase, k);
+            if (!isnan(skew)) {
+                printf(", skew %+.3f samples (signal)", skew);
+            }
+            printf("\n");
+        }
+    }
+
+    if (out.samples) {
+        fclose(out.samples);
+    }
+    if (out.times) {
+        fclose(out.times);
+    }
+    free(payload);
+    return 0;
+}
@@ -0,0 +1,173 @@
+/*
+    About:
+        Live monitor of a running SPI_isr (or rx_bench). Attaches read-only to the
+    receiver's shared-memory statistics (live_stats.h) and prints one line per pico
+    every interval: bursts and megabytes per second, records written per second,
+    queue depth and high water, errors since the previous line, percentiles of the
+    receive and write latencies over the interval, and the age of the latest burst.
+    The receiver does not notice it is watched, any number of monitors can run.
+
+        Columns: rx/s bursts clocked in, MB/s their bytes, wr/s records written,
+    queue full-queue depth / high water, lost sequence gaps, crc / bad CRC errors and
+    bad headers, drop bursts or edges dropped for lack of a buffer or reader, rx and
+    wr the p50 / p99 from the transfer edge to the frame in memory and to the record
+    on disk (upper bucket bounds, us), age since the latest burst.
+
+    Usage:
+        ./picomon                       watch /spi_isr every second until it stops
+        ./picomon -i 5 -c 12            every 5 s, 12 times
+        ./picomon -s /rx_bench          watch rx_bench
+
+    Compilation:
+        gcc -O2 -o picomon picomon.c
+*/
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <time.h>
+#include <errno.h>
+#include <unistd.h>
+#include "live_stats.h"
+
+// The counters of one pico at one moment
+typedef struct {
+    uint64_t bursts, rx_bytes, written, queue_depth, queue_high_water;
+    uint64_t frames_lost, crc_errors, bad_headers, pool_empty, edges_dropped, decode_errors;
+    uint64_t last_burst_ns;
+    uint64_t rx_bucket[LIVE_STATS_BUCKETS];
+    uint64_t write_bucket[LIVE_STATS_BUCKETS];
+} pico_snapshot_t;
+
+static volatile sig_atomic_t interrupted = 0;
+
+static void on_signal(int sig) {
+    (void)sig;
+    interrupted = 1;
+}
+
+static uint64_t monotonic_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+static void take_snapshot(const live_pico_t *p, pico_snapshot_t *s) {
+    s->bursts = live_get(&p->bursts);
+    s->rx_bytes = live_get(&p->rx_bytes);
+    s->written = live_get(&p->written);
+    s->queue_depth = live_get(&p->queue_depth);
+    s->queue_high_water = live_get(&p->queue_high_water);
+    s->frames_lost = live_get(&p->frames_lost);
+    s->crc_errors = live_get(&p->crc_errors);
+    s->bad_headers = live_get(&p->bad_headers);
+    s->pool_empty = live_get(&p->pool_empty);
+    s->edges_dropped = live_get(&p->edges_dropped);
+    s->decode_errors = live_get(&p->decode_errors);
+    s->last_burst_ns = live_get(&p->last_burst_ns);
+    for (unsigned b = 0; b < LIVE_STATS_BUCKETS; b++) {
+        s->rx_bucket[b] = live_get(&p->rx_latency.bucket[b]);
+        s->write_bucket[b] = live_get(&p->write_latency.bucket[b]);
+    }
+}
+
+// One pico's line, rates over the seconds between the two snapshots
+static void print_pico(const char *name, const pico_snapshot_t *now, const pico_snapshot_t *before,
+                       double seconds, uint64_t now_ns) {
+    char age[16] = "-";
+    if (now->last_burst_ns > 0) {
+        snprintf(age, sizeof(age), "%.1f s", (now_ns - now->last_burst_ns) / 1e9);
+    }
+    printf("%-6s %8.1f %8.2f %8.1f %5lu/%-5lu %6lu %5lu/%-5lu %5lu/%-5lu %6lu/%-7lu %6lu/%-7lu %8s\n",
+           name,
+           (now->bursts - before->bursts) / seconds,
+           (now->rx_bytes - before->rx_bytes) / seconds / 1e6,
+           (now->written - before->written) / seconds,
+           (unsigned long)now->queue_depth, (unsigned long)now->queue_high_water,
+           (unsigned long)(now->frames_lost - before->frames_lost),
+           (unsigned long)(now->crc_errors - before->crc_errors),
+           (unsigned long)(now->bad_headers - before->bad_headers + now->decode_errors - before->decode_errors),
+           (unsigned long)(now->pool_empty - before->pool_empty),
+           (unsigned long)(now->edges_dropped - before->edges_dropped),
+           (unsigned long)live_hist_quantile(now->rx_bucket, before->rx_bucket, 0.5),
+           (unsigned long)live_hist_quantile(now->rx_bucket, before->rx_bucket, 0.99),
+           (unsigned long)live_hist_quantile(now->write_bucket, before->write_bucket, 0.5),
+           (unsigned long)live_hist_quantile(now->write_bucket, before->write_bucket, 0.99),
+           age);
+}
+
+int main(int argc, char **argv) {
+    const char *name = "/spi_isr";
+    double interval = 1.0;
+    long count = 0;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "s:i:c:")) != -1) {
+        if (opt == 's') {
+            name = optarg;
+        } else if (opt == 'i') {
+            interval = atof(optarg);
+        } else if (opt == 'c') {
+            count = atol(optarg);
+        } else {
+            fprintf(stderr, "usage: %s [-s shm name] [-i seconds] [-c lines]\n", argv[0]);
+            return 1;
+        }
+    }
+    if (interval <= 0) {
+        interval = 1.0;
+    }
+
+    const live_stats_t *stats = live_stats_attach(name);
+    if (stats == NULL) {
+        fprintf(stderr, "picomon: no receiver statistics in %s, is SPI_isr running?\n", name);
+        return 1;
+    }
+    signal(SIGINT, on_signal);
+    signal(SIGTERM, on_signal);
+
+    unsigned picos = stats->picos;
+    uint64_t start_ns = stats->start_ns;
+    static pico_snapshot_t before[LIVE_STATS_MAX_PICOS], now[LIVE_STATS_MAX_PICOS];
+    for (unsigned i = 0; i < picos; i++) {
+        take_snapshot(&stats->pico[i], &before[i]);
+    }
+    uint64_t before_ns = monotonic_ns();
+    printf("picomon %s: receiver pid %d, %u picos, up %.1f s\n", name, stats->pid, picos, (before_ns - start_ns) / 1e9);
+
+    const struct timespec pause = { (time_t)interval, (long)((interval - (time_t)interval) * 1e9) };
+    for (long line = 0; !interrupted && (count == 0 || line < count); line++) {
+        nanosleep(&pause, NULL);
+        if (interrupted) {
+            break;
+        }
+        if (stats->start_ns != start_ns) {
+            // a new run has replaced the block, its picos and counters start over
+            printf("picomon %s: receiver restarted\n", name);
+            break;
+        }
+
+        uint64_t now_ns = monotonic_ns();
+        double seconds = (now_ns - before_ns) / 1e9;
+        printf("\n%-6s %8s %8s %8s %11s %6s %11s %11s %14s %14s %8s\n",
+               "pico", "rx/s", "MB/s", "wr/s", "queue", "lost", "crc/bad", "drop/edge", "rx p50/p99", "wr p50/p99", "age");
+        for (unsigned i = 0; i < picos; i++) {
+            take_snapshot(&stats->pico[i], &now[i]);
+            print_pico(stats->pico[i].name, &now[i], &before[i], seconds, now_ns);
+            before[i] = now[i];
+        }
+        before_ns = now_ns;
+        fflush(stdout);
+
+        int state = atomic_load_explicit((_Atomic uint32_t *)&stats->state, memory_order_acquire);
+        if (state == LIVE_STATS_STOPPED || (kill(stats->pid, 0) < 0 && errno == ESRCH)) {
+            printf("picomon %s: receiver %s\n", name, state == LIVE_STATS_STOPPED ? "stopped" : "is gone");
+            break;
+        }
+    }
+
+    live_stats_detach(stats);
+    return 0;
+}
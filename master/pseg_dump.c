@@ -0,0 +1,154 @@
+/*
+    About:
+        Lists the records of segment files written by SPI_isr, and optionally exports
+    every burst back to a raw binary file (the old data<n>.bin layout: BUFF_LEN
+    uint16_t samples, nothing else) for existing analysis scripts. Round-robin
+    bursts are exported as one file per ADC input. Records converted by SPI_isr
+    (CONVERT_VOLTS) export as float32 volts instead.
+
+    Usage:
+        ./pseg_dump data/seg_*.pseg                 list records
+        ./pseg_dump -x out data/seg_*.pseg          also write out/<pico>_<sequence>.bin
+                                                    (out/<pico>_<sequence>_ch<n>.bin per input)
+                                                    and spectra as out/<pico>_<sequence>_psd<n>.bin
+
+    Compilation:
+        gcc -O2 -o pseg_dump pseg_dump.c -lm
+*/
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "segment.h"
+#include "deinterleave.h"
+#include "telemetry.h"
+#include "spectrum.h"
+
+// Largest payload handled, well above one burst
+#define MAX_PAYLOAD (1u << 20)
+
+// Write one exported burst, reports and skips it on error
+static void export_file(const char *filename, const void *data, size_t bytes) {
+    FILE *out = fopen(filename, "wb");
+    if (out == NULL) {
+        perror("Error opening export file");
+        return;
+    }
+    fwrite(data, 1, bytes, out);
+    fclose(out);
+}
+
+int main(int argc, char **argv) {
+    const char *export_folder = NULL;
+    int opt;
+    while ((opt = getopt(argc, argv, "x:")) != -1) {
+        if (opt == 'x') {
+            export_folder = optarg;
+        } else {
+            fprintf(stderr, "usage: %s [-x folder] segment...\n", argv[0]);
+            return 1;
+        }
+    }
+
+    uint8_t *payload = malloc(MAX_PAYLOAD);
+    if (payload == NULL) {
+        return 1;
+    }
+
+    for (int i = optind; i < argc; i++) {
+        segment_header_t header;
+        FILE *f = segment_open_read(argv[i], &header);
+        if (f == NULL) {
+            continue;
+        }
+        printf("%s: segment %u, version %u\n", argv[i], header.index, header.version);
+
+        segment_record_t record;
+        unsigned long records = 0;
+        while (segment_read_next(f, &record, payload, MAX_PAYLOAD)) {
+            // edge time as wall clock, through the pair stored in the header
+            double wall = (double)(header.realtime_ns + (record.capture_ns - header.monotonic_ns)) / 1e9;
+            printf("  type %u  pico %u  seq %u  samples %u  channels 0x%x  bytes %u  t %.6f%s%s%s\n",
+                   record.type, record.source, record.sequence, record.sample_count,
+                   record.channel_mask, record.payload_bytes, wall,
+                   (record.flags & SEGMENT_FLAG_VOLTS) ? "  float32 volts" : "",
+                   (record.flags & SEGMENT_FLAG_CRC_ERROR) ? "  CRC error" : "",
+                   (record.flags & SEGMENT_FLAG_DECODE_ERROR) ? "  decode error" : "");
+            if (record.sample_time_ns != 0) {
+                // first sample on the same wall clock, spacing and fit residual from the timebase
+                double first = (double)(header.realtime_ns + (record.sample_time_ns - header.monotonic_ns)) / 1e9;
+                printf("      first sample %.9f  period %u ps  +-%u ns\n",
+                       first, record.sample_period_ps, record.align_error_ns);
+            }
+            records++;
+
+            if (record.type == SEGMENT_RECORD_TELEMETRY) {
+                telemetry_block_t block;
+                char name[16];
+                snprintf(name, sizeof(name), "%u", record.source);
+                if (telemetry_load(&block, payload, record.payload_bytes) == 0) {
+                    printf("      telemetry block %u\n", block.sequence);
+                    telemetry_print(stdout, name, &block);
+                } else {
+                    printf("      unreadable telemetry block\n");
+                }
+                continue;
+            }
+
+            if (record.type == SEGMENT_RECORD_SPECTRUM) {
+                spectrum_header_t sh;
+                if (record.payload_bytes < sizeof(sh)) {
+                    printf("      unreadable spectrum\n");
+                    continue;
+                }
+                memcpy(&sh, payload, sizeof(sh));
+                if (sh.magic != SPECTRUM_MAGIC || sh.version != SPECTRUM_VERSION
+                    || record.payload_bytes != sizeof(sh) + (size_t)sh.bins * sizeof(float)) {
+                    printf("      unreadable spectrum\n");
+                    continue;
+                }
+                double bin_hz = sh.sample_rate_hz > 0 ? sh.sample_rate_hz / sh.fft_size : 1.0 / sh.fft_size;
+                printf("      spectrum input %u, %u segments of %u from seq %u, mean %.2f, peaks",
+                       sh.input, sh.segments, sh.fft_size, sh.first_sequence, sh.mean);
+                for (unsigned k = 0; k < SPECTRUM_PEAKS && sh.peak_bin[k] > 0; k++) {
+                    printf(" %.6g (%.3g)", sh.peak_bin[k] * bin_hz, sh.peak_psd[k]);
+                }
+                printf(" %s\n", sh.sample_rate_hz > 0 ? "Hz" : "cycles/sample");
+                if (export_folder) {
+                    // the PSD alone, float32 per bin
+                    char filename[256];
+                    snprintf(filename, sizeof(filename), "%s/%u_%u_psd%u.bin", export_folder, record.source, record.sequence, sh.input);
+                    export_file(filename, payload + sizeof(sh), (size_t)sh.bins * sizeof(float));
+                }
+                continue;
+            }
+
+            if (export_folder && record.type == SEGMENT_RECORD_BURST) {
+                char filename[256];
+                unsigned channels = channel_count(record.channel_mask);
+                if (channels <= 1) {
+                    snprintf(filename, sizeof(filename), "%s/%u_%u.bin", export_folder, record.source, record.sequence);
+                    export_file(filename, payload, record.payload_bytes);
+                    continue;
+                }
+
+                // round-robin payloads hold one block per input, in ascending input order
+                uint32_t block_bytes = record.payload_bytes / channels;
+                unsigned block = 0;
+                for (unsigned input = 0; input < DEINTERLEAVE_MAX_CHANNELS; input++) {
+                    if (record.channel_mask & (1u << input)) {
+                        snprintf(filename, sizeof(filename), "%s/%u_%u_ch%u.bin", export_folder, record.source, record.sequence, input);
+                        export_file(filename, payload + block++ * block_bytes, block_bytes);
+                    }
+                }
+            }
+        }
+        printf("  %lu records\n", records);
+        fclose(f);
+    }
+
+    free(payload);
+    return 0;
+}
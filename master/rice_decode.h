@@ -0,0 +1,132 @@
+/*
+    About:
+        Decoder of Rice coded bursts (FRAME_FLAG_RICE), the pico side and the format
+    are described in src/adc_A/rice_encode.h, keep the constants in sync.
+
+        The bit stream is consumed from a 64-bit window refilled 32 bits at a time, so
+    every sample is one count-leading-zeros (a single CLZ instruction on the Pi 5 and
+    LZCNT/BSR on x86), two shifts and an add, with no per-bit loop. Reads are bounded
+    by the payload length, a corrupted stream fails instead of running past the frame.
+*/
+
+#ifndef RICE_DECODE_H
+#define RICE_DECODE_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+#define RICE_BLOCK          64
+#define RICE_K_BITS         4
+#define RICE_K_MAX          12
+#define RICE_RAW            15
+#define RICE_ESCAPE         16
+#define RICE_ESCAPE_BITS    13
+#define RICE_SAMPLE_BITS    12
+#define RICE_MAX_CHANNELS   5
+
+// longest possible coded burst of count samples in 16-bit words (every block raw)
+#define RICE_MAX_WORDS(count) \
+    ((((count) + RICE_BLOCK - 1) / RICE_BLOCK * RICE_K_BITS + (count) * RICE_SAMPLE_BITS + 31) / 32 * 2)
+
+typedef struct {
+    uint64_t window;            // next bits, left aligned
+    unsigned bits;              // valid bits in window
+    const uint8_t *p;           // next 32-bit word
+    const uint8_t *end;
+    uint64_t consumed;          // bits taken so far
+} rice_reader_t;
+
+static inline void rice_refill(rice_reader_t *r) {
+    if (r->bits <= 32) {
+        uint32_t word = 0;
+        if (r->p < r->end) {
+            memcpy(&word, r->p, sizeof(word));
+            r->p += sizeof(word);
+        }
+        // past the end reads as zeros, decode checks consumed against the length
+        r->window |= (uint64_t)word << (32 - r->bits);
+        r->bits += 32;
+    }
+}
+
+static inline uint32_t rice_take(rice_reader_t *r, unsigned len) {
+    uint32_t value = (uint32_t)(r->window >> (64 - len));
+    r->window <<= len;
+    r->bits -= len;
+    r->consumed += len;
+    return value;
+}
+
+/*
+    Description:
+        Decode one burst
+
+    Parameter:
+        const uint16_t *coded - payload words as received
+        size_t words          - payload_words of the frame (even)
+        uint16_t *out         - count samples
+        size_t count          - number of samples
+        unsigned channels     - interleaved ADC inputs, 1 to RICE_MAX_CHANNELS
+
+    Return:
+        int - 0 on success, -1 if the stream is malformed or too short
+*/
+static inline int rice_decode_u16(const uint16_t *coded, size_t words, uint16_t *out, size_t count, unsigned channels) {
+    rice_reader_t r = { 0, 0, (const uint8_t *)coded, (const uint8_t *)(coded + (words & ~(size_t)1)), 0 };
+    uint16_t prev[RICE_MAX_CHANNELS] = { 0 };
+    unsigned channel = 0;
+
+    if (channels < 1 || channels > RICE_MAX_CHANNELS) {
+        return -1;
+    }
+
+    for (size_t block = 0; block < count; block += RICE_BLOCK) {
+        size_t n = count - block < RICE_BLOCK ? count - block : RICE_BLOCK;
+        rice_refill(&r);
+        unsigned k = rice_take(&r, RICE_K_BITS);
+
+        if (k == RICE_RAW) {
+            for (size_t i = 0; i < n; i++) {
+                rice_refill(&r);
+                uint16_t s = (uint16_t)rice_take(&r, RICE_SAMPLE_BITS);
+                out[block + i] = s;
+                prev[channel] = s;
+                if (++channel == channels) {
+                    channel = 0;
+                }
+            }
+            continue;
+        }
+        if (k > RICE_K_MAX) {
+            return -1;
+        }
+
+        for (size_t i = 0; i < n; i++) {
+            rice_refill(&r);    // at least 33 bits, the longest code is 29
+            unsigned zeros = r.window ? (unsigned)__builtin_clzll(r.window) : 64;
+            uint32_t z;
+            if (zeros < RICE_ESCAPE) {
+                rice_take(&r, zeros + 1);
+                z = (uint32_t)zeros << k;
+                if (k) {
+                    z |= rice_take(&r, k);
+                }
+            } else {
+                rice_take(&r, RICE_ESCAPE);
+                z = rice_take(&r, RICE_ESCAPE_BITS);
+            }
+            int32_t d = (int32_t)(z >> 1) ^ -(int32_t)(z & 1);
+            uint16_t s = (uint16_t)((prev[channel] + d) & 0xffff);
+            out[block + i] = s;
+            prev[channel] = s;
+            if (++channel == channels) {
+                channel = 0;
+            }
+        }
+    }
+
+    return r.consumed <= (uint64_t)(words & ~(size_t)1) * 16 ? 0 : -1;
+}
+
+#endif
@@ -0,0 +1,189 @@
+/*
+    About:
+        Load test of the receiver on any Linux box. SPI_isr.c is compiled in whole
+    (RX_BENCH), so this measures exactly the code that runs on the Pi: edge loop,
+    reader threads, frame checks, the writer's decoding and the segment files. Only
+    the transport is swapped for the stand-in picos of transport_replay.h, which
+    replay data<n>.bin captures or a synthetic pattern at a given burst rate.
+
+        After the run it reports the throughput, the SPI calls and context switches
+    per burst, percentiles of the latency from the transfer edge to the burst being
+    written, and every burst that did not make it (overruns of the stand-in picos,
+    empty pools, frame errors). The receiver's own exit statistics come first.
+
+        The payload format follows the build, as for SPI_isr: add -DPACKED_12BIT or
+    -DRICE_CODED (and -DCONVERT_VOLTS) to compare them. Point -d at a tmpfs to take
+    the disk out of the measurement.
+
+    Usage:
+        ./rx_bench -n 2 -r 4 -b 200                 2 picos, 4 bursts/s each, 200 bursts each
+        ./rx_bench -n 4 -r 40 -p noise -c 5000000   noise, emulate a 5 MHz link
+        ./rx_bench -n 2 -r 20 -d /dev/shm/rx data0.bin data1.bin
+
+        -n picos (1 to 8), -r bursts per second per pico, -b bursts per pico, -p ramp,
+    sine or noise when no capture files are given, -c SPI clock to emulate (0: none),
+    -f sample rate for the header timing, -m ADC channel mask, -d output folder.
+
+    Compilation:
+        gcc -O2 -o rx_bench rx_bench.c -lpthread -lm
+*/
+
+#define RX_BENCH
+
+#include <stdint.h>
+#include <stddef.h>
+#include <sys/resource.h>
+
+// Called by the writer after each burst is written, defined below
+static void rx_bench_persisted(unsigned source, uint64_t capture_ns, size_t bytes);
+
+#include "SPI_isr.c"
+#include "transport_replay.h"
+
+// Percentiles reported, in per mille
+static const unsigned percentiles[] = { 500, 900, 990, 999 };
+
+static uint64_t *latency_ns;        // edge to written, in the order written
+static size_t latency_count;
+static size_t latency_room;
+static uint64_t persisted_bytes;
+static uint64_t last_persisted_ns;
+
+static void rx_bench_persisted(unsigned source, uint64_t capture_ns, size_t bytes) {
+    (void)source;
+    uint64_t now = segment_clock_ns(CLOCK_MONOTONIC);
+    if (latency_count < latency_room) {
+        latency_ns[latency_count++] = now - capture_ns;
+    }
+    persisted_bytes += bytes;
+    last_persisted_ns = now;
+}
+
+static int compare_u64(const void *a, const void *b) {
+    uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+    return (x > y) - (x < y);
+}
+
+// Stops the receiver once every replayed burst has been clocked out
+static void *stopper_thread(void *arg) {
+    transport_replay_t *r = (transport_replay_t *)arg;
+    transport_replay_wait(r, 10.0);
+    kill(getpid(), SIGTERM);
+    return NULL;
+}
+
+int main(int argc, char **argv) {
+    static transport_replay_t replay;
+    replay.picos = 2;
+    replay.rate_hz = 4.0;
+    replay.bursts = 200;
+    replay.samples = BUFF_LEN;
+    replay.flags = PAYLOAD_FLAGS;
+    replay.sample_rate_hz = 50000.0;
+    replay.pattern = REPLAY_RAMP;
+    data_folder = "/tmp/rx_bench";
+
+    int opt;
+    while ((opt = getopt(argc, argv, "n:r:b:p:c:f:m:d:")) != -1) {
+        if (opt == 'n') {
+            replay.picos = (unsigned)atoi(optarg);
+        } else if (opt == 'r') {
+            replay.rate_hz = atof(optarg);
+        } else if (opt == 'b') {
+            replay.bursts = strtoul(optarg, NULL, 0);
+        } else if (opt == 'p') {
+            replay.pattern = !strcmp(optarg, "sine") ? REPLAY_SINE : !strcmp(optarg, "noise") ? REPLAY_NOISE : REPLAY_RAMP;
+        } else if (opt == 'c') {
+            replay.wire_hz = (uint32_t)strtoul(optarg, NULL, 0);
+        } else if (opt == 'f') {
+            replay.sample_rate_hz = atof(optarg);
+        } else if (opt == 'm') {
+            replay.channel_mask = (uint16_t)strtoul(optarg, NULL, 0);
+        } else if (opt == 'd') {
+            data_folder = optarg;
+        } else {
+            fprintf(stderr, "usage: %s [-n picos] [-r rate] [-b bursts] [-p ramp|sine|noise] [-c wire Hz] "
+                            "[-f Fs] [-m mask] [-d folder] [capture.bin...]\n", argv[0]);
+            return 1;
+        }
+    }
+    replay.files = argv + optind;
+    replay.file_count = argc - optind;
+    if (replay.picos > MACHINES_EMPLOYED) {
+        fprintf(stderr, "rx_bench: at most %zu picos\n", MACHINES_EMPLOYED);
+        return 1;
+    }
+    machines = replay.picos;
+
+    frame_crc_init();   // the stand-in picos compute the trailer too
+    if (transport_replay_init(&replay) < 0) {
+        return 1;
+    }
+    latency_room = replay.picos * replay.bursts;
+    latency_ns = malloc(latency_room * sizeof(uint64_t));
+    if (latency_ns == NULL) {
+        return 1;
+    }
+
+    // the stopper's SIGTERM has to reach the receiver's signalfd, not a thread that takes it
+    sigset_t signals;
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGINT);
+    sigaddset(&signals, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &signals, NULL);
+    pthread_t stopper;
+    pthread_create(&stopper, NULL, stopper_thread, &replay);
+
+    printf("rx_bench: %u picos, %.1f bursts/s each, %lu bursts each, %u samples, %s, %s link\n",
+           replay.picos, replay.rate_hz, replay.bursts, replay.samples,
+           replay.file_count ? "replayed captures" : (replay.pattern == REPLAY_SINE ? "sine" : replay.pattern == REPLAY_NOISE ? "noise" : "ramp"),
+           replay.wire_hz ? "emulated" : "instant");
+
+    struct rusage usage_start, usage_end;
+    getrusage(RUSAGE_SELF, &usage_start);
+    transport_t stand_in = { &transport_replay_ops, &replay };
+    int status = receiver_run(&stand_in);
+    getrusage(RUSAGE_SELF, &usage_end);
+    pthread_join(stopper, NULL);
+    if (status != 0) {
+        return status;
+    }
+
+    // what was offered, what arrived
+    unsigned long sent = 0, overruns = 0, bursts = 0, ioctls = 0, dropped = 0, errors = 0;
+    for (unsigned k = 0; k < replay.picos; k++) {
+        sent += replay.pico[k].sent;
+        overruns += replay.pico[k].overruns;
+        bursts += channels[k].bursts;
+        ioctls += channels[k].ioctls;
+        dropped += channels[k].pool_empty;
+        errors += channels[k].bad_headers + channels[k].crc_errors + channels[k].decode_errors;
+    }
+    double seconds = (last_persisted_ns > replay.start_ns ? last_persisted_ns - replay.start_ns : 1) / 1e9;
+    long switches = (usage_end.ru_nvcsw - usage_start.ru_nvcsw) + (usage_end.ru_nivcsw - usage_start.ru_nivcsw);
+
+    printf("\nOffered %lu bursts, %lu written, %lu overruns (pico still held the last one), "
+           "%lu dropped (pool empty), %lu frame errors\n",
+           sent + overruns, (unsigned long)latency_count, overruns, dropped, errors);
+    printf("Throughput %.2f MB/s written over %.2f s, %.1f bursts/s\n",
+           persisted_bytes / seconds / 1e6, seconds, latency_count / seconds);
+    if (bursts > 0) {
+        printf("Per burst: %.2f SPI calls, 1 edge read, %.2f context switches, %.0f us CPU\n",
+               (double)ioctls / bursts, (double)switches / bursts,
+               ((usage_end.ru_utime.tv_sec - usage_start.ru_utime.tv_sec) * 1e6 + (usage_end.ru_utime.tv_usec - usage_start.ru_utime.tv_usec)
+                + (usage_end.ru_stime.tv_sec - usage_start.ru_stime.tv_sec) * 1e6 + (usage_end.ru_stime.tv_usec - usage_start.ru_stime.tv_usec)) / bursts);
+    }
+    if (latency_count > 0) {
+        qsort(latency_ns, latency_count, sizeof(uint64_t), compare_u64);
+        printf("Edge to written:");
+        for (size_t i = 0; i < sizeof(percentiles) / sizeof(percentiles[0]); i++) {
+            size_t at = latency_count * percentiles[i] / 1000;
+            printf(" p%g %.0f us,", percentiles[i] / 10.0, latency_ns[at < latency_count ? at : latency_count - 1] / 1e3);
+        }
+        printf(" max %.0f us\n", latency_ns[latency_count - 1] / 1e3);
+    }
+
+    free(latency_ns);
+    transport_replay_free(&replay);
+    return 0;
+}
@@ -0,0 +1,275 @@
+/*
+    About:
+        Segmented capture container. Bursts are appended to large segment files instead
+    of one small file per burst. A segment is preallocated to SEGMENT_BYTES with
+    fallocate, written strictly append-only, and rotated once the next record would
+    not fit. Closing a segment trims the unused preallocated tail.
+
+    Layout (little endian):
+        segment_header_t                            once per file
+        { segment_record_t, payload, pad to 8 }     once per burst
+
+        The preallocated tail reads as zeros, so a reader stops at the first record
+    whose magic is not SEGMENT_RECORD_MAGIC. A segment cut short by a crash is
+    still readable up to its last complete record.
+
+        Capture timestamps are the CLOCK_MONOTONIC nanoseconds of the transfer edge,
+    the segment header stores a CLOCK_REALTIME/CLOCK_MONOTONIC pair taken at creation
+    to convert them to wall-clock time. With the sync timebase (timebase.h) a record
+    also carries the receiver time of its first sample and the sample spacing in the
+    receiver's clock, sample k of a block is at sample_time_ns + k * sample_period_ps
+    (k counted in the interleaved order for round-robin payloads).
+*/
+
+#ifndef SEGMENT_H
+#define SEGMENT_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/uio.h>
+
+#define SEGMENT_MAGIC           "PICOSEG"   // 8 bytes with the terminator
+#define SEGMENT_VERSION         2   // 2: sample timing in the record
+#define SEGMENT_RECORD_MAGIC    0x54534250u // "PBST"
+#define SEGMENT_BYTES           (64u << 20) // rotate after 64 MiB
+#define SEGMENT_ALIGN           8
+
+// record types
+#define SEGMENT_RECORD_BURST    0
+#define SEGMENT_RECORD_TELEMETRY 1          // payload is a pico's telemetry_block_t (telemetry.h), no samples
+#define SEGMENT_RECORD_SPECTRUM 2           // payload is a spectrum_header_t and the PSD of one input (spectrum.h)
+
+// record flags
+#define SEGMENT_FLAG_CRC_ERROR  0x0001      // frame CRC did not match, payload may be corrupted
+#define SEGMENT_FLAG_DECODE_ERROR 0x0002    // coded payload could not be decoded, samples are zero
+#define SEGMENT_FLAG_VOLTS      0x0004      // payload is calibrated float32 volts, not raw uint16_t codes
+
+typedef struct {
+    char magic[8];
+    uint32_t version;
+    uint32_t header_bytes;      // sizeof(segment_header_t), records start here
+    uint32_t index;             // segment number within the run
+    uint32_t reserved;
+    uint64_t realtime_ns;       // CLOCK_REALTIME at creation
+    uint64_t monotonic_ns;      // CLOCK_MONOTONIC at creation
+} segment_header_t;
+
+typedef struct {
+    uint32_t magic;             // SEGMENT_RECORD_MAGIC
+    uint16_t type;              // SEGMENT_RECORD_*
+    uint16_t source;            // pico index in the receiver's table
+    uint32_t sequence;          // per-pico burst number
+    uint32_t sample_count;      // samples in the payload
+    uint64_t capture_ns;        // CLOCK_MONOTONIC of the transfer edge
+    uint32_t payload_bytes;     // payload length, excluding padding
+    uint16_t flags;             // SEGMENT_FLAG_*
+    uint16_t channel_mask;      // ADC inputs in the payload, one block per channel when more than one
+    uint64_t sample_time_ns;    // CLOCK_MONOTONIC of the first sample, 0 when unknown
+    uint32_t sample_period_ps;  // spacing of the samples in receiver time, 0 when trigger paced
+    uint32_t align_error_ns;    // residual of the timebase fit, how far sample_time_ns may be off
+} segment_record_t;
+
+_Static_assert(sizeof(segment_header_t) == 40, "segment header layout");
+_Static_assert(sizeof(segment_record_t) == 48, "segment record layout");
+
+typedef struct {
+    int fd;
+    uint32_t index;             // next segment number
+    uint64_t used;              // bytes written to the open segment
+    uint64_t segment_bytes;     // rotation size
+    char folder[128];
+    char prefix[32];            // run prefix, yyyymmdd-hhmmss
+} segment_writer_t;
+
+static inline uint64_t segment_clock_ns(clockid_t clock) {
+    struct timespec ts;
+    clock_gettime(clock, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+static inline uint64_t segment_padded(uint64_t bytes) {
+    return (bytes + SEGMENT_ALIGN - 1) & ~(uint64_t)(SEGMENT_ALIGN - 1);
+}
+
+/*
+    Description:
+        Close the open segment, trimming the preallocated tail
+*/
+static inline void segment_close(segment_writer_t *w) {
+    if (w->fd < 0) {
+        return;
+    }
+    if (ftruncate(w->fd, (off_t)w->used) < 0) {
+        perror("Error trimming segment");
+    }
+    close(w->fd);
+    w->fd = -1;
+}
+
+/*
+    Description:
+        Open and preallocate the next segment file, write its header
+
+    Return:
+        int - 0 on success, -1 on error
+*/
+static inline int segment_open_next(segment_writer_t *w) {
+    segment_close(w);
+
+    char filename[192];
+    snprintf(filename, sizeof(filename), "%s/seg_%s_%05u.pseg", w->folder, w->prefix, w->index);
+
+    w->fd = open(filename, O_WRONLY | O_CREAT | O_EXCL, 0644);
+    if (w->fd < 0) {
+        perror("Error opening segment file");
+        return -1;
+    }
+    int err = posix_fallocate(w->fd, 0, (off_t)w->segment_bytes);
+    if (err != 0) {
+        fprintf(stderr, "Segment preallocation failed (%s), continuing without\n", strerror(err));
+    }
+
+    segment_header_t header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, SEGMENT_MAGIC, sizeof(header.magic));
+    header.version = SEGMENT_VERSION;
+    header.header_bytes = sizeof(header);
+    header.index = w->index;
+    header.realtime_ns = segment_clock_ns(CLOCK_REALTIME);
+    header.monotonic_ns = segment_clock_ns(CLOCK_MONOTONIC);
+
+    if (pwrite(w->fd, &header, sizeof(header), 0) != (ssize_t)sizeof(header)) {
+        perror("Error writing segment header");
+        close(w->fd);
+        w->fd = -1;
+        return -1;
+    }
+    w->used = sizeof(header);
+    w->index++;
+    return 0;
+}
+
+/*
+    Description:
+        Set up a writer, the first segment is opened on the first append
+
+    Parameter:
+        segment_writer_t *w    - writer to set up
+        const char *folder     - output folder, must exist
+        uint64_t segment_bytes - rotation size, 0 for SEGMENT_BYTES
+*/
+static inline void segment_writer_init(segment_writer_t *w, const char *folder, uint64_t segment_bytes) {
+    memset(w, 0, sizeof(*w));
+    w->fd = -1;
+    w->segment_bytes = segment_bytes ? segment_bytes : SEGMENT_BYTES;
+    snprintf(w->folder, sizeof(w->folder), "%s", folder);
+
+    time_t now = time(NULL);
+    struct tm tm;
+    localtime_r(&now, &tm);
+    strftime(w->prefix, sizeof(w->prefix), "%Y%m%d-%H%M%S", &tm);
+}
+
+/*
+    Description:
+        Append one record, rotating to a new segment when it would not fit
+
+    Parameter:
+        segment_writer_t *w      - writer
+        segment_record_t *record - record header, magic and payload_bytes are filled in
+        const void *payload      - record payload
+        uint32_t payload_bytes   - payload length
+
+    Return:
+        int - 0 on success, -1 on error
+*/
+static inline int segment_append(segment_writer_t *w, segment_record_t *record, const void *payload, uint32_t payload_bytes) {
+    static const uint8_t zeros[SEGMENT_ALIGN] = { 0 };
+    uint64_t padded = segment_padded(payload_bytes);
+    uint64_t size = sizeof(*record) + padded;
+
+    if (w->fd < 0 || w->used + size > w->segment_bytes) {
+        if (segment_open_next(w) < 0) {
+            return -1;
+        }
+    }
+
+    record->magic = SEGMENT_RECORD_MAGIC;
+    record->payload_bytes = payload_bytes;
+
+    struct iovec iov[3] = {
+        { record, sizeof(*record) },
+        { (void *)payload, payload_bytes },
+        { (void *)zeros, padded - payload_bytes },
+    };
+    ssize_t written = pwritev(w->fd, iov, 3, (off_t)w->used);
+    if (written != (ssize_t)size) {
+        perror("Error writing segment record");
+        return -1;
+    }
+    w->used += size;
+    return 0;
+}
+
+/*
+    Description:
+        Open a segment for reading and check its header
+
+    Return:
+        FILE* - positioned at the first record, NULL on error
+*/
+static inline FILE *segment_open_read(const char *filename, segment_header_t *header) {
+    FILE *f = fopen(filename, "rb");
+    if (f == NULL) {
+        perror("Error opening segment file");
+        return NULL;
+    }
+    if (fread(header, sizeof(*header), 1, f) != 1
+        || memcmp(header->magic, SEGMENT_MAGIC, sizeof(header->magic)) != 0) {
+        fprintf(stderr, "%s: not a segment file\n", filename);
+        fclose(f);
+        return NULL;
+    }
+    if (header->version != SEGMENT_VERSION) {
+        fprintf(stderr, "%s: segment version %u, this build reads %u\n", filename, header->version, SEGMENT_VERSION);
+        fclose(f);
+        return NULL;
+    }
+    fseek(f, header->header_bytes, SEEK_SET);
+    return f;
+}
+
+/*
+    Description:
+        Read the next record of a segment
+
+    Parameter:
+        FILE *f                  - from segment_open_read()
+        segment_record_t *record - record header out
+        void *payload            - payload out, at least max_bytes long
+        uint32_t max_bytes       - payload buffer size, longer payloads are skipped
+
+    Return:
+        int - 1 if a record was read, 0 at the end of the segment
+*/
+static inline int segment_read_next(FILE *f, segment_record_t *record, void *payload, uint32_t max_bytes) {
+    while (fread(record, sizeof(*record), 1, f) == 1 && record->magic == SEGMENT_RECORD_MAGIC) {
+        uint64_t padded = segment_padded(record->payload_bytes);
+        if (record->payload_bytes > max_bytes) {
+            fseek(f, (long)padded, SEEK_CUR);
+            continue;
+        }
+        if (fread(payload, 1, record->payload_bytes, f) != record->payload_bytes) {
+            return 0;
+        }
+        fseek(f, (long)(padded - record->payload_bytes), SEEK_CUR);
+        return 1;
+    }
+    return 0;
+}
+
+#endif
@@ -0,0 +1,228 @@
+/*
+    About:
+        Streaming power spectral density of the received samples (Welch's method),
+    per pico and ADC input. Samples are collected across bursts into segments of
+    SPECTRUM_SIZE points with 50 % overlap, so the segments do not depend on the burst
+    length. Each segment has its mean removed and a Hann window applied, and its
+    |FFT|^2 (fft.h) is added to a running sum. Every few bursts the receiver turns
+    the sum into a one-sided PSD and stores it as a segment record of its own,
+    next to the bursts. The sum then starts over.
+
+    Record payload (SEGMENT_RECORD_SPECTRUM, one per input, little endian):
+        spectrum_header_t
+        float psd[bins]         codes^2 / Hz, bin k at k * sample_rate_hz / fft_size
+
+        Without a sample rate (trigger paced captures) the PSD is per cycle/sample:
+    sample_rate_hz is 0 and bin k is at k / fft_size cycles per sample. Peaks are
+    the largest local maxima above bin 1, with their position interpolated on a
+    parabola through the log of the three bins around them.
+*/
+
+#ifndef SPECTRUM_H
+#define SPECTRUM_H
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "fft.h"
+
+#define SPECTRUM_MAGIC      0x5350      // "PS"
+#define SPECTRUM_VERSION    1
+#define SPECTRUM_PEAKS      4
+#define SPECTRUM_WINDOW_HANN 1
+
+typedef struct {
+    uint16_t magic;                     // SPECTRUM_MAGIC
+    uint16_t version;                   // SPECTRUM_VERSION
+    uint16_t input;                     // ADC input, bit of the pico's channel_mask
+    uint16_t window;                    // SPECTRUM_WINDOW_HANN
+    uint32_t fft_size;                  // points per segment
+    uint32_t bins;                      // fft_size / 2 + 1 floats follow
+    uint32_t segments;                  // averaged into this PSD, 50 % overlap
+    uint32_t first_sequence;            // burst that completed the first segment
+    double sample_rate_hz;              // of this input, 0 when unknown
+    double mean;                        // average code over the segments, removed before the FFT
+    float peak_bin[SPECTRUM_PEAKS];     // interpolated, in bins, 0 when there are fewer peaks
+    float peak_psd[SPECTRUM_PEAKS];     // PSD at the peak bin
+} spectrum_header_t;
+
+_Static_assert(sizeof(spectrum_header_t) == 72, "spectrum header layout");
+
+// Running state of one input
+typedef struct {
+    unsigned size;                      // fft_size
+    unsigned fill;                      // samples in history
+    float *history;                     // size samples, the next segment
+    float *segment;                     // windowed copy handed to the FFT
+    float *window;                      // Hann, size points
+    float *power;                       // size / 2 + 1 bins, summed |X|^2
+    double window_power;                // sum of window^2
+    double mean_sum;
+    uint32_t segments;
+    uint32_t first_sequence;
+    double sample_rate_hz;
+} spectrum_t;
+
+static inline void spectrum_free(spectrum_t *s) {
+    free(s->history);
+    free(s->segment);
+    free(s->window);
+    free(s->power);
+    memset(s, 0, sizeof(*s));
+}
+
+/*
+    Description:
+        Set up the running state of one input
+
+    Parameter:
+        spectrum_t *s - state, free with spectrum_free()
+        unsigned size - FFT length, as planned
+
+    Return:
+        int - 0 on success, -1 without memory
+*/
+static inline int spectrum_init(spectrum_t *s, unsigned size) {
+    memset(s, 0, sizeof(*s));
+    s->size = size;
+    s->history = malloc(size * sizeof(float));
+    s->segment = malloc(size * sizeof(float));
+    s->window = malloc(size * sizeof(float));
+    s->power = calloc(size / 2 + 1, sizeof(float));
+    if (!s->history || !s->segment || !s->window || !s->power) {
+        spectrum_free(s);
+        return -1;
+    }
+    // periodic Hann, the one that overlaps-adds to a constant at 50 %
+    for (unsigned i = 0; i < size; i++) {
+        s->window[i] = (float)(0.5 - 0.5 * cos(2.0 * M_PI * i / size));
+        s->window_power += (double)s->window[i] * s->window[i];
+    }
+    return 0;
+}
+
+// One full segment of history: mean out, window, FFT, sum; then slide by half
+static inline void spectrum_segment(spectrum_t *s, fft_plan_t *plan, uint32_t sequence) {
+    const unsigned size = s->size;
+    float sum = 0;
+    for (unsigned i = 0; i < size; i++) {
+        sum += s->history[i];
+    }
+    float mean = sum / size;
+    for (unsigned i = 0; i < size; i++) {
+        s->segment[i] = (s->history[i] - mean) * s->window[i];
+    }
+    fft_power_add(plan, s->segment, s->power);
+    if (s->segments++ == 0) {
+        s->first_sequence = sequence;
+    }
+    s->mean_sum += mean;
+
+    memmove(s->history, s->history + size / 2, (size - size / 2) * sizeof(float));
+    s->fill = size - size / 2;
+}
+
+/*
+    Description:
+        Add the samples of one input of a burst, runs an FFT for every segment
+    they complete
+
+    Parameter:
+        spectrum_t *s          - state of the input
+        fft_plan_t *plan       - plan of s->size
+        const uint16_t *codes  - samples of this input, in order
+        size_t count           - how many
+        uint32_t sequence      - burst they came in
+        double sample_rate_hz  - of this input, 0 when unknown
+*/
+static inline void spectrum_feed(spectrum_t *s, fft_plan_t *plan, const uint16_t *codes, size_t count,
+                                 uint32_t sequence, double sample_rate_hz) {
+    s->sample_rate_hz = sample_rate_hz;
+    while (count > 0) {
+        size_t take = s->size - s->fill;
+        if (take > count) {
+            take = count;
+        }
+        for (size_t i = 0; i < take; i++) {
+            s->history[s->fill + i] = codes[i];
+        }
+        s->fill += take;
+        codes += take;
+        count -= take;
+        if (s->fill == s->size) {
+            spectrum_segment(s, plan, sequence);
+        }
+    }
+}
+
+/*
+    Description:
+        Turn the summed segments into a one-sided PSD with its peaks and start a
+    new average
+
+    Parameter:
+        spectrum_t *s             - state of the input
+        unsigned input            - ADC input, for the header
+        spectrum_header_t *header - filled in
+        float *psd                - s->size / 2 + 1 bins
+
+    Return:
+        int - 0 when written, -1 if no segment was completed since the last one
+*/
+static inline int spectrum_take(spectrum_t *s, unsigned input, spectrum_header_t *header, float *psd) {
+    if (s->segments == 0) {
+        return -1;
+    }
+    const unsigned bins = s->size / 2 + 1;
+    double rate = s->sample_rate_hz > 0 ? s->sample_rate_hz : 1.0;
+    float scale = (float)(2.0 / (rate * s->window_power * s->segments));
+    for (unsigned k = 0; k < bins; k++) {
+        psd[k] = s->power[k] * scale;
+    }
+    psd[0] *= 0.5f;                     // DC and Nyquist have no mirror image
+    if (s->size % 2 == 0) {
+        psd[bins - 1] *= 0.5f;
+    }
+
+    memset(header, 0, sizeof(*header));
+    header->magic = SPECTRUM_MAGIC;
+    header->version = SPECTRUM_VERSION;
+    header->input = (uint16_t)input;
+    header->window = SPECTRUM_WINDOW_HANN;
+    header->fft_size = s->size;
+    header->bins = bins;
+    header->segments = s->segments;
+    header->first_sequence = s->first_sequence;
+    header->sample_rate_hz = s->sample_rate_hz;
+    header->mean = s->mean_sum / s->segments;
+
+    // largest local maxima, kept sorted
+    unsigned found = 0;
+    for (unsigned k = 2; k + 1 < bins; k++) {
+        if (!(psd[k] > psd[k - 1] && psd[k] >= psd[k + 1])) {
+            continue;
+        }
+        unsigned at = found < SPECTRUM_PEAKS ? found++ : SPECTRUM_PEAKS;
+        while (at > 0 && header->peak_psd[at - 1] < psd[k]) {
+            if (at < SPECTRUM_PEAKS) {
+                header->peak_bin[at] = header->peak_bin[at - 1];
+                header->peak_psd[at] = header->peak_psd[at - 1];
+            }
+            at--;
+        }
+        if (at < SPECTRUM_PEAKS) {
+            float a = logf(psd[k - 1] + 1e-30f), b = logf(psd[k] + 1e-30f), c = logf(psd[k + 1] + 1e-30f);
+            float curve = a - 2 * b + c;
+            header->peak_bin[at] = k + (curve < 0 ? 0.5f * (a - c) / curve : 0.0f);
+            header->peak_psd[at] = psd[k];
+        }
+    }
+
+    memset(s->power, 0, bins * sizeof(float));
+    s->segments = 0;
+    s->mean_sum = 0;
+    return 0;
+}
+
+#endif
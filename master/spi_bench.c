@@ -0,0 +1,460 @@
+/*
+    About:
+        Receiver half of the SPI link benchmark, for a pico running src/SPI_test. For
+    every combination of pattern, burst length and SPI clock given, it sets the pico
+    up over MOSI (spi_bench.h), then clocks -n bursts as SPI_isr does: wait for the
+    transfer edge, wait TRANSFER_DELAY_US, clock the whole burst. Every word is
+    checked against the pattern generated here.
+
+        Per combination it reports:
+            bursts clocked, bursts lost (sequence gaps), bad headers and pico timeouts
+            payload bits, bit errors, word errors and the bit error rate; with no
+                error the 95 % upper bound of the rate, 3 / bits
+            link MB/s, bytes over the time spent clocking them
+            effective MB/s, error-free payload bytes over the whole run, gaps included,
+                and its share of the raw clock (clock / 8 bytes per second)
+            inter-burst gap, from the end of one burst to the next transfer edge
+                (mean, p50, p99, max) and the edge to edge period
+            edge latency, from the kernel's edge timestamp to the first clock (p50, p99)
+            the pico's time to generate a burst
+        as a table on stdout and, with -o, one CSV row per combination.
+
+        The pico's gap (-G) is from the end of a burst to its next pulse. With -G 0
+    it pulses as soon as the next burst is generated, which measures how fast the
+    link and this receiver can go.
+
+    Usage:
+        ./spi_bench -k 2,5,8,10 -o link.csv
+        ./spi_bench -d /dev/spidev1.0 -g 27 -p prbs,random -w 1024,12538,32768 -k 5 -n 500 -G 0
+
+        -d spidev device and -g the GPIO line of the pico's TRANSFER_PIN, as in the
+    picos table of SPI_isr. -k clocks in MHz, -w burst lengths in words (16 to
+    32768, header included), -p patterns (counter, prbs, random), -n bursts per
+    combination, -G the pico's gap in us, -D the delay after the edge in us.
+
+    Compilation:
+        gcc -O2 -o spi_bench spi_bench.c -lgpiod
+*/
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <poll.h>
+#include <unistd.h>
+#include "transport_gpiod.h"
+#include "spi_bench.h"
+
+#define GPIO_CHIP "/dev/gpiochip4"
+
+// Delay between the transfer edge and the first clock, as in SPI_isr
+#define TRANSFER_DELAY_US 100
+
+// Rate of the bursts that set the pico up, slow enough for any wiring
+#define SETUP_HZ LINK_CAL_REQUEST_HZ
+
+// Bursts to wait for the pico to take a new setup
+#define SETUP_ATTEMPTS 5
+
+// The pico drops a burst after 1 s, it pulses again right away
+#define EDGE_TIMEOUT_MS 2500
+
+#define MAX_LIST 16
+
+typedef struct {
+    unsigned pattern;
+    unsigned words;
+    uint32_t clock_hz;
+} bench_config_t;
+
+// One combination, its counters and the per-burst times
+typedef struct {
+    bench_config_t cfg;
+    unsigned long bursts, lost, bad_headers, pico_timeouts;
+    uint64_t bits, bit_errors, word_errors;
+    uint64_t clocked_bytes, good_bytes;
+    uint64_t read_ns, prep_us;
+    uint64_t start_ns, end_ns;              // first edge, end of the last burst
+    uint32_t *gap_us, *period_us, *latency_us;
+    unsigned long gaps, periods, latencies;
+} bench_result_t;
+
+typedef struct {
+    int spi;
+    int line;
+    int event_fd;
+    unsigned delay_us;
+    uint32_t gap_us;
+    transport_gpiod_t gpio;
+    uint16_t rx[BENCH_MAX_WORDS];
+    uint16_t tx[BENCH_MAX_WORDS];
+    uint16_t expected[BENCH_MAX_WORDS];
+} bench_link_t;
+
+static bench_link_t pico;
+
+static uint64_t monotonic_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+/*
+    Description:
+        Clock words in and out at once, in bufsiz-sized chunks
+
+    Return:
+        int - 0 on success, -1 on error
+*/
+static int transfer(const uint16_t *tx, uint16_t *rx, size_t words, uint32_t speed) {
+    size_t chunk_words = spi_bufsiz / sizeof(uint16_t);
+    for (size_t offset = 0; offset < words; offset += chunk_words) {
+        size_t n = words - offset < chunk_words ? words - offset : chunk_words;
+        struct spi_ioc_transfer t;
+        memset(&t, 0, sizeof(t));
+        t.tx_buf = (unsigned long)&tx[offset];
+        t.rx_buf = (unsigned long)&rx[offset];
+        t.len = n * sizeof(uint16_t);
+        t.speed_hz = speed;
+        t.bits_per_word = SPI_LINK_BITS;
+        if (ioctl(pico.spi, SPI_IOC_MESSAGE(1), &t) < 0) {
+            perror("Error clocking SPI data");
+            return -1;
+        }
+    }
+    return 0;
+}
+
+/*
+    Description:
+        Wait for the pico's next transfer edge, then the transfer delay
+
+    Return:
+        int - 0 and the kernel's timestamp of the edge, -1 if none came
+*/
+static int wait_edge(uint64_t *edge_ns) {
+    struct pollfd p = { .fd = pico.event_fd, .events = POLLIN };
+    if (poll(&p, 1, EDGE_TIMEOUT_MS) != 1
+        || transport_gpiod_ops.read_edge(&pico.gpio, pico.line, edge_ns) < 0) {
+        fprintf(stderr, "spi_bench: no transfer edge for %d ms, is SPI_test running?\n", EDGE_TIMEOUT_MS);
+        return -1;
+    }
+    if (pico.delay_us > 0) {
+        usleep(pico.delay_us);
+    }
+    return 0;
+}
+
+/*
+    Description:
+        Clock one burst of unknown length at the setup rate: the header first, then
+    as many words as it announces (or the longest burst when it is unreadable),
+    asking for cfg all along
+
+    Return:
+        int - 1 if the burst was already in cfg, 0 if not, -1 on error
+*/
+static int setup_burst(const bench_config_t *cfg) {
+    uint64_t edge_ns;
+    if (wait_edge(&edge_ns) < 0) {
+        return -1;
+    }
+    bench_command(pico.tx, BENCH_MAX_WORDS, cfg->words, cfg->pattern, pico.gap_us);
+    if (transfer(pico.tx, pico.rx, BENCH_HEADER_WORDS, SETUP_HZ) < 0) {
+        return -1;
+    }
+    const bench_header_t *h = (const bench_header_t *)pico.rx;
+    int ok = bench_header_ok(h);
+    size_t words = ok ? h->words : BENCH_MAX_WORDS;
+    int in_cfg = ok && h->words == cfg->words && h->pattern == cfg->pattern;
+    if (transfer(pico.tx + BENCH_HEADER_WORDS, pico.rx + BENCH_HEADER_WORDS, words - BENCH_HEADER_WORDS, SETUP_HZ) < 0) {
+        return -1;
+    }
+    return in_cfg;
+}
+
+static int compare_u32(const void *a, const void *b) {
+    uint32_t x = *(const uint32_t *)a, y = *(const uint32_t *)b;
+    return (x > y) - (x < y);
+}
+
+// q-quantile of count values, sorts them
+static uint32_t quantile(uint32_t *values, unsigned long count, double q) {
+    if (count == 0) {
+        return 0;
+    }
+    qsort(values, count, sizeof(uint32_t), compare_u32);
+    unsigned long at = (unsigned long)(q * (count - 1) + 0.5);
+    return values[at];
+}
+
+static double mean(const uint32_t *values, unsigned long count) {
+    double sum = 0;
+    for (unsigned long i = 0; i < count; i++) {
+        sum += values[i];
+    }
+    return count ? sum / count : 0;
+}
+
+/*
+    Description:
+        Set the pico up for one combination and clock its bursts
+
+    Parameter:
+        bench_result_t *r - cfg filled in, the rest is filled here
+        unsigned bursts   - bursts to clock
+
+    Return:
+        int - 0 on success, -1 if the pico stopped answering or never took the setup
+*/
+static int run_config(bench_result_t *r, unsigned bursts) {
+    const bench_config_t *cfg = &r->cfg;
+    int in_cfg = 0;
+    for (int attempt = 0; attempt < SETUP_ATTEMPTS && !in_cfg; attempt++) {
+        in_cfg = setup_burst(cfg);
+        if (in_cfg < 0) {
+            return -1;
+        }
+    }
+    // the burst after the one in cfg was asked for with it too, the setup holds
+    if (!in_cfg) {
+        fprintf(stderr, "spi_bench: the pico did not take %u words of %s\n", cfg->words,
+                bench_pattern_names[cfg->pattern]);
+        return -1;
+    }
+
+    size_t words = cfg->words, payload = words - BENCH_HEADER_WORDS;
+    bench_command(pico.tx, words, cfg->words, cfg->pattern, pico.gap_us);
+    uint32_t next_sequence = 0;
+    uint16_t first_timeouts = 0, last_timeouts = 0;
+    uint64_t last_edge_ns = 0, last_end_ns = monotonic_ns();
+
+    for (unsigned b = 0; b < bursts; b++) {
+        uint64_t edge_ns;
+        if (wait_edge(&edge_ns) < 0) {
+            return -1;
+        }
+        uint64_t t0 = monotonic_ns();
+        if (transfer(pico.tx, pico.rx, words, cfg->clock_hz) < 0) {
+            return -1;
+        }
+        uint64_t t1 = monotonic_ns();
+
+        if (b == 0) {
+            r->start_ns = edge_ns;
+        } else {
+            r->period_us[r->periods++] = (uint32_t)((edge_ns - last_edge_ns) / 1000);
+        }
+        r->gap_us[r->gaps++] = edge_ns > last_end_ns ? (uint32_t)((edge_ns - last_end_ns) / 1000) : 0;
+        r->latency_us[r->latencies++] = t0 > edge_ns ? (uint32_t)((t0 - edge_ns) / 1000) : 0;
+        last_edge_ns = edge_ns;
+        last_end_ns = t1;
+        r->end_ns = t1;
+        r->read_ns += t1 - t0;
+        r->clocked_bytes += words * sizeof(uint16_t);
+        r->bursts++;
+
+        // a corrupted header still has a payload to compare, at the sequence expected
+        const bench_header_t *h = (const bench_header_t *)pico.rx;
+        uint32_t sequence = next_sequence;
+        if (bench_header_ok(h) && h->words == cfg->words && h->pattern == cfg->pattern) {
+            if (b > 0 && h->sequence > next_sequence) {
+                r->lost += h->sequence - next_sequence;
+            }
+            sequence = h->sequence;
+            if (b == 0) {
+                first_timeouts = h->timeouts;
+            }
+            last_timeouts = h->timeouts;
+            r->prep_us += h->prep_us;
+        } else {
+            r->bad_headers++;
+        }
+        next_sequence = sequence + 1;
+
+        bench_fill(pico.expected, payload, cfg->pattern, sequence);
+        uint64_t bit_errors = link_cal_bit_errors(pico.rx + BENCH_HEADER_WORDS, pico.expected, payload,
+                                                  &r->word_errors);
+        r->bits += payload * 16;
+        r->bit_errors += bit_errors;
+        if (bit_errors == 0) {
+            r->good_bytes += payload * sizeof(uint16_t);
+        }
+    }
+    r->pico_timeouts = (uint16_t)(last_timeouts - first_timeouts);
+    return 0;
+}
+
+static void print_result(const bench_result_t *r, FILE *csv) {
+    double run_s = (r->end_ns - r->start_ns) / 1e9;
+    double link_mbs = r->read_ns ? r->clocked_bytes * 1e3 / r->read_ns : 0;
+    double effective_mbs = run_s > 0 ? r->good_bytes / run_s / 1e6 : 0;
+    double efficiency = effective_mbs / (r->cfg.clock_hz / 8e6);
+    double ber = r->bits ? (double)r->bit_errors / r->bits : 0;
+    double ber_bound = r->bits ? (r->bit_errors ? ber : 3.0 / r->bits) : 0;
+    double gap_mean = mean(r->gap_us, r->gaps), period_mean = mean(r->period_us, r->periods);
+    double prep_mean = r->bursts > r->bad_headers ? (double)r->prep_us / (r->bursts - r->bad_headers) : 0;
+    uint32_t gap_p50 = quantile(r->gap_us, r->gaps, 0.5), gap_p99 = quantile(r->gap_us, r->gaps, 0.99);
+    uint32_t gap_max = quantile(r->gap_us, r->gaps, 1.0);
+    uint32_t lat_p50 = quantile(r->latency_us, r->latencies, 0.5), lat_p99 = quantile(r->latency_us, r->latencies, 0.99);
+
+    printf("%-8s %6u %7.3f %6lu %5lu %5lu %5lu %9.2e %8lu %7.3f %7.3f %5.1f%% %8.0f %6u %6u %7u %8.0f %6u/%-6u %6.0f\n",
+           bench_pattern_names[r->cfg.pattern], r->cfg.words, r->cfg.clock_hz / 1e6, r->bursts, r->lost,
+           r->bad_headers, r->pico_timeouts, r->bit_errors ? ber : ber_bound, (unsigned long)r->bit_errors,
+           link_mbs, effective_mbs, efficiency * 100, gap_mean, gap_p50, gap_p99, gap_max, period_mean,
+           lat_p50, lat_p99, prep_mean);
+    fflush(stdout);
+
+    if (csv) {
+        fprintf(csv, "%s,%u,%u,%lu,%lu,%lu,%lu,%lu,%lu,%lu,%.3e,%.3e,%.4f,%.4f,%.4f,%.1f,%u,%u,%u,%.1f,%u,%u,%.1f\n",
+                bench_pattern_names[r->cfg.pattern], r->cfg.words, r->cfg.clock_hz, r->bursts, r->lost,
+                r->bad_headers, r->pico_timeouts, (unsigned long)r->bits, (unsigned long)r->bit_errors,
+                (unsigned long)r->word_errors, ber, ber_bound, link_mbs, effective_mbs, efficiency,
+                gap_mean, gap_p50, gap_p99, gap_max, period_mean, lat_p50, lat_p99, prep_mean);
+        fflush(csv);
+    }
+}
+
+// Split a comma-separated list, at most MAX_LIST entries: count
+static int parse_list(char *text, char **items) {
+    int count = 0;
+    for (char *item = strtok(text, ","); item != NULL && count < MAX_LIST; item = strtok(NULL, ",")) {
+        items[count++] = item;
+    }
+    return count;
+}
+
+int main(int argc, char **argv) {
+    const char *device = "/dev/spidev0.0", *chip = GPIO_CHIP, *output = NULL;
+    char clocks_arg[256] = "5", words_arg[256] = "12538", patterns_arg[256] = "counter,prbs,random";
+    unsigned gpio = 22, bursts = 100;
+    pico.delay_us = TRANSFER_DELAY_US;
+    pico.gap_us = 1000;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "d:g:c:k:w:p:n:G:D:o:")) != -1) {
+        switch (opt) {
+        case 'd': device = optarg; break;
+        case 'g': gpio = (unsigned)atoi(optarg); break;
+        case 'c': chip = optarg; break;
+        case 'k': snprintf(clocks_arg, sizeof(clocks_arg), "%s", optarg); break;
+        case 'w': snprintf(words_arg, sizeof(words_arg), "%s", optarg); break;
+        case 'p': snprintf(patterns_arg, sizeof(patterns_arg), "%s", optarg); break;
+        case 'n': bursts = (unsigned)atoi(optarg); break;
+        case 'G': pico.gap_us = (uint32_t)strtoul(optarg, NULL, 0); break;
+        case 'D': pico.delay_us = (unsigned)atoi(optarg); break;
+        case 'o': output = optarg; break;
+        default:
+            fprintf(stderr, "usage: %s [-d spidev] [-g gpio] [-c gpiochip] [-k MHz,...] [-w words,...]"
+                            " [-p counter,prbs,random] [-n bursts] [-G gap us] [-D delay us] [-o results.csv]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    // the combinations, checked before the pico is touched
+    char *items[MAX_LIST];
+    uint32_t clocks[MAX_LIST];
+    unsigned lengths[MAX_LIST], patterns[MAX_LIST];
+    int n_clocks = parse_list(clocks_arg, items);
+    for (int i = 0; i < n_clocks; i++) {
+        double mhz = atof(items[i]);
+        if (mhz <= 0 || mhz > 100) {
+            fprintf(stderr, "spi_bench: clock %s MHz out of range\n", items[i]);
+            return 1;
+        }
+        clocks[i] = (uint32_t)(mhz * 1e6 + 0.5);
+    }
+    int n_lengths = parse_list(words_arg, items);
+    for (int i = 0; i < n_lengths; i++) {
+        lengths[i] = (unsigned)atoi(items[i]);
+        if (lengths[i] < BENCH_MIN_WORDS || lengths[i] > BENCH_MAX_WORDS) {
+            fprintf(stderr, "spi_bench: bursts are %d to %d words\n", BENCH_MIN_WORDS, BENCH_MAX_WORDS);
+            return 1;
+        }
+    }
+    int n_patterns = parse_list(patterns_arg, items);
+    for (int i = 0; i < n_patterns; i++) {
+        patterns[i] = BENCH_PATTERNS;
+        for (unsigned p = 0; p < BENCH_PATTERNS; p++) {
+            if (!strcmp(items[i], bench_pattern_names[p])) {
+                patterns[i] = p;
+            }
+        }
+        if (patterns[i] == BENCH_PATTERNS) {
+            fprintf(stderr, "spi_bench: unknown pattern %s\n", items[i]);
+            return 1;
+        }
+    }
+    if (n_clocks == 0 || n_lengths == 0 || n_patterns == 0 || bursts == 0) {
+        fprintf(stderr, "spi_bench: nothing to run\n");
+        return 1;
+    }
+
+    FILE *csv = NULL;
+    if (output != NULL) {
+        csv = fopen(output, "w");
+        if (csv == NULL) {
+            perror("Error opening the results file");
+            return 1;
+        }
+        fprintf(csv, "pattern,words,clock_hz,bursts,lost,bad_headers,pico_timeouts,bits,bit_errors,word_errors,"
+                     "ber,ber_upper95,link_mbs,effective_mbs,efficiency,gap_us_mean,gap_us_p50,gap_us_p99,gap_us_max,"
+                     "period_us_mean,latency_us_p50,latency_us_p99,prep_us_mean\n");
+    }
+
+    if (transport_gpiod_open(&pico.gpio, chip) < 0) {
+        return 1;
+    }
+    pico.spi = spi_open_device(device, SETUP_HZ);
+    pico.line = transport_gpiod_ops.open_edges(&pico.gpio, gpio, "spi_bench", &pico.event_fd);
+    if (pico.spi < 0 || pico.line < 0) {
+        return 1;
+    }
+
+    bench_result_t r;
+    r.gap_us = malloc(bursts * sizeof(uint32_t));
+    r.period_us = malloc(bursts * sizeof(uint32_t));
+    r.latency_us = malloc(bursts * sizeof(uint32_t));
+    if (!r.gap_us || !r.period_us || !r.latency_us) {
+        perror("Error allocating");
+        return 1;
+    }
+
+    printf("spi_bench %s: %u bursts per combination, pico gap %u us, edge delay %u us, bufsiz %zu\n",
+           device, bursts, pico.gap_us, pico.delay_us, spi_bufsiz);
+    printf("%-8s %6s %7s %6s %5s %5s %5s %9s %8s %7s %7s %6s %8s %6s %6s %7s %8s %13s %6s\n",
+           "pattern", "words", "MHz", "bursts", "lost", "bad", "tmo", "BER", "bit err", "link", "eff", "eff",
+           "gap", "p50", "p99", "max", "period", "latency", "prep");
+    printf("%-8s %6s %7s %6s %5s %5s %5s %9s %8s %7s %7s %6s %8s %6s %6s %7s %8s %13s %6s\n",
+           "", "", "", "", "", "", "", "(<95%)", "", "MB/s", "MB/s", "clock", "us", "us", "us", "us", "us",
+           "p50/p99 us", "us");
+
+    int status = 0;
+    for (int p = 0; p < n_patterns && status == 0; p++) {
+        for (int w = 0; w < n_lengths && status == 0; w++) {
+            for (int k = 0; k < n_clocks && status == 0; k++) {
+                uint32_t *gap = r.gap_us, *period = r.period_us, *latency = r.latency_us;
+                memset(&r, 0, sizeof(r));
+                r.gap_us = gap;
+                r.period_us = period;
+                r.latency_us = latency;
+                r.cfg.pattern = patterns[p];
+                r.cfg.words = lengths[w];
+                r.cfg.clock_hz = clocks[k];
+                status = run_config(&r, bursts);
+                if (status == 0) {
+                    print_result(&r, csv);
+                }
+            }
+        }
+    }
+
+    if (csv) {
+        fclose(csv);
+    }
+    transport_gpiod_ops.close_line(&pico.gpio, pico.line);
+    close(pico.spi);
+    transport_gpiod_close(&pico.gpio);
+    return status == 0 ? 0 : 1;
+}
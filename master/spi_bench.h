@@ -0,0 +1,126 @@
+/*
+    About:
+        Burst format of the SPI link benchmark (spi_bench.c), keep in sync with
+    src/SPI_test/spi_bench.h.
+
+        Every burst starts with an 8-word header, then words - 8 payload words of a
+    pattern the receiver generates again from the header:
+        BENCH_PATTERN_COUNTER   word i is sequence + i, a slipped word shows at once
+        BENCH_PATTERN_PRBS      PRBS-15 from the same seed every burst (link_cal.h)
+        BENCH_PATTERN_RANDOM    xorshift32 seeded from the sequence, new data every burst
+
+        What the receiver clocks out on MOSI sets up the pico's next burst: the
+    command [BENCH_SET, words, pattern, gap_us low, gap_us high, 0, 0, check] over
+    and over, word j of the burst being command word j % BENCH_COMMAND_WORDS. The
+    pico's ring holds the last ones in that order, whatever the burst length. The
+    check of header and command is ~(sum of the 7 words before it).
+*/
+
+#ifndef SPI_BENCH_H
+#define SPI_BENCH_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "link_cal.h"
+
+#define BENCH_MAGIC             0xB3C4
+#define BENCH_SET               0x5345
+#define BENCH_HEADER_WORDS      8
+#define BENCH_COMMAND_WORDS     8
+#define BENCH_MIN_WORDS         (BENCH_HEADER_WORDS + BENCH_COMMAND_WORDS)
+#define BENCH_MAX_WORDS         32768
+
+#define BENCH_PATTERN_COUNTER   0
+#define BENCH_PATTERN_PRBS      1
+#define BENCH_PATTERN_RANDOM    2
+#define BENCH_PATTERNS          3
+
+typedef struct {
+    uint16_t magic;             // BENCH_MAGIC
+    uint16_t pattern;           // BENCH_PATTERN_*
+    uint16_t words;             // whole burst, header included
+    uint16_t timeouts;          // bursts since boot the receiver never clocked, wraps
+    uint32_t sequence;          // bursts since boot
+    uint16_t prep_us;           // time the pico took to generate this burst
+    uint16_t check;             // ~(sum of the words above)
+} bench_header_t;
+
+_Static_assert(sizeof(bench_header_t) == BENCH_HEADER_WORDS * sizeof(uint16_t), "bench header layout");
+
+static const char *const bench_pattern_names[BENCH_PATTERNS] = { "counter", "prbs", "random" };
+
+// ~(sum of count words), the check word of a header or command
+static inline uint16_t bench_check(const uint16_t *words, size_t count) {
+    uint16_t sum = 0;
+    for (size_t i = 0; i < count; i++) {
+        sum += words[i];
+    }
+    return (uint16_t)~sum;
+}
+
+/*
+    Description:
+        Generate the payload the pico sent in one burst
+
+    Parameter:
+        uint16_t *payload - count words
+        size_t count      - payload words, the burst's words - BENCH_HEADER_WORDS
+        unsigned pattern  - BENCH_PATTERN_*
+        uint32_t sequence - of the burst
+*/
+static inline void bench_fill(uint16_t *payload, size_t count, unsigned pattern, uint32_t sequence) {
+    if (pattern == BENCH_PATTERN_COUNTER) {
+        for (size_t i = 0; i < count; i++) {
+            payload[i] = (uint16_t)(sequence + i);
+        }
+    } else if (pattern == BENCH_PATTERN_PRBS) {
+        link_cal_prbs(payload, count);
+    } else {
+        uint32_t state = sequence * 2654435761u + 0x6d2b79f5u;
+        if (state == 0) {
+            state = 1;
+        }
+        for (size_t i = 0; i < count; i++) {
+            state ^= state << 13;
+            state ^= state >> 17;
+            state ^= state << 5;
+            payload[i] = (uint16_t)(state >> 16);
+        }
+    }
+}
+
+/*
+    Description:
+        Lay out a setup command over a whole MOSI buffer, word j is command word
+    j % BENCH_COMMAND_WORDS
+
+    Parameter:
+        uint16_t *tx      - MOSI words
+        size_t count      - how many
+        unsigned words    - burst length to ask for
+        unsigned pattern  - BENCH_PATTERN_*
+        uint32_t gap_us   - from the end of a burst to the next pulse
+*/
+static inline void bench_command(uint16_t *tx, size_t count, unsigned words, unsigned pattern, uint32_t gap_us) {
+    uint16_t command[BENCH_COMMAND_WORDS] = {
+        BENCH_SET, (uint16_t)words, (uint16_t)pattern, (uint16_t)gap_us, (uint16_t)(gap_us >> 16), 0, 0, 0
+    };
+    command[BENCH_COMMAND_WORDS - 1] = bench_check(command, BENCH_COMMAND_WORDS - 1);
+    for (size_t j = 0; j < count; j++) {
+        tx[j] = command[j % BENCH_COMMAND_WORDS];
+    }
+}
+
+/*
+    Description:
+        Whether a header arrived intact
+
+    Return:
+        int - 1 if magic, check, pattern and length are plausible
+*/
+static inline int bench_header_ok(const bench_header_t *h) {
+    return h->magic == BENCH_MAGIC && h->check == bench_check((const uint16_t *)h, BENCH_HEADER_WORDS - 1)
+        && h->pattern < BENCH_PATTERNS && h->words >= BENCH_MIN_WORDS && h->words <= BENCH_MAX_WORDS;
+}
+
+#endif
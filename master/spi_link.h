@@ -0,0 +1,131 @@
+/*
+    About:
+        spidev helpers for the receiver. Devices are opened and configured once at
+    startup, bursts are then read with as few ioctls as the spidev buffer allows.
+
+        spidev rejects any message whose total length is larger than its bufsiz
+    module parameter (4096 bytes by default), so a 12500-word burst takes 7 ioctls.
+    Raising it on the kernel command line, e.g. spidev.bufsiz=65536, brings that
+    down to one ioctl per burst.
+
+        The link runs in SPI mode 3 (CPOL 1, CPHA 1). With CPHA 1 the RP2040 slave
+    keeps shifting words while chip select stays low, so a whole chunk can be
+    clocked in one go. Mode 0 would need chip select to toggle after every word.
+*/
+
+#ifndef SPI_LINK_H
+#define SPI_LINK_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <linux/spi/spidev.h>
+
+#define SPI_LINK_MODE           SPI_MODE_3
+#define SPI_LINK_BITS           16
+#define SPI_BUFSIZ_PARAM        "/sys/module/spidev/parameters/bufsiz"
+#define SPI_BUFSIZ_DEFAULT      4096
+
+// largest message spidev accepts, read once at startup
+static size_t spi_bufsiz = SPI_BUFSIZ_DEFAULT;
+
+/*
+    Description:
+        Read the spidev bufsiz module parameter, keeps the default if unavailable
+
+    Return:
+        size_t - maximum bytes per SPI_IOC_MESSAGE
+*/
+static inline size_t spi_read_bufsiz(void) {
+    FILE *f = fopen(SPI_BUFSIZ_PARAM, "r");
+    if (f != NULL) {
+        unsigned long value;
+        if (fscanf(f, "%lu", &value) == 1 && value >= 2) {
+            spi_bufsiz = value;
+        }
+        fclose(f);
+    }
+    return spi_bufsiz;
+}
+
+/*
+    Description:
+        Open a spidev device and configure mode, word size and clock once
+
+    Parameter:
+        const char *device - e.g. "/dev/spidev0.0"
+        uint32_t speed     - clock frequency in Hz
+
+    Return:
+        int - file descriptor, -1 on error
+*/
+static inline int spi_open_device(const char *device, uint32_t speed) {
+    int spi_fd = open(device, O_RDWR);
+    if (spi_fd < 0) {
+        perror("Error opening SPI device");
+        return -1;
+    }
+
+    uint8_t mode = SPI_LINK_MODE;
+    uint8_t bits = SPI_LINK_BITS;
+    if (ioctl(spi_fd, SPI_IOC_WR_MODE, &mode) < 0) {
+        perror("Error setting SPI mode");
+        close(spi_fd);
+        return -1;
+    }
+    if (ioctl(spi_fd, SPI_IOC_WR_BITS_PER_WORD, &bits) < 0) {
+        perror("Error setting SPI word size");
+        close(spi_fd);
+        return -1;
+    }
+    if (ioctl(spi_fd, SPI_IOC_WR_MAX_SPEED_HZ, &speed) < 0) {
+        perror("Error setting SPI clock speed");
+        close(spi_fd);
+        return -1;
+    }
+
+    return spi_fd;
+}
+
+/*
+    Description:
+        Clock in a burst of 16-bit words in bufsiz-sized chunks
+
+    Parameter:
+        int spi_fd       - configured spidev descriptor
+        uint16_t *rx     - destination, at least words long
+        size_t words     - number of 16-bit words to read
+        uint32_t speed   - clock frequency in Hz
+        unsigned *ioctls - incremented by the number of ioctls issued, may be NULL
+
+    Return:
+        int - 0 on success, -1 on error
+*/
+static inline int spi_read_burst(int spi_fd, uint16_t *rx, size_t words, uint32_t speed, unsigned *ioctls) {
+    size_t chunk_words = spi_bufsiz / sizeof(uint16_t);
+
+    for (size_t offset = 0; offset < words; offset += chunk_words) {
+        size_t n = words - offset < chunk_words ? words - offset : chunk_words;
+        struct spi_ioc_transfer transfer;
+        memset(&transfer, 0, sizeof(transfer));
+        transfer.rx_buf = (unsigned long)&rx[offset];
+        transfer.len = n * sizeof(uint16_t);
+        transfer.speed_hz = speed;
+        transfer.bits_per_word = SPI_LINK_BITS;
+
+        if (ioctls) {
+            (*ioctls)++;
+        }
+        if (ioctl(spi_fd, SPI_IOC_MESSAGE(1), &transfer) < 0) {
+            perror("Error receiving SPI data");
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+#endif
@@ -0,0 +1,137 @@
+/*
+    About:
+        Trigger-path telemetry of the picos, keep the block layout in sync with
+    src/adc_A/telemetry.h. adc_A sends a block after the payload of every
+    TELEMETRY_EVERY-th frame (FRAME_FLAG_TELEMETRY), adc_trap at the end of a stream
+    record (TRAP_STREAM_TELEMETRY). SPI_isr stores each block as a segment record of
+    its own, pseg_dump and trap_decode print them.
+
+        Every histogram has power-of-two buckets: bucket 0 holds 0, bucket b holds
+    [2^(b-1), 2^b), the last one everything larger. The values are system clocks, or
+    microseconds for the histograms in us_mask. Counts, sums and buckets run from
+    the pico's boot, the difference of two blocks covers the time between them; max
+    covers the time since the previous block only.
+*/
+
+#ifndef TELEMETRY_H
+#define TELEMETRY_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+
+#define TELEMETRY_MAGIC         0x4D54      // "TM"
+#define TELEMETRY_VERSION       1
+#define TELEMETRY_BUCKETS       20          // the last one starts at 2^18
+
+// histograms
+#define TELEMETRY_TRIGGER_LATENCY   0       // trigger edge to the ISR callback, cycles
+#define TELEMETRY_ISR_DURATION      1       // capture ISR callback, entry to exit, cycles
+#define TELEMETRY_TRIGGER_INTERVAL  2       // rising edge to rising edge, cycles
+#define TELEMETRY_TRIGGER_JITTER    3       // change of that interval from the previous one, cycles
+#define TELEMETRY_HANDSHAKE         4       // token edge to capture armed, us
+#define TELEMETRY_TRANSFER          5       // transfer queued to its last word out, us
+#define TELEMETRY_HISTOGRAMS        6
+
+typedef struct {
+    uint32_t count;                         // values since boot
+    uint32_t max;                           // largest since the previous block
+    uint64_t sum;                           // since boot, the mean is sum / count
+    uint32_t bucket[TELEMETRY_BUCKETS];
+} telemetry_hist_t;
+
+typedef struct {
+    uint16_t magic;                         // TELEMETRY_MAGIC
+    uint16_t version;                       // TELEMETRY_VERSION
+    uint16_t words;                         // size of the block in 16-bit words
+    uint16_t histograms;                    // TELEMETRY_HISTOGRAMS
+    uint32_t cycle_hz;                      // system clock, the unit of the cycle histograms
+    uint32_t us_mask;                       // bit n: histogram n counts microseconds
+    uint32_t sequence;                      // blocks sent since boot
+    uint32_t latency_missed;                // trigger ISRs that found no latched edge
+    telemetry_hist_t hist[TELEMETRY_HISTOGRAMS];
+} telemetry_block_t;
+
+#define TELEMETRY_WORDS (sizeof(telemetry_block_t) / sizeof(uint16_t))
+
+_Static_assert(sizeof(telemetry_hist_t) == 96, "telemetry histogram layout");
+_Static_assert(sizeof(telemetry_block_t) == 24 + TELEMETRY_HISTOGRAMS * 96, "telemetry block layout");
+
+static const char *const telemetry_names[TELEMETRY_HISTOGRAMS] = {
+    "trigger latency", "ISR duration", "trigger interval", "trigger jitter", "handshake", "transfer"
+};
+
+/*
+    Description:
+        Copy a block out of a frame or record and check it
+
+    Parameter:
+        telemetry_block_t *block - copy out, aligned
+        const void *data         - the block as received, any alignment
+        size_t bytes             - its length
+
+    Return:
+        int - 0 if it is a block this build reads, -1 otherwise
+*/
+static inline int telemetry_load(telemetry_block_t *block, const void *data, size_t bytes) {
+    if (bytes != sizeof(*block)) {
+        return -1;
+    }
+    memcpy(block, data, sizeof(*block));
+    if (block->magic != TELEMETRY_MAGIC || block->version != TELEMETRY_VERSION
+        || block->words != TELEMETRY_WORDS || block->histograms != TELEMETRY_HISTOGRAMS || block->cycle_hz == 0) {
+        return -1;
+    }
+    return 0;
+}
+
+// Nanoseconds (or microseconds, see us_mask) per histogram unit
+static inline double telemetry_scale(const telemetry_block_t *block, unsigned k) {
+    return (block->us_mask >> k & 1) ? 1.0 : 1e9 / block->cycle_hz;
+}
+
+/*
+    Description:
+        Upper end of the bucket holding the q-quantile, in the histogram's unit. The
+    buckets are powers of two, so this is within a factor of two from above.
+*/
+static inline uint32_t telemetry_quantile(const telemetry_hist_t *h, double q) {
+    uint64_t target = (uint64_t)(h->count * q), seen = 0;
+    for (unsigned b = 0; b < TELEMETRY_BUCKETS; b++) {
+        seen += h->bucket[b];
+        if (seen > target) {
+            uint32_t top = b ? (1u << b) - 1 : 0;
+            return b == TELEMETRY_BUCKETS - 1 || top > h->max ? h->max : top;
+        }
+    }
+    return h->max;
+}
+
+/*
+    Description:
+        One line per histogram that has values: count, mean, p50, p99 and max, cycles
+    shown in ns
+
+    Parameter:
+        FILE *out                       - where to print
+        const char *name                - pico name, starts every line
+        const telemetry_block_t *block  - checked block
+*/
+static inline void telemetry_print(FILE *out, const char *name, const telemetry_block_t *block) {
+    for (unsigned k = 0; k < TELEMETRY_HISTOGRAMS; k++) {
+        const telemetry_hist_t *h = &block->hist[k];
+        if (h->count == 0) {
+            continue;
+        }
+        double scale = telemetry_scale(block, k);
+        fprintf(out, "Pico %s: %-16s %10u values, mean %8.0f, p50 <= %8.0f, p99 <= %8.0f, max %8.0f %s\n",
+                name, telemetry_names[k], h->count, (double)h->sum / h->count * scale,
+                telemetry_quantile(h, 0.5) * scale, telemetry_quantile(h, 0.99) * scale, h->max * scale,
+                (block->us_mask >> k & 1) ? "us" : "ns");
+    }
+    if (block->latency_missed > 0) {
+        fprintf(out, "Pico %s: %u trigger ISRs without a latched edge\n", name, block->latency_missed);
+    }
+}
+
+#endif
@@ -0,0 +1,130 @@
+/*
+    About:
+        Compact per-sample timestamps of the picos, keep in sync with src/adc_A/time_delta.h.
+
+        Instead of a uint32_t microsecond time per sample, every sample gets the time
+    since the previous one as an 8-bit (or 16-bit) delta. A delta that does not fit
+    is stored as TIME_DELTA_ESCAPE and the full time goes to the next slot of a small
+    escape table. The first delta is relative to the time the capture was armed.
+    Writing a sample costs the same few instructions either way, so it is fine in
+    the trigger ISR. With 8-bit deltas a sample and its time take 3 bytes instead of
+    6, twice the samples in the same RAM.
+
+        Times after the escape table has filled up cannot be rebuilt, the decoder
+    reports how many samples that affects.
+*/
+
+#ifndef TIME_DELTA_H
+#define TIME_DELTA_H
+
+#include <stdint.h>
+
+#ifndef TIME_DELTA_BITS
+#define TIME_DELTA_BITS 8           // 8: gaps up to 254 us stay inline, 16: up to 65534 us
+#endif
+#ifndef TIME_DELTA_ESCAPES
+#define TIME_DELTA_ESCAPES 1024     // long gaps per capture that keep their exact time
+#endif
+
+#if TIME_DELTA_BITS == 8
+typedef uint8_t time_delta_t;
+#elif TIME_DELTA_BITS == 16
+typedef uint16_t time_delta_t;
+#else
+#error TIME_DELTA_BITS must be 8 or 16
+#endif
+
+#define TIME_DELTA_ESCAPE ((time_delta_t)~0u)
+
+typedef struct {
+    uint32_t base;                  // time the capture was armed, the first delta counts from here
+    uint32_t last;                  // time of the previous sample
+    uint32_t escape_count;          // long gaps seen, more than TIME_DELTA_ESCAPES means times were lost
+    uint32_t escapes[TIME_DELTA_ESCAPES];
+} time_delta_log_t;
+
+/*
+    Description:
+        Start a new capture
+
+    Parameter:
+        time_delta_log_t *log - escape table of the capture
+        uint32_t now          - arm time in microseconds
+*/
+static inline void time_delta_reset(volatile time_delta_log_t *log, uint32_t now) {
+    log->base = now;
+    log->last = now;
+    log->escape_count = 0;
+}
+
+/*
+    Description:
+        Record the time of one sample, constant cost
+
+    Parameter:
+        time_delta_log_t *log - escape table of the capture
+        time_delta_t *deltas  - delta array of the capture
+        uint32_t index        - sample index
+        uint32_t now          - sample time in microseconds
+*/
+static inline void time_delta_put(volatile time_delta_log_t *log, volatile time_delta_t *deltas, uint32_t index, uint32_t now) {
+    uint32_t delta = now - log->last;
+    log->last = now;
+    if (delta < TIME_DELTA_ESCAPE) {
+        deltas[index] = (time_delta_t)delta;
+        return;
+    }
+    deltas[index] = TIME_DELTA_ESCAPE;
+    if (log->escape_count < TIME_DELTA_ESCAPES) {
+        log->escapes[log->escape_count] = now;
+    }
+    log->escape_count++;
+}
+
+/*
+    Description:
+        Rebuild absolute times, either width
+
+    Parameter:
+        const void *deltas       - count deltas of bits width
+        unsigned bits            - 8 or 16
+        uint32_t count           - number of samples
+        uint32_t base            - arm time of the capture
+        const uint32_t *escapes  - escape table
+        uint32_t escapes_kept    - valid escape entries
+        uint32_t *times          - count times out, UINT32_MAX where unknown
+
+    Return:
+        uint32_t - number of samples whose time could not be rebuilt
+*/
+static inline uint32_t time_delta_decode(const void *deltas, unsigned bits, uint32_t count, uint32_t base,
+                                         const uint32_t *escapes, uint32_t escapes_kept, uint32_t *times) {
+    const uint8_t *d8 = (const uint8_t *)deltas;
+    const uint16_t *d16 = (const uint16_t *)deltas;
+    uint32_t escape = bits == 8 ? 0xffu : 0xffffu;
+    uint32_t t = base;
+    uint32_t next_escape = 0;
+    uint32_t unknown = 0;
+
+    for (uint32_t i = 0; i < count; i++) {
+        uint32_t delta = bits == 8 ? d8[i] : d16[i];
+        if (delta == escape) {
+            if (next_escape < escapes_kept) {
+                t = escapes[next_escape++];
+            } else {
+                // table overflowed on the pico, the rest of the capture has no reference
+                for (; i < count; i++) {
+                    times[i] = UINT32_MAX;
+                    unknown++;
+                }
+                break;
+            }
+        } else {
+            t += delta;
+        }
+        times[i] = t;
+    }
+    return unknown;
+}
+
+#endif
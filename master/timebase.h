@@ -0,0 +1,238 @@
+/*
+    About:
+        Shared timebase of the picos and the receiver. A common sync pulse goes to
+    every pico (SYNC_PIN, GPIO 13) and to one receiver GPIO. Each pico latches the
+    time_us_64() of every rising edge and sends the latest latch and its count in
+    each frame header, the receiver keeps the CLOCK_MONOTONIC kernel timestamps of
+    the same edges. Pairs of (pico latch, receiver edge) give a least-squares line
+    per pico, pico time to receiver time, which takes out the offset and the drift
+    of each pico's crystal. Every sample then gets a receiver time:
+
+        sample i of a run = map(run_start_us + first_sample_ns + (run_offset + i) * sample_period_ps)
+
+        Matching a latch to its edge needs a rough idea of the offset first: the
+    frame's transfer_us against the TRANSFER_PIN edge the reader saw, good to a few
+    tens of microseconds, much less than the sync period. Once the line has two
+    points it predicts the edge itself. A latch only counts when the nearest edge is
+    within SYNC_MATCH_NS of the prediction.
+        The pico latches in an IRQ with microsecond resolution, the residual of the fit
+    is the honest alignment error and is reported with every record. Runs started
+    on a sync edge (FRAME_FLAG_SYNC_START) use the receiver's timestamp of that edge
+    directly, the pico latch only picks which edge it was.
+
+        The edge ring is written by the thread reading the GPIO events and read by the
+    writer thread, one of each. Edges are kept for SYNC_EDGE_RING periods, a burst
+    older than that has no edge to match and keeps the previous fit.
+*/
+
+#ifndef TIMEBASE_H
+#define TIMEBASE_H
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <math.h>
+#include <stdatomic.h>
+
+#define SYNC_EDGE_RING      64          // receiver sync edges kept for matching, power of two
+#define TIMEBASE_PAIRS      16          // latest matched pairs in each fit
+#define SYNC_MATCH_NS       200000      // a latch farther than this from every edge is not matched
+#define TIMEBASE_COARSE_NS  50000       // error of the transfer-edge offset (pulse and IRQ latency)
+
+typedef struct {
+    uint64_t ns[SYNC_EDGE_RING];        // CLOCK_MONOTONIC of each rising edge
+    _Atomic uint32_t head;              // edges seen, the newest is at head - 1
+} sync_edges_t;
+
+typedef struct {
+    // matched pairs, a ring of the latest TIMEBASE_PAIRS
+    uint64_t pico_us[TIMEBASE_PAIRS];
+    uint64_t edge_ns[TIMEBASE_PAIRS];
+    uint32_t pairs;                     // valid entries
+    uint32_t next;                      // slot of the next pair
+    uint32_t last_sync_count;           // latch already matched
+    int64_t coarse_ns;                  // receiver minus pico time from the transfer edge
+    int coarse_valid;
+    // fit, edge_ns = ref_ns + slope * (pico_us - ref_us)
+    uint64_t ref_us;
+    uint64_t ref_ns;
+    double slope;                       // receiver ns per pico us, 1000 for a perfect crystal
+    double rms_ns;                      // residual of the pairs against the fit
+    int valid;                          // at least two pairs
+    // statistics
+    unsigned long matched;              // pairs taken into the fit
+    unsigned long unmatched;            // latches without an edge within SYNC_MATCH_NS
+} timebase_t;
+
+/*
+    Description:
+        Store one receiver sync edge, from the thread reading the GPIO events only
+*/
+static inline void sync_edges_push(sync_edges_t *e, uint64_t ns) {
+    uint32_t head = atomic_load_explicit(&e->head, memory_order_relaxed);
+    e->ns[head % SYNC_EDGE_RING] = ns;
+    atomic_store_explicit(&e->head, head + 1, memory_order_release);
+}
+
+/*
+    Description:
+        Find the receiver edge nearest to a predicted time
+
+    Parameter:
+        sync_edges_t *e    - edge ring
+        int64_t predict_ns - predicted CLOCK_MONOTONIC of the edge
+        uint64_t *edge_ns  - nearest edge out
+
+    Return:
+        int - 1 if an edge within SYNC_MATCH_NS was found, 0 otherwise
+*/
+static inline int sync_edges_nearest(sync_edges_t *e, int64_t predict_ns, uint64_t *edge_ns) {
+    uint32_t head = atomic_load_explicit(&e->head, memory_order_acquire);
+    uint32_t count = head < SYNC_EDGE_RING - 1 ? head : SYNC_EDGE_RING - 1;   // keep clear of the slot being written
+    int64_t best = SYNC_MATCH_NS + 1;
+    for (uint32_t k = 1; k <= count; k++) {
+        uint64_t ns = e->ns[(head - k) % SYNC_EDGE_RING];
+        int64_t distance = llabs((int64_t)ns - predict_ns);
+        if (distance < best) {
+            best = distance;
+            *edge_ns = ns;
+        }
+    }
+    return best <= SYNC_MATCH_NS;
+}
+
+/*
+    Description:
+        Refit the line through the stored pairs
+*/
+static inline void timebase_fit(timebase_t *tb) {
+    if (tb->pairs < 2) {
+        tb->valid = 0;
+        return;
+    }
+    // relative to the newest pair, the sums stay small enough for doubles
+    uint32_t newest = (tb->next + TIMEBASE_PAIRS - 1) % TIMEBASE_PAIRS;
+    tb->ref_us = tb->pico_us[newest];
+    tb->ref_ns = tb->edge_ns[newest];
+
+    double sx = 0, sy = 0, sxx = 0, sxy = 0;
+    for (uint32_t k = 0; k < tb->pairs; k++) {
+        double x = (double)(int64_t)(tb->pico_us[k] - tb->ref_us);
+        double y = (double)(int64_t)(tb->edge_ns[k] - tb->ref_ns);
+        sx += x;
+        sy += y;
+        sxx += x * x;
+        sxy += x * y;
+    }
+    double n = tb->pairs;
+    double det = n * sxx - sx * sx;
+    if (det <= 0) {
+        tb->valid = 0;
+        return;
+    }
+    double slope = (n * sxy - sx * sy) / det;
+    double intercept = (sy - slope * sx) / n;
+
+    double sum2 = 0;
+    for (uint32_t k = 0; k < tb->pairs; k++) {
+        double x = (double)(int64_t)(tb->pico_us[k] - tb->ref_us);
+        double y = (double)(int64_t)(tb->edge_ns[k] - tb->ref_ns);
+        double r = y - (intercept + slope * x);
+        sum2 += r * r;
+    }
+    tb->slope = slope;
+    tb->ref_ns = (uint64_t)((int64_t)tb->ref_ns + llround(intercept));
+    tb->rms_ns = sqrt(sum2 / n);
+    tb->valid = 1;
+}
+
+/*
+    Description:
+        Receiver time of a pico time, through the fit (or the coarse offset before
+    there is one)
+
+    Parameter:
+        const timebase_t *tb - timebase of the pico
+        uint64_t pico_us     - whole microseconds of the pico's time_us_64()
+        double extra_ns      - nanoseconds on top, may be large (a run of samples)
+
+    Return:
+        uint64_t - CLOCK_MONOTONIC nanoseconds, 0 if nothing is known yet
+*/
+static inline uint64_t timebase_map(const timebase_t *tb, uint64_t pico_us, double extra_ns) {
+    if (tb->valid) {
+        double x = (double)(int64_t)(pico_us - tb->ref_us) + extra_ns / 1000.0;
+        return (uint64_t)((int64_t)tb->ref_ns + llround(tb->slope * x));
+    }
+    if (tb->coarse_valid) {
+        return (uint64_t)((int64_t)(pico_us * 1000) + tb->coarse_ns + llround(extra_ns));
+    }
+    return 0;
+}
+
+/*
+    Description:
+        Feed the timing of one frame: the transfer edge sets the coarse offset, a new
+    sync latch is matched to its receiver edge and refits the line
+
+    Parameter:
+        timebase_t *tb         - timebase of the pico
+        sync_edges_t *edges    - receiver sync edges
+        uint64_t transfer_us   - pico time of the transfer edge (frame header)
+        uint64_t capture_ns    - receiver time of the same edge
+        uint32_t sync_count    - pico's latch count (frame header)
+        uint64_t sync_latch_us - pico time of its latest latch (frame header)
+*/
+static inline void timebase_update(timebase_t *tb, sync_edges_t *edges, uint64_t transfer_us, uint64_t capture_ns,
+                                   uint32_t sync_count, uint64_t sync_latch_us) {
+    tb->coarse_ns = (int64_t)capture_ns - (int64_t)(transfer_us * 1000);
+    tb->coarse_valid = 1;
+
+    if (sync_count == 0 || sync_count == tb->last_sync_count) {
+        return;
+    }
+    tb->last_sync_count = sync_count;
+
+    uint64_t edge_ns = 0;
+    int64_t predict_ns = (int64_t)timebase_map(tb, sync_latch_us, 0);
+    if (!sync_edges_nearest(edges, predict_ns, &edge_ns)) {
+        tb->unmatched++;
+        return;
+    }
+    tb->pico_us[tb->next] = sync_latch_us;
+    tb->edge_ns[tb->next] = edge_ns;
+    tb->next = (tb->next + 1) % TIMEBASE_PAIRS;
+    if (tb->pairs < TIMEBASE_PAIRS) {
+        tb->pairs++;
+    }
+    tb->matched++;
+    timebase_fit(tb);
+}
+
+/*
+    Description:
+        Receiver time of the sync edge a pico latched at pico_us
+
+    Return:
+        uint64_t - CLOCK_MONOTONIC nanoseconds of the edge, 0 if none matches
+*/
+static inline uint64_t timebase_edge(const timebase_t *tb, sync_edges_t *edges, uint64_t pico_us) {
+    uint64_t edge_ns = 0;
+    uint64_t predict_ns = timebase_map(tb, pico_us, 0);
+    if (predict_ns == 0 || !sync_edges_nearest(edges, (int64_t)predict_ns, &edge_ns)) {
+        return 0;
+    }
+    return edge_ns;
+}
+
+/*
+    Description:
+        Drift of the pico's clock against the receiver's
+
+    Return:
+        double - parts per million, positive when the pico runs slow
+*/
+static inline double timebase_drift_ppm(const timebase_t *tb) {
+    return tb->valid ? (tb->slope / 1000.0 - 1.0) * 1e6 : 0.0;
+}
+
+#endif
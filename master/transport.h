@@ -0,0 +1,50 @@
+/*
+    About:
+        What the receiver needs from the hardware, behind one table of functions: SPI
+    devices to clock bursts in, GPIO lines with timestamped rising-edge events, and
+    GPIO outputs. SPI_isr.c only talks to a transport_t.
+
+        transport_gpiod.h is the real one (spidev and libgpiod on the Pi),
+    transport_replay.h stands in for the picos on any Linux box (rx_bench.c).
+
+        Handles are small integers owned by the transport. An edge line hands out a
+    file descriptor that becomes readable when an edge is pending, the receiver
+    waits on all of them in one epoll loop and then calls read_edge.
+*/
+
+#ifndef TRANSPORT_H
+#define TRANSPORT_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+typedef struct {
+    const char *name;
+
+    // SPI device, configured once: handle >= 0, -1 on error
+    int (*open_spi)(void *ctx, const char *device, uint32_t speed);
+    // clock in words 16-bit words, ioctls counts the calls it took (may be NULL): 0 or -1
+    int (*read_burst)(void *ctx, int spi, uint16_t *rx, size_t words, uint32_t speed, unsigned *ioctls);
+    void (*close_spi)(void *ctx, int spi);
+
+    // rising-edge events of a GPIO line: handle >= 0 and its pollable descriptor, -1 on error
+    int (*open_edges)(void *ctx, unsigned gpio, const char *consumer, int *event_fd);
+    // consume one pending edge: 0 and its CLOCK_MONOTONIC time, -1 if there was none
+    int (*read_edge)(void *ctx, int line, uint64_t *edge_ns);
+
+    // GPIO output, starts low: handle >= 0, -1 on error
+    int (*open_output)(void *ctx, unsigned gpio, const char *consumer);
+    void (*set_output)(void *ctx, int line, int value);
+
+    void (*close_line)(void *ctx, int line);
+
+    // everything is open and the receiver waits for edges, may be NULL
+    void (*start)(void *ctx);
+} transport_ops_t;
+
+typedef struct {
+    const transport_ops_t *ops;
+    void *ctx;
+} transport_t;
+
+#endif
@@ -0,0 +1,133 @@
+/*
+    About:
+        The receiver's hardware transport (transport.h): spidev devices through
+    spi_link.h and GPIO lines through libgpiod v1. Edge times are the kernel's
+    CLOCK_MONOTONIC event timestamps, an SPI handle is the spidev descriptor.
+*/
+
+#ifndef TRANSPORT_GPIOD_H
+#define TRANSPORT_GPIOD_H
+
+#include <stdio.h>
+#include <gpiod.h>
+#include "transport.h"
+#include "spi_link.h"
+
+#define GPIOD_MAX_LINES 16
+
+typedef struct {
+    struct gpiod_chip *chip;
+    struct gpiod_line *lines[GPIOD_MAX_LINES];
+    unsigned count;
+} transport_gpiod_t;
+
+static int hw_open_spi(void *ctx, const char *device, uint32_t speed) {
+    (void)ctx;
+    return spi_open_device(device, speed);
+}
+
+static int hw_read_burst(void *ctx, int spi, uint16_t *rx, size_t words, uint32_t speed, unsigned *ioctls) {
+    (void)ctx;
+    return spi_read_burst(spi, rx, words, speed, ioctls);
+}
+
+static void hw_close_spi(void *ctx, int spi) {
+    (void)ctx;
+    close(spi);
+}
+
+// Next free slot with the line requested, -1 on error
+static int hw_add_line(transport_gpiod_t *t, unsigned gpio, struct gpiod_line **line) {
+    if (t->count == GPIOD_MAX_LINES) {
+        fprintf(stderr, "More than %d GPIO lines\n", GPIOD_MAX_LINES);
+        return -1;
+    }
+    *line = gpiod_chip_get_line(t->chip, gpio);
+    return *line == NULL ? -1 : (int)t->count;
+}
+
+static int hw_open_edges(void *ctx, unsigned gpio, const char *consumer, int *event_fd) {
+    transport_gpiod_t *t = (transport_gpiod_t *)ctx;
+    struct gpiod_line *line;
+    int handle = hw_add_line(t, gpio, &line);
+    if (handle < 0 || gpiod_line_request_rising_edge_events(line, consumer) < 0) {
+        perror("Error requesting GPIO line events");
+        return -1;
+    }
+    t->lines[t->count++] = line;
+    *event_fd = gpiod_line_event_get_fd(line);
+    return handle;
+}
+
+static int hw_read_edge(void *ctx, int line, uint64_t *edge_ns) {
+    transport_gpiod_t *t = (transport_gpiod_t *)ctx;
+    struct gpiod_line_event edge;
+    if (gpiod_line_event_read(t->lines[line], &edge) < 0) {
+        return -1;
+    }
+    *edge_ns = (uint64_t)edge.ts.tv_sec * 1000000000ull + (uint64_t)edge.ts.tv_nsec;
+    return 0;
+}
+
+static int hw_open_output(void *ctx, unsigned gpio, const char *consumer) {
+    transport_gpiod_t *t = (transport_gpiod_t *)ctx;
+    struct gpiod_line *line;
+    int handle = hw_add_line(t, gpio, &line);
+    if (handle < 0 || gpiod_line_request_output(line, consumer, 0) < 0) {
+        perror("Error requesting GPIO output");
+        return -1;
+    }
+    t->lines[t->count++] = line;
+    return handle;
+}
+
+static void hw_set_output(void *ctx, int line, int value) {
+    transport_gpiod_t *t = (transport_gpiod_t *)ctx;
+    gpiod_line_set_value(t->lines[line], value);
+}
+
+static void hw_close_line(void *ctx, int line) {
+    transport_gpiod_t *t = (transport_gpiod_t *)ctx;
+    gpiod_line_release(t->lines[line]);
+}
+
+static const transport_ops_t transport_gpiod_ops = {
+    .name = "spidev",
+    .open_spi = hw_open_spi,
+    .read_burst = hw_read_burst,
+    .close_spi = hw_close_spi,
+    .open_edges = hw_open_edges,
+    .read_edge = hw_read_edge,
+    .open_output = hw_open_output,
+    .set_output = hw_set_output,
+    .close_line = hw_close_line,
+    .start = NULL,
+};
+
+/*
+    Description:
+        Open the GPIO chip of the header pins and read the spidev bufsiz
+
+    Parameter:
+        transport_gpiod_t *t - transport state
+        const char *chip     - e.g. "/dev/gpiochip4"
+
+    Return:
+        int - 0 on success, -1 on error
+*/
+static inline int transport_gpiod_open(transport_gpiod_t *t, const char *chip) {
+    memset(t, 0, sizeof(*t));
+    t->chip = gpiod_chip_open(chip);
+    if (t->chip == NULL) {
+        perror("Error opening GPIO chip");
+        return -1;
+    }
+    spi_read_bufsiz();
+    return 0;
+}
+
+static inline void transport_gpiod_close(transport_gpiod_t *t) {
+    gpiod_chip_close(t->chip);
+}
+
+#endif
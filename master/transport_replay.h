@@ -0,0 +1,396 @@
+/*
+    About:
+        Stand-in transport (transport.h) for running the receiver without a Pi or
+    picos. A generator thread plays up to REPLAY_MAX_PICOS picos: every pico sends a
+    burst every 1 / rate seconds, the picos evenly staggered across the period as
+    in the token ring. Each burst is built exactly as adc_A builds it, with the
+    firmware's own packing and Rice coding (pack12.h, rice_encode.h), the header
+    and the CRC-32 trailer.
+
+        Samples come from recorded captures (the old data<n>.bin layout, raw uint16_t
+    samples, cycled through) or from a synthetic pattern. An edge is an eventfd
+    written by the generator, its time is the CLOCK_MONOTONIC at which the frame
+    was ready. read_burst copies out of the frame, one "ioctl" per spidev bufsiz
+    chunk as spi_read_burst counts them, and with a wire clock set it also takes as
+    long as the real link would.
+
+        Like the pico's single TX DMA, a pico holds one frame. When its next burst is
+    due before the receiver has clocked the last one out, the burst is counted as an
+    overrun and skipped, the real pico would have stalled the ring.
+*/
+
+#ifndef TRANSPORT_REPLAY_H
+#define TRANSPORT_REPLAY_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <sys/eventfd.h>
+#include "transport.h"
+#include "burst_frame.h"
+
+// the firmware's encoders, compiled for the host
+#ifndef __not_in_flash_func
+#define __not_in_flash_func(f) f
+#endif
+#include "../src/adc_A/pack12.h"
+#include "../src/adc_A/rice_encode.h"
+
+#define REPLAY_MAX_PICOS    8
+#define REPLAY_CHUNK_BYTES  4096        // bufsiz assumed for the ioctl count, spidev's default
+
+// synthetic patterns
+#define REPLAY_RAMP         0           // sawtooth over the 12-bit range
+#define REPLAY_SINE         1           // 1 kHz sine, half scale
+#define REPLAY_NOISE        2           // uniform noise, the worst case for RICE_CODED
+
+typedef struct {
+    int event_fd;                       // one count per ready frame
+    uint16_t *frame;                    // header, payload, trailer
+    size_t words;                       // length of the ready frame
+    size_t cursor;                      // words clocked out so far
+    _Atomic int busy;                   // frame ready and not fully clocked out
+    uint64_t edge_ns;                   // time the frame was ready
+    uint32_t sequence;
+    unsigned long sent;                 // bursts made ready
+    unsigned long overruns;             // bursts skipped, the previous one was still there
+} replay_pico_t;
+
+typedef struct {
+    // configuration, set before transport_replay_init
+    unsigned picos;
+    double rate_hz;                     // bursts per second of each pico
+    unsigned long bursts;               // per pico, then the generator stops
+    uint32_t samples;                   // per burst
+    uint16_t flags;                     // FRAME_FLAG_PACKED12 / FRAME_FLAG_RICE, as the receiver is built
+    uint16_t channel_mask;
+    double sample_rate_hz;              // only for the timing fields of the header
+    uint32_t wire_hz;                   // SPI clock to emulate in read_burst, 0 for none
+    int pattern;                        // REPLAY_*, when no files are given
+    char **files;                       // data<n>.bin captures, cycled through
+    int file_count;
+    // state
+    replay_pico_t pico[REPLAY_MAX_PICOS];
+    uint16_t *capture;                  // samples of all files
+    size_t capture_samples;
+    size_t capture_pos;
+    uint32_t noise;                     // xorshift state
+    pthread_t thread;
+    _Atomic int started;                // 1 once the generator runs, -1 if it could not start
+    uint64_t start_ns;
+    uint64_t end_ns;                    // last burst made ready
+} transport_replay_t;
+
+static inline uint64_t replay_now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+// Load every capture file into one sample array, 0 on success
+static int replay_load(transport_replay_t *r) {
+    for (int i = 0; i < r->file_count; i++) {
+        FILE *f = fopen(r->files[i], "rb");
+        if (f == NULL) {
+            perror(r->files[i]);
+            return -1;
+        }
+        fseek(f, 0, SEEK_END);
+        size_t samples = (size_t)ftell(f) / sizeof(uint16_t);
+        fseek(f, 0, SEEK_SET);
+        uint16_t *grown = realloc(r->capture, (r->capture_samples + samples) * sizeof(uint16_t));
+        if (grown == NULL) {
+            fclose(f);
+            return -1;
+        }
+        r->capture = grown;
+        r->capture_samples += fread(r->capture + r->capture_samples, sizeof(uint16_t), samples, f);
+        fclose(f);
+    }
+    if (r->file_count > 0 && r->capture_samples == 0) {
+        fprintf(stderr, "Replay files hold no samples\n");
+        return -1;
+    }
+    return 0;
+}
+
+// Next samples of the capture or the pattern
+static void replay_fill(transport_replay_t *r, uint16_t *samples, uint32_t count, uint64_t first) {
+    for (uint32_t i = 0; i < count; i++) {
+        if (r->capture_samples > 0) {
+            samples[i] = r->capture[r->capture_pos++] & 0xfff;
+            if (r->capture_pos == r->capture_samples) {
+                r->capture_pos = 0;
+            }
+        } else if (r->pattern == REPLAY_SINE) {
+            double t = (double)(first + i) / r->sample_rate_hz;
+            samples[i] = (uint16_t)(2048 + 1024 * sin(2 * M_PI * 1000.0 * t));
+        } else if (r->pattern == REPLAY_NOISE) {
+            r->noise ^= r->noise << 13;
+            r->noise ^= r->noise >> 17;
+            r->noise ^= r->noise << 5;
+            samples[i] = r->noise & 0xfff;
+        } else {
+            samples[i] = (uint16_t)((first + i) & 0xfff);
+        }
+    }
+}
+
+// Build the next frame of a pico, as adc_A's start_transfer does
+static void replay_build(transport_replay_t *r, unsigned index, uint64_t now_ns) {
+    replay_pico_t *p = &r->pico[index];
+    burst_frame_t *header = (burst_frame_t *)p->frame;
+    uint16_t *payload = p->frame + FRAME_HEADER_WORDS;
+    uint64_t first = (uint64_t)p->sequence * r->samples;
+
+    replay_fill(r, payload, r->samples, first);
+    uint64_t encode_start = replay_now_ns();
+    uint32_t payload_words = r->samples;
+    if (r->flags & FRAME_FLAG_PACKED12) {
+        payload_words = pack12_in_place(payload, r->samples);
+    } else if (r->flags & FRAME_FLAG_RICE) {
+        unsigned channels = __builtin_popcount(r->channel_mask);
+        payload_words = rice_encode_in_place(payload, r->samples, channels > 1 ? channels : 1);
+    }
+
+    memset(header, 0, sizeof(*header));
+    header->magic = FRAME_MAGIC;
+    header->version = FRAME_VERSION;
+    header->machine_id = (uint16_t)index;
+    header->header_words = FRAME_HEADER_WORDS;
+    header->sequence = p->sequence++;
+    header->sample_count = r->samples;
+    header->payload_words = payload_words;
+    header->flags = r->flags;
+    header->channel_mask = r->channel_mask;
+    header->encode_us = (uint32_t)((replay_now_ns() - encode_start) / 1000);
+    // one endless run per pico on the receiver's clock, the timebase maps it 1:1
+    header->sample_period_ps = (uint32_t)(1e12 / r->sample_rate_hz + 0.5);
+    header->run_offset = (uint32_t)first;
+    header->run_start_us = r->start_ns / 1000;
+    header->transfer_us = now_ns / 1000;
+
+    size_t words = FRAME_HEADER_WORDS + payload_words;
+    uint32_t crc = frame_crc32(p->frame, words * sizeof(uint16_t));
+    p->frame[words] = (uint16_t)crc;
+    p->frame[words + 1] = (uint16_t)(crc >> 16);
+    p->words = words + FRAME_TRAILER_WORDS;
+    p->cursor = 0;
+}
+
+// Generator thread, plays every pico until each has made its bursts ready
+static void *replay_thread(void *arg) {
+    transport_replay_t *r = (transport_replay_t *)arg;
+    double period_ns = 1e9 / r->rate_hz;
+    r->start_ns = replay_now_ns();
+
+    for (unsigned long b = 0; b < r->bursts; b++) {
+        for (unsigned k = 0; k < r->picos; k++) {
+            // picos take turns, spread over the period
+            uint64_t due = r->start_ns + (uint64_t)((b + (double)k / r->picos) * period_ns);
+            struct timespec ts = { (time_t)(due / 1000000000ull), (long)(due % 1000000000ull) };
+            clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL);
+
+            replay_pico_t *p = &r->pico[k];
+            if (atomic_load_explicit(&p->busy, memory_order_acquire)) {
+                p->overruns++;
+                continue;
+            }
+            uint64_t now = replay_now_ns();
+            replay_build(r, k, now);
+            p->edge_ns = now;
+            p->sent++;
+            atomic_store_explicit(&p->busy, 1, memory_order_release);
+            uint64_t one = 1;
+            if (write(p->event_fd, &one, sizeof(one)) != sizeof(one)) {
+                perror("Error signalling a replay edge");
+            }
+        }
+    }
+    r->end_ns = replay_now_ns();
+    return NULL;
+}
+
+static int replay_open_spi(void *ctx, const char *device, uint32_t speed) {
+    transport_replay_t *r = (transport_replay_t *)ctx;
+    (void)speed;
+    int index = atoi(device);   // the stand-in picos are "0", "1", ...
+    if (index < 0 || (unsigned)index >= r->picos) {
+        fprintf(stderr, "No replay pico %s\n", device);
+        return -1;
+    }
+    return index;
+}
+
+static int replay_read_burst(void *ctx, int spi, uint16_t *rx, size_t words, uint32_t speed, unsigned *ioctls) {
+    transport_replay_t *r = (transport_replay_t *)ctx;
+    replay_pico_t *p = &r->pico[spi];
+    (void)speed;
+
+    if (ioctls) {
+        *ioctls += (unsigned)((words * sizeof(uint16_t) + REPLAY_CHUNK_BYTES - 1) / REPLAY_CHUNK_BYTES);
+    }
+    if (r->wire_hz > 0) {
+        // 16 clocks per word
+        uint64_t ns = (uint64_t)words * 16 * 1000000000ull / r->wire_hz;
+        struct timespec ts = { (time_t)(ns / 1000000000ull), (long)(ns % 1000000000ull) };
+        nanosleep(&ts, NULL);
+    }
+
+    // past the end of the frame the pico's FIFO runs empty, zeros
+    size_t available = p->cursor < p->words ? p->words - p->cursor : 0;
+    size_t n = words < available ? words : available;
+    memcpy(rx, p->frame + p->cursor, n * sizeof(uint16_t));
+    memset(rx + n, 0, (words - n) * sizeof(uint16_t));
+    p->cursor += words;
+    if (p->cursor >= p->words) {
+        atomic_store_explicit(&p->busy, 0, memory_order_release);
+    }
+    return 0;
+}
+
+static void replay_close_spi(void *ctx, int spi) {
+    (void)ctx;
+    (void)spi;
+}
+
+static int replay_open_edges(void *ctx, unsigned gpio, const char *consumer, int *event_fd) {
+    transport_replay_t *r = (transport_replay_t *)ctx;
+    (void)consumer;
+    if (gpio >= r->picos) {
+        // not a pico (sync input), a line that never fires
+        *event_fd = eventfd(0, EFD_SEMAPHORE);
+        return REPLAY_MAX_PICOS;
+    }
+    *event_fd = r->pico[gpio].event_fd;
+    return (int)gpio;
+}
+
+static int replay_read_edge(void *ctx, int line, uint64_t *edge_ns) {
+    transport_replay_t *r = (transport_replay_t *)ctx;
+    uint64_t count;
+    if (line >= REPLAY_MAX_PICOS || read(r->pico[line].event_fd, &count, sizeof(count)) != sizeof(count)) {
+        return -1;
+    }
+    *edge_ns = r->pico[line].edge_ns;
+    return 0;
+}
+
+static int replay_open_output(void *ctx, unsigned gpio, const char *consumer) {
+    (void)ctx;
+    (void)gpio;
+    (void)consumer;
+    return REPLAY_MAX_PICOS;
+}
+
+static void replay_set_output(void *ctx, int line, int value) {
+    (void)ctx;
+    (void)line;
+    (void)value;
+}
+
+static void replay_close_line(void *ctx, int line) {
+    (void)ctx;
+    (void)line;
+}
+
+static void replay_start(void *ctx) {
+    transport_replay_t *r = (transport_replay_t *)ctx;
+    if (pthread_create(&r->thread, NULL, replay_thread, r) != 0) {
+        perror("Error starting the replay generator");
+        atomic_store(&r->started, -1);
+        return;
+    }
+    atomic_store(&r->started, 1);
+}
+
+static const transport_ops_t transport_replay_ops = {
+    .name = "replay",
+    .open_spi = replay_open_spi,
+    .read_burst = replay_read_burst,
+    .close_spi = replay_close_spi,
+    .open_edges = replay_open_edges,
+    .read_edge = replay_read_edge,
+    .open_output = replay_open_output,
+    .set_output = replay_set_output,
+    .close_line = replay_close_line,
+    .start = replay_start,
+};
+
+/*
+    Description:
+        Allocate the stand-in picos and load the captures, after the configuration
+    fields are set
+
+    Return:
+        int - 0 on success, -1 on error
+*/
+static inline int transport_replay_init(transport_replay_t *r) {
+    if (r->picos == 0 || r->picos > REPLAY_MAX_PICOS || r->rate_hz <= 0 || r->samples == 0) {
+        fprintf(stderr, "Replay needs 1 to %d picos, a rate and a burst size\n", REPLAY_MAX_PICOS);
+        return -1;
+    }
+    r->noise = 0x2545f491u;
+    if (replay_load(r) < 0) {
+        return -1;
+    }
+    // longest frame: plain samples, or every Rice block raw
+    size_t payload = r->samples > RICE_MAX_WORDS(r->samples) ? r->samples : RICE_MAX_WORDS(r->samples);
+    for (unsigned k = 0; k < r->picos; k++) {
+        replay_pico_t *p = &r->pico[k];
+        p->frame = aligned_alloc(8, (FRAME_HEADER_WORDS + payload + FRAME_TRAILER_WORDS + 4) * sizeof(uint16_t));
+        p->event_fd = eventfd(0, EFD_SEMAPHORE);
+        if (p->frame == NULL || p->event_fd < 0) {
+            perror("Error setting up a replay pico");
+            return -1;
+        }
+        atomic_init(&p->busy, 0);
+    }
+    return 0;
+}
+
+/*
+    Description:
+        Wait for the receiver to start the generator, for the generator to finish and
+    for the receiver to clock out the last frames
+
+    Parameter:
+        transport_replay_t *r - replay state
+        double timeout_s      - give up on frames still held after this long
+
+    Return:
+        int - 0 when done, -1 if the generator never ran
+*/
+static inline int transport_replay_wait(transport_replay_t *r, double timeout_s) {
+    int started;
+    while ((started = atomic_load(&r->started)) == 0) {
+        usleep(1000);
+    }
+    if (started < 0) {
+        return -1;
+    }
+    pthread_join(r->thread, NULL);
+    uint64_t deadline = replay_now_ns() + (uint64_t)(timeout_s * 1e9);
+    for (unsigned k = 0; k < r->picos; k++) {
+        while (atomic_load_explicit(&r->pico[k].busy, memory_order_acquire) && replay_now_ns() < deadline) {
+            usleep(1000);
+        }
+    }
+    return 0;
+}
+
+static inline void transport_replay_free(transport_replay_t *r) {
+    for (unsigned k = 0; k < r->picos; k++) {
+        free(r->pico[k].frame);
+        close(r->pico[k].event_fd);
+    }
+    free(r->capture);
+}
+
+#endif
@@ -0,0 +1,241 @@
+/*
+    About:
+        Host side of the adc_trap STREAM_BUFFER mode. Reads the binary capture records
+    from the pico's USB serial port (or from a file holding a saved stream) and writes
+    the samples raw, or converted to a CSV with voltages, on the host where formatting
+    is cheap. Anything printed before a record (startup messages) is skipped. The
+    trigger-path histograms of a TELEMETRY build are printed with each record.
+
+    Usage:
+        ./trap_decode -o capture.bin                        raw uint16_t samples from /dev/ttyACM0
+        ./trap_decode -d /dev/ttyACM1 -c capture.csv        index, raw, voltage, time per line
+        ./trap_decode -d saved.stream -o capture.bin -t times.bin -n 4
+
+    Compilation:
+        gcc -O2 -o trap_decode trap_decode.c
+*/
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <termios.h>
+#include "trap_stream.h"
+#include "time_delta.h"
+#include "telemetry.h"
+
+// Define the default serial device of the pico
+#define SERIAL_DEVICE "/dev/ttyACM0"
+
+// Largest payload accepted, well above 32768 samples with timestamps
+#define MAX_PAYLOAD (4u << 20)
+#define MAX_SAMPLES (MAX_PAYLOAD / sizeof(uint16_t))    // bound by the payload check
+
+// digital-to-voltage conversion, convert ADC values to voltage
+static const double conversion_factor = 3.3 / (1 << 12);
+
+// Read exactly len bytes, 0 at end of stream
+static int read_full(int fd, void *buf, size_t len) {
+    uint8_t *p = (uint8_t *)buf;
+    while (len > 0) {
+        ssize_t n = read(fd, p, len);
+        if (n <= 0) {
+            return 0;
+        }
+        p += n;
+        len -= (size_t)n;
+    }
+    return 1;
+}
+
+/*
+    Description:
+        Bytes after the samples that a TRAP_STREAM_TIME_DELTA record needs before its
+    escape table, the escape table size is only known once the time block is read
+
+    Return:
+        uint64_t - time block plus padded deltas
+*/
+static uint64_t time_delta_bytes(uint32_t sample_count, uint16_t delta_bits) {
+    uint64_t deltas = (uint64_t)sample_count * (delta_bits / 8);
+    return sizeof(trap_time_block_t) + ((deltas + 3) & ~(uint64_t)3);
+}
+
+/*
+    Description:
+        Skip to the next record and read its header
+
+    Return:
+        int - 1 if a header was read, 0 at end of stream
+*/
+static int read_header(int fd, trap_stream_header_t *header, unsigned long *skipped) {
+    uint32_t window = 0;
+    uint8_t byte;
+    // the magic is little endian, slide over the stream one byte at a time until it lines up
+    while (window != TRAP_STREAM_MAGIC) {
+        if (!read_full(fd, &byte, 1)) {
+            return 0;
+        }
+        window = (window >> 8) | ((uint32_t)byte << 24);
+        (*skipped)++;
+    }
+    *skipped -= sizeof(window);
+
+    header->magic = window;
+    return read_full(fd, (uint8_t *)header + sizeof(window), sizeof(*header) - sizeof(window));
+}
+
+// Put a serial port in raw mode, leaves regular files alone
+static void set_raw(int fd) {
+    struct termios tio;
+    if (tcgetattr(fd, &tio) == 0) {
+        cfmakeraw(&tio);
+        tcsetattr(fd, TCSANOW, &tio);
+    }
+}
+
+int main(int argc, char **argv) {
+    const char *device = SERIAL_DEVICE;
+    const char *raw_name = NULL, *csv_name = NULL, *time_name = NULL;
+    long records_wanted = 1;
+    int opt;
+    while ((opt = getopt(argc, argv, "d:o:c:t:n:")) != -1) {
+        switch (opt) {
+        case 'd': device = optarg; break;
+        case 'o': raw_name = optarg; break;
+        case 'c': csv_name = optarg; break;
+        case 't': time_name = optarg; break;
+        case 'n': records_wanted = atol(optarg); break;
+        default:
+            fprintf(stderr, "usage: %s [-d device] [-o raw.bin] [-c out.csv] [-t times.bin] [-n records]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    int fd = open(device, O_RDONLY | O_NOCTTY);
+    if (fd < 0) {
+        perror("Error opening stream");
+        return 1;
+    }
+    set_raw(fd);
+
+    FILE *raw = raw_name ? fopen(raw_name, "wb") : NULL;
+    FILE *csv = csv_name ? fopen(csv_name, "w") : NULL;
+    FILE *times = time_name ? fopen(time_name, "wb") : NULL;
+    if ((raw_name && !raw) || (csv_name && !csv) || (time_name && !times)) {
+        perror("Error opening output file");
+        return 1;
+    }
+
+    uint8_t *payload = malloc(MAX_PAYLOAD);
+    uint32_t *decoded_times = malloc(MAX_SAMPLES * sizeof(uint32_t));
+    if (payload == NULL || decoded_times == NULL) {
+        return 1;
+    }
+
+    long records = 0;
+    while (records_wanted <= 0 || records < records_wanted) {
+        trap_stream_header_t header;
+        unsigned long skipped = 0;
+        if (!read_header(fd, &header, &skipped)) {
+            break;
+        }
+
+        // a TRAP_STREAM_TIME_DELTA record is checked exactly once its time block is in,
+        // the telemetry block is last and has a fixed size
+        uint32_t telemetry_bytes = (header.flags & TRAP_STREAM_TELEMETRY) ? sizeof(telemetry_block_t) : 0;
+        uint64_t minimum = (uint64_t)header.sample_count * sizeof(uint16_t) + telemetry_bytes;
+        uint64_t maximum = minimum;
+        if (header.flags & TRAP_STREAM_TIMESTAMPS) {
+            minimum += (uint64_t)header.sample_count * sizeof(uint32_t);
+            maximum = minimum;
+        } else if (header.flags & TRAP_STREAM_TIME_DELTA) {
+            minimum += time_delta_bytes(header.sample_count, 8);
+            maximum = MAX_PAYLOAD;
+        }
+        if (header.version != TRAP_STREAM_VERSION || header.header_bytes != sizeof(header)
+            || header.payload_bytes < minimum || header.payload_bytes > maximum
+            || header.payload_bytes > MAX_PAYLOAD) {
+            fprintf(stderr, "Bad record header (version %u, %u bytes), resyncing\n", header.version, header.payload_bytes);
+            continue;
+        }
+
+        struct timespec start, end;
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        if (!read_full(fd, payload, header.payload_bytes)) {
+            fprintf(stderr, "Stream ended inside record %u\n", header.sequence);
+            break;
+        }
+        clock_gettime(CLOCK_MONOTONIC, &end);
+        double seconds = (double)(end.tv_sec - start.tv_sec) + (double)(end.tv_nsec - start.tv_nsec) / 1e9;
+
+        const uint16_t *samples = (const uint16_t *)payload;
+        const uint32_t *timestamps = (header.flags & TRAP_STREAM_TIMESTAMPS)
+                                   ? (const uint32_t *)(payload + header.sample_count * sizeof(uint16_t)) : NULL;
+        uint32_t unknown_times = 0;
+
+        if (header.flags & TRAP_STREAM_TIME_DELTA) {
+            const uint8_t *block_start = payload + header.sample_count * sizeof(uint16_t);
+            trap_time_block_t block;
+            memcpy(&block, block_start, sizeof(block));
+            uint64_t layout = header.sample_count * sizeof(uint16_t)
+                            + time_delta_bytes(header.sample_count, block.delta_bits)
+                            + (uint64_t)block.escapes_kept * sizeof(uint32_t) + telemetry_bytes;
+            if ((block.delta_bits != 8 && block.delta_bits != 16) || block.escapes_kept > block.escape_count
+                || layout != header.payload_bytes) {
+                fprintf(stderr, "Bad time block in record %u, resyncing\n", header.sequence);
+                continue;
+            }
+            const uint8_t *deltas = block_start + sizeof(block);
+            const uint32_t *escapes = (const uint32_t *)(block_start + time_delta_bytes(header.sample_count, block.delta_bits));
+            unknown_times = time_delta_decode(deltas, block.delta_bits, header.sample_count, block.base,
+                                              escapes, block.escapes_kept, decoded_times);
+            if (unknown_times > 0) {
+                fprintf(stderr, "Record %u: escape table overflowed (%u long gaps), last %u times unknown\n",
+                        header.sequence, block.escape_count, unknown_times);
+            }
+            timestamps = decoded_times;
+        }
+
+        if (raw) {
+            fwrite(samples, sizeof(uint16_t), header.sample_count, raw);
+        }
+        if (times && timestamps) {
+            fwrite(timestamps, sizeof(uint32_t), header.sample_count, times);
+        }
+        if (csv) {
+            for (uint32_t i = 0; i < header.sample_count; i++) {
+                if (timestamps) {
+                    fprintf(csv, "%u,%u,%f,%u\n", i, samples[i], samples[i] * conversion_factor, timestamps[i]);
+                } else {
+                    fprintf(csv, "%u,%u,%f\n", i, samples[i], samples[i] * conversion_factor);
+                }
+            }
+        }
+
+        printf("Record %u: %u samples%s, %u bytes in %.3f s (%.0f kB/s), %lu bytes skipped\n",
+               header.sequence, header.sample_count,
+               (header.flags & TRAP_STREAM_TIME_DELTA) ? " with delta timestamps" : timestamps ? " with timestamps" : "",
+               header.payload_bytes, seconds, seconds > 0 ? header.payload_bytes / seconds / 1e3 : 0.0, skipped);
+        if (telemetry_bytes > 0) {
+            telemetry_block_t block;
+            if (telemetry_load(&block, payload + header.payload_bytes - telemetry_bytes, telemetry_bytes) == 0) {
+                telemetry_print(stdout, "trap", &block);
+            } else {
+                fprintf(stderr, "Record %u: unreadable telemetry block\n", header.sequence);
+            }
+        }
+        records++;
+    }
+
+    free(payload);
+    free(decoded_times);
+    if (raw) fclose(raw);
+    if (csv) fclose(csv);
+    if (times) fclose(times);
+    close(fd);
+    return records > 0 ? 0 : 1;
+}
@@ -0,0 +1,54 @@
+/*
+    About:
+        Binary capture record of adc_trap, keep in sync with src/adc_trap/trap_stream.h.
+
+    One record per capture (little endian):
+        trap_stream_header_t        header_bytes bytes
+        uint16_t samples[]          sample_count raw 12-bit ADC values
+        uint32_t timestamps[]       sample_count microsecond times, TRAP_STREAM_TIMESTAMPS only
+    or, with TRAP_STREAM_TIME_DELTA (time_delta.h):
+        trap_time_block_t           16 bytes
+        time deltas                 sample_count of delta_bits each, padded to 4 bytes
+        uint32_t escapes[]          escapes_kept full times
+    and last, with TRAP_STREAM_TELEMETRY:
+        telemetry_block_t           trigger-path histograms (telemetry.h)
+
+        The host finds the record by its magic, text printed before it is skipped.
+*/
+
+#ifndef TRAP_STREAM_H
+#define TRAP_STREAM_H
+
+#include <stdint.h>
+
+#define TRAP_STREAM_MAGIC       0x50415254u     // "TRAP"
+#define TRAP_STREAM_VERSION     1
+
+// flags
+#define TRAP_STREAM_TIMESTAMPS  0x0001          // a timestamp block follows the samples
+#define TRAP_STREAM_TIME_DELTA  0x0002          // compact time deltas follow the samples
+#define TRAP_STREAM_TELEMETRY   0x0004          // a telemetry block ends the payload
+
+typedef struct {
+    uint32_t magic;             // TRAP_STREAM_MAGIC
+    uint16_t version;           // TRAP_STREAM_VERSION
+    uint16_t header_bytes;      // sizeof(trap_stream_header_t), payload starts here
+    uint32_t sequence;          // capture number since boot
+    uint32_t sample_count;      // samples in the record
+    uint32_t flags;             // TRAP_STREAM_*
+    uint32_t payload_bytes;     // everything after the header
+} trap_stream_header_t;
+
+_Static_assert(sizeof(trap_stream_header_t) == 24, "stream header layout");
+
+typedef struct {
+    uint32_t base;              // arm time, the first delta counts from here
+    uint32_t escape_count;      // long gaps in the capture
+    uint32_t escapes_kept;      // entries in the escape table, less than escape_count if it overflowed
+    uint16_t delta_bits;        // 8 or 16
+    uint16_t reserved;
+} trap_time_block_t;
+
+_Static_assert(sizeof(trap_time_block_t) == 16, "time block layout");
+
+#endif
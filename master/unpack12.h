@@ -0,0 +1,99 @@
+/*
+    About:
+        Unpack 12-bit packed bursts (FRAME_FLAG_PACKED12, see src/adc_A/pack12.h) back
+    to one uint16_t per sample. In memory order every 2 samples take 3 bytes:
+        byte 0 = s0 bits 0-7,   byte 1 = s0 bits 8-11 | s1 bits 0-3 << 4,   byte 2 = s1 bits 4-11
+
+        The Raspberry Pi 5 path uses the NEON structure load vld3q_u8, which splits 16
+    byte triples in one instruction, 32 samples per iteration. On x86 (build with
+    -march=native) a byte shuffle lines up the two bytes of each sample, 8 samples per
+    SSSE3 shuffle, 16 with AVX2. The tail of every burst is done by the scalar loop.
+    Assumes a little-endian host, like the rest of the receiver.
+*/
+
+#ifndef UNPACK12_H
+#define UNPACK12_H
+
+#include <stdint.h>
+#include <stddef.h>
+#if defined(__ARM_NEON)
+#include <arm_neon.h>
+#elif defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSSE3__)
+#include <tmmintrin.h>
+#endif
+
+static inline size_t unpack12_scalar(const uint8_t *in, uint16_t *out, size_t start, size_t count) {
+    size_t i = start;
+    for (; i + 2 <= count; i += 2) {
+        const uint8_t *b = in + i / 2 * 3;
+        out[i] = (uint16_t)(b[0] | (b[1] & 0x0f) << 8);
+        out[i + 1] = (uint16_t)(b[1] >> 4 | b[2] << 4);
+    }
+    if (i < count) {
+        const uint8_t *b = in + i / 2 * 3;
+        out[i] = (uint16_t)(b[0] | (b[1] & 0x0f) << 8);
+    }
+    return count;
+}
+
+/*
+    Description:
+        Unpack count samples
+
+    Parameter:
+        const uint16_t *packed - (count * 3 + 3) / 4 words as received
+        uint16_t *out          - count samples
+        size_t count           - number of samples
+*/
+static inline void unpack12_u16(const uint16_t *packed, uint16_t *out, size_t count) {
+    const uint8_t *in = (const uint8_t *)packed;
+    size_t i = 0;
+
+#if defined(__ARM_NEON)
+    const uint8x16_t low_nibble = vdupq_n_u8(0x0f);
+    for (; i + 32 <= count; i += 32) {
+        uint8x16x3_t b = vld3q_u8(in + i / 2 * 3);     // byte 0, 1 and 2 of 16 sample pairs
+        // even samples: byte 0 and the low nibble of byte 1, zipped into little-endian words
+        uint8x16x2_t even = vzipq_u8(b.val[0], vandq_u8(b.val[1], low_nibble));
+        // odd samples: high nibble of byte 1 and byte 2 shifted up by 4
+        uint8x16_t high = vshrq_n_u8(b.val[1], 4);
+        uint16x8_t odd_lo = vorrq_u16(vmovl_u8(vget_low_u8(high)), vshll_n_u8(vget_low_u8(b.val[2]), 4));
+        uint16x8_t odd_hi = vorrq_u16(vmovl_u8(vget_high_u8(high)), vshll_n_u8(vget_high_u8(b.val[2]), 4));
+
+        uint16x8x2_t lo = { { vreinterpretq_u16_u8(even.val[0]), odd_lo } };
+        uint16x8x2_t hi = { { vreinterpretq_u16_u8(even.val[1]), odd_hi } };
+        vst2q_u16(out + i, lo);
+        vst2q_u16(out + i + 16, hi);
+    }
+#elif defined(__SSSE3__)
+    // word j gets the 2 bytes that hold sample j, even samples keep the low 12 bits,
+    // odd samples are shifted down by 4
+    const __m128i pick = _mm_setr_epi8(0, 1, 1, 2, 3, 4, 4, 5, 6, 7, 7, 8, 9, 10, 10, 11);
+#if defined(__AVX2__)
+    const __m256i pick2 = _mm256_broadcastsi128_si256(pick);
+    const __m256i mask2 = _mm256_set1_epi16(0x0fff);
+    // each lane loads 16 bytes and uses 12, stop while a whole load still fits
+    for (; i + 32 <= count; i += 16) {
+        const uint8_t *p = in + i / 2 * 3;
+        __m256i v = _mm256_inserti128_si256(_mm256_castsi128_si256(_mm_loadu_si128((const __m128i *)p)),
+                                            _mm_loadu_si128((const __m128i *)(p + 12)), 1);
+        v = _mm256_shuffle_epi8(v, pick2);
+        v = _mm256_blend_epi16(_mm256_and_si256(v, mask2), _mm256_srli_epi16(v, 4), 0xAA);
+        _mm256_storeu_si256((__m256i *)(out + i), v);
+    }
+#endif
+    const __m128i even_mask = _mm_setr_epi16(0x0fff, 0, 0x0fff, 0, 0x0fff, 0, 0x0fff, 0);
+    const __m128i odd_mask = _mm_setr_epi16(0, -1, 0, -1, 0, -1, 0, -1);
+    for (; i + 16 <= count; i += 8) {
+        __m128i v = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(in + i / 2 * 3)), pick);
+        v = _mm_or_si128(_mm_and_si128(v, even_mask), _mm_and_si128(_mm_srli_epi16(v, 4), odd_mask));
+        _mm_storeu_si128((__m128i *)(out + i), v);
+    }
+#endif
+
+    unpack12_scalar(in, out, i, count);
+}
+
+#endif
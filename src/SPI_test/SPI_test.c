@@ -1,39 +1,164 @@
+/*
+    About:
+        Sender half of the SPI link benchmark, master/spi_bench.c is the receiver.
+    The pico sends bursts of a known pattern (spi_bench.h) as the ADC firmware
+    does: the burst is queued on DMA before TRANSFER_PIN is pulsed, the TX channel
+    keeps the FIFO full and the master clocks it at whatever rate it is testing.
+    The receiver checks every word and measures the rate and the gaps.
+
+        The receiver sets burst length, pattern and the gap between bursts with the
+    words it clocks out on MOSI, an RX DMA channel keeps the last ones in a small ring.
+    Until it does, the pico sends DEFAULT_WORDS of DEFAULT_PATTERN every
+    DEFAULT_GAP_US. A burst the master does not clock within BURST_TIMEOUT_US is
+    dropped and counted, and the port is reset, so the receiver can start and stop
+    at any time.
+
+    Usage:
+        Flash, then run spi_bench on the Pi. USB prints a line every second: bursts,
+    timeouts, the current setup and the pico-side time of the latest burst.
+*/
+
 #include <stdio.h>
 #include <stdint.h>
 #include "pico/stdlib.h"
 #include "hardware/spi.h"
+#include "hardware/dma.h"
+#include "hardware/sync.h"
 #include "hardware/timer.h"
+#include "spi_bench.h"
 
 #define SPI_PORT                spi0
 #define TRANSFER_PIN            4
-#define BUF_LEN                 100005
-#define CLOCK_FREQUENCY         25000000 
-
-// helper function to print buffer
-void printbuf(uint16_t buf[], size_t len) {
-    size_t i;
-    for (i = 0; i < len; ++i) {
-        if (i % 16 == 15)
-            printf("%02x\n", buf[i]);
-        else
-            printf("%02x ", buf[i]);
-    }
+#define CLOCK_FREQUENCY         25000000    // a slave follows the master's clock, up to clk_peri / 12
+
+#define DEFAULT_WORDS           12538       // an adc_A frame: header, 12500 samples, CRC
+#define DEFAULT_PATTERN         BENCH_PATTERN_COUNTER
+#define DEFAULT_GAP_US          1000        // from the end of a burst to the next pulse
+#define BURST_TIMEOUT_US        1000000     // master not clocking, drop the burst
+#define PULSE_US                50          // TRANSFER_PIN pulse, as for a burst of adc_A
+#define REPORT_US               1000000     // USB status line
+
+uint16_t burst[BENCH_MAX_WORDS];
+uint16_t command_ring[BENCH_COMMAND_WORDS] __attribute__((aligned(BENCH_COMMAND_WORDS * sizeof(uint16_t))));
+int tx_channel, rx_channel;
+
+// current setup, changed by BENCH_SET commands
+uint32_t burst_words = DEFAULT_WORDS;
+uint32_t burst_pattern = DEFAULT_PATTERN;
+uint32_t gap_us = DEFAULT_GAP_US;
+
+uint32_t sequence = 0;              // bursts generated since boot
+uint32_t timeouts = 0;              // bursts the master never clocked
+
+/*
+    Description:
+        Set up the slave port: mode 3, 16 bits, as adc_A
+*/
+void bench_spi_init(void) {
+    spi_init(SPI_PORT, CLOCK_FREQUENCY);
+    spi_set_slave(SPI_PORT, true); // Set SPI0 to slave mode
+    spi_set_format(SPI_PORT, 16, SPI_CPOL_1, SPI_CPHA_1, SPI_MSB_FIRST); // mode 3, CS may stay low across words
+}
 
-    // append trailing newline if there isn't one
-    if (i % 16) {
-        putchar('\n');
-    }
+/*
+    Description:
+        Claim the DMA channels: TX paced by the TX DREQ from the burst, RX paced by
+    the RX DREQ into the command ring, so the last words on MOSI stay behind
+*/
+void bench_dma_init(void) {
+    tx_channel = dma_claim_unused_channel(true);
+    rx_channel = dma_claim_unused_channel(true);
+
+    dma_channel_config tx_cfg = dma_channel_get_default_config(tx_channel);
+    channel_config_set_transfer_data_size(&tx_cfg, DMA_SIZE_16);
+    channel_config_set_read_increment(&tx_cfg, true);
+    channel_config_set_write_increment(&tx_cfg, false);
+    channel_config_set_dreq(&tx_cfg, spi_get_dreq(SPI_PORT, true));
+    channel_config_set_high_priority(&tx_cfg, true);
+    dma_channel_configure(tx_channel, &tx_cfg, &spi_get_hw(SPI_PORT)->dr, burst, 0, false);
+
+    dma_channel_config rx_cfg = dma_channel_get_default_config(rx_channel);
+    channel_config_set_transfer_data_size(&rx_cfg, DMA_SIZE_16);
+    channel_config_set_read_increment(&rx_cfg, false);
+    channel_config_set_write_increment(&rx_cfg, true);
+    channel_config_set_ring(&rx_cfg, true, __builtin_ctz(sizeof(command_ring)));
+    channel_config_set_dreq(&rx_cfg, spi_get_dreq(SPI_PORT, false));
+    dma_channel_configure(rx_channel, &rx_cfg, command_ring, &spi_get_hw(SPI_PORT)->dr, 0, false);
 }
 
-// Low-level sleep function in microseconds
-void sleep_us_low_level(uint64_t us) {
-    absolute_time_t end_time = make_timeout_time_us(us);
-    busy_wait_until(end_time);
+/*
+    Description:
+        Header and payload of the next burst in the current setup
+
+    Return:
+        uint32_t - time it took in us
+*/
+uint32_t bench_prepare(void) {
+    uint32_t start = time_us_32();
+    bench_fill(burst + BENCH_HEADER_WORDS, burst_words - BENCH_HEADER_WORDS, burst_pattern, sequence);
+    bench_header_t *header = (bench_header_t *)burst;
+    header->magic = BENCH_MAGIC;
+    header->pattern = burst_pattern;
+    header->words = burst_words;
+    header->timeouts = timeouts;
+    header->sequence = sequence++;
+    uint32_t prep_us = time_us_32() - start;
+    header->prep_us = prep_us > 0xffff ? 0xffff : prep_us;
+    header->check = bench_check(burst, BENCH_HEADER_WORDS - 1);
+    return prep_us;
 }
 
-// Low-level sleep function in milliseconds
-void sleep_ms_low_level(uint64_t ms) {
-    sleep_us_low_level(ms * 1000);
+/*
+    Description:
+        Take the setup the master sent with the last burst. Word j of the burst went
+    to ring slot j % BENCH_COMMAND_WORDS, as the master lays out the command, so the
+    ring holds it in order. A command that did not arrive intact keeps the setup.
+*/
+void bench_apply_command(void) {
+    const uint16_t *command = command_ring;
+    if (command[0] != BENCH_SET || command[BENCH_COMMAND_WORDS - 1] != bench_check(command, BENCH_COMMAND_WORDS - 1)
+        || command[1] < BENCH_MIN_WORDS || command[1] > BENCH_MAX_WORDS || command[2] >= BENCH_PATTERNS) {
+        return;
+    }
+    burst_words = command[1];
+    burst_pattern = command[2];
+    gap_us = command[3] | ((uint32_t)command[4] << 16);
+}
+
+/*
+    Description:
+        Queue the prepared burst, pulse the master and wait until it has clocked
+    every word
+
+    Return:
+        int - 0 when the burst went out, -1 on a timeout
+*/
+int bench_send(uint32_t words) {
+    spi_get_hw(SPI_PORT)->icr = SPI_SSPICR_RORIC_BITS;    // clear stale RX overrun
+    dma_channel_set_write_addr(rx_channel, command_ring, false);
+    dma_channel_set_trans_count(rx_channel, words, true);
+    dma_channel_set_trans_count(tx_channel, words, false);
+    dma_channel_set_read_addr(tx_channel, burst, true);
+
+    gpio_set_dir(TRANSFER_PIN, GPIO_OUT); // impedence low
+    gpio_put(TRANSFER_PIN, 1);  // set GPIO pin HIGH
+    busy_wait_us_32(PULSE_US);
+    gpio_put(TRANSFER_PIN, 0);  // set GPIO pin LOW
+    gpio_set_dir(TRANSFER_PIN, GPIO_IN); // impedence high
+
+    uint32_t start = time_us_32();
+    while (dma_channel_is_busy(rx_channel)) {
+        if (time_us_32() - start > BURST_TIMEOUT_US) {
+            // the FIFO still holds words of this burst, only a reset clears it
+            dma_channel_abort(tx_channel);
+            dma_channel_abort(rx_channel);
+            spi_deinit(SPI_PORT);
+            bench_spi_init();
+            return -1;
+        }
+        tight_loop_contents();
+    }
+    return 0;
 }
 
 int main() {
@@ -50,51 +175,45 @@ int main() {
     puts("Default SPI pins were not defined");
 #else
 
-    printf("SPI master example\n");
+    printf("SPI link benchmark, waiting for spi_bench\n");
 
-    // enable SPI 0 at 1 MHz and connect to GPIOs
-    spi_init(SPI_PORT, CLOCK_FREQUENCY);
-    spi_set_slave(SPI_PORT, true); // Set SPI0 to slave mode
-    spi_set_format(SPI_PORT, 16, 0, 0, 0);
+    bench_spi_init();
     gpio_set_function(PICO_DEFAULT_SPI_RX_PIN, GPIO_FUNC_SPI);
     gpio_set_function(PICO_DEFAULT_SPI_SCK_PIN, GPIO_FUNC_SPI);
     gpio_set_function(PICO_DEFAULT_SPI_TX_PIN, GPIO_FUNC_SPI);
     gpio_set_function(PICO_DEFAULT_SPI_CSN_PIN, GPIO_FUNC_SPI);
-
-    uint16_t out_buf[BUF_LEN], in_buf[BUF_LEN];
-
-    // printf("The baudrate is at: %u Hz\n", spi_get_baudrate(SPI_PORT));
-
-    // uint16_t b16_num = 0;
-    // initialize output buffer
-    for (size_t i = 0; i < BUF_LEN; i++) {
-        out_buf[i] = 641;
-    }
-
     gpio_init(TRANSFER_PIN);
-    gpio_set_dir(TRANSFER_PIN, GPIO_OUT); // impedence low
-
-    // indefinite loop
-    for (size_t i = 0; ; ++i) {
-        // generate signal sending to masterboard
-        gpio_put(TRANSFER_PIN, 1);  // set GPIO pin HIGH
-        sleep_us_low_level(100);
-        gpio_put(TRANSFER_PIN, 0);  // set GPIO pin LOW
+    bench_dma_init();
 
-        int t1 = time_us_32();
+    const char *pattern_names[BENCH_PATTERNS] = { "counter", "prbs", "random" };
+    uint32_t sent = 0, last_report = time_us_32(), last_tx_us = 0;
 
-        // write the output buffer to MOSI, and at the same time read from MISO.
-        int bytes_written = spi_write16_blocking(SPI_PORT, out_buf, BUF_LEN);
-
-        printf("SPI TTK: %d ms\n", (time_us_32() - t1)/1000);
-        
-        // sleep for a little bit of time.
-        sleep_ms_low_level(3000);
+    // indefinite loop
+    while (true) {
+        uint32_t words = burst_words;
+        uint32_t prep_us = bench_prepare();
+        if (prep_us < gap_us) {
+            busy_wait_us_32(gap_us - prep_us);
+        }
+
+        // the master's time on the link, pulse to last word
+        uint32_t t1 = time_us_32();
+        if (bench_send(words) == 0) {
+            last_tx_us = time_us_32() - t1;
+            sent++;
+            bench_apply_command();
+        } else {
+            timeouts++;
+        }
+
+        if (time_us_32() - last_report > REPORT_US) {
+            last_report = time_us_32();
+            printf("bursts %u, timeouts %u, %u words of %s every %u us, SPI TTK %u us\n",
+                   sent, timeouts, burst_words, pattern_names[burst_pattern], gap_us, last_tx_us);
+        }
     }
 
-    printf("Buffer finished transferring\n");
-    
 #endif
 
     return 0;
-}
\ No newline at end of file
+}
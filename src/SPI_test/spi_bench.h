@@ -0,0 +1,92 @@
+#include "pico/stdlib.h"
+
+/*
+    Burst format of the SPI link benchmark, keep in sync with master/spi_bench.h.
+
+    Every burst starts with an 8-word header, then words - 8 payload words of the
+    configured pattern, all generated again by the receiver from the header:
+        BENCH_PATTERN_COUNTER   word i is sequence + i, a slipped word shows at once
+        BENCH_PATTERN_PRBS      PRBS-15 (x^15 + x^14 + 1) from the same seed every burst
+        BENCH_PATTERN_RANDOM    xorshift32 seeded from the sequence, new data every burst
+
+    What the receiver clocks out on MOSI during a burst sets up the next one: the
+    command [BENCH_SET, words, pattern, gap_us low, gap_us high, 0, 0, check] over
+    and over, word j of the burst being command word j % BENCH_COMMAND_WORDS. The
+    pico keeps the last BENCH_COMMAND_WORDS words in a ring indexed the same way,
+    so it holds the command in order whatever the burst length. The check of header
+    and command is ~(sum of the 7 words before it).
+*/
+
+#define BENCH_MAGIC             0xB3C4
+#define BENCH_SET               0x5345
+#define BENCH_HEADER_WORDS      8
+#define BENCH_COMMAND_WORDS     8
+#define BENCH_MIN_WORDS         (BENCH_HEADER_WORDS + BENCH_COMMAND_WORDS)
+#define BENCH_MAX_WORDS         32768
+#define BENCH_PRBS_SEED         0x7fff
+
+#define BENCH_PATTERN_COUNTER   0
+#define BENCH_PATTERN_PRBS      1
+#define BENCH_PATTERN_RANDOM    2
+#define BENCH_PATTERNS          3
+
+typedef struct {
+    uint16_t magic;             // BENCH_MAGIC
+    uint16_t pattern;           // BENCH_PATTERN_*
+    uint16_t words;             // whole burst, header included
+    uint16_t timeouts;          // bursts since boot the receiver never clocked, wraps
+    uint32_t sequence;          // bursts since boot
+    uint16_t prep_us;           // time the pico took to generate this burst
+    uint16_t check;             // ~(sum of the words above)
+} bench_header_t;
+
+_Static_assert(sizeof(bench_header_t) == BENCH_HEADER_WORDS * sizeof(uint16_t), "bench header layout");
+
+// ~(sum of count words), the check word of a header or command
+uint16_t bench_check(const uint16_t *words, uint32_t count) {
+    uint16_t sum = 0;
+    for (uint32_t i = 0; i < count; i++) {
+        sum += words[i];
+    }
+    return (uint16_t)~sum;
+}
+
+/*
+    Description:
+        Generate the payload of one burst
+
+    Parameter:
+        uint16_t *payload - words - BENCH_HEADER_WORDS long
+        uint32_t count    - payload words
+        uint32_t pattern  - BENCH_PATTERN_*
+        uint32_t sequence - of the burst
+*/
+void __not_in_flash_func(bench_fill)(uint16_t *payload, uint32_t count, uint32_t pattern, uint32_t sequence) {
+    if (pattern == BENCH_PATTERN_COUNTER) {
+        for (uint32_t i = 0; i < count; i++) {
+            payload[i] = (uint16_t)(sequence + i);
+        }
+    } else if (pattern == BENCH_PATTERN_PRBS) {
+        uint32_t state = BENCH_PRBS_SEED;
+        for (uint32_t i = 0; i < count; i++) {
+            uint16_t word = 0;
+            for (int bit = 0; bit < 16; bit++) {
+                uint32_t next = ((state >> 14) ^ (state >> 13)) & 1;
+                state = ((state << 1) | next) & 0x7fff;
+                word = (uint16_t)((word << 1) | next);
+            }
+            payload[i] = word;
+        }
+    } else {
+        uint32_t state = sequence * 2654435761u + 0x6d2b79f5u;
+        if (state == 0) {
+            state = 1;
+        }
+        for (uint32_t i = 0; i < count; i++) {
+            state ^= state << 13;
+            state ^= state >> 17;
+            state ^= state << 5;
+            payload[i] = (uint16_t)(state >> 16);
+        }
+    }
+}
@@ -1,12 +1,12 @@
 /*
     About:
         This program attempts to utilize multiple micro-controller pico to achieve cycling
-    adc reading and buffer transferring. You NEED to adjust the machine state before 
-    compilation.
+    adc reading and buffer transferring. Every pico runs this same image, its place in
+    the token ring is read at boot (ring_config.h).
         
     Example:
-        Machine state - 0; Lock status: false
-        Machine state - 1; Lock status: true
+        Ring position - 0 (no strap jumper); Lock status: false
+        Ring position - 1 (jumper on GPIO 10); Lock status: true
     
     Usage:
         In the README file
@@ -14,19 +14,33 @@
 
 #include <stdio.h>
 #include "pico/stdlib.h"
+#include "pico/multicore.h"
 #include "hardware/adc.h"
 #include "hardware/spi.h"
+#include "hardware/sync.h"
+#include "hardware/clocks.h"
 #include "adc_timer.h"
+#include "adc_dma.h"
+#include "adc_pio_trigger.h"
+#include "spi_dma.h"
+#include "ring_config.h"
+#include "link_cal.h"
+#include "burst_frame.h"
+#include "time_delta.h"
+#include "pack12.h"
+#include "rice_encode.h"
 
 /*
     SPI configs:
 */
 #define SPI_PORT                spi0
 #define SPI_CLOCK_FREQUENCY     5000000 // clock speed for SPI channel
+#define LINK_CAL_LISTEN_MS      500     // listen this long at boot for master/link_cal, 0 never calibrates
 
 #define TRANSFER_PIN 4      // GPIO-4 - pin used to signal transfer status
 #define SENDER_PIN 8        // GPIO-8 - pin used to send flag signal for unstalling main
 #define RECEIVER_PIN 9      // GPIO-9 - pin used to receive flag signal for unstalling main
+#define SYNC_PIN 13         // GPIO-13 - common sync pulse, every rising edge is latched for the receiver's timebase
 
 /*
     ADC configs:
@@ -37,36 +51,194 @@
 #define ADC_PIN 26          // ADC0 aka GPIO-26, pin corresponding to adc unit
 #define ADC_CHANNEL 0       // ADC channels, pick from 0-3 (4 is reserved for temp. sensor)
 
+// round-robin capture: bit n enables ADC input n (bit 4 is the temp. sensor). The
+// inputs are converted in ascending order and interleaved in the buffer, each one
+// at Fs / ADC_CHANNELS_USED. A single bit keeps the plain single-channel capture.
+#define ADC_CHANNEL_MASK (1u << ADC_CHANNEL)
+#define ADC_CHANNELS_USED (((ADC_CHANNEL_MASK) & 1) + ((ADC_CHANNEL_MASK) >> 1 & 1) + ((ADC_CHANNEL_MASK) >> 2 & 1) \
+                         + ((ADC_CHANNEL_MASK) >> 3 & 1) + ((ADC_CHANNEL_MASK) >> 4 & 1))
+
 // choose buffer size 
 #define SAMPLE_BUFFER_SIZE 12500
-#define BUFFER_THRESHOLD 12500
+
+// early hand-off: the next pico gets the token this many samples before the buffer is
+// full, so its arming (the 50 us pulse and its wake-up) overlaps the tail of this one.
+// 0 hands off on the last sample.
+#define HANDOFF_LEAD 32
+#define BUFFER_THRESHOLD (SAMPLE_BUFFER_SIZE - HANDOFF_LEAD)
+#define HANDOFF_PULSE_US 50 // width of the hand-off pulse, the next pico wakes on its falling edge
+
+// number of capture buffers: 1 keeps the fill -> transfer -> hand-off cycle,
+// 2 or more keep capturing into the next buffer while the previous one drains over SPI
+#define CAPTURE_BUFFERS 1
 
 // USER EDIT (OPTIONAL)
-#define Fs 250000.0          // Sample rate (Hz) (must not goes higer than 75 kSPS)
+#define Fs 250000.0          // Sample rate (Hz) (must not goes higer than 75 kSPS, 500 kSPS with DMA_CAPTURE)
+                            // with DECIMATE this is the ADC rate, buffers fill at Fs / FIR_DECIMATION
 #define ADCCLK 48000000.0   // ADC clock rate (unmutable!)
 
-#define MACHINES_EMPLOYED 2 // how many pico we are using
+// sample timing sent in every frame header, the receiver turns it into its own time
+#define ADC_CONVERSION_NS (96 * 1e9 / ADCCLK)   // first result after a free-running start
+#define ADC_PERIOD_PS ((1.0 + (uint32_t)((ADCCLK / Fs - 1.0) * 256) / 256.0) * 1e12 / ADCCLK) // as the 8.8 divider runs
+
+#define MACHINES_EMPLOYED 2 // how many pico are in the ring, unless the flash config block says otherwise
+
+#define TELEMETRY_EVERY 16  // TELEMETRY: frames per telemetry block
 
 // ---------------- Preprocessor variable ----------------
 // #define MSG
 // #define RECORD_TIME
+// #define DMA_CAPTURE      // free-running ADC at Fs, DMA fills the buffer (ignores ADC_PULSE_PIN)
+// #define DUAL_CORE        // core0 only captures, core1 runs SPI, USB and the handshake pins
+// #define PIO_TRIGGER      // PIO starts a conversion on each ADC_PULSE_PIN edge, DMA fills the buffer
+// #define PACKED_12BIT     // 4 samples in 3 words on the link (pack12.h), bursts take a quarter less time
+// #define RICE_CODED       // lossless delta + Rice coding on the link (rice_encode.h), burst time follows the signal
+// #define DECIMATE         // DMA_CAPTURE: low-pass the ADC stream and keep every FIR_DECIMATION-th sample (decimate.h)
+// #define INTERLEAVE       // DMA_CAPTURE: no token, every pico starts on the same sync pulse, ring_position / ring_size
+                            // of a sample period late, the receiver merges them into ring_size x the rate
+// #define TELEMETRY        // trigger-path latency / jitter histograms in RAM, sent after the payload (telemetry.h)
+
+#if defined(DMA_CAPTURE) && defined(RECORD_TIME)
+#error RECORD_TIME needs a per-sample ISR, sample times in DMA_CAPTURE are n / Fs
+#endif
+
+#if defined(PIO_TRIGGER) && (defined(DMA_CAPTURE) || defined(RECORD_TIME))
+#error PIO_TRIGGER has no per-sample ISR, it cannot be combined with DMA_CAPTURE or RECORD_TIME
+#endif
+
+#if defined(DECIMATE) && (!defined(DMA_CAPTURE) || ADC_CHANNELS_USED > 1)
+#error DECIMATE filters the free-running stream of one ADC input, it needs DMA_CAPTURE and a single channel
+#endif
+
+#if defined(INTERLEAVE) && !defined(DMA_CAPTURE)
+#error INTERLEAVE sets the phase of a free-running ADC, it needs DMA_CAPTURE
+#endif
+
+#if HANDOFF_LEAD < 0 || HANDOFF_LEAD >= SAMPLE_BUFFER_SIZE
+#error HANDOFF_LEAD must leave the hand-off point inside the buffer
+#endif
+
+#if CAPTURE_BUFFERS < 1
+#error CAPTURE_BUFFERS must be at least 1
+#endif
+
+#if defined(PACKED_12BIT) && defined(RICE_CODED)
+#error PACKED_12BIT and RICE_CODED are alternative payload formats, pick one
+#endif
+
+#if ADC_CHANNEL_MASK == 0 || ADC_CHANNEL_MASK > 0x1f
+#error ADC_CHANNEL_MASK must select inputs 0-4
+#endif
+
+#if SAMPLE_BUFFER_SIZE % ADC_CHANNELS_USED != 0
+#error SAMPLE_BUFFER_SIZE must hold a whole number of round-robin cycles
+#endif
+
+#if LINK_CAL_LISTEN_MS > 0 && SAMPLE_BUFFER_SIZE < LINK_CAL_WORDS
+#error link_cal builds its PRBS block in the first capture buffer, SAMPLE_BUFFER_SIZE is too small
+#endif
+
+#if defined(DUAL_CORE) && CAPTURE_BUFFERS > 7
+#error DUAL_CORE passes every buffer through the 8-entry inter-core FIFO, use at most 7 buffers
+#endif
+
+// the filter is only pulled in (and into RAM) when it is used
+#ifdef DECIMATE
+#include "decimate.h"
+#endif
+
+// likewise the histograms and the PIO latch
+#ifdef TELEMETRY
+#include "telemetry.h"
+_Static_assert(TELEMETRY_WORDS <= FRAME_TELEMETRY_MAX_WORDS, "telemetry block does not fit the receiver's frame");
+#endif
+
+// spacing of the buffered samples and the time from the ADC start to the first one
+#if defined(DECIMATE)
+#define SAMPLE_PERIOD_PS (ADC_PERIOD_PS * FIR_DECIMATION)
+#define FIRST_SAMPLE_NS (ADC_CONVERSION_NS + (FIR_DECIMATION - 1 - (FIR_TAPS - 1) / 2.0) * ADC_PERIOD_PS / 1000) // group delay
+#elif defined(DMA_CAPTURE)
+#define SAMPLE_PERIOD_PS ADC_PERIOD_PS
+#define FIRST_SAMPLE_NS ADC_CONVERSION_NS
+#else
+#define SAMPLE_PERIOD_PS 0  // paced by the trigger pulses
+#define FIRST_SAMPLE_NS 0   // the run starts at the first trigger
+#endif
+
+// inter-core FIFO messages, DUAL_CORE only
+#define CORE_MSG_CAPTURE    1   // core1 -> core0: token received, capture may start
+#define CORE_MSG_FREE       2   // core1 -> core0: oldest filled buffer is sent and cleared
+#define CORE_MSG_FILLED     3   // core0 -> core1: next buffer is full, send it
+#define CORE_MSG_HANDOFF    4   // core0 -> core1: threshold reached, pulse the next machine
 
 // ------------------- Buffer Config ---------------------
-volatile uint16_t sample_buffer[SAMPLE_BUFFER_SIZE]; // buffer that stores all the ADC values
+// each buffer is a complete frame: header directly followed by the samples,
+// so one DMA transfer (and one sniffer CRC) covers both
+typedef struct {
+    burst_frame_t header;
+    uint16_t samples[SAMPLE_BUFFER_SIZE];
+#ifdef TELEMETRY
+    uint16_t telemetry_room[TELEMETRY_WORDS];   // the block follows the payload, past the samples when they are not packed
+#endif
+} capture_frame_t;
+
+volatile capture_frame_t capture_frame[CAPTURE_BUFFERS]; // buffers that store all the ADC values
+uint32_t frame_sequence = 0;        // frames sent so far, the receiver uses it to count drops
 #ifdef RECORD_TIME
-volatile uint32_t timestamp[SAMPLE_BUFFER_SIZE]; // buffer that stores timestamp values
+volatile time_delta_t timestamp[CAPTURE_BUFFERS][SAMPLE_BUFFER_SIZE]; // time since the previous sample (time_delta.h)
+volatile time_delta_log_t time_log[CAPTURE_BUFFERS];                // arm time and long gaps of each buffer
 #endif
 volatile uint32_t sample_index = 0; // buffer index, current ADC value
-volatile bool sampling_done = false;    // flag to signal if sampling is done
+volatile uint32_t fill_buffer = 0;      // buffer being filled by the ISR / DMA
+volatile uint32_t drain_buffer = 0;     // oldest filled buffer, next one to go over SPI
+volatile uint32_t buffers_ready = 0;    // filled buffers waiting for SPI
+volatile bool capturing = false;        // flag to signal if the trigger / DMA is armed
+#ifdef DECIMATE
+// the DMA fills two raw blocks in turn, a low-priority IRQ filters each into the buffer
+#define DECIM_BLOCK 256
+volatile uint16_t decim_raw[2][DECIM_BLOCK];    // raw ADC samples at Fs
+volatile uint32_t decim_dma_block = 0;          // raw block the DMA is filling
+volatile int32_t decim_pending = -1;            // raw block waiting for the filter, -1 if none
+volatile bool decim_busy = false;               // filter IRQ is working on a block
+volatile uint32_t decim_overruns = 0;           // raw blocks overwritten before they were filtered
+decimator_t decimator;                          // filter history (decimate.h)
+uint decim_irq;                                 // user IRQ the filter runs in
+#endif
+
+// ---------------------- Timebase -----------------------
+// a run is a gap-free stretch of buffers from one start_capture() to the next stop
+volatile uint64_t run_start_us[CAPTURE_BUFFERS];    // start of the run each buffer belongs to
+volatile uint32_t run_offset[CAPTURE_BUFFERS];      // samples of the run before each buffer
+volatile bool run_first_pending = false;            // trigger ISR: the run starts at the next trigger
+volatile uint32_t sync_count = 0;       // sync pulses latched since boot
+volatile uint64_t sync_latch_us = 0;    // time of the latest one
+#ifdef INTERLEAVE
+volatile bool interleave_armed = false; // the next sync pulse starts the ADC
+uint32_t interleave_delay_cycles = 0;   // ring_position / ring_size of a sample period
+int32_t interleave_delay_ns = 0;
+#endif
 
-// **********************************************************************
-// ------------ IMPORTANT: ADJUST THE FOLLOWING VARIABLE !!! ------------
-// **********************************************************************
+// ------------------- Stage Timings ---------------------
+volatile uint32_t fill_start_us[CAPTURE_BUFFERS];   // first sample of each buffer
+volatile uint32_t fill_end_us[CAPTURE_BUFFERS];     // last sample of each buffer
+volatile uint32_t capture_idle_us = 0;  // total time spent with no buffer to capture into
+volatile uint32_t capture_idle_since = 0;
+volatile uint32_t capture_overruns = 0; // times every buffer was still waiting for SPI
+volatile uint32_t tx_start_us, tx_end_us;           // DMA feeding the SPI FIFO
+volatile uint32_t tx_idle_start, tx_idle_end;       // capture idle time at both ends
+volatile bool tx_done = false;          // transfer finished, buffer not yet handed back
+volatile uint32_t buffers_sending = 0;  // buffer owned by the SPI side (0 or 1)
+volatile uint32_t tx_buffer = 0;        // buffer currently going out over SPI
+uint32_t tx_queued = 0;                 // DUAL_CORE: filled buffers core1 has not sent yet
 
-// USER EDIT: indicate the current machine, useful for debugging.
-unsigned int machine_state = 0;
-// USER EDIT: machine 0 starts off unlocked, the rest starts off locked.
-volatile bool lock = false;
+// ------------------- Ring Position ---------------------
+// read at boot from the flash config block or the strap pins (ring_config.h),
+// every pico runs the same image
+uint32_t ring_position = 0;         // place in the token ring, 0 starts with the token
+uint32_t ring_size = MACHINES_EMPLOYED;
+uint32_t link_hz = 0;               // SPI clock link_cal settled on (link_cal.h), sent in every frame header
+unsigned int machine_state = 0;     // ring_position + ring_size * bursts so far, useful for debugging
+volatile bool lock = false;         // position 0 starts off unlocked, the rest starts off locked
 
 // digital-to-voltage conversion, convert ADC values to voltage
 const float conversion_factor = 3.3f/(1<<12); 
@@ -78,6 +250,103 @@ const float conversion_factor = 3.3f/(1<<12);
 */
 void __not_in_flash_func(unlock_trigger_callback)(uint gpio, uint32_t events) { 
     lock = false;   // unlock
+#ifdef TELEMETRY
+    telemetry_token();
+#endif
+}
+
+/*
+    Description:
+        Alarm callback (timer IRQ), ends the hand-off pulse: the falling edge is what
+    unlocks the next machine
+
+    Return:
+        int64_t - 0, the alarm does not repeat
+*/
+int64_t __not_in_flash_func(handoff_pulse_end)(alarm_id_t id, void *user_data) {
+    gpio_put(SENDER_PIN, 0);  // set GPIO pin LOW
+
+    // temporarily disable gpio
+    gpio_set_dir(SENDER_PIN, GPIO_IN); // impedence high
+    return 0;
+}
+
+/*
+    Description:
+        Pulse the sender pin so the next machine leaves its stalling stage. Only the
+    rising edge is driven here, an alarm ends the pulse, so it is safe to call from
+    the capture IRQ.
+*/
+void __not_in_flash_func(send_handoff_pulse)(void) {
+    // set out-mode for sender pin, and pull up for irq sending
+    gpio_set_dir(SENDER_PIN, GPIO_OUT); // impedence low
+
+    // generate signal sending to the next machine
+    gpio_put(SENDER_PIN, 1);  // set GPIO pin HIGH
+    if (add_alarm_in_us(HANDOFF_PULSE_US, handoff_pulse_end, NULL, true) < 0) {
+        // no free alarm slot, fall back to a busy pulse
+        sleep_us_low_level(HANDOFF_PULSE_US);
+        handoff_pulse_end(0, NULL);
+    }
+}
+
+/*
+    Description:
+        Hand the token to the next machine. With DUAL_CORE core1 drives the pulse,
+    so not even the alarm that ends it runs on the capture core.
+*/
+static inline void request_handoff(void) {
+#if defined(INTERLEAVE)
+    // no token, every pico captures at once
+#elif defined(DUAL_CORE)
+    multicore_fifo_push_blocking(CORE_MSG_HANDOFF);
+#else
+    send_handoff_pulse();
+#endif
+}
+
+/*
+    Description:
+        Mark the buffer being filled as ready for SPI and move on to the next free
+    buffer. If every buffer is still waiting for SPI, capture stops (overrun) and
+    main re-arms it once a buffer has drained. Called from IRQ context.
+
+    Return:
+        volatile uint16_t* - the buffer capture continues into, NULL if stopped
+*/
+volatile uint16_t* __not_in_flash_func(buffer_filled)(void) {
+    uint32_t now = time_us_32();
+    fill_end_us[fill_buffer] = now;
+    buffers_ready++;
+    sample_index = 0;
+#ifdef DUAL_CORE
+    multicore_fifo_push_blocking(CORE_MSG_FILLED);  // never blocks, at most CAPTURE_BUFFERS + 1 in flight
+#endif
+
+    if (CAPTURE_BUFFERS > 1 && buffers_ready < CAPTURE_BUFFERS) {
+        uint32_t previous = fill_buffer;
+        fill_buffer = (fill_buffer + 1) % CAPTURE_BUFFERS;
+        fill_start_us[fill_buffer] = now;
+        run_start_us[fill_buffer] = run_start_us[previous];     // same run, no gap
+        run_offset[fill_buffer] = run_offset[previous] + SAMPLE_BUFFER_SIZE;
+#ifdef RECORD_TIME
+        time_delta_reset(&time_log[fill_buffer], now);
+#endif
+        return capture_frame[fill_buffer].samples;
+    }
+
+    // nothing left to capture into
+    if (CAPTURE_BUFFERS > 1) {
+        capture_overruns++;
+    }
+    capturing = false;
+    capture_idle_since = now;
+#if defined(PIO_TRIGGER)
+    adc_pio_trigger_stop();
+#elif !defined(DMA_CAPTURE)
+    gpio_set_irq_enabled(ADC_PULSE_PIN, GPIO_IRQ_EDGE_RISE | GPIO_IRQ_EDGE_FALL, false);
+#endif
+    return NULL;
 }
 
 /*
@@ -95,56 +364,589 @@ void __not_in_flash_func(unlock_trigger_callback)(uint gpio, uint32_t events) {
         NULL
 */
 void __not_in_flash_func(ADC_trigger_callback)(uint gpio, uint32_t events) {
+#ifdef TELEMETRY
+    if (events & GPIO_IRQ_EDGE_RISE) {
+        telemetry_trigger_enter();  // stops the edge latch, before anything else
+    }
+    uint32_t entry = telemetry_cycles();
+#endif
 
     if (sample_index < SAMPLE_BUFFER_SIZE) {
-        sample_buffer[sample_index] = adc_read();   // single ADC sample acquire
+        capture_frame[fill_buffer].samples[sample_index] = adc_read();   // single ADC sample acquire
+        if (run_first_pending) {
+            run_start_us[fill_buffer] = time_us_64();   // the run starts at its first trigger
+            run_first_pending = false;
+        }
 
 #ifdef RECORD_TIME
-        timestamp[sample_index] = time_us_32(); // get timestamp in microsecond
+        time_delta_put(&time_log[fill_buffer], timestamp[fill_buffer], sample_index, time_us_32()); // get timestamp in microsecond
 #endif
 
         sample_index++; // increment the sampling index
         // printf("Sample index is %d\n",sample_index);
 
+#if CAPTURE_BUFFERS == 1
         // check if the index exceeds certain threshold
         if (sample_index == BUFFER_THRESHOLD){
-            // set out-mode for sender pin, and pull up for irq sending
-            gpio_set_dir(SENDER_PIN, GPIO_OUT); // impedence low
-
-            // generate signal sending to machine 2
-            gpio_put(SENDER_PIN, 1);  // set GPIO pin HIGH
-            sleep_us_low_level(50);
-            gpio_put(SENDER_PIN, 0);  // set GPIO pin LOW
-
-            // temporarily disable gpio
-            gpio_set_dir(SENDER_PIN, GPIO_IN); // impedence high
+            request_handoff();
         }
+#endif
 
         // check if the sample index is out of the BUFFER bound
         if (sample_index >= SAMPLE_BUFFER_SIZE) {
-            sampling_done = true;
+            buffer_filled();
+        }
+    }
+
+#ifdef TELEMETRY
+    if (events & GPIO_IRQ_EDGE_RISE) {
+        telemetry_trigger_done(entry);
+    } else {
+        telemetry_isr_done(entry);
+    }
+#endif
+}
+
+#if defined(DMA_CAPTURE) || defined(PIO_TRIGGER)
+/*
+    Description:
+        DMA capture callback (IRQ context), mirrors the bookkeeping of ADC_trigger_callback
+
+    Parameter:
+        uint32_t samples_captured - BUFFER_THRESHOLD on hand-off, SAMPLE_BUFFER_SIZE when done
+*/
+volatile uint16_t* __not_in_flash_func(ADC_dma_callback)(uint32_t samples_captured) {
+#ifdef TELEMETRY
+    uint32_t entry = telemetry_cycles();
+#endif
+    volatile uint16_t *next = NULL;
+    if (samples_captured < SAMPLE_BUFFER_SIZE) {
+        sample_index = samples_captured;
+#if CAPTURE_BUFFERS == 1
+        request_handoff();
+#endif
+    } else {
+        next = buffer_filled();
+    }
+
+#ifdef TELEMETRY
+    telemetry_isr_done(entry);
+#endif
+    return next;
+}
+#endif
+
+#ifdef DECIMATE
+/*
+    Description:
+        DMA capture callback with DECIMATE (IRQ context): pass the full raw block to
+    the filter IRQ and keep the DMA going into the other one
+
+    Parameter:
+        uint32_t samples_captured - always DECIM_BLOCK, raw blocks have no threshold
+
+    Return:
+        volatile uint16_t* - the raw block to continue into
+*/
+volatile uint16_t* __not_in_flash_func(ADC_decim_dma_callback)(uint32_t samples_captured) {
+    if (decim_pending >= 0 || decim_busy) {
+        decim_overruns++;   // the filter is behind, the block it has not finished gets overwritten
+    }
+    decim_pending = decim_dma_block;
+    decim_dma_block ^= 1;
+    irq_set_pending(decim_irq);
+    return decim_raw[decim_dma_block];
+}
+
+/*
+    Description:
+        Filter IRQ, at the lowest priority so the DMA, SPI and GPIO interrupts preempt
+    it. Decimates the pending raw block into the fill buffer, with the threshold and
+    buffer bookkeeping of ADC_trigger_callback.
+*/
+void __not_in_flash_func(ADC_decim_irq_handler)(void) {
+#ifdef TELEMETRY
+    uint32_t entry = telemetry_cycles();
+#endif
+    uint32_t irq_status = save_and_disable_interrupts();
+    int32_t block = decim_pending;
+    decim_pending = -1;
+    decim_busy = (block >= 0 && capturing);
+    restore_interrupts(irq_status);
+    if (!decim_busy) {
+        return;
+    }
+
+    const volatile uint16_t *raw = decim_raw[block];
+    uint32_t left = DECIM_BLOCK;
+    while (left > 0) {
+        uint32_t before = sample_index, produced;
+        uint32_t used = decimator_run(&decimator, raw, left, &capture_frame[fill_buffer].samples[before],
+                                      SAMPLE_BUFFER_SIZE - before, &produced);
+        raw += used;
+        left -= used;
+        sample_index = before + produced;
+
+#if CAPTURE_BUFFERS == 1
+        if (before < BUFFER_THRESHOLD && sample_index >= BUFFER_THRESHOLD) {
+            request_handoff();
+        }
+#endif
+
+        // the rest of the block goes into the next buffer, if there is one
+        if (sample_index >= SAMPLE_BUFFER_SIZE && buffer_filled() == NULL) {
+            adc_dma_stop();
+            break;
         }
     }
+    decim_busy = false;
+#ifdef TELEMETRY
+    telemetry_isr_done(entry);
+#endif
 }
+#endif
 
-int clear_buffer(volatile uint16_t* data){
+/*
+    Description:
+        Sync pulse IRQ: latch the local time of every rising edge on SYNC_PIN. The
+    receiver sees the same edges and fits its clock against these latches. With
+    INTERLEAVE an armed capture is started here, after this pico's share of the
+    sample period.
+*/
+void __not_in_flash_func(sync_pulse_irq)(void) {
+    if (!(gpio_get_irq_event_mask(SYNC_PIN) & GPIO_IRQ_EDGE_RISE)) {
+        return;     // another pin of the bank
+    }
+    gpio_acknowledge_irq(SYNC_PIN, GPIO_IRQ_EDGE_RISE);
+    uint64_t now = time_us_64();
+
+#ifdef INTERLEAVE
+    if (interleave_armed) {
+        busy_wait_at_least_cycles(interleave_delay_cycles);
+        adc_dma_run();
+        run_start_us[fill_buffer] = now;    // the receiver matches it to the edge, the delay is in the header
+        interleave_armed = false;
+    }
+#endif
+
+    sync_latch_us = now;
+    sync_count++;
+}
+
+/*
+    Description:
+        Listen to SYNC_PIN, on the core that calls it
+*/
+void sync_pulse_init(void) {
+    gpio_init(SYNC_PIN);
+    gpio_set_dir(SYNC_PIN, GPIO_IN);
+    gpio_pull_down(SYNC_PIN);   // no pulses without a generator
+    gpio_add_raw_irq_handler(SYNC_PIN, &sync_pulse_irq);
+    gpio_set_irq_enabled(SYNC_PIN, GPIO_IRQ_EDGE_RISE, true);
+#ifdef INTERLEAVE
+    irq_set_priority(IO_IRQ_BANK0, PICO_HIGHEST_IRQ_PRIORITY);  // the start phase is the sample phase
+#endif
+    irq_set_enabled(IO_IRQ_BANK0, true);
+}
+
+/*
+    Description:
+        Arm the trigger (or start the DMA capture) into the current fill buffer
+*/
+void start_capture(void) {
+    uint32_t now = time_us_32();
+
+    uint32_t irq_status = save_and_disable_interrupts();
+    if (capture_idle_since != 0) {
+        capture_idle_us += now - capture_idle_since;
+        capture_idle_since = 0;
+    }
+    fill_start_us[fill_buffer] = now;
+#ifdef RECORD_TIME
+    time_delta_reset(&time_log[fill_buffer], now);
+#endif
+    sample_index = 0;
+    run_offset[fill_buffer] = 0;
+    run_start_us[fill_buffer] = time_us_64();   // arm time, refined below
+    run_first_pending = true;
+    capturing = true;
+    restore_interrupts(irq_status);
+
+    // every buffer starts at the first input, so the receiver knows the interleaving
+    adc_select_input(__builtin_ctz(ADC_CHANNEL_MASK));
+
+#if defined(DECIMATE)
+    // free-running conversions into the raw blocks, the filter IRQ fills the buffer
+    decimator_reset(&decimator);
+    decim_pending = -1;
+    decim_dma_block = 0;
+    adc_dma_start(decim_raw[0], DECIM_BLOCK, DECIM_BLOCK);
+#elif defined(DMA_CAPTURE)
+    // free-running conversions, DMA moves every sample into the buffer
+    adc_dma_start(capture_frame[fill_buffer].samples, SAMPLE_BUFFER_SIZE,
+                  CAPTURE_BUFFERS == 1 ? BUFFER_THRESHOLD : SAMPLE_BUFFER_SIZE);
+#elif defined(PIO_TRIGGER)
+    // the PIO starts each conversion, DMA moves every sample into the buffer
+    adc_pio_trigger_start(capture_frame[fill_buffer].samples, SAMPLE_BUFFER_SIZE,
+                          CAPTURE_BUFFERS == 1 ? BUFFER_THRESHOLD : SAMPLE_BUFFER_SIZE);
+#else
+    gpio_set_dir(ADC_PULSE_PIN, GPIO_IN);
+    gpio_pull_up(ADC_PULSE_PIN);
+
+    // enabled the IRS
+    gpio_set_irq_enabled_with_callback(ADC_PULSE_PIN, GPIO_IRQ_EDGE_RISE | GPIO_IRQ_EDGE_FALL, true, &ADC_trigger_callback);
+#endif
+
+#if defined(INTERLEAVE)
+    // set up but not started, the next sync pulse starts the ADC
+    interleave_armed = true;
+#elif defined(DMA_CAPTURE)
+    run_start_us[fill_buffer] = adc_dma_run_us;
+#endif
+#ifdef TELEMETRY
+    telemetry_capture_armed();
+    telemetry_trigger_restart();    // edges were not watched while the capture was stopped
+#endif
+}
+
+/*
+    Description:
+        Total time capture has been stopped up to now, used for the overlap metric
+*/
+uint32_t __not_in_flash_func(capture_idle_at)(uint32_t now) {
+    uint32_t irq_status = save_and_disable_interrupts();
+    uint32_t idle = capture_idle_us;
+    if (capture_idle_since != 0) {
+        idle += now - capture_idle_since;
+    }
+    restore_interrupts(irq_status);
+    return idle;
+}
+
+/*
+    Description:
+        SPI DMA completion callback (IRQ context), latch the end-of-transfer timings.
+    With DUAL_CORE the capture idle time is read from the other core, the overlap
+    metric is then approximate.
+*/
+void __not_in_flash_func(transfer_done_callback)(void) {
+    tx_end_us = time_us_32();
+    tx_idle_end = capture_idle_at(tx_end_us);
+    tx_done = true;
+#ifdef TELEMETRY
+    telemetry_record(TELEMETRY_TRANSFER, tx_end_us - tx_start_us);
+#endif
+}
+
+int clear_buffer(uint32_t buffer){
     // clear the sample buffer
     for (int i = 0; i < SAMPLE_BUFFER_SIZE; i++) {
-        data[i] = 0;
+        capture_frame[buffer].samples[i] = 0;
 #ifdef RECORD_TIME
-        timestamp[i] = 0; // clear the timestamp buffer if RECORD_TIME is defined
+        timestamp[buffer][i] = 0; // clear the timestamp buffer if RECORD_TIME is defined
 #endif
     }
+#ifdef RECORD_TIME
+    time_delta_reset(&time_log[buffer], 0);
+#endif
     
     return 0;
 }
 
+/*
+    Description:
+        Finish a completed SPI transfer: report the per-buffer stage timings, clear
+    the buffer and hand it back to the capture side. Called from the main loop
+    wherever it waits, a no-op while nothing has completed.
+
+    Return:
+        int - 1 if the buffer could not be cleared, 0 otherwise
+*/
+int finish_transfer(void) {
+    if (!tx_done) {
+        return 0;
+    }
+    tx_done = false;
+
+    uint32_t buffer = tx_buffer;
+
+    // how long it took to fill, how long it waited for SPI, how long SPI took
+    // and for how much of that the capture kept running
+    printf("Buffer %d: fill %d us, wait %d us, SPI TTK %d us, overlap %d us, overruns %d\n",
+           buffer,
+           fill_end_us[buffer] - fill_start_us[buffer],
+           tx_start_us - fill_end_us[buffer],
+           tx_end_us - tx_start_us,
+           (tx_end_us - tx_start_us) - (tx_idle_end - tx_idle_start),
+           capture_overruns);
+#if defined(PACKED_12BIT) || defined(RICE_CODED)
+    // size against plain 16-bit words in per mille (integer, no soft-float printf), and what it cost
+    printf("Buffer %d: %d samples in %d words, %d per mille of plain, encode %d us\n",
+           buffer, SAMPLE_BUFFER_SIZE, capture_frame[buffer].header.payload_words,
+           (int)(capture_frame[buffer].header.payload_words * 1000u / SAMPLE_BUFFER_SIZE),
+           capture_frame[buffer].header.encode_us);
+#endif
+#ifdef DECIMATE
+    printf("Buffer %d: decimated %d:1, %d raw blocks lost\n", buffer, FIR_DECIMATION, decim_overruns);
+#endif
+
+#ifdef MSG
+    printf("Machine state %d: transferring finished , now clearing the buffer! \n", machine_state);
+#endif
+
+    // clear the BUFFER before it is reused
+    if(clear_buffer(buffer)){
+        printf("Error: Buffer cannot be clear. \n");
+        return 1;
+    }
+
+#ifdef DUAL_CORE
+    // the buffer counters belong to core0, it releases the buffer itself
+    buffers_sending = 0;
+    multicore_fifo_push_blocking(CORE_MSG_FREE);
+#else
+    uint32_t irq_status = save_and_disable_interrupts();
+    drain_buffer = (drain_buffer + 1) % CAPTURE_BUFFERS;
+    buffers_ready--;
+    buffers_sending = 0;
+    restore_interrupts(irq_status);
+#endif
+    return 0;
+}
+
+/*
+    Description:
+        Service the transport side while waiting: pick up messages from core0
+    (DUAL_CORE) and finish a completed transfer
+
+    Return:
+        int - 1 on error, 0 otherwise
+*/
+int transport_poll(void) {
+#ifdef DUAL_CORE
+    while (multicore_fifo_rvalid()) {
+        uint32_t msg = multicore_fifo_pop_blocking();
+        if (msg == CORE_MSG_FILLED) {
+            tx_queued++;
+        } else if (msg == CORE_MSG_HANDOFF) {
+            send_handoff_pulse();
+        }
+    }
+#endif
+    return finish_transfer();
+}
+
+/*
+    Description:
+        Stalling stage, wait for the previous machine to hand over the token. The
+    first machine skips it. The previous burst keeps going out over SPI meanwhile.
+
+    Return:
+        int - 1 on error, 0 otherwise
+*/
+int wait_for_token(void) {
+    // let the first state skips the stalling stage, with INTERLEAVE every state does
+#ifdef INTERLEAVE
+    return 0;
+#endif
+    if (machine_state < 1) {
+        return 0;
+    }
+#ifdef MSG
+    printf("Machine state %d: stalling! \n", machine_state);
+#endif
+    // set in-mode for receiver pin and pull it down for irq pending
+    gpio_set_dir(RECEIVER_PIN, GPIO_IN);
+    gpio_pull_up(RECEIVER_PIN);
+
+    // initialize callback function for stalling stage, unlock once interrupted 
+    gpio_set_irq_enabled_with_callback(RECEIVER_PIN, GPIO_IRQ_EDGE_FALL, true, &unlock_trigger_callback);
+
+    while(lock){
+        if (transport_poll()) {
+            return 1;
+        }
+        tight_loop_contents();
+    }
+
+    gpio_set_irq_enabled(RECEIVER_PIN, GPIO_IRQ_EDGE_FALL, false);
+    return 0;
+}
+
+/*
+    Description:
+        Fill in the frame header of a buffer, queue it on the SPI DMA and pulse
+    TRANSFER_PIN so the master starts clocking
+
+    Parameter:
+        uint32_t buffer - filled buffer to send
+*/
+void start_transfer(uint32_t buffer) {
+    tx_buffer = buffer;
+    buffers_sending = 1;
+
+#ifdef MSG     
+    printf("Machine state %d: ADC-reading of buffer %d finished, now starts transferring! \n", machine_state, buffer);
+#endif
+
+    // packed / coded here on the transport side, capture is not held up and the master is not pulsed yet
+    uint32_t encode_start = time_us_32();
+#if defined(PACKED_12BIT)
+    uint32_t payload_words = pack12_in_place(capture_frame[buffer].samples, SAMPLE_BUFFER_SIZE);
+    uint16_t payload_flags = FRAME_FLAG_PACKED12;
+#elif defined(RICE_CODED)
+    uint32_t payload_words = rice_encode_in_place(capture_frame[buffer].samples, SAMPLE_BUFFER_SIZE, ADC_CHANNELS_USED);
+    uint16_t payload_flags = FRAME_FLAG_RICE;
+#else
+    uint32_t payload_words = SAMPLE_BUFFER_SIZE;
+    uint16_t payload_flags = 0;
+#endif
+    uint32_t encode_us = time_us_32() - encode_start;
+
+    // every TELEMETRY_EVERY-th frame carries the histograms between payload and CRC
+    uint32_t telemetry_words = 0;
+#ifdef TELEMETRY
+    if (frame_sequence % TELEMETRY_EVERY == 0) {
+        telemetry_words = telemetry_snapshot((volatile uint16_t *)&capture_frame[buffer] + FRAME_HEADER_WORDS + payload_words);
+        payload_flags |= FRAME_FLAG_TELEMETRY;
+    }
+#endif
+
+    // queue the whole buffer first so the FIFO is full by the time the master starts
+    tx_start_us = time_us_32();
+    tx_idle_start = capture_idle_at(tx_start_us);
+    volatile burst_frame_t *header = &capture_frame[buffer].header;
+    header->magic = FRAME_MAGIC;
+    header->version = FRAME_VERSION;
+    header->machine_id = ring_position;
+    header->header_words = FRAME_HEADER_WORDS;
+    header->sequence = frame_sequence++;
+    header->sample_count = SAMPLE_BUFFER_SIZE;
+    header->payload_words = payload_words;
+    header->flags = payload_flags;
+    header->telemetry_words = telemetry_words;
+    header->link_khz = (uint16_t)(link_hz / 1000);
+    header->encode_us = encode_us;
+    header->channel_mask = ADC_CHANNEL_MASK;
+    header->sample_period_ps = (uint32_t)(SAMPLE_PERIOD_PS + 0.5);
+    header->run_offset = run_offset[buffer];
+    header->first_sample_ns = (int32_t)(FIRST_SAMPLE_NS);
+    header->run_start_us = run_start_us[buffer];
+#ifdef INTERLEAVE
+    header->first_sample_ns += interleave_delay_ns;
+    header->flags |= FRAME_FLAG_SYNC_START;
+#endif
+    // the sync IRQ may sit on the other core, read until the count is stable around the latch
+    uint32_t count;
+    do {
+        count = sync_count;
+        header->sync_latch_us = sync_latch_us;
+    } while (count != sync_count);
+    header->sync_count = count;
+    header->transfer_us = time_us_64();     // TRANSFER_PIN goes high right after the DMA is queued
+    spi_dma_write_frame_async((volatile uint16_t *)&capture_frame[buffer],
+                              FRAME_HEADER_WORDS + payload_words + telemetry_words);
+
+    gpio_set_dir(TRANSFER_PIN, GPIO_OUT); // impedence low
+
+    // generate signal sending to masterboard
+    gpio_put(TRANSFER_PIN, 1);  // set GPIO pin HIGH
+    sleep_us_low_level(50);
+    gpio_put(TRANSFER_PIN, 0);  // set GPIO pin LOW
+    
+    gpio_set_dir(TRANSFER_PIN, GPIO_IN); // impedence high
+
+    // no waiting here: the DMA drains the buffer while we go back to
+    // stalling / capturing, finish_transfer() picks up the completion
+}
+
+#ifdef DUAL_CORE
+/*
+    Description:
+        Core1 entry: USB stdio, the SPI transmit path and the handshake pins. Core0
+    fills buffers and reports each one through the FIFO, core1 sends them in order
+    and returns them the same way. The stage sections match the single-core loop.
+*/
+void core1_transport(void) {
+    stdio_init_all();           // USB IRQs run on core1, away from the trigger
+    sleep_ms_low_level(5000);   // wait for USB initialization
+
+    spi_dma_init(SPI_PORT, &transfer_done_callback);    // DMA_IRQ_1 on core1
+
+    bool token_held = false;    // with more than one buffer the trigger is kept after the first unlock
+    uint32_t next_buffer = 0;   // buffers arrive and leave in ring order
+
+    while (true) {
+        // *************************************************
+        // ------------- Stalling Stage Starts -------------
+        // -------------------------------------------------
+        if (!token_held) {
+            if (wait_for_token()) {
+                return;
+            }
+            multicore_fifo_push_blocking(CORE_MSG_CAPTURE);
+            token_held = (CAPTURE_BUFFERS > 1);
+        }
+        // -------------------------------------------------
+        // ------------- Stalling Stage Exited -------------
+        // *************************************************
+
+        // wait for a filled buffer and an idle link
+        while (tx_queued == 0 || buffers_sending || spi_dma_busy()) {
+            if (transport_poll()) {
+                return;
+            }
+            tight_loop_contents();
+        }
+        tx_queued--;
+
+        // *************************************************
+        // ------------ SPI Transferring Starts -----------
+        // -------------------------------------------------
+        start_transfer(next_buffer);
+        next_buffer = (next_buffer + 1) % CAPTURE_BUFFERS;
+        // -------------------------------------------------
+        // ------------- SPI Transferring Ends -------------
+        // *************************************************
+
+        // *************************************************
+        // ------------------ State Reset ------------------
+        // -------------------------------------------------
+#if CAPTURE_BUFFERS == 1
+        lock = true;    // lock up the main, re-entring stalling stage
+#endif
+        // -------------------------------------------------
+        // ---------------- Reset Completed ----------------
+        // *************************************************
+
+        // increment the machine states for debug
+        machine_state += ring_size; 
+    }
+}
+#endif
+
 int main() {
+    // ring position first, it decides whether this pico starts with the token
+    int ring_source = ring_config_read(&ring_position, &ring_size, MACHINES_EMPLOYED);
+    machine_state = ring_position;
+    lock = (ring_position != 0);
+
+#ifndef DUAL_CORE
     stdio_init_all();           // initialize stdio lib
     sleep_ms_low_level(5000);   // wait for USB initialization
 #ifdef MSG
     printf("USB initilization completed \n\n");
 #endif
+#endif
+
+    if (ring_source < 0) {
+        printf("Error: ring position %d does not fit in a ring of %d picos. \n", ring_position, ring_size);
+        return 1;
+    }
+#ifdef MSG
+    printf("Machine state %d: ring position %d of %d, from the %s \n", machine_state, ring_position, ring_size,
+           ring_source ? "flash config block" : "strap pins");
+#endif
 
     // initialize all the operating pin
     gpio_init(ADC_PULSE_PIN);
@@ -154,9 +956,46 @@ int main() {
     
     // initialize ADC configurations
     adc_init();
-    adc_gpio_init(ADC_PIN);
-    adc_select_input(ADC_CHANNEL);
+    for (uint channel = 0; channel < 4; channel++) {
+        if (ADC_CHANNEL_MASK & (1u << channel)) {
+            adc_gpio_init(ADC_PIN + channel);   // ADC n is GPIO 26 + n
+        }
+    }
+    adc_set_temp_sensor_enabled(ADC_CHANNEL_MASK & (1u << 4));
+    adc_select_input(__builtin_ctz(ADC_CHANNEL_MASK));
+    if (ADC_CHANNELS_USED > 1) {
+        adc_set_round_robin(ADC_CHANNEL_MASK);  // each conversion moves on to the next input
+    }
+#ifdef TELEMETRY
+    telemetry_init();   // SysTick of core0, the capture core in every build
+#endif
+#if defined(DECIMATE)
+    // sample period is (1 + div) ADC clock cycles, the filter runs in a spare IRQ below everything else
+    adc_dma_init(ADCCLK/Fs - 1.0f, &ADC_decim_dma_callback);
+    decim_irq = user_irq_claim_unused(true);
+    irq_set_exclusive_handler(decim_irq, ADC_decim_irq_handler);
+    irq_set_priority(decim_irq, PICO_LOWEST_IRQ_PRIORITY);
+    irq_set_enabled(decim_irq, true);
+#elif defined(DMA_CAPTURE)
+    // sample period is (1 + div) ADC clock cycles
+    adc_dma_init(ADCCLK/Fs - 1.0f, &ADC_dma_callback);
+#elif defined(PIO_TRIGGER)
+    // both edges, as with the GPIO interrupt
+    gpio_set_dir(ADC_PULSE_PIN, GPIO_IN);
+    gpio_pull_up(ADC_PULSE_PIN);
+    adc_pio_trigger_init(ADC_PULSE_PIN, true, &ADC_dma_callback);
+#else
     // adc_set_clkdiv(ADCCLK/Fs); // adjust the sampling rate
+#ifdef TELEMETRY
+    telemetry_latency_init(ADC_PULSE_PIN);  // only this trigger has an ISR per edge to be late
+#endif
+#endif
+#ifdef INTERLEAVE
+    // each pico starts ring_position / ring_size of a sample period after the sync edge
+    adc_dma_free_running = false;
+    interleave_delay_ns = (int32_t)(ring_position * SAMPLE_PERIOD_PS / ring_size / 1000);
+    interleave_delay_cycles = (uint32_t)((uint64_t)interleave_delay_ns * clock_get_hz(clk_sys) / 1000000000u);
+#endif
 
 #if !defined(spi_default) || \
         !defined(PICO_DEFAULT_SPI_SCK_PIN) || \
@@ -169,111 +1008,121 @@ int main() {
 
     spi_init(SPI_PORT, SPI_CLOCK_FREQUENCY);
     spi_set_slave(SPI_PORT, true); // Set SPI0 to slave mode
-    spi_set_format(SPI_PORT, 16, 0, 0, 0);
+    spi_set_format(SPI_PORT, 16, SPI_CPOL_1, SPI_CPHA_1, SPI_MSB_FIRST); // mode 3, CS may stay low across words
     gpio_set_function(PICO_DEFAULT_SPI_RX_PIN, GPIO_FUNC_SPI);
     gpio_set_function(PICO_DEFAULT_SPI_SCK_PIN, GPIO_FUNC_SPI);
     gpio_set_function(PICO_DEFAULT_SPI_TX_PIN, GPIO_FUNC_SPI);
     gpio_set_function(PICO_DEFAULT_SPI_CSN_PIN, GPIO_FUNC_SPI);
 
+    // link_cal may ask for a calibration now, still on core0 alone and before the SPI DMA
+    link_hz = ring_config_link_hz();
+    uint32_t calibrated_hz = link_cal_run(SPI_PORT, TRANSFER_PIN, (uint16_t *)capture_frame[0].samples,
+                                          LINK_CAL_LISTEN_MS, MACHINES_EMPLOYED);
+    if (calibrated_hz > 0) {
+        link_hz = calibrated_hz;
+    }
+
 #ifdef MSG    
     printf("Machine state %d: pins initialized... \n", machine_state);
+    printf("Machine state %d: SPI link calibrated at %d Hz (0: never) \n", machine_state, link_hz);
 #endif
 
+    // core0 in both builds: the trigger path has it to itself with DUAL_CORE, and
+    // INTERLEAVE starts the ADC from this IRQ
+    sync_pulse_init();
+
+#ifdef DUAL_CORE
+    multicore_launch_core1(&core1_transport);
+
+    // core0 only arms the capture, every interrupt left on this core is the trigger
+    // path; buffers come back from core1 in the order they were filled
+    bool armed = false;
     while(true){
+        uint32_t msg = multicore_fifo_pop_blocking();
+        if (msg == CORE_MSG_CAPTURE) {
+            armed = true;
+        } else if (msg == CORE_MSG_FREE) {
+            uint32_t irq_status = save_and_disable_interrupts();
+            drain_buffer = (drain_buffer + 1) % CAPTURE_BUFFERS;
+            buffers_ready--;
+            restore_interrupts(irq_status);
+        }
+
         // *************************************************
-        // ------------- Stalling Stage Starts -------------
+        // ---------------- ADC Read Starts ----------------
         // -------------------------------------------------
-        // let the first state skips the stalling stage
-        if (machine_state >= 1) {
-#ifdef MSG
-            printf("Machine state %d: stalling! \n", machine_state);
-#endif
-            // set in-mode for receiver pin and pull it down for irq pending
-            gpio_set_dir(RECEIVER_PIN, GPIO_IN);
-            gpio_pull_up(RECEIVER_PIN);
+        if (armed && !capturing && buffers_ready < CAPTURE_BUFFERS) {
+            fill_buffer = (drain_buffer + buffers_ready) % CAPTURE_BUFFERS;
+            start_capture();
+            armed = (CAPTURE_BUFFERS > 1);  // one buffer needs the token again
+        }
+    }
+#else
+    spi_dma_init(SPI_PORT, &transfer_done_callback);
 
-            // initialize callback function for stalling stage, unlock once interrupted 
-            gpio_set_irq_enabled_with_callback(RECEIVER_PIN, GPIO_IRQ_EDGE_FALL, true, &unlock_trigger_callback);
+    bool token_held = false;    // with more than one buffer the trigger is kept after the first unlock
 
-            while(lock){
-                tight_loop_contents();
+    while(true){
+        // with more than one buffer the capture keeps running across iterations,
+        // stalling and arming only happen when it is stopped
+        if (!capturing) {
+            if (!token_held) {
+                // *************************************************
+                // ------------- Stalling Stage Starts -------------
+                // -------------------------------------------------
+                if (wait_for_token()) {
+                    return 1;
+                }
+                // -------------------------------------------------
+                // ------------- Stalling Stage Exited -------------
+                // *************************************************
+                token_held = (CAPTURE_BUFFERS > 1);
             }
- 
-            gpio_set_irq_enabled(RECEIVER_PIN, GPIO_IRQ_EDGE_FALL, false);
-        }
-        // -------------------------------------------------
-        // ------------- Stalling Stage Exited -------------
-        // *************************************************
-    
+
 #ifdef MSG 
-        printf("Machine state %d: stalling exited (skipped), now starts ADC-capturing! \n", machine_state);
+            printf("Machine state %d: stalling exited (skipped), now starts ADC-capturing! \n", machine_state);
 #endif
 
-        // *************************************************
-        // ---------------- ADC Read Starts ----------------
-        // -------------------------------------------------
-        gpio_set_dir(ADC_PULSE_PIN, GPIO_IN);
-        gpio_pull_up(ADC_PULSE_PIN);
+            // capture needs a free buffer, wait for SPI to hand one back
+            while (buffers_ready == CAPTURE_BUFFERS) {
+                if (transport_poll()) {
+                    return 1;
+                }
+                tight_loop_contents();
+            }
 
-        // enabled the IRS
-        gpio_set_irq_enabled_with_callback(ADC_PULSE_PIN, GPIO_IRQ_EDGE_RISE | GPIO_IRQ_EDGE_FALL, true, &ADC_trigger_callback);
+            // *************************************************
+            // ---------------- ADC Read Starts ----------------
+            // -------------------------------------------------
+            fill_buffer = (drain_buffer + buffers_ready) % CAPTURE_BUFFERS;
+            start_capture();
+        }
 
-        while (!sampling_done) {
+        // wait for a filled buffer and an idle link
+        while (buffers_ready == 0 || buffers_sending || spi_dma_busy()) {
+            if (transport_poll()) {
+                return 1;
+            }
             tight_loop_contents();
         }
-
-        // disabled the IRS after ADC values is finished reading
-        gpio_set_irq_enabled(ADC_PULSE_PIN, GPIO_IRQ_EDGE_RISE | GPIO_IRQ_EDGE_FALL, false);
         // -------------------------------------------------
         // --------------- ADC Read Complete ---------------
         // *************************************************
 
-#ifdef MSG     
-        printf("Machine state %d: ADC-reading finished, now starts transferring! \n", machine_state);
-#endif
-
         // *************************************************
         // ------------ SPI Transferring Starts -----------
         // -------------------------------------------------
-        gpio_set_dir(TRANSFER_PIN, GPIO_OUT); // impedence low
-
-        // generate signal sending to masterboard
-        gpio_put(TRANSFER_PIN, 1);  // set GPIO pin HIGH
-        sleep_us_low_level(50);
-        gpio_put(TRANSFER_PIN, 0);  // set GPIO pin LOW
-        
-        gpio_set_dir(TRANSFER_PIN, GPIO_IN); // impedence high
-
-        int t1 = time_us_32();
-        // write the output buffer to MOSI, and at the same time read from MISO.
-        if(spi_write16_blocking(SPI_PORT, (const uint16_t*)sample_buffer, SAMPLE_BUFFER_SIZE) 
-            != SAMPLE_BUFFER_SIZE){
-            printf("Buffer transfer incomplete\n");
-        }
-
-        printf("SPI TTK: %d ms\n", (time_us_32() - t1)/1000);
+        start_transfer(drain_buffer);
         // -------------------------------------------------
         // ------------- SPI Transferring Ends -------------
         // *************************************************
 
-#ifdef MSG
-        printf("Machine state %d: transferring finished , now clearing the buffer! \n", machine_state);
-#endif
-
         // *************************************************
         // ------------------ State Reset ------------------
         // -------------------------------------------------
-        // clear the BUFFER and reinitialize the counter
-        if(clear_buffer(sample_buffer)){
-            printf("Error: Buffer cannot be clear. \n");
-            return 1;
-        }
-
-        // reset the sampling index and flags
-        sample_index = 0;
-        sampling_done = false;
-
+#if CAPTURE_BUFFERS == 1
         lock = true;    // lock up the main, re-entring stalling stage
+#endif
         // -------------------------------------------------
         // ---------------- Reset Completed ----------------
         // *************************************************
@@ -283,8 +1132,9 @@ int main() {
 #endif
 
         // increment the machine states for debug
-        machine_state += MACHINES_EMPLOYED; 
+        machine_state += ring_size; 
     }
+#endif
 
     return 0;
 }
@@ -0,0 +1,163 @@
+#include "hardware/adc.h"
+#include "hardware/dma.h"
+#include "hardware/irq.h"
+#include "hardware/timer.h"
+
+/*
+    Free-running ADC capture through DMA.
+
+    The ADC runs continuously at the rate set by adc_set_clkdiv() and pushes every
+    conversion into its FIFO, the DMA channel is paced by DREQ_ADC and moves each
+    result straight into the sample buffer. The CPU is only involved once per
+    segment (DMA_IRQ_0), never per sample.
+
+    A capture is split into two segments, [0, threshold) and [threshold, count),
+    so that the caller still gets notified when the hand-off threshold is reached.
+    The second segment is re-armed inside the IRQ, well within the 4-entry ADC FIFO.
+    On completion the callback may hand back another buffer, the DMA is then
+    retargeted without stopping the ADC so consecutive buffers stay gap-free.
+
+    With adc_dma_free_running cleared the ADC is not started here, conversions are
+    started one at a time from outside (adc_pio_trigger.h) and the DMA only collects
+    their results. A free-running capture can also be set up with it cleared and
+    started later with adc_dma_run(), at a moment the caller picks.
+*/
+
+// called from the DMA IRQ: once with the threshold index, once with the total count.
+// On completion, return the next buffer to keep capturing into, or NULL to stop.
+typedef volatile uint16_t* (*adc_dma_callback_t)(uint32_t samples_captured);
+
+int adc_dma_channel = -1;                   // claimed DMA channel
+volatile uint16_t *adc_dma_buffer;          // buffer being filled
+volatile uint32_t adc_dma_count = 0;        // total samples requested
+volatile uint32_t adc_dma_threshold = 0;    // first segment length
+volatile bool adc_dma_second_segment = false;
+adc_dma_callback_t adc_dma_callback = NULL;
+bool adc_dma_free_running = true;           // false when conversions are started externally
+volatile uint64_t adc_dma_run_us = 0;       // time the free-running ADC was last started
+
+/*
+    Description:
+        DMA_IRQ_0 handler, re-arms the second segment or stops the ADC
+*/
+void __not_in_flash_func(adc_dma_irq_handler)(void) {
+    dma_channel_acknowledge_irq0(adc_dma_channel);
+
+    if (!adc_dma_second_segment && adc_dma_threshold < adc_dma_count) {
+        // re-arm first, the FIFO only buffers 4 conversions
+        adc_dma_second_segment = true;
+        dma_channel_set_trans_count(adc_dma_channel, adc_dma_count - adc_dma_threshold, false);
+        dma_channel_set_write_addr(adc_dma_channel, &adc_dma_buffer[adc_dma_threshold], true);
+
+        if (adc_dma_callback) {
+            adc_dma_callback(adc_dma_threshold);
+        }
+        return;
+    }
+
+    // capture complete, continue into the next buffer if there is one
+    volatile uint16_t *next = adc_dma_callback ? adc_dma_callback(adc_dma_count) : NULL;
+    if (next == NULL) {
+        adc_run(false);
+        return;
+    }
+
+    adc_dma_buffer = next;
+    adc_dma_threshold = adc_dma_count;  // no hand-off point in chained buffers
+    dma_channel_set_trans_count(adc_dma_channel, adc_dma_count, false);
+    dma_channel_set_write_addr(adc_dma_channel, next, true);
+}
+
+/*
+    Description:
+        Start the free-running conversions and note when, the first result is ready
+    one conversion (96 ADC clocks) later
+*/
+void __not_in_flash_func(adc_dma_run)(void) {
+    adc_dma_run_us = time_us_64();
+    adc_run(true);
+}
+
+/*
+    Description:
+        Put the ADC in free-running FIFO mode at the given clock divider and claim
+    a DMA channel paced by the ADC FIFO
+
+    Parameter:
+        float clkdiv                - ADC clock divider, sample period is (1 + clkdiv) ADC cycles
+        adc_dma_callback_t callback - called on threshold and on completion (IRQ context),
+                                      returns the next buffer on completion or NULL
+
+    Return:
+        NULL
+*/
+void adc_dma_init(float clkdiv, adc_dma_callback_t callback) {
+    adc_set_clkdiv(clkdiv);
+    adc_fifo_setup(
+        true,   // write each conversion to the FIFO
+        true,   // enable DMA data request (DREQ)
+        1,      // DREQ asserted when at least 1 sample is present
+        false,  // no error bit, keep the full 12-bit sample
+        false   // no byte shifting, DMA transfers 16-bit
+    );
+
+    adc_dma_channel = dma_claim_unused_channel(true);
+    adc_dma_callback = callback;
+
+    dma_channel_config cfg = dma_channel_get_default_config(adc_dma_channel);
+    channel_config_set_transfer_data_size(&cfg, DMA_SIZE_16);
+    channel_config_set_read_increment(&cfg, false);     // always read the FIFO
+    channel_config_set_write_increment(&cfg, true);     // walk the sample buffer
+    channel_config_set_dreq(&cfg, DREQ_ADC);             // paced by the ADC
+    dma_channel_configure(adc_dma_channel, &cfg, NULL, &adc_hw->fifo, 0, false);
+
+    dma_channel_set_irq0_enabled(adc_dma_channel, true);
+    irq_set_exclusive_handler(DMA_IRQ_0, adc_dma_irq_handler);
+    irq_set_enabled(DMA_IRQ_0, true);
+}
+
+/*
+    Description:
+        Start a capture of count samples into buffer, the callback is called when
+    threshold samples are in and when the buffer is full
+
+    Parameter:
+        volatile uint16_t* buffer - destination buffer
+        uint32_t count            - number of samples
+        uint32_t threshold        - first notification point (count for none)
+
+    Return:
+        NULL
+*/
+void adc_dma_start(volatile uint16_t* buffer, uint32_t count, uint32_t threshold) {
+    adc_dma_buffer = buffer;
+    adc_dma_count = count;
+    adc_dma_threshold = (threshold == 0 || threshold > count) ? count : threshold;
+    adc_dma_second_segment = false;
+
+    adc_run(false);
+    adc_fifo_drain();
+
+    dma_channel_set_trans_count(adc_dma_channel, adc_dma_threshold, false);
+    dma_channel_set_write_addr(adc_dma_channel, buffer, true);
+
+    if (adc_dma_free_running) {
+        adc_dma_run();  // free-running from here on, spacing set by the divider
+    }
+}
+
+/*
+    Description:
+        Abort an ongoing capture and leave the ADC idle
+*/
+void adc_dma_stop(void) {
+    adc_run(false);
+
+    // abort can raise a spurious completion IRQ (RP2040-E13), mask it around the abort
+    dma_channel_set_irq0_enabled(adc_dma_channel, false);
+    dma_channel_abort(adc_dma_channel);
+    dma_channel_acknowledge_irq0(adc_dma_channel);
+    dma_channel_set_irq0_enabled(adc_dma_channel, true);
+
+    adc_fifo_drain();
+}
@@ -0,0 +1,99 @@
+#include "hardware/adc.h"
+#include "hardware/dma.h"
+#include "hardware/pio.h"
+#include "hardware/address_mapped.h"
+#include "adc_trigger.pio.h"
+
+/*
+    Externally triggered ADC capture with no CPU in the loop.
+
+    A PIO state machine watches the trigger pin and pushes ADC_CS_START_ONCE_BITS
+    on every edge (adc_trigger.pio). A DMA channel paced by the RX DREQ writes it into
+    the set alias of ADC CS, so the conversion starts a fixed few system clocks after
+    the edge, whatever the cores are doing. The results are collected by the DMA of
+    adc_dma.h exactly as in free-running mode, including the threshold and buffer
+    chaining callbacks, so include adc_dma.h first.
+
+    The start channel counts down with every edge, so two channels chained to each
+    other take turns and the trigger never runs out. Edges must be at least one
+    conversion (96 ADC clocks, 2 us) apart.
+*/
+
+PIO adc_trigger_pio = pio0;
+int adc_trigger_sm = -1;
+uint adc_trigger_offset;
+int adc_trigger_channel[2] = { -1, -1 };    // edge -> ADC CS start channels, chained in a loop
+
+/*
+    Description:
+        Claim the state machine and DMA channels and set up the ADC DMA, nothing
+    runs until adc_pio_trigger_start()
+
+    Parameter:
+        uint pin                    - trigger input, must already be an input
+        bool both_edges             - convert on falling edges too
+        adc_dma_callback_t callback - see adc_dma_init()
+
+    Return:
+        NULL
+*/
+void adc_pio_trigger_init(uint pin, bool both_edges, adc_dma_callback_t callback) {
+    adc_dma_init(0, callback);
+    adc_dma_free_running = false;
+
+    const pio_program_t *program = both_edges ? &adc_trigger_any_program : &adc_trigger_rise_program;
+    adc_trigger_sm = pio_claim_unused_sm(adc_trigger_pio, true);
+    adc_trigger_offset = pio_add_program(adc_trigger_pio, program);
+    pio_sm_config c = both_edges ? adc_trigger_any_program_get_default_config(adc_trigger_offset)
+                                 : adc_trigger_rise_program_get_default_config(adc_trigger_offset);
+    adc_trigger_sm_init(adc_trigger_pio, adc_trigger_sm, adc_trigger_offset, c, pin);
+
+    adc_trigger_channel[0] = dma_claim_unused_channel(true);
+    adc_trigger_channel[1] = dma_claim_unused_channel(true);
+    for (int i = 0; i < 2; i++) {
+        dma_channel_config cfg = dma_channel_get_default_config(adc_trigger_channel[i]);
+        channel_config_set_transfer_data_size(&cfg, DMA_SIZE_32);
+        channel_config_set_read_increment(&cfg, false);
+        channel_config_set_write_increment(&cfg, false);
+        channel_config_set_dreq(&cfg, pio_get_dreq(adc_trigger_pio, adc_trigger_sm, false));
+        channel_config_set_high_priority(&cfg, true);   // the start must not queue behind SPI
+        channel_config_set_chain_to(&cfg, adc_trigger_channel[i ^ 1]);
+        dma_channel_configure(adc_trigger_channel[i], &cfg,
+                              hw_set_alias(&adc_hw->cs),
+                              &adc_trigger_pio->rxf[adc_trigger_sm],
+                              0xffffffff, false);
+    }
+    dma_channel_start(adc_trigger_channel[0]);      // waits for the first edge
+}
+
+/*
+    Description:
+        Arm a capture of count samples into buffer, one sample per trigger edge
+
+    Parameter:
+        volatile uint16_t* buffer - destination buffer
+        uint32_t count            - number of samples
+        uint32_t threshold        - first notification point (count for none)
+
+    Return:
+        NULL
+*/
+void adc_pio_trigger_start(volatile uint16_t* buffer, uint32_t count, uint32_t threshold) {
+    pio_sm_set_enabled(adc_trigger_pio, adc_trigger_sm, false);
+    pio_sm_clear_fifos(adc_trigger_pio, adc_trigger_sm);
+    pio_sm_restart(adc_trigger_pio, adc_trigger_sm);
+    pio_sm_exec(adc_trigger_pio, adc_trigger_sm, pio_encode_jmp(adc_trigger_offset));
+
+    adc_dma_start(buffer, count, threshold);    // drains the ADC FIFO, results land from index 0
+
+    pio_sm_set_enabled(adc_trigger_pio, adc_trigger_sm, true);
+}
+
+/*
+    Description:
+        Stop reacting to edges, safe to call from IRQ context. A conversion already
+    started still lands in the ADC FIFO and is drained by the next start.
+*/
+void __not_in_flash_func(adc_pio_trigger_stop)(void) {
+    pio_sm_set_enabled(adc_trigger_pio, adc_trigger_sm, false);
+}
@@ -0,0 +1,60 @@
+#include <stdint.h>
+
+/*
+    Burst frame sent over SPI, keep in sync with master/burst_frame.h.
+
+    On the wire (16-bit words, little-endian fields):
+        burst_frame_t header        FRAME_HEADER_WORDS words
+        payload                     payload_words words (the samples)
+        telemetry                   telemetry_words words, FRAME_FLAG_TELEMETRY only (telemetry.h)
+        CRC32                       FRAME_TRAILER_WORDS words, low half first
+
+    The CRC is the standard CRC-32 (zlib / IEEE 802.3) over the header, payload
+    and telemetry bytes in memory order. It is computed by the DMA sniffer while the TX channel
+    feeds the SPI FIFO, so it costs no CPU time.
+    FRAME_MAGIC is above 0x0FFF, so it can never be mistaken for a 12-bit sample
+    when the receiver has to resynchronise. Packed payload words can take any value,
+    a false match there is caught by the header check.
+*/
+
+#define FRAME_MAGIC             0xA5C3
+#define FRAME_VERSION           3
+#define FRAME_HEADER_WORDS      36
+#define FRAME_TRAILER_WORDS     2
+#define FRAME_TELEMETRY_MAX_WORDS 512   // room the receiver keeps for a telemetry block
+
+// flags
+#define FRAME_FLAG_PACKED12     0x0001  // payload is 12-bit packed, 4 samples in 3 words (pack12.h)
+#define FRAME_FLAG_RICE         0x0002  // payload is delta + Rice coded, variable length (rice_encode.h)
+#define FRAME_FLAG_SYNC_START   0x0004  // the run started on the sync pulse latched at run_start_us (INTERLEAVE)
+#define FRAME_FLAG_TELEMETRY    0x0008  // a telemetry block follows the payload (TELEMETRY)
+
+// payload words of sample_count samples with the given flags, fixed length formats only
+#define FRAME_PAYLOAD_WORDS(samples, flags) \
+    (((flags) & FRAME_FLAG_PACKED12) ? ((samples) * 3 + 3) / 4 : (samples))
+
+typedef struct {
+    uint16_t magic;             // FRAME_MAGIC
+    uint16_t version;           // FRAME_VERSION
+    uint16_t machine_id;        // position of the pico in the ring
+    uint16_t header_words;      // FRAME_HEADER_WORDS
+    uint32_t sequence;          // per-pico frame counter, gaps mean dropped frames
+    uint32_t sample_count;      // samples in the payload
+    uint32_t payload_words;     // 16-bit words between header and CRC
+    uint16_t flags;             // FRAME_FLAG_*, 0 for plain 16-bit samples
+    uint16_t channel_mask;      // ADC inputs in the payload, interleaved in ascending order (0: one channel)
+    uint32_t encode_us;         // time the pico spent packing / coding the payload
+    // timing, pico times are its time_us_64(): sample i of the run is at
+    // run_start_us + first_sample_ns + (run_offset + i) * sample_period_ps
+    uint32_t sample_period_ps;  // spacing of the payload samples, 0 when paced by trigger pulses
+    uint32_t run_offset;        // samples of the same gap-free run before this frame
+    int32_t first_sample_ns;    // from run_start_us to the first sample of the run
+    uint32_t sync_count;        // sync pulses latched since boot, 0 if none yet
+    uint16_t telemetry_words;   // words between payload and CRC, 0 without FRAME_FLAG_TELEMETRY
+    uint16_t link_khz;          // SPI clock stored by link_cal, 0 if the link was never calibrated
+    uint64_t run_start_us;      // start of the run (capture armed, ADC started or first trigger)
+    uint64_t sync_latch_us;     // time of the latest sync pulse
+    uint64_t transfer_us;       // time TRANSFER_PIN went high for this frame
+} burst_frame_t;
+
+_Static_assert(sizeof(burst_frame_t) == FRAME_HEADER_WORDS * sizeof(uint16_t), "frame header layout");
@@ -0,0 +1,102 @@
+#include <stdint.h>
+#include "fir_taps.h"   // generated by gen_fir.py at build time
+
+/*
+    Anti-alias low-pass and decimation of the raw ADC stream (DECIMATE).
+
+    The ADC runs FIR_DECIMATION times faster than the wanted output rate and only
+    every FIR_DECIMATION-th output of the low-pass is kept. Only those are computed,
+    the other raw samples just go into the history (a polyphase FIR, without the
+    phase split). The taps are Q15 from gen_fir.py, symmetric with a DC gain of
+    exactly 1. Products are summed in 32 bits and rounded back to 12-bit codes, so
+    the result is an ordinary sample buffer and PACKED_12BIT / RICE_CODED still
+    apply to it.
+
+    The history holds every sample twice, at i and i + FIR_TAPS, so the newest
+    FIR_TAPS samples are always one contiguous window and the inner loop has no
+    wrap test. Symmetric taps are folded, one multiply per pair of samples. With the
+    taps copied to RAM an output costs about 5 cycles per tap on the M0+, 128 taps
+    at 500 kSPS raw (62.5 kSPS out) take about a third of a core.
+*/
+
+typedef struct {
+    int16_t taps[(FIR_TAPS + 1) / 2];   // first half of fir_taps, out of flash
+    int16_t history[2 * FIR_TAPS];      // every sample twice, see above
+    uint32_t pos;                       // slot of the next sample
+    uint32_t phase;                     // samples until the next output
+    bool primed;                        // history holds samples of this capture
+} decimator_t;
+
+/*
+    Description:
+        Start a new capture, the history is refilled from its first sample
+*/
+void decimator_reset(decimator_t *d) {
+    for (uint32_t k = 0; k < (FIR_TAPS + 1) / 2; k++) {
+        d->taps[k] = fir_taps[k];
+    }
+    d->pos = 0;
+    d->phase = FIR_DECIMATION;
+    d->primed = false;
+}
+
+/*
+    Description:
+        Filter raw samples into output samples, until the input is used up or the
+    output is full
+
+    Parameter:
+        decimator_t *d              - filter state
+        const volatile uint16_t *in - raw ADC samples
+        uint32_t count              - number of raw samples
+        volatile uint16_t *out      - output samples
+        uint32_t room               - free output slots
+        uint32_t *produced          - output samples written
+
+    Return:
+        uint32_t - raw samples consumed
+*/
+uint32_t __not_in_flash_func(decimator_run)(decimator_t *d, const volatile uint16_t *in, uint32_t count,
+                                            volatile uint16_t *out, uint32_t room, uint32_t *produced) {
+    uint32_t used = 0, made = 0;
+
+    if (!d->primed && count > 0) {
+        // as if the input had been steady before the capture, no start-up ramp
+        int16_t first = in[0] & 0xfff;
+        for (uint32_t i = 0; i < 2 * FIR_TAPS; i++) {
+            d->history[i] = first;
+        }
+        d->primed = true;
+    }
+
+    while (used < count && made < room) {
+        int16_t s = in[used++] & 0xfff;
+        d->history[d->pos] = s;
+        d->history[d->pos + FIR_TAPS] = s;
+        if (++d->pos == FIR_TAPS) {
+            d->pos = 0;
+        }
+        if (--d->phase) {
+            continue;
+        }
+        d->phase = FIR_DECIMATION;
+
+        // oldest and newest sample of the window, folded towards the middle
+        const int16_t *lo = &d->history[d->pos];
+        const int16_t *hi = lo + FIR_TAPS - 1;
+        int32_t acc = 1 << 14;  // rounding
+        for (uint32_t k = 0; k < FIR_TAPS / 2; k++) {
+            acc += d->taps[k] * (*lo++ + *hi--);
+        }
+#if FIR_TAPS % 2
+        acc += d->taps[FIR_TAPS / 2] * *lo;
+#endif
+
+        // overshoot of the taps can leave the 12-bit range at the rails
+        int32_t y = acc >> 15;
+        out[made++] = y < 0 ? 0 : (y > 0xfff ? 0xfff : y);
+    }
+
+    *produced = made;
+    return used;
+}
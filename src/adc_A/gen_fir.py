@@ -0,0 +1,133 @@
+#!/usr/bin/env python3
+"""
+    About:
+        Generates fir_taps.h, the anti-alias low-pass of the DECIMATE stage
+    (decimate.h). Run by CMake at build time, the parameters are cache variables
+    of the pico projects (ADC_DECIMATION, ADC_FIR_TAPS, ADC_FIR_CUTOFF).
+
+        Windowed-sinc design with a Kaiser window. The taps are rounded to Q15 and
+    the rounding error is moved onto the center taps, so the DC gain is exactly 1
+    and a steady input comes out unchanged. The taps stay symmetric (linear phase,
+    the filter folds pairs of samples into one multiply).
+
+    Usage:
+        python3 gen_fir.py -d 8 -n 128 -c 0.7 -o fir_taps.h
+
+        -d raw samples per output sample, -n taps, -c passband edge as a fraction of
+    the output Nyquist frequency, -a stopband attenuation in dB (sets the window).
+    Only the standard library is used, the build host needs nothing else.
+"""
+
+import argparse
+import math
+import sys
+
+Q15 = 1 << 15
+
+
+def bessel_i0(x):
+    # power series, converges fast for the window arguments used here
+    term, total, k = 1.0, 1.0, 1
+    while term > 1e-12 * total:
+        term *= (x / (2 * k)) ** 2
+        total += term
+        k += 1
+    return total
+
+
+def kaiser_beta(attenuation):
+    if attenuation > 50:
+        return 0.1102 * (attenuation - 8.7)
+    if attenuation >= 21:
+        return 0.5842 * (attenuation - 21) ** 0.4 + 0.07886 * (attenuation - 21)
+    return 0.0
+
+
+def design(decimation, taps, cutoff, attenuation):
+    # cutoff in cycles per raw sample: halfway between passband edge and output Nyquist
+    nyquist_out = 0.5 / decimation
+    fc = nyquist_out * (cutoff + 1.0) / 2
+    beta = kaiser_beta(attenuation)
+    center = (taps - 1) / 2
+    h = []
+    for i in range(taps):
+        t = i - center
+        ideal = 2 * fc if t == 0 else math.sin(2 * math.pi * fc * t) / (math.pi * t)
+        r = 2 * i / (taps - 1) - 1 if taps > 1 else 0.0
+        h.append(ideal * bessel_i0(beta * math.sqrt(max(0.0, 1 - r * r))) / bessel_i0(beta))
+    gain = sum(h)
+    return [x / gain for x in h]
+
+
+def quantize(h):
+    taps = len(h)
+    q = [max(-Q15, min(Q15 - 1, int(round(x * Q15)))) for x in h[:(taps + 1) // 2]]
+    q += q[:taps // 2][::-1]
+
+    # put the rounding error on the center tap(s), keeping the symmetry
+    error = Q15 - sum(q)
+    if taps % 2:
+        q[taps // 2] += error
+    else:
+        # pairs sum to an even number, so does the error
+        q[taps // 2 - 1] += error // 2
+        q[taps // 2] += error // 2
+    if max(q) >= Q15 or min(q) < -Q15:
+        sys.exit("gen_fir.py: taps do not fit Q15, use more taps or a lower cutoff")
+    return q
+
+
+def response_db(q, f):
+    re = sum(c * math.cos(2 * math.pi * f * i) for i, c in enumerate(q))
+    im = sum(c * math.sin(2 * math.pi * f * i) for i, c in enumerate(q))
+    return 20 * math.log10(max(math.hypot(re, im) / Q15, 1e-12))
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Q15 decimation filter for the pico firmware")
+    parser.add_argument("-d", "--decimation", type=int, default=8)
+    parser.add_argument("-n", "--taps", type=int, default=128)
+    parser.add_argument("-c", "--cutoff", type=float, default=0.7)
+    parser.add_argument("-a", "--attenuation", type=float, default=60.0)
+    parser.add_argument("-o", "--output", default="fir_taps.h")
+    args = parser.parse_args()
+
+    if args.decimation < 2 or args.decimation > 64:
+        sys.exit("gen_fir.py: decimation must be 2 to 64")
+    if args.taps < args.decimation or args.taps > 256:
+        sys.exit("gen_fir.py: taps must be between the decimation and 256")
+    if not 0.0 < args.cutoff < 1.0:
+        sys.exit("gen_fir.py: cutoff is a fraction of the output Nyquist frequency, 0 to 1")
+
+    q = quantize(design(args.decimation, args.taps, args.cutoff, args.attenuation))
+
+    # worst passband ripple and stopband leak, printed into the header for reference
+    nyquist_out = 0.5 / args.decimation
+    grid = 512
+    passband = [response_db(q, nyquist_out * args.cutoff * i / grid) for i in range(grid + 1)]
+    stop_start = nyquist_out * (2 - args.cutoff)     # aliases onto the passband
+    stopband = [response_db(q, stop_start + (0.5 - stop_start) * i / grid) for i in range(grid + 1)] \
+        if stop_start < 0.5 else [-300.0]
+
+    lines = [
+        "// generated by gen_fir.py, do not edit",
+        "// -d %d -n %d -c %g -a %g" % (args.decimation, args.taps, args.cutoff, args.attenuation),
+        "// passband ripple %.3f dB, stopband below %.1f dB" % (max(passband) - min(passband), max(stopband)),
+        "#include <stdint.h>",
+        "",
+        "#define FIR_DECIMATION %d" % args.decimation,
+        "#define FIR_TAPS %d" % args.taps,
+        "",
+        "// Q15, symmetric, sum 32768",
+        "static const int16_t fir_taps[FIR_TAPS] = {",
+    ]
+    for i in range(0, len(q), 8):
+        lines.append("    " + " ".join("%6d," % c for c in q[i:i + 8]))
+    lines.append("};")
+
+    with open(args.output, "w") as f:
+        f.write("\n".join(lines) + "\n")
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,229 @@
+#include "pico/stdlib.h"
+#include "hardware/spi.h"
+#include "hardware/sync.h"
+
+/*
+    SPI link-speed calibration, the pico side of master/link_cal.c.
+
+    For a short window at boot the pico listens on MOSI for the request pair
+    LINK_CAL_REQUEST, ~LINK_CAL_REQUEST, which link_cal clocks in at a slow, safe
+    rate. Without it the firmware starts as usual. With it the pico serves blocks of
+    a known PRBS-15 pattern: the block goes into the TX FIFO, TRANSFER_PIN is
+    pulsed, and the master clocks it at whatever rate it is testing, counting bit
+    errors against its own copy of the pattern. The rate does not matter here, an
+    SPI slave follows SCK (up to clk_peri / 12).
+
+    The last 4 words the master sends with each block are its command for the next
+    one, [command, argument, ~argument, ~command]: LINK_CAL_NEXT for another block,
+    LINK_CAL_DONE with the chosen rate in kHz, or LINK_CAL_QUIT. Anything else (a
+    command clocked too fast to arrive intact) counts as NEXT. On DONE the rate is
+    stored in the flash config block (ring_config.h, include it first) and a
+    4-word ack block [LINK_CAL_ACK, rate, ~rate, ~LINK_CAL_ACK] confirms it.
+
+        A rate above what the slave follows loses words, so a block can end short:
+    SCK stops for LINK_CAL_STALL_US before every word arrived. That block counts as
+    NEXT too, the port is reset to empty its FIFOs and the next block is served.
+    The pico only gives up after LINK_CAL_IDLE_BLOCKS blocks in a row without a
+    single word, the master is gone then.
+
+    The blocks are fed from a polled loop in RAM, not the SPI DMA, so this runs on
+    core0 before spi_dma_init() and before core1 is launched, which also leaves the
+    flash to this core alone while it is written. Interrupts are off while the
+    master clocks, so the FIFO never runs dry.
+*/
+
+// keep in sync with master/link_cal.h
+#define LINK_CAL_REQUEST    0x4C43      // "LC"
+#define LINK_CAL_NEXT       0x4E58
+#define LINK_CAL_DONE       0x444E
+#define LINK_CAL_QUIT       0x5154
+#define LINK_CAL_ACK        0x414B
+#define LINK_CAL_WORDS      4096        // PRBS words per block, a multiple of 4
+#define LINK_CAL_ACK_WORDS  4
+#define LINK_CAL_PRBS_SEED  0x7fff
+
+#define LINK_CAL_QUIET_US   2000        // MOSI idle this long after the request, then the first block
+#define LINK_CAL_TIMEOUT_US 2000000     // no clock on a block at all, serve it again
+#define LINK_CAL_STALL_US   50000       // clock stopped this long mid-block, the block ended short
+#define LINK_CAL_IDLE_BLOCKS 3          // blocks in a row without a clock, boot on without a calibration
+#define LINK_CAL_PULSE_US   50          // TRANSFER_PIN pulse, as for a burst
+
+/*
+    Description:
+        Fill a buffer with the PRBS-15 (x^15 + x^14 + 1) bit stream, most significant
+    bit first in every word. The master generates the same words.
+
+    Parameter:
+        uint16_t *words - destination
+        uint32_t count  - number of 16-bit words
+*/
+void link_cal_prbs(uint16_t *words, uint32_t count) {
+    uint32_t state = LINK_CAL_PRBS_SEED;
+    for (uint32_t i = 0; i < count; i++) {
+        uint16_t word = 0;
+        for (int bit = 0; bit < 16; bit++) {
+            uint32_t next = ((state >> 14) ^ (state >> 13)) & 1;
+            state = ((state << 1) | next) & 0x7fff;
+            word = (uint16_t)((word << 1) | next);
+        }
+        words[i] = word;
+    }
+}
+
+/*
+    Description:
+        Serve one block: preload the TX FIFO, pulse the transfer pin and keep the FIFO
+    fed while the master clocks every word out. The words it sends back land in a
+    4-word ring, which leaves its command in order.
+
+    Parameter:
+        spi_inst_t *spi       - slave port, set up as for the bursts
+        uint transfer_pin     - TRANSFER_PIN
+        const uint16_t *block - words to send
+        uint32_t words        - a multiple of 4
+        uint16_t *command     - 4 words, the last ones on MOSI
+
+    Return:
+        uint32_t - words the master clocked, words for the whole block, 0 if it never started
+*/
+uint32_t __not_in_flash_func(link_cal_block)(spi_inst_t *spi, uint transfer_pin, const uint16_t *block,
+                                             uint32_t words, uint16_t *command) {
+    spi_hw_t *hw = spi_get_hw(spi);
+    uint32_t tx = 0, rx = 0;
+    while (tx < words && spi_is_writable(spi)) {
+        hw->dr = block[tx++];
+    }
+
+    gpio_set_dir(transfer_pin, GPIO_OUT);
+    gpio_put(transfer_pin, 1);
+    busy_wait_us_32(LINK_CAL_PULSE_US);
+    gpio_put(transfer_pin, 0);
+    gpio_set_dir(transfer_pin, GPIO_IN);
+
+    // interrupts stay on until the master starts, the full FIFO covers its first words
+    uint32_t irq_status = 0;
+    uint32_t last = time_us_32();
+    while (rx < words) {
+        if (tx < words && spi_is_writable(spi)) {
+            hw->dr = block[tx++];
+        }
+        if (spi_is_readable(spi)) {
+            if (rx == 0) {
+                irq_status = save_and_disable_interrupts();
+            }
+            command[rx++ & 3] = (uint16_t)hw->dr;
+            last = time_us_32();
+        } else if (time_us_32() - last > (rx == 0 ? LINK_CAL_TIMEOUT_US : LINK_CAL_STALL_US)) {
+            break;
+        }
+    }
+    if (rx > 0) {
+        restore_interrupts(irq_status);
+    }
+    return rx;
+}
+
+/*
+    Description:
+        Reset the port, which empties both FIFOs, and set it up again: mode 3, 16 bits,
+    as for the bursts
+*/
+void link_cal_reset(spi_inst_t *spi) {
+    spi_deinit(spi);
+    spi_init(spi, 1000000);     // the baud rate of a slave is irrelevant
+    spi_set_slave(spi, true);
+    spi_set_format(spi, 16, SPI_CPOL_1, SPI_CPHA_1, SPI_MSB_FIRST);
+}
+
+/*
+    Description:
+        Wait for the request pair on MOSI, then for the master to stop clocking
+
+    Return:
+        bool - true if link_cal asked within listen_ms
+*/
+bool link_cal_listen(spi_inst_t *spi, uint32_t listen_ms) {
+    uint32_t start = time_us_32();
+    uint16_t last = 0;
+    bool requested = false;
+    while (!requested && time_us_32() - start < listen_ms * 1000) {
+        if (spi_is_readable(spi)) {
+            uint16_t word = (uint16_t)spi_get_hw(spi)->dr;
+            requested = (last == LINK_CAL_REQUEST && word == (uint16_t)~LINK_CAL_REQUEST);
+            last = word;
+        }
+    }
+    if (!requested) {
+        return false;
+    }
+
+    // the rest of the request burst, the first block must start on an empty FIFO
+    start = time_us_32();
+    uint32_t quiet = start;
+    while (time_us_32() - quiet < LINK_CAL_QUIET_US) {
+        if (spi_is_readable(spi)) {
+            (void)spi_get_hw(spi)->dr;
+            quiet = time_us_32();
+        }
+        if (time_us_32() - start > LINK_CAL_TIMEOUT_US) {
+            return false;
+        }
+    }
+    spi_get_hw(spi)->icr = SPI_SSPICR_RORIC_BITS;  // overruns while nobody read
+    return true;
+}
+
+/*
+    Description:
+        Listen for link_cal at boot and serve the calibration if it asks. A block
+    the master walked away from leaves words in the TX FIFO, so the port is reset
+    before the next block and before the firmware uses it.
+
+    Parameter:
+        spi_inst_t *spi     - slave port, pins set up, no DMA yet
+        uint transfer_pin   - TRANSFER_PIN, initialized as an input
+        uint16_t *block     - LINK_CAL_WORDS of scratch, e.g. a capture buffer
+        uint32_t listen_ms  - how long to listen, 0 skips the calibration
+        uint32_t ring_size  - ring size for a new config block (ring_config_write_link)
+
+    Return:
+        uint32_t - rate stored in Hz, 0 if there was no calibration or it did not finish
+*/
+uint32_t link_cal_run(spi_inst_t *spi, uint transfer_pin, uint16_t *block, uint32_t listen_ms, uint32_t ring_size) {
+    if (listen_ms == 0 || !link_cal_listen(spi, listen_ms)) {
+        return 0;
+    }
+
+    link_cal_prbs(block, LINK_CAL_WORDS);
+    uint32_t stored_hz = 0;
+    uint16_t command[4];
+    uint32_t idle = 0;
+    while (idle < LINK_CAL_IDLE_BLOCKS) {
+        uint32_t rx = link_cal_block(spi, transfer_pin, block, LINK_CAL_WORDS, command);
+        if (rx < LINK_CAL_WORDS) {
+            // too fast to follow, or not clocked at all: words may be left in the FIFOs
+            idle = (rx == 0) ? idle + 1 : 0;
+            link_cal_reset(spi);
+            continue;
+        }
+        idle = 0;
+        bool valid = (command[3] == (uint16_t)~command[0] && command[2] == (uint16_t)~command[1]);
+        if (valid && command[0] == LINK_CAL_QUIT) {
+            break;
+        }
+        if (valid && command[0] == LINK_CAL_DONE) {
+            uint32_t rate_khz = command[1];
+            if (ring_config_write_link(rate_khz * 1000, ring_size)) {
+                stored_hz = rate_khz * 1000;
+            }
+            uint16_t ack[LINK_CAL_ACK_WORDS] = {
+                LINK_CAL_ACK, (uint16_t)(stored_hz / 1000), (uint16_t)~(stored_hz / 1000), (uint16_t)~LINK_CAL_ACK
+            };
+            link_cal_block(spi, transfer_pin, ack, LINK_CAL_ACK_WORDS, command);
+            break;
+        }
+    }
+
+    link_cal_reset(spi);
+    return stored_hz;
+}
@@ -0,0 +1,59 @@
+#include <stdint.h>
+
+/*
+    12-bit sample packing for the SPI link, the receiver unpacks with master/unpack12.h.
+
+    ADC results have 12 bits, sent as 16-bit words a quarter of every burst is zeros.
+    Packed, every 4 samples take 3 words: s0 | s1 << 12 | s2 << 24 | s3 << 36 as a
+    48-bit little-endian value, i.e. in memory order 2 samples in 3 bytes. The last
+    group is padded with zero samples.
+
+    Packing runs in place: each group reads 4 words and writes 3, so the write side
+    never catches up with samples it still has to read. It is done once per burst
+    before the transfer is queued, about 15 cycles per 4 samples, well under a
+    millisecond for 12500 samples against the quarter of the burst time it saves.
+*/
+
+/*
+    Description:
+        Pack a buffer of 12-bit samples in place
+
+    Parameter:
+        volatile uint16_t *samples - count samples in, packed words out
+        uint32_t count             - number of samples
+
+    Return:
+        uint32_t - packed length in 16-bit words, (count * 3 + 3) / 4
+*/
+uint32_t __not_in_flash_func(pack12_in_place)(volatile uint16_t *samples, uint32_t count) {
+    volatile uint16_t *out = samples;
+    uint32_t i = 0;
+
+    for (; i + 4 <= count; i += 4) {
+        uint32_t s0 = samples[i] & 0xfff;
+        uint32_t s1 = samples[i + 1] & 0xfff;
+        uint32_t s2 = samples[i + 2] & 0xfff;
+        uint32_t s3 = samples[i + 3] & 0xfff;
+        out[0] = (uint16_t)(s0 | s1 << 12);
+        out[1] = (uint16_t)(s1 >> 4 | s2 << 8);
+        out[2] = (uint16_t)(s2 >> 8 | s3 << 4);
+        out += 3;
+    }
+
+    if (i < count) {
+        // 1 to 3 samples left, the missing ones are zero
+        uint32_t s0 = samples[i] & 0xfff;
+        uint32_t s1 = i + 1 < count ? samples[i + 1] & 0xfff : 0;
+        uint32_t s2 = i + 2 < count ? samples[i + 2] & 0xfff : 0;
+        out[0] = (uint16_t)(s0 | s1 << 12);
+        if (i + 1 < count) {
+            out[1] = (uint16_t)(s1 >> 4 | s2 << 8);
+        }
+        if (i + 2 < count) {
+            out[2] = (uint16_t)(s2 >> 8);
+        }
+        out += count - i;
+    }
+
+    return (uint32_t)(out - samples);
+}
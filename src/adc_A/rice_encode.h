@@ -0,0 +1,132 @@
+#include <stdint.h>
+
+/*
+    Lossless burst compression for the SPI link, the receiver decodes with
+    master/rice_decode.h (keep the constants in sync).
+
+    Every sample is replaced by its difference to the previous sample of the same
+    ADC input (round-robin bursts keep one predecessor per input, the first one is
+    relative to 0), zigzag-mapped to an unsigned value and Rice coded. A block of
+    RICE_BLOCK samples shares one parameter k, sent as a 4-bit block header:
+        k = 0..12       per sample: q = z >> k zero bits, a one, then the low k bits of z
+        q >= 16         escape: 16 zero bits, then z in 13 bits (large jumps)
+        RICE_RAW        the block as plain 12-bit samples, when coding would not help
+    Slow signals need a few bits per sample, noise never costs more than 12 bits
+    plus the block header, so the compressed burst is never longer than the packed one.
+
+    The bit stream is written most significant bit first into 32-bit words, stored
+    little endian as the rest of the frame. Encoding runs in place: each block is
+    copied out before any of its output is written, and the output (at most 12.07
+    bits per sample) never overtakes the 16 bits per sample still to be read.
+    The Cortex-M0+ has no CLZ and no divider, so k is found by a shift loop and the
+    cost of a block by one more pass over it. That is about 30 cycles per sample,
+    3 ms for 12500 samples at 125 MHz.
+*/
+
+#define RICE_BLOCK          64      // samples per k
+#define RICE_K_BITS         4       // block header
+#define RICE_K_MAX          12
+#define RICE_RAW            15      // block header of an uncoded block
+#define RICE_ESCAPE         16      // zero bits that start an escape
+#define RICE_ESCAPE_BITS    13      // zigzag of a 12-bit difference
+#define RICE_SAMPLE_BITS    12
+
+// longest possible output of count samples in 16-bit words (every block raw)
+#define RICE_MAX_WORDS(count) \
+    ((((count) + RICE_BLOCK - 1) / RICE_BLOCK * RICE_K_BITS + (count) * RICE_SAMPLE_BITS + 31) / 32 * 2)
+
+typedef struct {
+    volatile uint32_t *out;
+    uint32_t acc;       // bits not yet stored, left aligned
+    uint32_t free;      // unused bits in acc, 1 to 32
+} rice_writer_t;
+
+// append the low len bits of value (len 1 to 32, value has no higher bits)
+static inline void rice_put(rice_writer_t *w, uint32_t value, uint32_t len) {
+    if (len < w->free) {
+        w->free -= len;
+        w->acc |= value << w->free;
+        return;
+    }
+    len -= w->free;
+    *w->out++ = w->acc | (value >> len);
+    w->free = 32 - len;
+    w->acc = len ? value << w->free : 0;
+}
+
+/*
+    Description:
+        Compress a buffer of 12-bit samples in place
+
+    Parameter:
+        volatile uint16_t *samples - count samples in, coded words out, 4-byte aligned
+        uint32_t count             - number of samples
+        uint32_t channels          - interleaved ADC inputs, 1 to 5
+
+    Return:
+        uint32_t - coded length in 16-bit words (always even)
+*/
+uint32_t __not_in_flash_func(rice_encode_in_place)(volatile uint16_t *samples, uint32_t count, uint32_t channels) {
+    rice_writer_t w = { (volatile uint32_t *)samples, 0, 32 };
+    uint32_t start = (uint32_t)(uintptr_t)samples;
+    uint16_t prev[5] = { 0 };
+    uint16_t raw[RICE_BLOCK];
+    uint16_t zigzag[RICE_BLOCK];
+    uint32_t channel = 0;
+
+    for (uint32_t block = 0; block < count; block += RICE_BLOCK) {
+        uint32_t n = count - block < RICE_BLOCK ? count - block : RICE_BLOCK;
+
+        // copy the block out and map the differences, before any output lands on it
+        uint32_t sum = 0;
+        for (uint32_t i = 0; i < n; i++) {
+            uint32_t s = samples[block + i] & 0xfff;
+            int32_t d = (int32_t)s - (int32_t)prev[channel];
+            uint32_t z = ((uint32_t)d << 1) ^ (uint32_t)(d >> 31);
+            raw[i] = (uint16_t)s;
+            zigzag[i] = (uint16_t)z;
+            sum += z;
+            prev[channel] = (uint16_t)s;
+            if (++channel == channels) {
+                channel = 0;
+            }
+        }
+
+        // k about log2 of the mean, then the exact cost with it
+        uint32_t k = 0;
+        while (k < RICE_K_MAX && (n << (k + 1)) <= sum) {
+            k++;
+        }
+        uint32_t cost = 0;
+        for (uint32_t i = 0; i < n; i++) {
+            uint32_t q = zigzag[i] >> k;
+            cost += q < RICE_ESCAPE ? q + 1 + k : RICE_ESCAPE + RICE_ESCAPE_BITS;
+        }
+
+        if (cost >= n * RICE_SAMPLE_BITS) {
+            rice_put(&w, RICE_RAW, RICE_K_BITS);
+            for (uint32_t i = 0; i < n; i++) {
+                rice_put(&w, raw[i], RICE_SAMPLE_BITS);
+            }
+            continue;
+        }
+
+        rice_put(&w, k, RICE_K_BITS);
+        uint32_t mask = (1u << k) - 1;
+        for (uint32_t i = 0; i < n; i++) {
+            uint32_t z = zigzag[i];
+            uint32_t q = z >> k;
+            if (q < RICE_ESCAPE) {
+                // q zeros, the stop bit and the remainder in one go, at most 28 bits
+                rice_put(&w, (1u << k) | (z & mask), q + 1 + k);
+            } else {
+                rice_put(&w, z, RICE_ESCAPE + RICE_ESCAPE_BITS);
+            }
+        }
+    }
+
+    if (w.free < 32) {
+        *w.out++ = w.acc;
+    }
+    return ((uint32_t)(uintptr_t)w.out - start) / sizeof(uint16_t);
+}
@@ -0,0 +1,168 @@
+#include <string.h>
+#include "pico/stdlib.h"
+#include "hardware/flash.h"
+#include "hardware/sync.h"
+
+/*
+    Position of this pico in the token ring, read once at boot so every pico runs
+    the same image.
+
+    A config block in the last flash sector wins if it is valid. ring_config.py
+    writes one as a small UF2, dropped onto the pico after the firmware, it can also
+    change the ring size. Without it the position comes from RING_STRAP_BITS strap
+    pins starting at RING_STRAP_PIN, read with pull-downs (a jumper to 3V3 sets the
+    bit, no jumper is position 0), and the ring size is the compile-time default.
+
+    The block also keeps the SPI link rate settled on by link_cal (link_cal.h). A
+    block that only carries the rate has RING_CONFIG_STRAPS set: the position still
+    comes from the straps and the size is the default, as without a block.
+*/
+
+#define RING_STRAP_PIN      10      // GPIO 10 - lowest bit of the ring position
+#define RING_STRAP_BITS     3       // GPIO 10-12, positions 0-7
+
+#define RING_CONFIG_MAGIC   0x474e4952      // "RING", keep in sync with ring_config.py
+#define RING_CONFIG_VERSION 1
+#define RING_CONFIG_OFFSET  (PICO_FLASH_SIZE_BYTES - FLASH_SECTOR_SIZE)
+
+// flags
+#define RING_CONFIG_STRAPS  0x0001      // position from the strap pins, size the default
+
+typedef struct {
+    uint32_t magic;             // RING_CONFIG_MAGIC
+    uint16_t version;           // RING_CONFIG_VERSION
+    uint8_t position;           // ring position, 0 starts with the token
+    uint8_t size;               // picos in the ring
+    uint32_t link_hz;           // SPI clock link_cal settled on, 0 if never calibrated
+    uint32_t flags;             // RING_CONFIG_*
+    uint32_t reserved[3];
+    uint32_t check;             // ~(sum of the 32-bit words above)
+} ring_config_t;
+
+_Static_assert(sizeof(ring_config_t) == 32, "ring config layout");
+
+/*
+    Description:
+        Validate the flash config block
+
+    Return:
+        const ring_config_t* - the block, NULL if the sector holds none
+*/
+const ring_config_t *ring_config_flash(void) {
+    const ring_config_t *cfg = (const ring_config_t *)(XIP_BASE + RING_CONFIG_OFFSET);
+    const uint32_t *words = (const uint32_t *)cfg;
+    uint32_t sum = 0;
+    for (uint32_t i = 0; i < sizeof(ring_config_t) / sizeof(uint32_t) - 1; i++) {
+        sum += words[i];
+    }
+    if (cfg->magic != RING_CONFIG_MAGIC || cfg->version != RING_CONFIG_VERSION || cfg->check != ~sum) {
+        return NULL;
+    }
+    return cfg;
+}
+
+/*
+    Description:
+        Read the ring position from the strap pins, then release them
+*/
+uint32_t ring_config_straps(void) {
+    uint32_t position = 0;
+    for (uint32_t bit = 0; bit < RING_STRAP_BITS; bit++) {
+        gpio_init(RING_STRAP_PIN + bit);
+        gpio_set_dir(RING_STRAP_PIN + bit, GPIO_IN);
+        gpio_pull_down(RING_STRAP_PIN + bit);
+    }
+    sleep_us(10);   // let the pulls settle
+    for (uint32_t bit = 0; bit < RING_STRAP_BITS; bit++) {
+        position |= (uint32_t)gpio_get(RING_STRAP_PIN + bit) << bit;
+        gpio_disable_pulls(RING_STRAP_PIN + bit);   // no current through the jumper afterwards
+    }
+    return position;
+}
+
+/*
+    Description:
+        Find out where this pico sits in the ring
+
+    Parameter:
+        uint32_t *position    - ring position, 0 starts with the token
+        uint32_t *size        - picos in the ring
+        uint32_t default_size - ring size when the flash holds no config block
+
+    Return:
+        int - 1 from the flash config block, 0 from the strap pins, -1 if the position
+              does not fit in the ring
+*/
+int ring_config_read(uint32_t *position, uint32_t *size, uint32_t default_size) {
+    const ring_config_t *cfg = ring_config_flash();
+    bool from_flash = (cfg != NULL && !(cfg->flags & RING_CONFIG_STRAPS));
+    if (from_flash) {
+        *position = cfg->position;
+        *size = cfg->size;
+    } else {
+        *position = ring_config_straps();
+        *size = default_size;
+    }
+    if (*size == 0 || *position >= *size) {
+        return -1;
+    }
+    return from_flash;
+}
+
+/*
+    Description:
+        SPI link rate stored by link_cal
+
+    Return:
+        uint32_t - Hz, 0 if the link was never calibrated
+*/
+uint32_t ring_config_link_hz(void) {
+    const ring_config_t *cfg = ring_config_flash();
+    return cfg != NULL ? cfg->link_hz : 0;
+}
+
+/*
+    Description:
+        Store the SPI link rate in the config block, keeping the position and size it
+    holds. Without a block a new one keeps using the strap pins. The last sector is
+    erased and programmed with interrupts off; nothing may run from flash meanwhile,
+    so call it before core1 is launched.
+
+    Parameter:
+        uint32_t link_hz      - rate to keep
+        uint32_t default_size - ring size for a new block
+
+    Return:
+        bool - true if the block reads back with the rate
+*/
+bool ring_config_write_link(uint32_t link_hz, uint32_t default_size) {
+    ring_config_t cfg;
+    const ring_config_t *old = ring_config_flash();
+    if (old != NULL) {
+        cfg = *old;
+    } else {
+        memset(&cfg, 0, sizeof(cfg));
+        cfg.magic = RING_CONFIG_MAGIC;
+        cfg.version = RING_CONFIG_VERSION;
+        cfg.size = (uint8_t)default_size;
+        cfg.flags = RING_CONFIG_STRAPS;
+    }
+    cfg.link_hz = link_hz;
+    const uint32_t *words = (const uint32_t *)&cfg;
+    uint32_t sum = 0;
+    for (uint32_t i = 0; i < sizeof(ring_config_t) / sizeof(uint32_t) - 1; i++) {
+        sum += words[i];
+    }
+    cfg.check = ~sum;
+
+    uint8_t page[FLASH_PAGE_SIZE];
+    memset(page, 0xff, sizeof(page));
+    memcpy(page, &cfg, sizeof(cfg));
+    uint32_t irq_status = save_and_disable_interrupts();
+    flash_range_erase(RING_CONFIG_OFFSET, FLASH_SECTOR_SIZE);
+    flash_range_program(RING_CONFIG_OFFSET, page, FLASH_PAGE_SIZE);
+    restore_interrupts(irq_status);
+
+    const ring_config_t *now = ring_config_flash();
+    return now != NULL && now->link_hz == link_hz;
+}
@@ -0,0 +1,74 @@
+#!/usr/bin/env python3
+"""
+    About:
+        Writes the ring config block of one pico (ring_config.h) as a UF2 file. Hold
+    BOOTSEL, drop the firmware, then this file: only the last flash sector is
+    written, the firmware stays. A pico without the block uses its strap pins.
+
+    Usage:
+        python3 ring_config.py -p 2 -n 4 -o ring_2.uf2
+        python3 ring_config.py --clear -o ring_clear.uf2    (back to the strap pins)
+        python3 ring_config.py -p 2 -n 4 --link-hz 8000000 -o ring_2.uf2
+
+        -p ring position (0 starts with the token), -n picos in the ring, -f flash size
+    in bytes if the board has more than the 2 MiB of a Pico, --link-hz the SPI rate
+    link_cal settled on (it stores that itself, this keeps it when the block is
+    rewritten by hand).
+"""
+
+import argparse
+import struct
+import sys
+
+RING_CONFIG_MAGIC = 0x474E4952      # "RING", keep in sync with ring_config.h
+RING_CONFIG_VERSION = 1
+RING_CONFIG_STRAPS = 0x0001
+
+XIP_BASE = 0x10000000
+FLASH_SECTOR_SIZE = 4096
+
+UF2_MAGIC_START0 = 0x0A324655
+UF2_MAGIC_START1 = 0x9E5D5157
+UF2_MAGIC_END = 0x0AB16F30
+UF2_FLAG_FAMILY_ID = 0x00002000
+RP2040_FAMILY_ID = 0xE48BFF56
+
+
+def config_block(position, size, link_hz=0, flags=0):
+    body = struct.pack("<IHBB5I", RING_CONFIG_MAGIC, RING_CONFIG_VERSION, position, size, link_hz, flags, 0, 0, 0)
+    check = ~sum(struct.unpack("<7I", body)) & 0xFFFFFFFF
+    return body + struct.pack("<I", check)
+
+
+def uf2_page(address, data):
+    page = data.ljust(256, b"\xff")
+    header = struct.pack("<8I", UF2_MAGIC_START0, UF2_MAGIC_START1, UF2_FLAG_FAMILY_ID,
+                         address, len(page), 0, 1, RP2040_FAMILY_ID)
+    return header + page.ljust(476, b"\x00") + struct.pack("<I", UF2_MAGIC_END)
+
+
+def main():
+    parser = argparse.ArgumentParser(description="ring config block for the pico firmware")
+    parser.add_argument("-p", "--position", type=int, default=0)
+    parser.add_argument("-n", "--size", type=int, default=2)
+    parser.add_argument("-f", "--flash-size", type=int, default=2 * 1024 * 1024)
+    parser.add_argument("--link-hz", type=int, default=0, help="SPI link rate, 0 when not calibrated")
+    parser.add_argument("--clear", action="store_true", help="erase the block, use the strap pins")
+    parser.add_argument("-o", "--output", required=True)
+    args = parser.parse_args()
+
+    if args.clear:
+        data = b"\xff" * 32
+    else:
+        if not 0 < args.size <= 255 or not 0 <= args.position < args.size:
+            sys.exit("ring_config.py: position must be below the ring size (1 to 255)")
+        if not 0 <= args.link_hz < 2 ** 32:
+            sys.exit("ring_config.py: link rate out of range")
+        data = config_block(args.position, args.size, args.link_hz)
+
+    with open(args.output, "wb") as f:
+        f.write(uf2_page(XIP_BASE + args.flash_size - FLASH_SECTOR_SIZE, data))
+
+
+if __name__ == "__main__":
+    main()
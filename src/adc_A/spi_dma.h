@@ -0,0 +1,193 @@
+#include "hardware/spi.h"
+#include "hardware/dma.h"
+#include "hardware/irq.h"
+#include "hardware/address_mapped.h"
+
+/*
+    Asynchronous SPI slave transmit through DMA.
+
+    The TX channel is paced by the SPI TX DREQ and keeps the 8-entry FIFO topped up
+    for the whole burst, so the link runs at whatever rate the master clocks it
+    without the core polling the FIFO. A second channel drains the RX FIFO into a
+    dummy word, like spi_write16_blocking() does, so it never overruns.
+    Completion is reported from DMA_IRQ_1 (DMA_IRQ_0 belongs to the ADC capture).
+
+    spi_dma_write_frame_async() also lets the DMA sniffer compute a CRC-32 over
+    everything the TX channel moves, and appends it as a 2-word trailer without the
+    CPU: the TX channel chains to a CRC channel that copies the sniffer result into
+    spi_dma_trailer, which chains to a trailer channel paced by the same DREQ. Only
+    8 words stand in the FIFO when the data is in, 25 us at 5 MHz and 12.8 us at
+    10 MHz, less than a capture or trigger IRQ (IO_IRQ_BANK0 runs at the highest
+    priority) plus USB stdio may hold off DMA_IRQ_1. With the chain the FIFO is
+    refilled within a few bus cycles, DMA_IRQ_1 only reports completion and may
+    come late. The sniffer runs in bit-reversed CRC-32 mode with reversed and
+    inverted output. That gives the zlib CRC-32 of the little-endian byte stream.
+*/
+
+// called from DMA_IRQ_1 once the last word of the burst is in the TX FIFO
+typedef void (*spi_dma_callback_t)(void);
+
+spi_inst_t *spi_dma_port;
+int spi_dma_tx_channel = -1;
+int spi_dma_rx_channel = -1;
+int spi_dma_crc_channel = -1;               // sniffer result -> spi_dma_trailer, chained from TX
+int spi_dma_trailer_channel = -1;           // spi_dma_trailer -> SSPDR, chained from the CRC channel
+dma_channel_config spi_dma_tx_config;       // chains to the CRC channel for frames only
+uint16_t spi_dma_rx_dummy;                  // sink for the words clocked in on MOSI
+uint32_t spi_dma_trailer;                   // CRC-32 of the last frame, goes out low half first
+volatile bool spi_dma_active = false;       // a burst has been queued and not yet completed
+spi_dma_callback_t spi_dma_callback = NULL;
+
+/*
+    Description:
+        DMA_IRQ_1 handler, the whole burst (trailer included) has been handed to
+    the SPI FIFO
+*/
+void __not_in_flash_func(spi_dma_irq_handler)(void) {
+    uint32_t done = dma_hw->ints1 & ((1u << spi_dma_tx_channel) | (1u << spi_dma_trailer_channel));
+    if (!done) {
+        return;
+    }
+    dma_hw->ints1 = done;
+
+    spi_dma_active = false;
+
+    if (spi_dma_callback) {
+        spi_dma_callback();
+    }
+}
+
+/*
+    Description:
+        Claim the TX/RX DMA channels for an SPI port that has already been set up
+    with spi_init()/spi_set_format()
+
+    Parameter:
+        spi_inst_t *spi             - SPI instance
+        spi_dma_callback_t callback - called on completion (IRQ context), may be NULL
+
+    Return:
+        NULL
+*/
+void spi_dma_init(spi_inst_t *spi, spi_dma_callback_t callback) {
+    spi_dma_port = spi;
+    spi_dma_callback = callback;
+    spi_dma_tx_channel = dma_claim_unused_channel(true);
+    spi_dma_rx_channel = dma_claim_unused_channel(true);
+
+    spi_dma_crc_channel = dma_claim_unused_channel(true);
+    spi_dma_trailer_channel = dma_claim_unused_channel(true);
+
+    // TX: buffer -> SSPDR, one halfword per TX DREQ
+    spi_dma_tx_config = dma_channel_get_default_config(spi_dma_tx_channel);
+    channel_config_set_transfer_data_size(&spi_dma_tx_config, DMA_SIZE_16);
+    channel_config_set_read_increment(&spi_dma_tx_config, true);
+    channel_config_set_write_increment(&spi_dma_tx_config, false);
+    channel_config_set_dreq(&spi_dma_tx_config, spi_get_dreq(spi, true));
+    channel_config_set_high_priority(&spi_dma_tx_config, true);    // the master will not wait for us
+    channel_config_set_sniff_enable(&spi_dma_tx_config, true);     // CRC of everything it sends
+    dma_channel_configure(spi_dma_tx_channel, &spi_dma_tx_config, &spi_get_hw(spi)->dr, NULL, 0, false);
+
+    // CRC: sniffer result -> trailer, one word, unpaced, then the trailer goes out
+    dma_channel_config crc_cfg = dma_channel_get_default_config(spi_dma_crc_channel);
+    channel_config_set_transfer_data_size(&crc_cfg, DMA_SIZE_32);
+    channel_config_set_read_increment(&crc_cfg, false);
+    channel_config_set_write_increment(&crc_cfg, false);
+    channel_config_set_high_priority(&crc_cfg, true);
+    channel_config_set_chain_to(&crc_cfg, spi_dma_trailer_channel);
+    dma_channel_configure(spi_dma_crc_channel, &crc_cfg, &spi_dma_trailer, &dma_hw->sniff_data, 1, false);
+
+    // trailer: 2 halfwords -> SSPDR, paced like the data
+    dma_channel_config trailer_cfg = dma_channel_get_default_config(spi_dma_trailer_channel);
+    channel_config_set_transfer_data_size(&trailer_cfg, DMA_SIZE_16);
+    channel_config_set_read_increment(&trailer_cfg, true);
+    channel_config_set_write_increment(&trailer_cfg, false);
+    channel_config_set_dreq(&trailer_cfg, spi_get_dreq(spi, true));
+    channel_config_set_high_priority(&trailer_cfg, true);
+    dma_channel_configure(spi_dma_trailer_channel, &trailer_cfg, &spi_get_hw(spi)->dr, &spi_dma_trailer, 2, false);
+
+    // RX: SSPDR -> dummy, keeps the RX FIFO empty
+    dma_channel_config rx_cfg = dma_channel_get_default_config(spi_dma_rx_channel);
+    channel_config_set_transfer_data_size(&rx_cfg, DMA_SIZE_16);
+    channel_config_set_read_increment(&rx_cfg, false);
+    channel_config_set_write_increment(&rx_cfg, false);
+    channel_config_set_dreq(&rx_cfg, spi_get_dreq(spi, false));
+    dma_channel_configure(spi_dma_rx_channel, &rx_cfg, &spi_dma_rx_dummy, &spi_get_hw(spi)->dr, 0, false);
+
+    // CRC-32 over bit-reversed data, reversed and inverted on readout (zlib CRC-32)
+    dma_sniffer_enable(spi_dma_tx_channel, DMA_SNIFF_CTRL_CALC_VALUE_CRC32R, true);
+    hw_set_bits(&dma_hw->sniff_ctrl, DMA_SNIFF_CTRL_OUT_REV_BITS | DMA_SNIFF_CTRL_OUT_INV_BITS);
+
+    dma_channel_set_irq1_enabled(spi_dma_trailer_channel, true);
+    irq_add_shared_handler(DMA_IRQ_1, spi_dma_irq_handler, PICO_SHARED_IRQ_HANDLER_DEFAULT_ORDER_PRIORITY);
+    irq_set_enabled(DMA_IRQ_1, true);
+}
+
+/*
+    Description:
+        Queue a burst for the master to clock out, returns immediately. The first
+    8 words land in the TX FIFO right away, so the master can start at once.
+
+    Parameter:
+        const volatile uint16_t* data - words to send, must stay untouched until completion
+        uint32_t len                  - number of 16-bit words
+
+    Return:
+        NULL
+*/
+void spi_dma_write16_async(const volatile uint16_t* data, uint32_t len) {
+    spi_get_hw(spi_dma_port)->icr = SPI_SSPICR_RORIC_BITS;    // clear stale RX overrun
+    spi_dma_active = true;
+    channel_config_set_chain_to(&spi_dma_tx_config, spi_dma_tx_channel);    // no trailer
+    dma_channel_set_config(spi_dma_tx_channel, &spi_dma_tx_config, false);
+    dma_channel_set_irq1_enabled(spi_dma_tx_channel, true);
+
+    dma_channel_set_trans_count(spi_dma_rx_channel, len, true);
+    dma_channel_set_trans_count(spi_dma_tx_channel, len, false);
+    dma_channel_set_read_addr(spi_dma_tx_channel, data, true);
+}
+
+/*
+    Description:
+        Queue a frame and follow it with its CRC-32 trailer (2 words), returns
+    immediately. The receiver clocks len + 2 words.
+
+    Parameter:
+        const volatile uint16_t* data - header and payload, must stay untouched until completion
+        uint32_t len                  - number of 16-bit words, trailer excluded
+
+    Return:
+        NULL
+*/
+void spi_dma_write_frame_async(const volatile uint16_t* data, uint32_t len) {
+    spi_get_hw(spi_dma_port)->icr = SPI_SSPICR_RORIC_BITS;    // clear stale RX overrun
+    spi_dma_active = true;
+    channel_config_set_chain_to(&spi_dma_tx_config, spi_dma_crc_channel);   // completion comes from the trailer
+    dma_channel_set_config(spi_dma_tx_channel, &spi_dma_tx_config, false);
+    dma_channel_set_irq1_enabled(spi_dma_tx_channel, false);
+    dma_channel_set_read_addr(spi_dma_trailer_channel, &spi_dma_trailer, false);    // not reloaded on a chain
+    dma_hw->sniff_data = 0xffffffff;                            // CRC-32 seed
+
+    dma_channel_set_trans_count(spi_dma_rx_channel, len + 2, true);
+    dma_channel_set_trans_count(spi_dma_tx_channel, len, false);
+    dma_channel_set_read_addr(spi_dma_tx_channel, data, true);
+}
+
+/*
+    Description:
+        Whether the link is still busy with the last burst, either DMA still feeding
+    the FIFO or the master not having clocked the FIFO out yet
+*/
+bool spi_dma_busy(void) {
+    return spi_dma_active || spi_is_busy(spi_dma_port);
+}
+
+/*
+    Description:
+        Block until the last burst has left the pico entirely
+*/
+void spi_dma_wait(void) {
+    while (spi_dma_busy()) {
+        tight_loop_contents();
+    }
+}
@@ -0,0 +1,276 @@
+#include <stdint.h>
+#include <string.h>
+#include "hardware/pio.h"
+#include "hardware/timer.h"
+#include "hardware/clocks.h"
+#include "hardware/structs/systick.h"
+#include "adc_trigger.pio.h"
+
+/*
+    Trigger-path telemetry, keep the block layout in sync with master/telemetry.h.
+
+    Fixed-bucket histograms kept in RAM and filled on the hot paths: how late the
+    trigger ISR runs after its edge, how long the capture ISR takes, the spacing of
+    the trigger edges and how much it changes from one to the next, the delay from
+    the token to the armed capture and the transfer time. A copy of all of them,
+    the telemetry block, goes out with the data now and then (adc_A: after the
+    payload of a frame, adc_trap: at the end of a stream record).
+
+    Short spans are counted in system clocks by SysTick. The M0+ has no DWT cycle
+    counter, SysTick is 24 bits at clk_sys (134 ms at 125 MHz) and belongs to one
+    core: telemetry_init() starts it on the capture core and only spans inside that
+    core's IRQs use it. Spans that cross cores or last milliseconds use the 1 MHz
+    timer. The edge itself has no timestamp in software, a PIO state machine latches
+    it (trigger_latency in adc_trigger.pio): it counts from the rising edge until the
+    ISR writes its TX FIFO, three clocks a step.
+
+    Buckets are powers of two: bucket 0 holds 0, bucket b holds [2^(b-1), 2^b), the
+    last one everything larger. Counts, sums and buckets run from boot, so blocks can
+    be subtracted from each other and a lost one costs nothing. max starts over with
+    every block. Each histogram is written from one context only. The copy is taken
+    while they keep running, it may be a few values off between fields.
+*/
+
+#define TELEMETRY_MAGIC         0x4D54      // "TM"
+#define TELEMETRY_VERSION       1
+#define TELEMETRY_BUCKETS       20          // the last one starts at 2^18
+
+// histograms
+#define TELEMETRY_TRIGGER_LATENCY   0       // trigger edge to the ISR callback, cycles
+#define TELEMETRY_ISR_DURATION      1       // capture ISR callback, entry to exit, cycles
+#define TELEMETRY_TRIGGER_INTERVAL  2       // rising edge to rising edge, cycles
+#define TELEMETRY_TRIGGER_JITTER    3       // change of that interval from the previous one, cycles
+#define TELEMETRY_HANDSHAKE         4       // token edge to capture armed, us
+#define TELEMETRY_TRANSFER          5       // transfer queued to its last word out, us
+#define TELEMETRY_HISTOGRAMS        6
+
+#define TELEMETRY_US_MASK ((1u << TELEMETRY_HANDSHAKE) | (1u << TELEMETRY_TRANSFER))
+
+#define TELEMETRY_LATENCY_STEP      3       // clocks per count of the latch
+#define TELEMETRY_LATENCY_FIXED     4       // input synchroniser, wait, pull and mov before the first step
+#define TELEMETRY_EDGE_SPAN_US      65000   // edges further apart start over, well inside the SysTick wrap
+#define TELEMETRY_SYSTICK_MASK      0xFFFFFFu
+
+typedef struct {
+    uint32_t count;                         // values since boot
+    uint32_t max;                           // largest since the previous block
+    uint64_t sum;                           // since boot, the mean is sum / count
+    uint32_t bucket[TELEMETRY_BUCKETS];
+} telemetry_hist_t;
+
+typedef struct {
+    uint16_t magic;                         // TELEMETRY_MAGIC
+    uint16_t version;                       // TELEMETRY_VERSION
+    uint16_t words;                         // size of the block in 16-bit words
+    uint16_t histograms;                    // TELEMETRY_HISTOGRAMS
+    uint32_t cycle_hz;                      // system clock, the unit of the cycle histograms
+    uint32_t us_mask;                       // bit n: histogram n counts microseconds
+    uint32_t sequence;                      // blocks sent since boot
+    uint32_t latency_missed;                // trigger ISRs that found no latched edge
+    telemetry_hist_t hist[TELEMETRY_HISTOGRAMS];
+} telemetry_block_t;
+
+#define TELEMETRY_WORDS (sizeof(telemetry_block_t) / sizeof(uint16_t))
+
+_Static_assert(sizeof(telemetry_hist_t) == 96, "telemetry histogram layout");
+_Static_assert(sizeof(telemetry_block_t) == 24 + TELEMETRY_HISTOGRAMS * 96, "telemetry block layout");
+
+telemetry_block_t telemetry;                // the live histograms
+PIO telemetry_pio = pio1;                   // pio0 belongs to the PIO trigger
+int telemetry_sm = -1;                      // latency latch, -1 when not running
+volatile uint32_t telemetry_token_us = 0;   // token edge not yet matched to a capture, 0 if none
+uint32_t telemetry_edge = 0;                // SysTick at the previous rising edge
+uint32_t telemetry_edge_us = 0;
+uint32_t telemetry_interval = 0;            // previous interval, 0 at the start of a run
+bool telemetry_edge_valid = false;
+
+/*
+    Description:
+        Start SysTick on the calling core (the capture core) and clear the histograms
+*/
+void telemetry_init(void) {
+    memset(&telemetry, 0, sizeof(telemetry));
+    telemetry.magic = TELEMETRY_MAGIC;
+    telemetry.version = TELEMETRY_VERSION;
+    telemetry.words = TELEMETRY_WORDS;
+    telemetry.histograms = TELEMETRY_HISTOGRAMS;
+    telemetry.cycle_hz = clock_get_hz(clk_sys);
+    telemetry.us_mask = TELEMETRY_US_MASK;
+
+    // free running from the processor clock, no interrupt
+    systick_hw->rvr = TELEMETRY_SYSTICK_MASK;
+    systick_hw->cvr = 0;
+    systick_hw->csr = M0PLUS_SYST_CSR_CLKSOURCE_BITS | M0PLUS_SYST_CSR_ENABLE_BITS;
+}
+
+/*
+    Description:
+        Latch the rising edges of the trigger pin, for a trigger handled by a GPIO ISR
+
+    Parameter:
+        uint pin - trigger input, must already be an input
+*/
+void telemetry_latency_init(uint pin) {
+    telemetry_sm = pio_claim_unused_sm(telemetry_pio, true);
+    uint offset = pio_add_program(telemetry_pio, &trigger_latency_program);
+    trigger_latency_sm_init(telemetry_pio, telemetry_sm, offset, pin);
+}
+
+// SysTick now, it counts down
+static inline uint32_t telemetry_cycles(void) {
+    return systick_hw->cvr;
+}
+
+// Cycles since a telemetry_cycles() reading, spans up to the 24-bit wrap
+static inline uint32_t telemetry_since(uint32_t start) {
+    return (start - systick_hw->cvr) & TELEMETRY_SYSTICK_MASK;
+}
+
+/*
+    Description:
+        Add one value to a histogram, constant cost
+
+    Parameter:
+        uint32_t which - TELEMETRY_* histogram
+        uint32_t value - cycles or microseconds, see TELEMETRY_US_MASK
+*/
+void __not_in_flash_func(telemetry_record)(uint32_t which, uint32_t value) {
+    telemetry_hist_t *h = &telemetry.hist[which];
+    uint32_t b = value ? 32 - __builtin_clz(value) : 0;
+    h->bucket[b < TELEMETRY_BUCKETS ? b : TELEMETRY_BUCKETS - 1]++;
+    h->count++;
+    h->sum += value;
+    if (value > h->max) {
+        h->max = value;
+    }
+}
+
+// First thing in the trigger ISR on a rising edge: stop the latch
+static inline void telemetry_trigger_enter(void) {
+    if (telemetry_sm >= 0) {
+        pio_sm_put(telemetry_pio, telemetry_sm, 0);
+    }
+}
+
+/*
+    Description:
+        Last thing in the trigger ISR on a rising edge: record the latched latency,
+    the ISR time and, with the edge put back where the latch says it was, the
+    interval to the previous edge and its change
+
+    Parameter:
+        uint32_t entry - telemetry_cycles() at ISR entry
+*/
+void __not_in_flash_func(telemetry_trigger_done)(uint32_t entry) {
+    uint32_t duration = telemetry_since(entry);
+    uint32_t latency = 0;
+    if (telemetry_sm >= 0 && !pio_sm_is_rx_fifo_empty(telemetry_pio, telemetry_sm)) {
+        latency = pio_sm_get(telemetry_pio, telemetry_sm) * TELEMETRY_LATENCY_STEP + TELEMETRY_LATENCY_FIXED;
+        telemetry_record(TELEMETRY_TRIGGER_LATENCY, latency);
+    } else if (telemetry_sm >= 0) {
+        telemetry.latency_missed++;
+    }
+    telemetry_record(TELEMETRY_ISR_DURATION, duration);
+
+    uint32_t edge = (entry + latency) & TELEMETRY_SYSTICK_MASK;    // counts down, the edge is earlier
+    uint32_t edge_us = timer_hw->timerawl;
+    if (telemetry_edge_valid && edge_us - telemetry_edge_us < TELEMETRY_EDGE_SPAN_US) {
+        uint32_t interval = (telemetry_edge - edge) & TELEMETRY_SYSTICK_MASK;
+        telemetry_record(TELEMETRY_TRIGGER_INTERVAL, interval);
+        if (telemetry_interval != 0) {
+            telemetry_record(TELEMETRY_TRIGGER_JITTER, interval > telemetry_interval ? interval - telemetry_interval
+                                                                                      : telemetry_interval - interval);
+        }
+        telemetry_interval = interval;
+    } else {
+        telemetry_interval = 0;
+    }
+    telemetry_edge = edge;
+    telemetry_edge_us = edge_us;
+    telemetry_edge_valid = true;
+}
+
+// The trigger ISR was off, the next edge has no predecessor
+static inline void telemetry_trigger_restart(void) {
+    telemetry_edge_valid = false;
+}
+
+// Last thing in a capture ISR that is not a trigger ISR
+static inline void telemetry_isr_done(uint32_t entry) {
+    telemetry_record(TELEMETRY_ISR_DURATION, telemetry_since(entry));
+}
+
+// Token edge seen, the next armed capture is matched to it
+static inline void telemetry_token(void) {
+    telemetry_token_us = timer_hw->timerawl | 1;    // never 0
+}
+
+// Capture armed, closes the handshake of a pending token
+static inline void telemetry_capture_armed(void) {
+    uint32_t token_us = telemetry_token_us;
+    if (token_us != 0) {
+        telemetry_token_us = 0;
+        telemetry_record(TELEMETRY_HANDSHAKE, timer_hw->timerawl - token_us);
+    }
+}
+
+/*
+    Description:
+        Copy the block out one 16-bit word at a time (the destination in a frame is
+    only 2-byte aligned) and start the max values over
+
+    Parameter:
+        volatile uint16_t *words - TELEMETRY_WORDS of room
+
+    Return:
+        uint32_t - TELEMETRY_WORDS
+*/
+uint32_t telemetry_snapshot(volatile uint16_t *words) {
+    telemetry.sequence++;
+    const uint16_t *block = (const uint16_t *)&telemetry;
+    for (uint32_t i = 0; i < TELEMETRY_WORDS; i++) {
+        words[i] = block[i];
+    }
+    for (uint32_t k = 0; k < TELEMETRY_HISTOGRAMS; k++) {
+        telemetry.hist[k].max = 0;
+    }
+    return TELEMETRY_WORDS;
+}
+
+// Upper end of the bucket holding the q-quantile, in the histogram's unit
+uint32_t telemetry_quantile(const telemetry_hist_t *h, float q) {
+    uint32_t target = (uint32_t)(h->count * q), seen = 0;
+    for (uint32_t b = 0; b < TELEMETRY_BUCKETS; b++) {
+        seen += h->bucket[b];
+        if (seen > target) {
+            uint32_t top = b ? (1u << b) - 1 : 0;
+            return b == TELEMETRY_BUCKETS - 1 || top > h->max ? h->max : top;
+        }
+    }
+    return h->max;
+}
+
+/*
+    Description:
+        One line per histogram over stdio, mean, p50, p99 and max in ns or us
+*/
+void telemetry_print(void) {
+    static const char *names[TELEMETRY_HISTOGRAMS] = {
+        "trigger latency", "ISR duration", "trigger interval", "trigger jitter", "handshake", "transfer"
+    };
+    for (uint32_t k = 0; k < TELEMETRY_HISTOGRAMS; k++) {
+        const telemetry_hist_t *h = &telemetry.hist[k];
+        if (h->count == 0) {
+            continue;
+        }
+        // cycles are shown in ns
+        float scale = (telemetry.us_mask >> k & 1) ? 1.0f : 1e9f / telemetry.cycle_hz;
+        printf("Telemetry %s: %d values, mean %.0f, p50 <= %.0f, p99 <= %.0f, max %.0f %s\n",
+               names[k], h->count, (float)h->sum / h->count * scale,
+               telemetry_quantile(h, 0.5f) * scale, telemetry_quantile(h, 0.99f) * scale,
+               h->max * scale, (telemetry.us_mask >> k & 1) ? "us" : "ns");
+    }
+    if (telemetry.latency_missed > 0) {
+        printf("Telemetry: %d trigger ISRs without a latched edge\n", telemetry.latency_missed);
+    }
+}
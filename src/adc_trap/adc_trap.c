@@ -1,11 +1,21 @@
 #include <stdio.h>
 #include "pico/stdlib.h"
+#include "pico/stdio_usb.h"
 #include "hardware/adc.h"
 #include "hardware/timer.h"
+#include "adc_dma.h"            // shared with adc_A
+#include "adc_pio_trigger.h"
+#include "trap_stream.h"
+#include "time_delta.h"         // shared with adc_A
 
 #define ADC_PIN 26 // ADC0 aka GPIO26
 #define TRIGGER_PIN 2 // GPIO2
+// #define COMPACT_TIME // 8-bit time deltas (time_delta.h) instead of uint32_t times, 3 bytes per sample instead of 6
+#ifdef COMPACT_TIME
+#define SAMPLE_BUFFER_SIZE 65536 // twice the samples in the same RAM, 2^(x=16)
+#else
 #define SAMPLE_BUFFER_SIZE 32768 // choose your buffer size (logrithmic of 2), 2^(x=15)
+#endif
 #define ADC_CHANNEL 0 // ADC channels, pick from 0-3 (4 is reserved for temp. sensor)
 
 #define Fs 50000.0 // Sample rate (Hz) (must not goes higer than 75 kSPS)
@@ -14,15 +24,34 @@
 // ---------------- preprocessor variable ----------------
 // #define DEEBUGG
 #define PRINT_BUFFER
+// #define STREAM_BUFFER    // send the buffer as one binary record over USB instead (master/trap_decode.c)
+// #define PIO_TRIGGER      // PIO starts a conversion on each rising edge, DMA fills the buffer (no timestamps)
+// #define TELEMETRY        // trigger latency / ISR time / edge jitter histograms, printed or streamed with the capture (telemetry.h)
+
+#if defined(PIO_TRIGGER) && defined(COMPACT_TIME)
+#error PIO_TRIGGER records no times, COMPACT_TIME has nothing to compact
+#endif
+
+#ifdef TELEMETRY
+#include "telemetry.h"          // shared with adc_A
+#endif
 
 volatile uint16_t sample_buffer[SAMPLE_BUFFER_SIZE];
+#if defined(PIO_TRIGGER)
+// sample n belongs to edge n, no times
+#elif defined(COMPACT_TIME)
+volatile time_delta_t timestamp[SAMPLE_BUFFER_SIZE];
+volatile time_delta_log_t time_log;
+#else
 volatile uint32_t timestamp[SAMPLE_BUFFER_SIZE];
-volatile uint16_t sample_index = 0;
+#endif
+volatile uint32_t sample_index = 0;
 volatile bool sampling_done = false;
 
 // digital-to-voltage conversion
 const float conversion_factor = 3.3f / (1 << 12); 
 
+#ifndef PIO_TRIGGER
 /*
     Callback function for the interrupt that enables the ADC sampling
     Parameter:
@@ -35,11 +64,19 @@ const float conversion_factor = 3.3f / (1 << 12);
         NULL
 */
 void gpio_callback(uint gpio, uint32_t events) {
+#ifdef TELEMETRY
+    telemetry_trigger_enter();  // stops the edge latch, before anything else
+    uint32_t entry = telemetry_cycles();
+#endif
     if (sample_index < SAMPLE_BUFFER_SIZE) {
         // single ADC sample acquire
         sample_buffer[sample_index] = adc_read();
         // get timestamp in microsecond from timer API
+#ifdef COMPACT_TIME
+        time_delta_put(&time_log, timestamp, sample_index, time_us_32());
+#else
         timestamp[sample_index] = time_us_32();
+#endif
 
         sample_index++;
 
@@ -48,16 +85,119 @@ void gpio_callback(uint gpio, uint32_t events) {
             sampling_done = true;
         }
     }
+#ifdef TELEMETRY
+    telemetry_trigger_done(entry);
+#endif
+}
+
+#else
+/*
+    DMA completion callback for PIO_TRIGGER, the whole buffer is in
+    Parameter:
+        uint32_t samples_captured - SAMPLE_BUFFER_SIZE
+
+    Return:
+        NULL, no further buffer
+*/
+volatile uint16_t* dma_callback(uint32_t samples_captured) {
+#ifdef TELEMETRY
+    uint32_t entry = telemetry_cycles();
+#endif
+    sample_index = samples_captured;
+    sampling_done = true;
+#ifdef TELEMETRY
+    telemetry_isr_done(entry);
+#endif
+    return NULL;
 }
+#endif
 
 // simple helper print function to print the BUFFER
 void print_buffer(){
+#ifdef COMPACT_TIME
+    uint32_t time = time_log.base;  // rebuilt sample by sample
+    uint32_t next_escape = 0;
+#endif
     // output the buffer over serial
     for (int i = 0; i < SAMPLE_BUFFER_SIZE; i++) {
         uint16_t result = sample_buffer[i];
+#if defined(PIO_TRIGGER)
+        printf("Raw value: %d, voltage: %f, at edge: %d\n", result, result * conversion_factor, i);
+#elif defined(COMPACT_TIME)
+        if (timestamp[i] != TIME_DELTA_ESCAPE) {
+            time += timestamp[i];
+        } else if (next_escape < TIME_DELTA_ESCAPES) {
+            time = time_log.escapes[next_escape++];
+        } else {
+            printf("Escape table full, no times past sample %d\n", i);
+            return;
+        }
+        printf("Raw value: %d, voltage: %f, at time: %d\n", result, result * conversion_factor, time);
+#else
         uint32_t time = timestamp[i];
         printf("Raw value: %d, voltage: %f, at time: %d\n", result, result * conversion_factor, time);
+#endif
+    }
+}
+
+/*
+    Send the buffer as one binary record (trap_stream.h), raw samples and timestamps,
+    no formatting. Waits for the host to open the port, USB CDC drops output otherwise.
+*/
+void stream_buffer(uint32_t sequence){
+    trap_stream_header_t header = {
+        .magic = TRAP_STREAM_MAGIC,
+        .version = TRAP_STREAM_VERSION,
+        .header_bytes = sizeof(trap_stream_header_t),
+        .sequence = sequence,
+        .sample_count = SAMPLE_BUFFER_SIZE,
+        .flags = 0,
+        .payload_bytes = sizeof(sample_buffer),
+    };
+#if defined(COMPACT_TIME)
+    trap_time_block_t time_block = {
+        .base = time_log.base,
+        .escape_count = time_log.escape_count,
+        .escapes_kept = time_log.escape_count < TIME_DELTA_ESCAPES ? time_log.escape_count : TIME_DELTA_ESCAPES,
+        .delta_bits = TIME_DELTA_BITS,
+    };
+    static const uint8_t pad[4] = { 0 };
+    uint32_t pad_bytes = (4 - sizeof(timestamp) % 4) % 4;
+    header.flags |= TRAP_STREAM_TIME_DELTA;
+    header.payload_bytes += sizeof(time_block) + sizeof(timestamp) + pad_bytes + time_block.escapes_kept * sizeof(uint32_t);
+#elif !defined(PIO_TRIGGER)
+    header.flags |= TRAP_STREAM_TIMESTAMPS;
+    header.payload_bytes += sizeof(timestamp);
+#endif
+#ifdef TELEMETRY
+    static telemetry_block_t block;
+    telemetry_snapshot((uint16_t *)&block);
+    header.flags |= TRAP_STREAM_TELEMETRY;
+    header.payload_bytes += sizeof(block);
+#endif
+
+    while (!stdio_usb_connected()) {
+        sleep_ms(100);
     }
+    stdio_flush();
+    stdio_set_translate_crlf(&stdio_usb, false);    // binary from here on, no \n -> \r\n
+
+    fwrite(&header, 1, sizeof(header), stdout);
+    fwrite((const void *)sample_buffer, 1, sizeof(sample_buffer), stdout);
+#if defined(COMPACT_TIME)
+    fwrite(&time_block, 1, sizeof(time_block), stdout);
+    fwrite((const void *)timestamp, 1, sizeof(timestamp), stdout);
+    fwrite(pad, 1, pad_bytes, stdout);
+    fwrite((const void *)time_log.escapes, sizeof(uint32_t), time_block.escapes_kept, stdout);
+#elif !defined(PIO_TRIGGER)
+    fwrite((const void *)timestamp, 1, sizeof(timestamp), stdout);
+#endif
+#ifdef TELEMETRY
+    fwrite(&block, 1, sizeof(block), stdout);
+#endif
+    fflush(stdout);
+
+    stdio_set_translate_crlf(&stdio_usb, true);
 }
 
 int main() {
@@ -72,6 +212,9 @@ int main() {
     adc_select_input(ADC_CHANNEL);
     adc_set_clkdiv(ADCCLK/Fs); // adjust the sampling rate
     printf("ADC initialized\n");
+#ifdef TELEMETRY
+    telemetry_init();   // SysTick of this core, the one that takes the trigger IRQ
+#endif
 
     // ----------------------------------------
     // ----- Triggering PIN for Reading -------
@@ -79,7 +222,19 @@ int main() {
     gpio_init(TRIGGER_PIN);
     gpio_set_dir(TRIGGER_PIN, GPIO_IN);
     gpio_pull_up(TRIGGER_PIN);
+#ifdef PIO_TRIGGER
+    // conversions started by the PIO, no interrupt per sample
+    adc_pio_trigger_init(TRIGGER_PIN, false, &dma_callback);
+    adc_pio_trigger_start(sample_buffer, SAMPLE_BUFFER_SIZE, SAMPLE_BUFFER_SIZE);
+#else
+#ifdef COMPACT_TIME
+    time_delta_reset(&time_log, time_us_32());  // first delta counts from here
+#endif
+#ifdef TELEMETRY
+    telemetry_latency_init(TRIGGER_PIN);
+#endif
     gpio_set_irq_enabled_with_callback(TRIGGER_PIN, GPIO_IRQ_EDGE_RISE, true, &gpio_callback);
+#endif
     printf("Trigger pin initialized\n");
 
 
@@ -88,8 +243,13 @@ int main() {
         tight_loop_contents();
     }
 
-#ifdef PRINT_BUFFER
+#if defined(STREAM_BUFFER)
+    stream_buffer(0);
+#elif defined(PRINT_BUFFER)
     print_buffer();
+#ifdef TELEMETRY
+    telemetry_print();
+#endif
 #endif
 
     return 0;